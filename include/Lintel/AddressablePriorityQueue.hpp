@@ -0,0 +1,223 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief Priority queue whose entries can be updated or removed by handle
+*/
+
+#ifndef LINTEL_ADDRESSABLE_PRIORITY_QUEUE_HPP
+#define LINTEL_ADDRESSABLE_PRIORITY_QUEUE_HPP
+
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/utility.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+
+/// \brief Binary heap with handles for changing or cancelling queued entries.
+///
+/// push() returns a Handle that stays attached to the value until it is
+/// popped or erased, however the heap moves it.  update(handle, val)
+/// changes the priority and erase(handle) removes it, both in O(log n),
+/// so a scheduler can reschedule or cancel a queued item instead of
+/// pushing a duplicate and skipping the stale copy when it reaches the
+/// top.
+///
+/// LessImportant has the same meaning as for PriorityQueue, the most
+/// important entry is at the top.
+///
+/// Each heap entry carries its handle, and a side array indexed by
+/// handle holds the entry's heap position.  Every move of an entry in
+/// the heap goes through place(), which updates the side array, so the
+/// two can't get out of sync.  Handles are small integers, reused after
+/// their entry is popped or erased, like file descriptors; don't hold
+/// on to one past that point.
+template<class T, class LessImportant = std::less_equal<T> >
+class AddressablePriorityQueue : boost::noncopyable {
+public:
+    typedef uint32_t Handle;
+    static const Handle invalid_handle = 0xFFFFFFFFU;
+
+    AddressablePriorityQueue(const LessImportant &li = LessImportant())
+	: lessimportant(li) { }
+
+    typedef AddressablePriorityQueue<T, LessImportant> mytype;
+
+    const T &top() const { DEBUG_SINVARIANT(!empty()); return heap[0].val; }
+    Handle topHandle() const { DEBUG_SINVARIANT(!empty()); return heap[0].handle; }
+
+    /// Add val; the returned handle is valid until val is popped or erased
+    Handle push(const T &val) {
+	Handle handle;
+	if (free_handles.empty()) {
+	    INVARIANT(positions.size() < invalid_handle, "AddressablePriorityQueue: out of handles");
+	    handle = positions.size();
+	    positions.push_back(not_queued);
+	} else {
+	    handle = free_handles.back();
+	    free_handles.pop_back();
+	}
+	heap.push_back(Entry(val, handle));
+	siftUp(heap.size() - 1);
+	return handle;
+    }
+
+    void pop() {
+	DEBUG_SINVARIANT(!empty());
+	erase(heap[0].handle);
+    }
+
+    /// true if handle refers to a queued value
+    bool contains(Handle handle) const {
+	return handle < positions.size() && positions[handle] != not_queued;
+    }
+
+    const T &get(Handle handle) const {
+	return heap[position(handle)].val;
+    }
+
+    /// Change the value for handle, moving it up or down as needed
+    void update(Handle handle, const T &val) {
+	uint32_t pos = position(handle);
+	heap[pos].val = val;
+	fix(pos);
+    }
+
+    /// Remove the value for handle; handle may then be reused
+    void erase(Handle handle) {
+	uint32_t pos = position(handle);
+	uint32_t last = heap.size() - 1;
+	positions[handle] = not_queued;
+	free_handles.push_back(handle);
+	if (pos != last) {
+	    place(pos, heap[last]);
+	    heap.pop_back();
+	    fix(pos);
+	} else {
+	    heap.pop_back();
+	}
+    }
+
+    uint32_t size() const {
+	return heap.size();
+    }
+
+    bool empty() const {
+	return heap.empty();
+    }
+
+    void clear() {
+	heap.clear();
+	positions.clear();
+	free_handles.clear();
+    }
+
+    void reserve(uint32_t amt) {
+	heap.reserve(amt);
+	positions.reserve(amt);
+    }
+
+    void selfVerify() const {
+	uint32_t queued = 0;
+	for(uint32_t i = 0; i < heap.size(); ++i) {
+	    SINVARIANT(positions[heap[i].handle] == i);
+	    if (i > 0) {
+		SINVARIANT(!lessimportant(heap[(i - 1) / 2].val, heap[i].val)
+			   || lessimportant(heap[i].val, heap[(i - 1) / 2].val));
+	    }
+	}
+	for(uint32_t h = 0; h < positions.size(); ++h) {
+	    if (positions[h] != not_queued) {
+		++queued;
+	    }
+	}
+	SINVARIANT(queued == heap.size() && queued + free_handles.size() == positions.size());
+    }
+
+private:
+    static const uint32_t not_queued = 0xFFFFFFFFU;
+
+    struct Entry {
+	Entry(const T &val, Handle handle) : val(val), handle(handle) { }
+	T val;
+	Handle handle;
+    };
+
+    uint32_t position(Handle handle) const {
+	INVARIANT(contains(handle),
+		  boost::format("AddressablePriorityQueue: handle %d is not queued") % handle);
+	return positions[handle];
+    }
+
+    /// the only way entries are stored in the heap
+    void place(uint32_t pos, const Entry &entry) {
+	heap[pos] = entry;
+	positions[entry.handle] = pos;
+    }
+
+    void fix(uint32_t pos) {
+	if (pos > 0 && !lessimportant(heap[pos].val, heap[(pos - 1) / 2].val)) {
+	    siftUp(pos);
+	} else {
+	    siftDown(pos);
+	}
+    }
+
+    void siftUp(uint32_t pos) {
+	Entry moving(heap[pos]);
+	while(pos > 0) {
+	    uint32_t up_pos = (pos - 1) / 2;
+	    if (!lessimportant(moving.val, heap[up_pos].val)) {
+		place(pos, heap[up_pos]);
+		pos = up_pos;
+	    } else {
+		break;
+	    }
+	}
+	place(pos, moving);
+    }
+
+    void siftDown(uint32_t pos) {
+	Entry moving(heap[pos]);
+	uint32_t size = heap.size();
+	while(1) {
+	    uint32_t down_left = 2*pos + 1;
+	    if (down_left >= size)
+		break;
+	    uint32_t down_right = down_left + 1;
+
+	    uint32_t more_important_down = down_left;
+	    if (down_right < size && lessimportant(heap[down_left].val, heap[down_right].val)) {
+		more_important_down = down_right;
+	    }
+	    if (lessimportant(moving.val, heap[more_important_down].val)) {
+		place(pos, heap[more_important_down]);
+		pos = more_important_down;
+	    } else {
+		break; // at final position
+	    }
+	}
+	place(pos, moving);
+    }
+
+    LessImportant lessimportant;
+    std::vector<Entry> heap;
+    std::vector<uint32_t> positions; // by handle, not_queued if the handle is free
+    std::vector<Handle> free_handles;
+};
+
+template<class T, class LessImportant> const uint32_t
+AddressablePriorityQueue<T, LessImportant>::invalid_handle;
+
+template<class T, class LessImportant> const uint32_t
+AddressablePriorityQueue<T, LessImportant>::not_queued;
+
+#endif
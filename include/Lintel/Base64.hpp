@@ -2,7 +2,7 @@
 #define LINTEL_BASE_64_HPP
 
 /** @file
-    \brief Header for the ASCIIbeticalB64 class
+    \brief Header for the ASCIIbeticalB64 and Base64 classes
 */
 
 #include <sys/types.h>
@@ -27,16 +27,27 @@ namespace lintel {
 	    return table;
 	}
 
+	/// inverse of translate(); characters not in the alphabet map to 0
 	static const char * detranslate() {
-	    static char * inverse = 0;
-	    if (inverse) {
-		return inverse;
-	    }
-	    inverse = new char[256];
-	    for (int8_t i=0; i<64; ++i) {
-		inverse[static_cast<int32_t>(translate()[i])] = 
-		    static_cast<char>(i);
-	    }
+	    // a constant table, so there is no initialization race
+	    static const char inverse[256] = {
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,
+		 2,  3,  4,  5,  6,  7,  8,  9, 10, 11,  0,  0,  0,  0,  0,  0,
+		 0, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26,
+		27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37,  0,  0,  0,  0,  0,
+		 0, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52,
+		53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+	    };
 	    return inverse;
 	}
 	
@@ -53,7 +64,7 @@ namespace lintel {
 	    uint32_t bits = 0;
 	    for(size_t in_off = 0;
 		in_off < size && out_off < ret_size; ++in_off) {
-		trans_buf += ((uint32_t)table[(uint32_t)data[in_off]]) << (32-6-bits);
+		trans_buf += ((uint32_t)table[(uint8_t)data[in_off]]) << (32-6-bits);
 		bits += 6;
 		if (bits >= 8) {
 		    ret[out_off] = trans_buf >> (32-8);
@@ -198,6 +209,133 @@ namespace lintel {
 	    encode(data.data(), data.size(), digits, ret);
 	}
     };
+
+    class ByteBuffer;
+
+    /** \brief Base64 encoding and decoding of bulk data
+
+	Supports the RFC 4648 standard and URL and filename safe
+	alphabets, and the ASCIIbetical alphabet, for which encoding
+	without padding gives the same result as
+	ASCIIbeticalB64::encode(data, size, 0).  With SSSE3 or AVX2,
+	12 or 24 bytes are converted at a time, using the method from
+	"Faster Base64 Encoding and Decoding Using AVX2 Instructions,"
+	by Wojciech Mula and Daniel Lemire, ACM TWEB 12(3), 2018, with
+	the alphabet applied as a few contiguous ranges of characters
+	so that all three alphabets share the same code.
+
+	Decoding accepts input with or without padding, and fails on
+	any character that is not in the alphabet, including white
+	space.  The Encoder and Decoder classes convert a stream that
+	arrives in chunks of any size.
+    */
+    class Base64 {
+    public:
+	enum Alphabet { Standard, URLSafe, ASCIIbetical };
+	enum Strategy { Auto, Scalar, SSSE3, AVX2 };
+
+	/// Standard pads the output with '=' to a multiple of 4
+	/// characters, the other alphabets do not.
+	explicit Base64(Alphabet alphabet = Standard, Strategy strategy = Auto);
+
+	Base64(Alphabet alphabet, bool pad, Strategy strategy = Auto);
+
+	/// Characters needed to encode size bytes.
+	size_t encodedLength(size_t size) const {
+	    return pad ? (size + 2) / 3 * 4 : (size * 4 + 2) / 3;
+	}
+
+	/// Upper bound on the bytes decoded from len characters.
+	static size_t maxDecodedLength(size_t len) {
+	    return len / 4 * 3 + 2;
+	}
+
+	/// Encode size bytes of data into out, which needs
+	/// encodedLength(size) characters of room; returns the length.
+	size_t encode(const void *data, size_t size, char *out) const;
+
+	std::string encode(const void *data, size_t size) const;
+
+	std::string encode(const std::string &data) const {
+	    return encode(data.data(), data.size());
+	}
+
+	/// Append the encoding of size bytes of data to out.
+	void encode(const void *data, size_t size, ByteBuffer &out) const;
+
+	/// Decode len characters into out, which needs
+	/// maxDecodedLength(len) bytes of room, setting out_len to the
+	/// bytes decoded; returns false if the input is not valid.
+	bool decode(const char *in, size_t len, void *out, size_t &out_len) const;
+
+	/// Decode len characters, replacing the contents of out.
+	bool decode(const char *in, size_t len, std::string &out) const;
+
+	bool decode(const std::string &in, std::string &out) const {
+	    return decode(in.data(), in.size(), out);
+	}
+
+	/// Append the decoding of len characters to out; on failure
+	/// out may have some of the decoded data appended.
+	bool decode(const char *in, size_t len, ByteBuffer &out) const;
+
+	/// \brief Encode a stream arriving in chunks
+	class Encoder {
+	public:
+	    explicit Encoder(const Base64 &codec) : codec(codec), npending(0) { }
+
+	    /// Append the encoding of as much of the data as possible to out.
+	    void update(const void *data, size_t size, ByteBuffer &out);
+
+	    /// Append the end of the encoding to out and start a new stream.
+	    void finish(ByteBuffer &out);
+
+	private:
+	    const Base64 &codec;
+	    uint8_t pending[3];
+	    size_t npending;
+	};
+
+	/// \brief Decode a stream arriving in chunks
+	class Decoder {
+	public:
+	    explicit Decoder(const Base64 &codec) : codec(codec), npending(0) { }
+
+	    /// Append the decoding of as much of the data as possible to
+	    /// out; returns false if the data is not valid.
+	    bool update(const char *data, size_t len, ByteBuffer &out);
+
+	    /// Append the end of the decoding to out and start a new
+	    /// stream; returns false if the data is not valid.
+	    bool finish(ByteBuffer &out);
+
+	private:
+	    const Base64 &codec;
+	    char pending[4];
+	    size_t npending;
+	};
+
+	Alphabet alphabet() const { return which; }
+	bool padding() const { return pad; }
+
+	/// The strategy in use; never Auto.
+	Strategy strategy() const { return chosen; }
+
+	/// Can strategy be used on this machine?
+	static bool strategyAvailable(Strategy strategy);
+
+	/// Printable name for strategy.
+	static const char *strategyName(Strategy strategy);
+
+    private:
+	void init(Strategy strategy);
+	bool decodeImpl(const char *in, size_t len, uint8_t *out, size_t &out_len,
+			bool allow_padding) const;
+
+	Alphabet which;
+	bool pad;
+	Strategy chosen;
+    };
 }
 
 #endif
@@ -0,0 +1,111 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief Helpers for writing values to and reading them from a ByteBuffer in binary
+*/
+
+#ifndef LINTEL_BINARY_SERIALIZE_HPP
+#define LINTEL_BINARY_SERIALIZE_HPP
+
+#include <string.h>
+
+#include <string>
+
+#include <boost/static_assert.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/type_traits/is_pod.hpp>
+
+#include <Lintel/ByteBuffer.hpp>
+
+// Values are written in host byte order with no padding, so the
+// encoding is compact and cheap but is only portable between machines
+// with the same endianness and type sizes.  Readers consume from the
+// front of the buffer and INVARIANT that enough bytes are present.
+
+namespace lintel {
+    /// Append a plain-old-data value to buf.
+    template<typename T> inline void binaryWrite(ByteBuffer &buf, const T &v) {
+	BOOST_STATIC_ASSERT(boost::is_pod<T>::value);
+	buf.append(&v, sizeof(T));
+    }
+
+    /// Consume a plain-old-data value from the front of buf.
+    template<typename T> inline void binaryRead(ByteBuffer &buf, T &v) {
+	BOOST_STATIC_ASSERT(boost::is_pod<T>::value);
+	INVARIANT(buf.readAvailable() >= sizeof(T), "binaryRead: buffer truncated");
+	memcpy(&v, buf.readStart(), sizeof(T));
+	buf.consume(sizeof(T));
+    }
+
+    /// Append count values starting at v to buf with a single copy.
+    template<typename T> inline void binaryWriteArray(ByteBuffer &buf, const T *v, size_t count) {
+	BOOST_STATIC_ASSERT(boost::is_pod<T>::value);
+	buf.append(v, count * sizeof(T));
+    }
+
+    /// Consume count values from the front of buf into v with a single copy.
+    template<typename T> inline void binaryReadArray(ByteBuffer &buf, T *v, size_t count) {
+	BOOST_STATIC_ASSERT(boost::is_pod<T>::value);
+	INVARIANT(buf.readAvailable() >= count * sizeof(T), "binaryReadArray: buffer truncated");
+	memcpy(v, buf.readStart(), count * sizeof(T));
+	buf.consume(count * sizeof(T));
+    }
+
+    /// Strings are written as a 32 bit length followed by the bytes.
+    inline void binaryWrite(ByteBuffer &buf, const std::string &v) {
+	binaryWrite(buf, static_cast<uint32_t>(v.size()));
+	buf.append(v);
+    }
+
+    inline void binaryRead(ByteBuffer &buf, std::string &v) {
+	uint32_t size;
+	binaryRead(buf, size);
+	INVARIANT(buf.readAvailable() >= size, "binaryRead: buffer truncated");
+	v.assign(buf.readStartAs<char>(), size);
+	buf.consume(size);
+    }
+
+    // Tuples are written element by element, so they can contain strings.
+
+    inline void binaryWrite(ByteBuffer &, const boost::tuples::null_type &) { }
+
+    inline void binaryRead(ByteBuffer &, boost::tuples::null_type) { }
+
+    template<class H, class T>
+    inline void binaryWrite(ByteBuffer &buf, const boost::tuples::cons<H, T> &v) {
+	binaryWrite(buf, v.get_head());
+	binaryWrite(buf, v.get_tail());
+    }
+
+    template<class H, class T>
+    inline void binaryRead(ByteBuffer &buf, boost::tuples::cons<H, T> &v) {
+	binaryRead(buf, v.get_head());
+	binaryRead(buf, v.get_tail());
+    }
+
+    // Without these, a tuple would be an exact match for the
+    // plain-old-data versions rather than converting to its cons base.
+
+    template<class T0, class T1, class T2, class T3, class T4,
+	     class T5, class T6, class T7, class T8, class T9>
+    inline void binaryWrite(ByteBuffer &buf, 
+			    const boost::tuple<T0, T1, T2, T3, T4, T5, T6, T7, T8, T9> &v) {
+	typedef boost::tuple<T0, T1, T2, T3, T4, T5, T6, T7, T8, T9> Tuple;
+	binaryWrite(buf, static_cast<const typename Tuple::inherited &>(v));
+    }
+
+    template<class T0, class T1, class T2, class T3, class T4,
+	     class T5, class T6, class T7, class T8, class T9>
+    inline void binaryRead(ByteBuffer &buf, 
+			   boost::tuple<T0, T1, T2, T3, T4, T5, T6, T7, T8, T9> &v) {
+	typedef boost::tuple<T0, T1, T2, T3, T4, T5, T6, T7, T8, T9> Tuple;
+	binaryRead(buf, static_cast<typename Tuple::inherited &>(v));
+    }
+}
+
+#endif
@@ -0,0 +1,140 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief A queue of ByteBuffers moved to and from file descriptors with
+    scatter-gather I/O
+*/
+
+#ifndef LINTEL_BYTEBUFFER_CHAIN_HPP
+#define LINTEL_BYTEBUFFER_CHAIN_HPP
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include <Lintel/ByteBuffer.hpp>
+
+namespace lintel {
+    /// \brief A queue of bytes held as a list of ByteBuffers.
+    ///
+    /// Data is appended at the back, either by sharing an existing
+    /// ByteBuffer, by copying, or by readFrom() reading straight into
+    /// the free space of the last buffer and into new blocks with one
+    /// readv(2).  Data is removed from the front by consume(), or by
+    /// writeTo(), which hands every buffer to one writev(2).  Moving
+    /// data from one descriptor to another through a chain therefore
+    /// costs no memcpy beyond the kernel's.
+    ///
+    /// forward() goes further and moves data from one descriptor to
+    /// another without it entering user space: sendfile(2) when the
+    /// source is a regular file, splice(2) through a pipe otherwise.
+    /// Both are Linux only; elsewhere, or if the kernel refuses the
+    /// pair of descriptors, forward() falls back to readFrom() and
+    /// writeTo().
+    ///
+    /// The I/O functions return what the system calls do: the number
+    /// of bytes moved, 0 at end of file, or -1 with errno set, so
+    /// non-blocking descriptors work as usual (errno == EAGAIN).
+    class ByteBufferChain : boost::noncopyable {
+    public:
+	/// @param block_size size of the buffers allocated by readFrom()
+	/// and append(const void *, size_t)
+	explicit ByteBufferChain(size_t block_size = 64 * 1024);
+	~ByteBufferChain();
+
+	/// total bytes in the chain
+	size_t readAvailable() const {
+	    return available;
+	}
+
+	bool empty() const {
+	    return available == 0;
+	}
+
+	/// number of ByteBuffers holding the data
+	size_t nBuffers() const {
+	    return buffers.size();
+	}
+
+	size_t blockSize() const {
+	    return block_size;
+	}
+
+	/// Add buf to the end of the chain without copying it; the chain
+	/// shares buf's storage, so buf must not be changed afterwards.
+	void append(const ByteBuffer &buf);
+
+	/// Copy size bytes to the end of the chain
+	void append(const void *data, size_t size);
+
+	/// Remove amt bytes from the front; amt <= readAvailable()
+	void consume(size_t amt);
+
+	/// Remove everything
+	void clear();
+
+	/// Fill iov[0 .. max_iov) with the readable data from the front,
+	/// stopping after max_bytes; returns the number of iovecs filled.
+	size_t gather(struct iovec *iov, size_t max_iov, size_t max_bytes) const;
+
+	/// Copy the whole chain into a string, for debugging and tests
+	std::string asString() const;
+
+	/// Read up to max_bytes from fd with one readv(2), into the
+	/// free space at the end of the chain and new blocks as needed.
+	/// max_bytes must be positive, so that 0 always means end of file.
+	ssize_t readFrom(int fd, size_t max_bytes);
+
+	ssize_t readFrom(int fd) {
+	    return readFrom(fd, block_size);
+	}
+
+	/// Write as much of the chain as fd will take with one writev(2),
+	/// and consume what was written.
+	ssize_t writeTo(int fd);
+
+	/// Move up to max_bytes from in_fd to out_fd, writing anything
+	/// already in the chain first; see the class comment.  Returns
+	/// the number of bytes written to out_fd, 0 if the chain is
+	/// empty and in_fd is at end of file, or -1 with errno set.
+	/// Data read from in_fd that out_fd would not take stays queued
+	/// and goes first next time.  max_bytes must be positive.
+	ssize_t forward(int in_fd, int out_fd, size_t max_bytes);
+
+    private:
+	static const size_t max_iov = 64;
+
+	ByteBuffer newBlock();
+	ssize_t forwardCopy(int in_fd, int out_fd, size_t max_bytes);
+	ssize_t forwardSplice(int in_fd, int out_fd, size_t max_bytes);
+	ssize_t drainPipe(int out_fd);
+
+	// Buffers appended by the caller may be shared, so they are
+	// never changed: the bytes consumed from the front buffer are
+	// counted in front_offset instead.
+	std::deque<ByteBuffer> buffers;
+	size_t front_offset;
+	size_t available;
+	size_t block_size;
+	// true if the last buffer was allocated here, so readFrom() and
+	// append() may write into its free space
+	bool tail_owned;
+	std::vector<ByteBuffer> spare; // allocated but unused by readFrom()
+
+	// for forward(): a pipe for splice(2), and the bytes in it
+	int pipe_fds[2];
+	size_t in_pipe;
+    };
+}
+
+#endif
@@ -0,0 +1,278 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief A HashTupleStats variant storing the statistics in columns
+*/
+
+#ifndef LINTEL_COLUMNAR_HASH_TUPLE_STATS_HPP
+#define LINTEL_COLUMNAR_HASH_TUPLE_STATS_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/mpl/bool.hpp>
+
+#include <Lintel/Double.hpp>
+#include <Lintel/HashMap.hpp>
+#include <Lintel/HashTupleStats.hpp>
+#include <Lintel/Stats.hpp>
+#include <Lintel/TupleRadixSort.hpp>
+
+namespace lintel {
+    /// \cond SEMI_INTERNAL_CLASSES
+    namespace detail {
+	/// A Stats whose fields can be set directly, used to hand one
+	/// column entry at a time to the walk functions.
+	class ColumnarStatsView : public Stats {
+	public:
+	    void set(uint64_t count, double total, double total_sq, double min_v, double max_v) {
+		number = count;
+		sum = total;
+		sumsq = total_sq;
+		min_value = min_v;
+		max_value = max_v;
+	    }
+	};
+    }
+    /// \endcond
+
+    /// \brief HashTupleStats storing count/sum/sumsq/min/max in parallel arrays
+    ///
+    /// HashTupleStats<Tuple, Stats> allocates a separate Stats for
+    /// each key, so every add() chases a pointer to a heap object
+    /// with a vtable.  Here each new key is given a dense group id,
+    /// and the five Stats values for the group are stored in
+    /// std::vectors indexed by the id, so add() is a hash lookup and
+    /// five array updates, and a group costs 40 bytes plus its key.
+    /// The walk functions materialize a Stats for each group in a
+    /// single reused object, so the reference is only valid during
+    /// the call.  Only plain Stats are supported since the columns
+    /// hold exactly the Stats values; use fill() to make a
+    /// HashTupleStats for use with StatsCube.
+    template<class Tuple> class ColumnarHashTupleStats {
+    public:
+	typedef HashMap<Tuple, uint32_t, lintel::tuples::TupleHash<Tuple> > IdMap;
+	typedef boost::function<void (const Tuple &key, const Stats &value)> WalkFn;
+	typedef boost::function<bool (const Tuple &key)> PruneFn;
+
+	ColumnarHashTupleStats() { }
+
+	/// add a value into the stats based on the selected key.
+	void add(const Tuple &key, double value) {
+	    uint32_t id = getGroupId(key);
+	    ++counts[id];
+	    sums[id] += value;
+	    sumsqs[id] += value * value;
+	    if (value < mins[id]) {
+		mins[id] = value;
+	    }
+	    if (value > maxs[id]) {
+		maxs[id] = value;
+	    }
+	}
+
+	/// merge stats into the entry for key.
+	void add(const Tuple &key, const Stats &stats) {
+	    uint32_t id = getGroupId(key);
+	    counts[id] += stats.countll();
+	    sums[id] += stats.total();
+	    sumsqs[id] += stats.total_sq();
+	    if (stats.countll() > 0) {
+		mins[id] = std::min(mins[id], stats.min());
+		maxs[id] = std::max(maxs[id], stats.max());
+	    }
+	}
+
+	/// Get the dense id for key, creating an empty group if it
+	/// doesn't already exist.  Ids run from 0 to size()-1 and are
+	/// stable until prune() or clear().
+	uint32_t getGroupId(const Tuple &key) {
+	    uint32_t *id = ids.lookup(key);
+	    if (id != NULL) {
+		return *id;
+	    }
+	    uint32_t ret = keys.size();
+	    INVARIANT(ret < 0xFFFFFFFFU, "ColumnarHashTupleStats: too many groups");
+	    ids[key] = ret;
+	    keys.push_back(key);
+	    counts.push_back(0);
+	    sums.push_back(0);
+	    sumsqs.push_back(0);
+	    mins.push_back(Double::Inf);
+	    maxs.push_back(-Double::Inf);
+	    return ret;
+	}
+
+	/// Returns true and sets id if there is a group for key.
+	bool lookupGroupId(const Tuple &key, uint32_t &id) const {
+	    const uint32_t *v = ids.lookup(key);
+	    if (v == NULL) {
+		return false;
+	    }
+	    id = *v;
+	    return true;
+	}
+
+	// Direct access to the columns by group id.
+	const Tuple &key(uint32_t id) const { return keys[id]; }
+	uint64_t count(uint32_t id) const { return counts[id]; }
+	double total(uint32_t id) const { return sums[id]; }
+	double total_sq(uint32_t id) const { return sumsqs[id]; }
+	double min(uint32_t id) const { return mins[id]; }
+	double max(uint32_t id) const { return maxs[id]; }
+	double mean(uint32_t id) const {
+	    return counts[id] == 0 ? 0.0 : sums[id] / counts[id];
+	}
+
+	/// Add the statistics for group id into into.
+	void getStats(uint32_t id, Stats &into) const {
+	    detail::ColumnarStatsView view;
+	    view.set(counts[id], sums[id], sumsqs[id], mins[id], maxs[id]);
+	    into.add(view);
+	}
+
+	/// apply walk_fn(const Tuple &, const Stats &) to each entry in
+	/// group id order, i.e. the order the keys were first added.
+	void walk(const WalkFn &walk_fn) const {
+	    detail::ColumnarStatsView view;
+	    for(uint32_t i = 0; i < keys.size(); ++i) {
+		view.set(counts[i], sums[i], sumsqs[i], mins[i], maxs[i]);
+		walk_fn(keys[i], view);
+	    }
+	}
+
+	/// apply walk_fn(const Tuple &, const Stats &) to each entry,
+	/// sorted in tuple order; sorts a vector of the group ids, with
+	/// radixSortTuples() if the tuple is TupleRadixSortable.
+	void walkOrdered(const WalkFn &walk_fn) const {
+	    std::vector<uint32_t> sorted(keys.size());
+	    for(uint32_t i = 0; i < keys.size(); ++i) {
+		sorted[i] = i;
+	    }
+	    sortIds(sorted, boost::mpl::bool_<TupleRadixSortable<Tuple>::value>());
+
+	    detail::ColumnarStatsView view;
+	    for(std::vector<uint32_t>::iterator i = sorted.begin(); i != sorted.end(); ++i) {
+		view.set(counts[*i], sums[*i], sumsqs[*i], mins[*i], maxs[*i]);
+		walk_fn(keys[*i], view);
+	    }
+	}
+
+	/// Add each entry into hts, e.g. to cube the data with a
+	/// StatsCube.
+	template<class StatsT> void fill(HashTupleStats<Tuple, StatsT> &hts) const {
+	    detail::ColumnarStatsView view;
+	    for(uint32_t i = 0; i < keys.size(); ++i) {
+		view.set(counts[i], sums[i], sumsqs[i], mins[i], maxs[i]);
+		hts.getHashEntry(keys[i]).add(view);
+	    }
+	}
+
+	/// how many groups are there
+	size_t size() const {
+	    return keys.size();
+	}
+
+	/// Reserve space for n groups.
+	void reserve(size_t n) {
+	    ids.reserve(n);
+	    keys.reserve(n);
+	    counts.reserve(n);
+	    sums.reserve(n);
+	    sumsqs.reserve(n);
+	    mins.reserve(n);
+	    maxs.reserve(n);
+	}
+
+	/// remove all of the entries for which fn(key) returns true;
+	/// the remaining groups are renumbered, keeping their order.
+	void prune(const PruneFn &fn) {
+	    uint32_t to = 0;
+	    for(uint32_t from = 0; from < keys.size(); ++from) {
+		if (fn(keys[from])) {
+		    ids.remove(keys[from]);
+		    continue;
+		}
+		if (to != from) {
+		    ids[keys[from]] = to;
+		    keys[to] = keys[from];
+		    counts[to] = counts[from];
+		    sums[to] = sums[from];
+		    sumsqs[to] = sumsqs[from];
+		    mins[to] = mins[from];
+		    maxs[to] = maxs[from];
+		}
+		++to;
+	    }
+	    keys.resize(to);
+	    counts.resize(to);
+	    sums.resize(to);
+	    sumsqs.resize(to);
+	    mins.resize(to);
+	    maxs.resize(to);
+	}
+
+	/// clear out all the values.
+	void clear() {
+	    ids.clear();
+	    keys.clear();
+	    counts.clear();
+	    sums.clear();
+	    sumsqs.clear();
+	    mins.clear();
+	    maxs.clear();
+	}
+
+	/// how much memory is being used; accurate only if Tuple does
+	/// not have internal allocated memory.
+	size_t memoryUsage() const {
+	    return ids.memoryUsage() + sizeof(*this)
+		+ keys.capacity() * sizeof(Tuple) + counts.capacity() * sizeof(uint64_t)
+		+ (sums.capacity() + sumsqs.capacity() + mins.capacity() + maxs.capacity())
+		* sizeof(double);
+	}
+
+    private:
+	struct KeyLess {
+	    explicit KeyLess(const std::vector<Tuple> &keys) : keys(keys) { }
+	    bool operator()(uint32_t a, uint32_t b) const {
+		return keys[a] < keys[b];
+	    }
+	    const std::vector<Tuple> &keys;
+	};
+
+	struct RadixKeyOf {
+	    typedef Tuple TupleType;
+	    static const bool has_any = false;
+	    explicit RadixKeyOf(const std::vector<Tuple> &keys) : keys(keys) { }
+	    const Tuple &tuple(uint32_t id) const {
+		return keys[id];
+	    }
+	    bool any(uint32_t, int) const {
+		return false;
+	    }
+	    const std::vector<Tuple> &keys;
+	};
+
+	void sortIds(std::vector<uint32_t> &sorted, boost::mpl::true_) const {
+	    radixSortTuples(sorted, RadixKeyOf(keys));
+	}
+
+	void sortIds(std::vector<uint32_t> &sorted, boost::mpl::false_) const {
+	    std::sort(sorted.begin(), sorted.end(), KeyLess(keys));
+	}
+
+	IdMap ids;
+	std::vector<Tuple> keys;
+	std::vector<uint64_t> counts;
+	std::vector<double> sums, sumsqs, mins, maxs;
+    };
+}
+
+#endif
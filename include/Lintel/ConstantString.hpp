@@ -16,19 +16,16 @@
 
 #include <sys/types.h>
 
+#include <iosfwd>
 #include <string>
 #include <vector>
 #include <cstring>
 
 #include <boost/static_assert.hpp>
+#include <boost/utility.hpp>
 
 #include <Lintel/HashMap.hpp>
 
-// TODO: think about how to make this thread safe; potentially one
-// choice is to make the constructor the constantstring take a
-// stringpool argument with a choice on the pool as to whether it is
-// locked or not.
-
 // Class is here merely to force type incompatibility
 struct ConstantStringValue;
 
@@ -42,11 +39,61 @@ inline const char *ConstantString_c_str(const ConstantStringValue *ptr) {
     return reinterpret_cast<const char *>(ptr); 
 }
 
+/** \brief A thread-safe pool of the strings used by ConstantString
+ *
+ * Strings are spread over a power of two number of shards by their hash.  Each shard has an
+ * open addressing table of pointers to its strings that is searched without locking: slots
+ * are only ever filled in, and a full table is replaced by a larger copy, with the old one
+ * kept until the pool is destroyed so that concurrent readers can finish with it.  Adding a
+ * string takes the shard's spin lock, searches again, and bump allocates the string from the
+ * shard's current buffer, so threads interning different strings rarely contend.
+ *
+ * Strings are only freed when the pool is destroyed, so the pool must outlive every
+ * ConstantString made from it.  ConstantStrings from different pools are never equal.
+ */
+class ConstantStringPool : boost::noncopyable {
+public:
+    /// nshards is rounded up to a power of two, at most 256
+    explicit ConstantStringPool(uint32_t nshards = 16);
+    ~ConstantStringPool();
+
+    /// The pool used by ConstantStrings constructed without one; never destroyed.
+    static ConstantStringPool &defaultPool();
+
+    /// The unique copy of s in this pool, adding it if necessary.
+    ConstantStringValue *intern(const void *s, uint32_t slen);
+
+    /// The copy of s in this pool, or NULL if there isn't one; never locks, and may miss a
+    /// string that another thread is adding at the same time.
+    ConstantStringValue *find(const void *s, uint32_t slen) const;
+
+    ConstantStringValue *emptyString() const { return empty_string; }
+
+    uint32_t nShards() const { return shard_mask + 1; }
+    size_t nStrings() const;
+    /// Bytes in the strings, including a null for each.
+    size_t stringBytes() const;
+    /// Bytes in the string buffers and tables.
+    size_t bytesAllocated() const;
+
+    void dumpInfo(std::ostream &to) const;
+
+private:
+    struct Shard;
+
+    Shard &shardFor(uint32_t hash) const;
+
+    Shard *shards;
+    uint32_t shard_mask;
+    ConstantStringValue *empty_string;
+};
+
 /** \brief A class representing a constant string.
  * 
  * ConstantString is much like std::string except that only a single instance of each string
- * will be stored.  Currently the implementation uses globals so there is only a single string
- * pool.  This approach means that the memory allocated for constant string will never be freed. 
+ * will be stored in a ConstantStringPool, so comparing two of them for equality is a pointer
+ * comparison.  Strings constructed without a pool go in ConstantStringPool::defaultPool().
+ * The memory allocated for a constant string is not freed until its pool is destroyed.
  */
 
 class ConstantString {
@@ -67,13 +114,15 @@ public:
     ConstantString(const void *s, uint32_t slen) {
 	init(static_cast<const char *>(s), slen);
     }
-    ConstantString() { 
-	if (empty_string_myptr != NULL) {
-	    myptr = empty_string_myptr;
-	} else {
-	    init("", 0); 
-	}
-    }
+    ConstantString(const std::string &str, ConstantStringPool &pool)
+	: myptr(pool.intern(str.data(), str.size())) { }
+    ConstantString(const char *s, ConstantStringPool &pool)
+	: myptr(pool.intern(s, strlen(s))) { }
+    ConstantString(const void *s, uint32_t slen, ConstantStringPool &pool)
+	: myptr(pool.intern(s, slen)) { }
+    ConstantString() : myptr(ConstantStringPool::defaultPool().emptyString()) { }
+
+    /// Set to s from the default pool.
     void init(const void *s, uint32_t slen);
 
     const char *c_str() const { return ConstantString_c_str(myptr); }
@@ -117,13 +166,8 @@ public:
 
     /// \cond SEMI_INTERNAL_CLASSES
 
-    struct buffer {
-	ConstantStringValue *data;
-	int size;
-	int amt_used;
-    };
+    /// Print the usage of the default pool to cout.
     static void dumpInfo();
-    typedef std::vector<buffer> bufvect;
 
     // Comparisons are done with char *'s here so that when doing a
     // hash check to see if we already have a string, we don't have to
@@ -154,15 +198,6 @@ public:
     }
 private:
     ConstantStringValue *myptr;
-
-    static int nstrings;
-    static int string_bytes;
-    static const int buffer_size = 512*1024;
-    static bufvect *buffers;
-    typedef HashTable<ConstantStringValue *, hteHash, hteEqual> CS_hashtable;
-
-    static CS_hashtable *hashtable;
-    static ConstantStringValue *empty_string_myptr;
 };
 
 inline bool
@@ -12,8 +12,15 @@
 #ifndef LINTEL_DEQUE_HPP
 #define LINTEL_DEQUE_HPP
 
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
 #include <vector>
 
+#include <boost/type_traits/has_trivial_copy.hpp>
+#include <boost/type_traits/has_trivial_destructor.hpp>
 #include <boost/utility.hpp>
 
 #include <Lintel/AssertBoost.hpp>
@@ -21,7 +28,8 @@
 // HP-UX (~10us / insertion to empty deque) Instead, standard
 // rules on a rotating vector, valid range is [q_front
 // .. q_back -1] (wrapping), one slot is wasted, front ==
-// back -> empty
+// back -> empty.  q_size is always a power of two so that
+// positions wrap with a mask rather than a division.
 
 /*!
     \class Deque
@@ -36,17 +44,30 @@
     Deque implementation that has amortized constant-time performance,
     rather than log(n); g++ deque looks better since it does the linked list
     of multiple elements; performance comparison unclear.
+
+    The capacity is always one less than a power of two, so every
+    access wraps with a mask instead of a division, which makes a
+    front/back/at/pop_front/push_back step several times cheaper (see
+    the timing in src/tests/deque.cpp).  The iterators are random access, so
+    std::sort, std::lower_bound and the like work on a Deque.
+
+    Types that can be copied bitwise (trivial copy constructor and
+    destructor) are moved with memcpy when the deque grows, and the
+    bulk push_back and pop_front copy them with at most two memcpy's,
+    one for each side of the wrap point.
 */
 template <class T, class Alloc = std::allocator<T> >
 class Deque : boost::noncopyable {
 public:
+    /// default_size is rounded up to a power of two
     Deque(size_t default_size = 8) 
-	: q_front(0), q_back(0), q_size(default_size) {
-	INVARIANT(q_size > 1, "Must have size at least 2\n");
+	: q_front(0), q_back(0), q_size(roundUpPow2(default_size)) {
+	INVARIANT(default_size > 1, "Must have size at least 2\n");
 	deque = allocator.allocate(q_size);
     }
 
     ~Deque() {
+	clear();
 	allocator.deallocate(deque, q_size);
     }
     typedef Deque<T> mytype;
@@ -57,56 +78,95 @@ public:
     }
     T &back() {
 	DEBUG_INVARIANT(!empty(), "back() on empty dequeue");
-	return deque[(q_back + q_size - 1) % q_size];
+	return deque[(q_back - 1) & mask()];
     }
     T &at(size_t pos) {
 	DEBUG_INVARIANT(pos < size(), "invalid position for at()");
-	return deque[(q_front + pos) % q_size];
+	return deque[(q_front + pos) & mask()];
     }
     void pop_front() {
 	DEBUG_INVARIANT(!empty(), "pop_front() on empty dequeue");
 	allocator.destroy(deque + q_front);
-	q_front = (q_front + 1) % q_size;
+	q_front = (q_front + 1) & mask();
+    }
+    /// Remove count values from the front, assigning them to out[0
+    /// .. count-1].
+    void pop_front(T *out, size_t count) {
+	INVARIANT(count <= size(), "pop_front() of more values than are in the deque");
+	size_t first = std::min(count, q_size - q_front);
+	copyOut(out, deque + q_front, first);
+	copyOut(out + first, deque, count - first);
+	q_front = (q_front + count) & mask();
     }
     void push_back(const T &val) { 
-	size_t back_next = (q_back + 1) % q_size; 
+	size_t back_next = (q_back + 1) & mask(); 
 	if (back_next != q_front) {
 	    allocator.construct(deque + q_back, val);
 	    q_back = back_next;
 	} else { 
-	    push_expand(val);
+	    // construct first, val may be in the deque
+	    T *new_deque = allocator.allocate(2 * q_size);
+	    allocator.construct(new_deque + q_size - 1, val);
+	    replaceBuffer(new_deque, 2 * q_size, 1);
+	}
+    }
+#if __cplusplus >= 201103L
+    void push_back(T &&val) {
+	emplace_back(std::move(val));
+    }
+    /// Construct a value on the back from args.
+    template<class... Args> void emplace_back(Args&&... args) {
+	size_t back_next = (q_back + 1) & mask(); 
+	if (back_next != q_front) {
+	    std::allocator_traits<Alloc>::construct(allocator, deque + q_back,
+						    std::forward<Args>(args)...);
+	    q_back = back_next;
+	} else { 
+	    T *new_deque = allocator.allocate(2 * q_size);
+	    std::allocator_traits<Alloc>::construct(allocator, new_deque + q_size - 1,
+						    std::forward<Args>(args)...);
+	    replaceBuffer(new_deque, 2 * q_size, 1);
+	}
+    }
+#endif
+    /// Add count values starting at vals onto the back.
+    void push_back(const T *vals, size_t count) {
+	if (size() + count > capacity()) {
+	    reserve(std::max(size() + count, 2 * q_size - 1));
 	}
+	size_t first = std::min(count, q_size - q_back);
+	copyIn(deque + q_back, vals, first);
+	copyIn(deque, vals + first, count - first);
+	q_back = (q_back + count) & mask();
     }
     /// Add in an entire vector of values onto the back.
     void push_back(const std::vector<T> &vals) {
-	typedef typename std::vector<T>::const_iterator vector_iterator;
-	for(vector_iterator i = vals.begin(); 
-	    i != vals.end(); ++i) {
-	    push_back(*i);
+	if (!vals.empty()) {
+	    push_back(&vals[0], vals.size());
 	}
     }
 
     bool empty() const { return q_front == q_back;} ;
-    size_t size() const { return (q_back + q_size - q_front) % q_size; }
+    size_t size() const { return (q_back - q_front) & mask(); }
 
-    // TODO: Implement correct resize (reserve + push_back's, or pop_back's if we handle non-empty)
+    /// Set the capacity to the smallest one that holds new_size
+    /// values; new_size must be at least size(), the values are kept.
     void reserve(size_t new_size) {
-	INVARIANT(empty(),"Lame implementation only does reserve when empty");
-	INVARIANT(new_size > 0 && new_size < std::numeric_limits<size_t>::max(), 
-                  "Must have size at least 1, and at most size_t::max() - 1");
-	new_size += 1; // for the empty entry that always exists
-	q_front = q_back = 0;
-	allocator.deallocate(deque, q_size);
-	q_size = new_size;
-	deque = allocator.allocate(q_size);
+	INVARIANT(new_size > 0 && new_size <= std::numeric_limits<size_t>::max() / 2, 
+                  "Must have size at least 1, and at most size_t::max() / 2");
+	INVARIANT(new_size >= size(), "Can not reserve less than the current size");
+	size_t new_q_size = roundUpPow2(new_size + 1); // + 1 for the empty entry that always exists
+	if (new_q_size != q_size) {
+	    replaceBuffer(allocator.allocate(new_q_size), new_q_size, 0);
+	}
     }
 
     size_t capacity() const { return q_size - 1; }
 
-    /// \brief an iterator for Deque's
+    /// \brief a random access iterator for Deque's
     class iterator {
     public:
-	typedef std::forward_iterator_tag iterator_category;
+	typedef std::random_access_iterator_tag iterator_category;
 
 	typedef T value_type;
 	typedef T &reference;
@@ -118,8 +178,6 @@ public:
 	{ }
         iterator() : mydeque(NULL), cur_pos(-1)
         { }
-        iterator(const iterator &it) : mydeque(it.mydeque), cur_pos(it.cur_pos)
-        { }
 
         /// compares two iterators for equality
 	bool operator==(const iterator &y) const {
@@ -132,14 +190,18 @@ public:
 	    return cur_pos != y.cur_pos;
 	}
         /// dereference the iterator
-	T &operator *() {
+	T &operator *() const {
 	    DEBUG_INVARIANT(cur_pos < mydeque->q_size, "invalid use of iterator");
 	    return mydeque->deque[cur_pos];
 	}
         /// dereference the iterator
-	T *operator ->() {
+	T *operator ->() const {
 	    return &(operator *());
 	}
+        /// the value diff after the iterator
+        T &operator[](ptrdiff_t diff) const {
+            return *(*this + diff);
+        }
         /// pre-increments the iterator
 	iterator &operator++() { increment(); return *this; }
         /// post-increments the iterator
@@ -157,79 +219,75 @@ public:
             return tmp;
         }
 
-        // TODO: We are missing (n + a) variant of + and - operator, as defined by
-        // RandomAccessIterator characteristics, where a is iterator type and n is integral type.
         /// adds diff and returns the iterator
-        iterator operator+(ptrdiff_t diff) {
-            DEBUG_SINVARIANT(inRangePlus(diff));
-            return iterator(mydeque, static_cast<size_t>(cur_pos + diff) % mydeque->q_size);
+        iterator operator+(ptrdiff_t diff) const {
+            DEBUG_SINVARIANT(inRange(diff));
+            return iterator(mydeque, (cur_pos + diff) & mydeque->mask());
+        }
+        /// adds diff to it and returns the iterator
+        friend iterator operator+(ptrdiff_t diff, const iterator &it) {
+            return it + diff;
         }
         /// subtracts diff and returns the iterator
-        iterator operator-(ptrdiff_t diff) {
-            DEBUG_SINVARIANT(inRangeMinus(diff));
-            return iterator(mydeque, static_cast<size_t>(cur_pos + mydeque->q_size 
-                                                         - diff) % mydeque->q_size);
+        iterator operator-(ptrdiff_t diff) const {
+            DEBUG_SINVARIANT(inRange(-diff));
+            return iterator(mydeque, (cur_pos - diff) & mydeque->mask());
         }
         /// compares if lhs iterator is smaller than rhs iterator
-        bool operator<(const iterator &rhs) {
+        bool operator<(const iterator &rhs) const {
             DEBUG_INVARIANT(mydeque == rhs.mydeque, "invalid use of iterator");
-            return logicalOffset(*this) < logicalOffset(rhs);
+            return logicalOffset() < rhs.logicalOffset();
         }
         /// compares if lhs iterator is greater than rhs iterator
-        bool operator>(const iterator &rhs) {
+        bool operator>(const iterator &rhs) const {
             DEBUG_INVARIANT(mydeque == rhs.mydeque, "invalid use of iterator");
-            return logicalOffset(*this) > logicalOffset(rhs);
+            return logicalOffset() > rhs.logicalOffset();
         }
         /// compares if lhs iterator is smaller than and equal to rhs iterator
-        bool operator<=(const iterator &rhs) {
+        bool operator<=(const iterator &rhs) const {
             DEBUG_INVARIANT(mydeque == rhs.mydeque, "invalid use of iterator");
-            return logicalOffset(*this) <= logicalOffset(rhs);
+            return logicalOffset() <= rhs.logicalOffset();
         }
         /// compares if lhs iterator is greater than and equal to rhs iterator
-        bool operator>=(const iterator &rhs) {
+        bool operator>=(const iterator &rhs) const {
             DEBUG_INVARIANT(mydeque == rhs.mydeque, "invalid use of iterator");
-            return logicalOffset(*this) >= logicalOffset(rhs);
+            return logicalOffset() >= rhs.logicalOffset();
         }
         /// adds diff to the iterator and returns the reference
         iterator &operator+=(ptrdiff_t diff) {
-            DEBUG_SINVARIANT(inRangePlus(diff));
-            cur_pos = static_cast<size_t>(cur_pos + diff) % mydeque->q_size;
+            DEBUG_SINVARIANT(inRange(diff));
+            cur_pos = (cur_pos + diff) & mydeque->mask();
             return *this;
         }
         /// subtracts diff to the iterator and returns the reference
         iterator &operator-=(ptrdiff_t diff) {
-            DEBUG_SINVARIANT(inRangeMinus(diff));
-                                  
-            cur_pos = static_cast<size_t>(cur_pos + mydeque->q_size - diff) % mydeque->q_size;
+            DEBUG_SINVARIANT(inRange(-diff));
+            cur_pos = (cur_pos - diff) & mydeque->mask();
             return *this;
         }
         /// returns difference between two iterators
         ptrdiff_t operator-(const iterator &rhs) const {
             DEBUG_INVARIANT(mydeque == rhs.mydeque, "invalid use of iterator");
-            return logicalOffset(*this) - logicalOffset(rhs);
+            return static_cast<ptrdiff_t>(logicalOffset()) 
+                - static_cast<ptrdiff_t>(rhs.logicalOffset());
         }
 
-
     private:
-        bool inRangeMinus(ptrdiff_t diff) { // safer to do minus/plus than -diff because of overflow
-            return logicalOffset(*this) - diff >= 0 // <= size as iterator at ::end is ok
-                && static_cast<size_t>(logicalOffset(*this) - diff) <= mydeque->size();
-        }
-        bool inRangePlus(ptrdiff_t diff) {
-            return logicalOffset(*this) + diff >= 0 // <= size as iterator at ::end is ok
-                && static_cast<size_t>(logicalOffset(*this) + diff) <= mydeque->size();
+        bool inRange(ptrdiff_t diff) const { // <= size as iterator at ::end is ok
+            return static_cast<ptrdiff_t>(logicalOffset()) + diff >= 0 
+                && static_cast<size_t>(logicalOffset() + diff) <= mydeque->size();
         }
 	void increment() {
 	    DEBUG_INVARIANT(cur_pos < mydeque->q_size, "invalid use of iterator");
-	    cur_pos = (cur_pos + 1) % mydeque->q_size;
+	    cur_pos = (cur_pos + 1) & mydeque->mask();
 	}
         void decrement() {
-            DEBUG_INVARIANT(logicalOffset(*this) > 0, "invalid use of iterator");
-            cur_pos = (cur_pos + mydeque->q_size - 1) % mydeque->q_size;
+            DEBUG_INVARIANT(logicalOffset() > 0, "invalid use of iterator");
+            cur_pos = (cur_pos - 1) & mydeque->mask();
         }
         // The logical offset in the deque, as if the deque was a vector starting at 0.
-        inline int64_t logicalOffset(const iterator &i) const {
-            return (i.cur_pos - i.mydeque->q_front + i.mydeque->q_size) % i.mydeque->q_size;
+        size_t logicalOffset() const {
+            return (cur_pos - mydeque->q_front) & mydeque->mask();
         }
 	Deque *mydeque;
 	size_t cur_pos;
@@ -265,37 +323,81 @@ public:
 
 private:
     friend class iterator;
-    void push_expand(const T &val) {
-	T *new_deque = allocator.allocate(q_size * 2);
-	size_t i = 0;
-	// copy back to 0 offset
-	if (q_front == 0) {
-	    // special case if it's already 0 offset
-	    for(;i<q_back;i++) {
-		allocator.construct(new_deque + i, deque[i]);
-		allocator.destroy(deque + i);
+
+    size_t mask() const { return q_size - 1; }
+
+    static size_t roundUpPow2(size_t size) {
+	size_t ret = 2;
+	while (ret < size) {
+	    ret *= 2;
+	}
+	return ret;
+    }
+
+    // The memcpy's are only used for types that are bitwise copyable;
+    // the casts keep g++ from warning about the other instantiations.
+    static const bool bitwise_copyable = boost::has_trivial_copy<T>::value
+	&& boost::has_trivial_destructor<T>::value;
+
+    /// Construct to[0 .. count-1] from from[0 .. count-1]
+    void copyIn(T *to, const T *from, size_t count) {
+	if (bitwise_copyable) {
+	    memcpy(static_cast<void *>(to), static_cast<const void *>(from), count * sizeof(T));
+	} else {
+	    for(size_t i = 0; i < count; ++i) {
+		allocator.construct(to + i, from[i]);
 	    }
+	}
+    }
+
+    /// Assign to[0 .. count-1] from from[0 .. count-1] and destroy the latter
+    void copyOut(T *to, T *from, size_t count) {
+	if (bitwise_copyable) {
+	    memcpy(static_cast<void *>(to), static_cast<const void *>(from), count * sizeof(T));
 	} else {
-	    for(size_t j=q_front; j<q_size;++j) {
-		allocator.construct(new_deque + i, deque[j]);
-		allocator.destroy(deque + j);
-		++i;
+	    for(size_t i = 0; i < count; ++i) {
+#if __cplusplus >= 201103L
+		to[i] = std::move(from[i]);
+#else
+		to[i] = from[i];
+#endif
+		allocator.destroy(from + i);
 	    }
-	    for(size_t j=0;j<q_back;++j) {
-		allocator.construct(new_deque + i, deque[j]);
-		allocator.destroy(deque + j);
-		++i;
+	}
+    }
+
+    /// Construct to[0 .. count-1] from from[0 .. count-1] and destroy the latter
+    void relocate(T *to, T *from, size_t count) {
+	if (bitwise_copyable) {
+	    memcpy(static_cast<void *>(to), static_cast<const void *>(from), count * sizeof(T));
+	} else {
+	    for(size_t i = 0; i < count; ++i) {
+#if __cplusplus >= 201103L
+		allocator.construct(to + i, std::move(from[i]));
+#else
+		allocator.construct(to + i, from[i]);
+#endif
+		allocator.destroy(from + i);
 	    }
 	}
-	INVARIANT(i == q_size-1, boost::format("internal %u %u %u %u")
-                  % i % q_size % q_front % q_back);
-	q_front = 0;
-	allocator.construct(new_deque + i, val);
-	q_back = i + 1;
+    }
+
+    /// Move the values to the start of new_deque, which has room for
+    /// new_q_size entries, and switch to it; extra values have
+    /// already been constructed after the moved ones.
+    void replaceBuffer(T *new_deque, size_t new_q_size, size_t extra) {
+	size_t count = size();
+	size_t first = std::min(count, q_size - q_front);
+	relocate(new_deque, deque + q_front, first);
+	relocate(new_deque + first, deque, count - first);
 	allocator.deallocate(deque, q_size);
-	q_size = q_size * 2;
 	deque = new_deque;
+	q_size = new_q_size;
+	q_front = 0;
+	q_back = count + extra;
+	DEBUG_SINVARIANT(q_back < q_size);
     }
+
     Alloc allocator;
     T *deque; 
     size_t q_front; 
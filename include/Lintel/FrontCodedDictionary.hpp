@@ -0,0 +1,154 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief Sorted, prefix compressed, immutable string dictionary
+*/
+
+#ifndef LINTEL_FRONT_CODED_DICTIONARY_HPP
+#define LINTEL_FRONT_CODED_DICTIONARY_HPP
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/HashUnique.hpp>
+
+namespace lintel {
+    /** \brief An immutable sorted set of strings with dense ids
+
+	The strings are numbered 0 .. size()-1 in sorted (memcmp)
+	order, so comparing two ids gives the same answer as comparing
+	their strings, and all the strings in a range, or with a given
+	prefix, have a contiguous range of ids.
+
+	The strings are stored front coded in blocks of blockSize():
+	the first string of each block is stored whole, and each
+	following one as the length of the prefix it shares with the
+	previous string plus the rest of its bytes, with the lengths
+	as variable length integers.  Sets of strings with long common
+	prefixes such as URLs or file names shrink several times.  An
+	array of block offsets gives O(1) access to the start of any
+	block; looking up a string is a binary search on the first
+	strings of the blocks and then a scan of one block, and
+	getting the string for an id decodes at most one block.
+
+	Build one with a Builder from strings in increasing order, or
+	from an unsorted HashUnique or vector of strings.
+    */
+    class FrontCodedDictionary {
+    public:
+	static const uint32_t npos = 0xFFFFFFFFU;
+	static const uint32_t default_block_size = 16;
+
+	/// \brief Assembles a dictionary from strings in increasing order
+	class Builder {
+	public:
+	    explicit Builder(uint32_t block_size = default_block_size);
+
+	    /// Add the next string, which must be greater than the
+	    /// previous one; it gets the next id.
+	    void add(const char *data, size_t size);
+	    void add(const std::string &str) { add(str.data(), str.size()); }
+
+	    /// Replace the contents of dict with the strings added so
+	    /// far, and reset the builder.
+	    void finish(FrontCodedDictionary &dict);
+
+	private:
+	    uint32_t block_size;
+	    uint32_t count;
+	    std::vector<uint8_t> data;
+	    std::vector<uint64_t> block_starts;
+	    std::string last;
+	};
+
+	/// \brief Iterates over the strings in id order
+	class Iterator {
+	public:
+	    /// Start at id start; the iterator is not valid() if
+	    /// start >= dict.size()
+	    explicit Iterator(const FrontCodedDictionary &dict, uint32_t start = 0);
+
+	    bool valid() const { return cur_id < dict.count; }
+	    uint32_t id() const { return cur_id; }
+	    const std::string &operator*() const { return cur; }
+	    const std::string *operator->() const { return &cur; }
+	    Iterator &operator++();
+
+	private:
+	    const FrontCodedDictionary &dict;
+	    uint32_t cur_id;
+	    const uint8_t *pos;
+	    std::string cur;
+	};
+
+	/// An empty dictionary
+	FrontCodedDictionary();
+
+	/// The distinct strings in strings, sorted.
+	explicit FrontCodedDictionary(const HashUnique<std::string> &strings,
+				      uint32_t block_size = default_block_size);
+
+	/// The distinct strings in strings, sorted.
+	explicit FrontCodedDictionary(const std::vector<std::string> &strings,
+				      uint32_t block_size = default_block_size);
+
+	uint32_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	uint32_t blockSize() const { return block_size; }
+
+	/// The id of the string, or npos if it is not present.
+	uint32_t find(const char *data, size_t size) const;
+	uint32_t find(const std::string &str) const { return find(str.data(), str.size()); }
+
+	/// The id of the first string >= str, or size() if there is none.
+	uint32_t lowerBound(const std::string &str) const {
+	    bool exact;
+	    return search(str.data(), str.size(), exact);
+	}
+
+	/// The id of the first string > str, or size() if there is none.
+	uint32_t upperBound(const std::string &str) const {
+	    bool exact;
+	    uint32_t ret = search(str.data(), str.size(), exact);
+	    return exact ? ret + 1 : ret;
+	}
+
+	/// Set [begin, end) to the ids of the strings starting with prefix.
+	void prefixRange(const std::string &prefix, uint32_t &begin, uint32_t &end) const;
+
+	/// Set out to string id, which must be < size().
+	void getString(uint32_t id, std::string &out) const;
+
+	std::string getString(uint32_t id) const {
+	    std::string ret;
+	    getString(id, ret);
+	    return ret;
+	}
+
+	/// Bytes used by the encoded strings and the block offsets.
+	size_t memoryUsage() const;
+
+    private:
+	friend class Builder;
+	friend class Iterator;
+
+	void build(std::vector<std::string> &sorted);
+	/// first string >= key; exact is set if it equals key
+	uint32_t search(const char *key, size_t key_size, bool &exact) const;
+
+	uint32_t block_size;
+	uint32_t count;
+	std::vector<uint8_t> data;
+	std::vector<uint64_t> block_starts;
+    };
+}
+
+#endif
@@ -13,10 +13,13 @@
 #include <bitset>
 
 #include <boost/bind.hpp>
+#include <boost/mpl/bool.hpp>
 
+#include <Lintel/BinarySerialize.hpp>
 #include <Lintel/HashTable.hpp>
 #include <Lintel/HashUnique.hpp>
 #include <Lintel/Stats.hpp>
+#include <Lintel/TupleRadixSort.hpp>
 #include <Lintel/Tuples.hpp>
 
 // TODO: consider renaming this to TupleHashMap or something like that
@@ -141,20 +144,11 @@ namespace lintel {
 	/// apply walk_fn(const Tuple &, StatsT &) to each entry,
 	/// sorted in tuple order.  If you can avoid using this
 	/// function, do, it will use additional memory as a result of
-	/// having to sort the tuples.
+	/// having to sort the tuples.  If all of the tuple elements
+	/// are numbers (see TupleRadixSortable), the entries are radix
+	/// sorted, otherwise they are sorted with std::sort.
 	void walkOrdered(const WalkFn &walk_fn) const {
-	    HTSValueVector sorted;
-
-	    sorted.reserve(data.size());
-	    // TODO: figure out why the below doesn't work.
-	    //	sorted.push_back(base_data.begin(), base_data.end());
-	    for(HTSconst_iterator i = data.begin(); i != data.end(); ++i) {
-		sorted.push_back(*i);
-	    }
-	    sort(sorted.begin(), sorted.end());
-	    for(HTSVViterator i = sorted.begin(); i != sorted.end(); ++i) {
-		walk_fn(i->first, *i->second);
-	    }
+	    walkOrdered(walk_fn, boost::mpl::bool_<TupleRadixSortable<Tuple>::value>());
 	}
 
 	/// apply walk_fn(const Tuple &, StatsT &) to each entry,
@@ -220,6 +214,18 @@ namespace lintel {
 	    return getHashEntry(key);
 	}
 
+	typedef HTSconst_iterator const_iterator;
+
+	/// iterate over the (Tuple, StatsT *) entries in a pseudo-random
+	/// order; cheaper than walk() when the per-entry work is small.
+	const_iterator begin() const {
+	    return data.begin();
+	}
+
+	const_iterator end() const {
+	    return data.end();
+	}
+
 	/// how big is the hash tuple stats
 	size_t size() const {
 	    return data.size();
@@ -248,6 +254,47 @@ namespace lintel {
 	    data.clear();
 	}
 
+	/// Append the table to buf as a header, an entry count, and
+	/// then each key followed by its serialized StatsT.  Keys are
+	/// written with binaryWrite(), so the tuple elements must be
+	/// plain-old-data or strings.
+	void serialize(ByteBuffer &buf) const {
+	    Stats::serializeHeader(buf, Stats::SerialHashTupleStats, 1);
+	    binaryWrite(buf, static_cast<uint64_t>(data.size()));
+	    for(HTSconst_iterator i = data.begin(); i != data.end(); ++i) {
+		binaryWrite(buf, i->first);
+		i->second->serialize(buf);
+	    }
+	}
+
+	/// Merge a table consumed from buf into this one.  Entries for
+	/// new keys are deserialized in place; entries for existing
+	/// keys are read into a scratch StatsT and added, so
+	/// deserializing the tables from many sources into one
+	/// aggregates them.  Call clear() first to replace the contents.
+	void deserialize(ByteBuffer &buf) {
+	    Stats::deserializeHeader(buf, Stats::SerialHashTupleStats, 1);
+	    uint64_t nentries;
+	    binaryRead(buf, nentries);
+	    StatsT *scratch = NULL;
+	    Tuple key;
+	    for(uint64_t i = 0; i < nentries; ++i) {
+		binaryRead(buf, key);
+		StatsT * &v = data[key];
+		if (v == NULL) {
+		    v = stats_factory_fn();
+		    v->deserialize(buf);
+		} else {
+		    if (scratch == NULL) {
+			scratch = stats_factory_fn();
+		    }
+		    scratch->deserialize(buf);
+		    v->add(*scratch);
+		}
+	    }
+	    delete scratch;
+	}
+
 	/// how much memory is the hash tuple stats using; accurate
 	/// only if StatsT does not have internal allocated memory.
 	size_t memoryUsage() const {
@@ -255,6 +302,45 @@ namespace lintel {
 	}
 
     private:
+	struct RadixKeyOf {
+	    typedef Tuple TupleType;
+	    static const bool has_any = false;
+	    const Tuple &tuple(const typename HTSMap::value_type *v) const {
+		return v->first;
+	    }
+	    bool any(const typename HTSMap::value_type *, int) const {
+		return false;
+	    }
+	};
+
+	void walkOrdered(const WalkFn &walk_fn, boost::mpl::true_) const {
+	    std::vector<const typename HTSMap::value_type *> sorted;
+
+	    sorted.reserve(data.size());
+	    for(HTSconst_iterator i = data.begin(); i != data.end(); ++i) {
+		sorted.push_back(&*i);
+	    }
+	    radixSortTuples(sorted, RadixKeyOf());
+	    for(size_t i = 0; i < sorted.size(); ++i) {
+		walk_fn(sorted[i]->first, *sorted[i]->second);
+	    }
+	}
+
+	void walkOrdered(const WalkFn &walk_fn, boost::mpl::false_) const {
+	    HTSValueVector sorted;
+
+	    sorted.reserve(data.size());
+	    // TODO: figure out why the below doesn't work.
+	    //	sorted.push_back(base_data.begin(), base_data.end());
+	    for(HTSconst_iterator i = data.begin(); i != data.end(); ++i) {
+		sorted.push_back(*i);
+	    }
+	    sort(sorted.begin(), sorted.end());
+	    for(HTSVViterator i = sorted.begin(); i != sorted.end(); ++i) {
+		walk_fn(i->first, *i->second);
+	    }
+	}
+
 	HTSMap data;
 	StatsFactoryFn stats_factory_fn;
     };
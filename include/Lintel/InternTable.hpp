@@ -0,0 +1,152 @@
+/* -*-C++-*-
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief Lock-free-read hash table shared by ConstantStringPool and ConcurrentStringId
+*/
+
+#ifndef LINTEL_INTERN_TABLE_HPP
+#define LINTEL_INTERN_TABLE_HPP
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/AtomicCounter.hpp>
+
+/// \cond SEMI_INTERNAL_CLASSES
+namespace lintel { namespace detail {
+    /// Open-addressed hash table that readers probe without a lock while writers insert
+    /// under a spin lock.  Slots are never removed, and when the table grows the old one is
+    /// kept until the InternTable is destroyed, so a reader may keep probing whichever table
+    /// it loaded.  Traits supplies the slot type and how to use it:
+    ///
+    ///   typedef ... Slot;                           // POD, all zero bytes is empty
+    ///   static bool empty(const Slot &);            // atomic read of the published part
+    ///   uint32_t hash(const Slot &) const;          // for rehashing when growing
+    ///   static void publish(Slot &to, const Slot &); // fill in, ending with an atomic store
+    template<class Traits> class InternTable : boost::noncopyable {
+    public:
+	typedef typename Traits::Slot Slot;
+
+	explicit InternTable(const Traits &slot_traits = Traits(), uint32_t initial_size = 64)
+	    : lock_word(0), traits(slot_traits), table(Table::make(initial_size)) { }
+
+	~InternTable() {
+	    free(table);
+	    for(size_t i = 0; i < old_tables.size(); ++i) {
+		free(old_tables[i]);
+	    }
+	}
+
+	// Writers are rare once the table has warmed up, so yield rather than spin hard.
+	void lock() {
+	    while (true) {
+		uint32_t expected = 0;
+		if (lock_word.compare_exchange_strong(&expected, 1)) {
+		    return;
+		}
+		sched_yield();
+	    }
+	}
+
+	void unlock() {
+	    lock_word = 0;
+	}
+
+	/// Returns the slot with the given hash for which match(slot) is true, or NULL.  Safe
+	/// without the lock; match is only called on published slots.
+	template<class Match> const Slot *find(uint32_t hash, const Match &match) const {
+	    const Table *t = lintel::unsafe::atomic_load(&table);
+	    for(uint32_t i = hash & t->mask; ; i = (i + 1) & t->mask) {
+		const Slot &slot = t->slots[i];
+		if (Traits::empty(slot)) {
+		    return NULL;
+		}
+		if (match(slot)) {
+		    return &slot;
+		}
+	    }
+	}
+
+	/// Called with the lock held, after find() has failed.
+	void insert(uint32_t hash, const Slot &slot) {
+	    if (2 * (table->used + 1) > table->mask + 1) {
+		grow();
+	    }
+	    uint32_t i = hash & table->mask;
+	    while (!Traits::empty(table->slots[i])) {
+		i = (i + 1) & table->mask;
+	    }
+	    Traits::publish(table->slots[i], slot);
+	    ++table->used;
+	}
+
+	/// The remaining accessors are called with the lock held.
+	uint32_t used() const { return table->used; }
+	uint32_t capacity() const { return table->mask + 1; }
+	/// Bytes in the current and old tables.
+	size_t bytes() const {
+	    size_t ret = table->bytes();
+	    for(size_t i = 0; i < old_tables.size(); ++i) {
+		ret += old_tables[i]->bytes();
+	    }
+	    return ret;
+	}
+
+    private:
+	struct Table {
+	    uint32_t mask;
+	    uint32_t used;
+	    Slot slots[1];
+
+	    static Table *make(uint32_t size) {
+		size_t bytes = sizeof(Table) + (size - 1) * sizeof(Slot);
+		Table *ret = static_cast<Table *>(malloc(bytes));
+		INVARIANT(ret != NULL, "out of memory");
+		memset(ret, 0, bytes);
+		ret->mask = size - 1;
+		return ret;
+	    }
+
+	    size_t bytes() const {
+		return sizeof(Table) + mask * sizeof(Slot);
+	    }
+	};
+
+	// Readers keep using the old table until they see the new one.
+	void grow() {
+	    Table *old = table;
+	    Table *bigger = Table::make(2 * (old->mask + 1));
+	    for(uint32_t i = 0; i <= old->mask; ++i) {
+		if (!Traits::empty(old->slots[i])) {
+		    uint32_t j = traits.hash(old->slots[i]) & bigger->mask;
+		    while (!Traits::empty(bigger->slots[j])) {
+			j = (j + 1) & bigger->mask;
+		    }
+		    bigger->slots[j] = old->slots[i];
+		    ++bigger->used;
+		}
+	    }
+	    lintel::unsafe::atomic_store(&table, bigger);
+	    old_tables.push_back(old);
+	}
+
+	lintel::Atomic<uint32_t> lock_word;
+	Traits traits;
+	Table *table;
+	std::vector<Table *> old_tables;
+    };
+} }
+/// \endcond
+
+#endif
@@ -15,7 +15,9 @@
     \section Data Structures
 
       - Double-ended queue: Deque
-      - Priority queue: PriorityQueue
+      - Priority queue: PriorityQueue, with update/erase by handle: AddressablePriorityQueue, for monotone integer keys: RadixHeap
+      - Timers keyed on Clock::Tfrac: TimingWheel, CalendarQueue
+      - Merging sorted runs: MultiwayMerge, parallelMultiwayMerge
       - Constant/interned strings: ConstantString
       - Hashing:
          - map-like interface: HashMap
@@ -49,6 +51,7 @@
     \section Misc
 
       - Notes on using the stl: LintelStlNotes
+      - Scatter-gather and zero-copy I/O on lists of ByteBuffers: ByteBufferChain
 
     \section Obsolete or being removed
     
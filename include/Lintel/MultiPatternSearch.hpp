@@ -0,0 +1,174 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief Search for many patterns at once with an Aho-Corasick automaton
+*/
+
+#ifndef LINTEL_MULTI_PATTERN_SEARCH_HPP
+#define LINTEL_MULTI_PATTERN_SEARCH_HPP
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/ByteBuffer.hpp>
+
+namespace lintel {
+    /** \brief Find all occurrences of a set of patterns in one pass
+
+	Add the patterns with addPattern(), which returns each one's
+	id, then call compile() to build the automaton.  Searching
+	costs one table lookup per haystack byte no matter how many
+	patterns there are, plus the work of reporting matches, so it
+	replaces scanning the same buffer with one BoyerMooreHorspool
+	per pattern.
+
+	The automaton is a deterministic Aho-Corasick automaton stored
+	as one flat transition table.  Bytes that do not occur in any
+	pattern share a single column, so the table has a row of
+	(number of distinct pattern bytes + 1) entries per trie node,
+	which keeps it small enough to stay in cache for typical
+	pattern sets.  Matches are reported as (pattern id, offset of
+	the first byte of the match), including overlapping matches
+	and matches of patterns that are suffixes of other patterns.
+    */
+    class MultiPatternSearch : boost::noncopyable {
+    public:
+	struct Match {
+	    Match() : pattern(0), offset(0) { }
+	    Match(uint32_t pattern, uint64_t offset) : pattern(pattern), offset(offset) { }
+	    bool operator==(const Match &rhs) const {
+		return pattern == rhs.pattern && offset == rhs.offset;
+	    }
+	    bool operator<(const Match &rhs) const {
+		return offset < rhs.offset || (offset == rhs.offset && pattern < rhs.pattern);
+	    }
+	    uint32_t pattern;
+	    uint64_t offset;
+	};
+
+	MultiPatternSearch();
+
+	/// Add a pattern, returning its id; ids count up from 0.
+	/// Patterns must be non-empty and must be added before compile().
+	uint32_t addPattern(const void *pattern, size_t length);
+
+	uint32_t addPattern(const std::string &pattern) {
+	    return addPattern(pattern.data(), pattern.size());
+	}
+
+	/// Build the automaton; call once after adding all the patterns.
+	void compile();
+
+	size_t nPatterns() const { return lengths.size(); }
+	size_t patternLength(uint32_t pattern) const { return lengths[pattern]; }
+	/// Number of automaton states.
+	size_t nStates() const { return nclasses == 0 ? 0 : delta.size() / nclasses; }
+	/// Bytes used by the automaton tables.
+	size_t memoryUsage() const;
+
+	/// Call fn(uint32_t pattern, uint64_t offset) for each match in
+	/// haystack, in order of the end of the match.
+	template<class Function> void scan(const void *haystack, size_t hay_len,
+					   Function &fn) const {
+	    run(start_row, static_cast<const uint8_t *>(haystack), hay_len, 0, fn);
+	}
+
+	/// Append all the matches in haystack to matches.
+	void findAll(const void *haystack, size_t hay_len, std::vector<Match> &matches) const;
+
+	/// Does any pattern occur in haystack?
+	bool matchesAny(const void *haystack, size_t hay_len) const;
+
+	/** \brief Search a stream of data arriving in chunks
+
+	    The automaton state is carried between calls, so matches
+	    that span chunk boundaries are found, and offsets are
+	    relative to the start of the stream.
+	*/
+	class Stream {
+	public:
+	    explicit Stream(const MultiPatternSearch &search)
+		: search(search), row(search.start_row), position(0) {
+		INVARIANT(search.compiled, "MultiPatternSearch: compile() before searching");
+	    }
+
+	    /// Call fn(uint32_t pattern, uint64_t offset) for each match
+	    /// ending in this chunk.
+	    template<class Function> void scan(const void *chunk, size_t len, Function &fn) {
+		row = search.run(row, static_cast<const uint8_t *>(chunk), len, position, fn);
+		position += len;
+	    }
+
+	    /// Append the matches ending in this chunk to matches.
+	    void scan(const void *chunk, size_t len, std::vector<Match> &matches);
+
+	    /// Scan the readable bytes of buf, leaving buf unchanged.
+	    void scan(const ByteBuffer &buf, std::vector<Match> &matches) {
+		if (buf.readAvailable() > 0) {
+		    scan(buf.readStart(), buf.readAvailable(), matches);
+		}
+	    }
+
+	    /// Bytes scanned so far.
+	    uint64_t streamPosition() const { return position; }
+
+	    /// Start a new stream.
+	    void reset() {
+		row = search.start_row;
+		position = 0;
+	    }
+
+	private:
+	    const MultiPatternSearch &search;
+	    uint32_t row;
+	    uint64_t position;
+	};
+
+    private:
+	// Entries in delta are the row offset (state * nclasses) of the
+	// next state, with output_flag set if that state has matches.
+	static const uint32_t output_flag = 0x80000000U;
+
+	template<class Function>
+	uint32_t run(uint32_t row, const uint8_t *p, size_t len, uint64_t base,
+		     Function &fn) const {
+	    INVARIANT(compiled, "MultiPatternSearch: compile() before searching");
+	    const uint32_t *table = &delta[0];
+	    for(size_t i = 0; i < len; ++i) {
+		uint32_t next = table[row + byte_class[p[i]]];
+		row = next & ~output_flag;
+		if (next & output_flag) {
+		    uint32_t state = row / nclasses;
+		    uint64_t end = base + i + 1;
+		    for(uint32_t j = output_start[state]; j < output_start[state + 1]; ++j) {
+			fn(outputs[j], end - lengths[outputs[j]]);
+		    }
+		}
+	    }
+	    return row;
+	}
+
+	std::vector<std::string> patterns; // only kept until compile()
+	std::vector<uint32_t> lengths;
+
+	uint16_t byte_class[256];
+	uint32_t nclasses;
+	uint32_t start_row;
+	std::vector<uint32_t> delta;
+	std::vector<uint32_t> output_start; // outputs for state s are [start[s], start[s+1])
+	std::vector<uint32_t> outputs;
+	bool compiled;
+    };
+}
+
+#endif
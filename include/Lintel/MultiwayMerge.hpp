@@ -0,0 +1,382 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief k-way merge of sorted runs with a loser tree, optionally in parallel
+*/
+
+#ifndef LINTEL_MULTIWAY_MERGE_HPP
+#define LINTEL_MULTIWAY_MERGE_HPP
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <boost/type_traits/is_arithmetic.hpp>
+#include <boost/type_traits/is_scalar.hpp>
+#include <boost/utility.hpp>
+#include <boost/utility/enable_if.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/PThread.hpp>
+#include <Lintel/unstable/InterpolationSearch.hpp>
+
+namespace lintel {
+    /// \cond SEMI_INTERNAL_CLASSES
+    namespace detail {
+	// The key of the current winner while MultiwayMerge replays its
+	// matches.  Scalars are held by value so that the chain from one
+	// match to the next has no loads in it; anything else by
+	// pointer, to avoid copying it.
+	template<class T, bool by_value = boost::is_scalar<T>::value> class CarriedKey {
+	public:
+	    CarriedKey(const T &v) : p(&v) { }
+	    const T &get() const { return *p; }
+	    void select(bool take, const T &v) { p = take ? &v : p; }
+	private:
+	    const T *p;
+	};
+
+	template<class T> class CarriedKey<T, true> {
+	public:
+	    CarriedKey(const T &v) : v(v) { }
+	    const T &get() const { return v; }
+	    void select(bool take, const T &other) { v = take ? other : v; }
+	private:
+	    T v;
+	};
+    }
+    /// \endcond
+
+    /// \brief A run for MultiwayMerge over the sorted range [begin, end)
+    ///
+    /// Other sources, for example a sorted trace file, can be merged
+    /// by providing the same four members.
+    template<class Iter> class IteratorRun {
+    public:
+	typedef typename std::iterator_traits<Iter>::value_type value_type;
+
+	IteratorRun(Iter begin, Iter end) : cur(begin), end(end) { }
+
+	bool atEnd() const { return cur == end; }
+	const value_type &current() const { return *cur; }
+	void advance() { ++cur; }
+
+	Iter position() const { return cur; }
+    private:
+	Iter cur, end;
+    };
+
+    /// \brief Merge of k sorted runs using a tournament (loser) tree
+    ///
+    /// Each internal node of the tree holds the run that lost the
+    /// match played there, and the overall winner is kept at the root,
+    /// so after the winning run advances, only the matches on the path
+    /// from its leaf to the root are replayed: one match per level and
+    /// no early exit, so the loop has no data dependent branches, where
+    /// PriorityQueue::replaceTop() on a heap of cursors compares two
+    /// children per level and branches on both.  Each match copies no
+    /// values, but the head of each run is copied into the tree, so
+    /// value_type must be default constructible and assignable; merge
+    /// pointers or indexes for large records.
+    ///
+    /// The merge is stable: equal values come out in run order, and
+    /// within a run in their original order.  Exhausted runs lose
+    /// every match.  Less is a strict weak ordering, as for std::sort.
+    template<class Run, class Less = std::less<typename Run::value_type> >
+    class MultiwayMerge : boost::noncopyable {
+    public:
+	typedef typename Run::value_type value_type;
+
+	MultiwayMerge(const std::vector<Run> &runs, const Less &less = Less())
+	    : runs(runs), keys(runs.size()), done(runs.size()), losers(runs.size()),
+	      less(less) {
+	    build();
+	}
+
+	bool empty() const {
+	    return runs.empty() || done[losers[0]];
+	}
+
+	/// The smallest remaining value
+	const value_type &top() const {
+	    DEBUG_SINVARIANT(!empty());
+	    return keys[losers[0]];
+	}
+
+	/// The index of the run that top() comes from
+	unsigned topRun() const {
+	    return losers[0];
+	}
+
+	/// Advance past top() and find the next winner
+	void pop() {
+	    DEBUG_SINVARIANT(!empty());
+	    unsigned winner = losers[0];
+	    runs[winner].advance();
+	    setHead(winner);
+	    detail::CarriedKey<value_type> key(keys[winner]);
+	    bool winner_done = done[winner];
+	    for(unsigned i = (winner + runs.size()) / 2; i > 0; i /= 2) {
+		// exchange the two if the loser wins this time
+		unsigned loser = losers[i];
+		const value_type &loser_key = keys[loser];
+		bool swap = beats(loser, winner, key.get(), winner_done);
+		unsigned flip = (winner ^ loser) & -static_cast<unsigned>(swap);
+		losers[i] = loser ^ flip;
+		winner ^= flip;
+		key.select(swap, loser_key);
+		winner_done = winner_done & !swap;
+	    }
+	    losers[0] = winner;
+	}
+
+	/// Stream the rest of the merge to fn(value); returns the count
+	template<class Fn> size_t mergeTo(Fn fn) {
+	    size_t count = 0;
+	    for(; !empty(); pop()) {
+		fn(top());
+		++count;
+	    }
+	    return count;
+	}
+
+	const Run &run(unsigned i) const {
+	    return runs[i];
+	}
+
+	size_t nRuns() const {
+	    return runs.size();
+	}
+
+    private:
+	/// true if run a's head goes before b_key, the head of run b,
+	/// which is exhausted if b_done; ties go to the lower numbered
+	/// run.  Written without branches, as which run wins is
+	/// unpredictable; for a cheap Less the extra comparison for ties
+	/// costs less than a branch on a < b.
+	bool beats(unsigned a, unsigned b, const value_type &b_key, bool b_done) const {
+	    const value_type &a_key = keys[a];
+	    bool before = less(a_key, b_key) | (!less(b_key, a_key) & (a < b));
+	    return (!done[a]) & (b_done | before);
+	}
+
+	void setHead(unsigned i) {
+	    done[i] = runs[i].atEnd();
+	    if (!done[i]) {
+		keys[i] = runs[i].current();
+	    }
+	}
+
+	// Leaf i is node k + i, node n has children 2n and 2n + 1, so
+	// nodes 1 .. k-1 are internal for any k; losers[0] is the winner.
+	void build() {
+	    unsigned k = runs.size();
+	    if (k == 0) {
+		return;
+	    }
+	    std::vector<unsigned> winners(2 * k);
+	    for(unsigned i = 0; i < k; ++i) {
+		setHead(i);
+		winners[k + i] = i;
+	    }
+	    for(unsigned i = k - 1; i > 0; --i) {
+		unsigned left = winners[2 * i], right = winners[2 * i + 1];
+		if (beats(right, left, keys[left], done[left])) {
+		    std::swap(left, right);
+		}
+		winners[i] = left;
+		losers[i] = right;
+	    }
+	    losers[0] = winners[1];
+	}
+
+	std::vector<Run> runs;
+	// head of each run, copied out so a match needs no iterator
+	// chasing, and whether the run is exhausted
+	std::vector<value_type> keys;
+	std::vector<uint8_t> done;
+	std::vector<unsigned> losers; // loser of each match, [0] the winner
+	Less less;
+    };
+
+    /// Merge the sorted ranges runs[i].first .. runs[i].second into out
+    template<class Iter, class Out, class Less>
+    Out multiwayMerge(const std::vector<std::pair<Iter, Iter> > &runs, Out out,
+		      const Less &less) {
+	std::vector<IteratorRun<Iter> > cursors;
+	cursors.reserve(runs.size());
+	for(size_t i = 0; i < runs.size(); ++i) {
+	    cursors.push_back(IteratorRun<Iter>(runs[i].first, runs[i].second));
+	}
+	MultiwayMerge<IteratorRun<Iter>, Less> merge(cursors, less);
+	for(; !merge.empty(); merge.pop()) {
+	    *out = merge.top();
+	    ++out;
+	}
+	return out;
+    }
+
+    template<class Iter, class Out>
+    Out multiwayMerge(const std::vector<std::pair<Iter, Iter> > &runs, Out out) {
+	return multiwayMerge(runs, out, std::less<typename std::iterator_traits<Iter>::value_type>());
+    }
+
+    /// \cond SEMI_INTERNAL_CLASSES
+    namespace detail {
+	// EstimateOffset works in ValueT, which can overflow for signed
+	// values and does not compile for floating point; this works in
+	// double for any arithmetic type.  Called with first < v <= last.
+	template<class T> struct SplitEstimate {
+	    size_t operator()(const T &v, const T &first, const T &last, size_t last_pos) const {
+		double range = static_cast<double>(last) - static_cast<double>(first);
+		if (!(range > 0)) {
+		    return last_pos / 2; // too close together to tell apart
+		}
+		double relative_pos = (static_cast<double>(v) - static_cast<double>(first)) / range;
+		// NaN when an end is infinite; converting that to size_t is undefined
+		if (!(relative_pos >= 0 && relative_pos <= 1)) {
+		    return last_pos / 2;
+		}
+		return static_cast<size_t>(relative_pos * last_pos);
+	    }
+	};
+
+	// Where pivot cuts a run: interpolation search for arithmetic
+	// values in their natural order, a binary search otherwise.
+	template<class Iter, class T, class Less>
+	Iter splitPoint(Iter begin, Iter end, const T &pivot, const Less &less) {
+	    return std::lower_bound(begin, end, pivot, less);
+	}
+
+	template<class Iter, class T>
+	typename boost::enable_if<boost::is_arithmetic<T>, Iter>::type
+	splitPoint(Iter begin, Iter end, const T &pivot, const std::less<T> &) {
+	    return interpolationLowerBound<2, 4, 256>(begin, end, pivot, SplitEstimate<T>(),
+						      Compare<T>());
+	}
+    }
+    /// \endcond
+
+    /// \brief Split sorted ranges into nparts independent merges
+    ///
+    /// Pivots are chosen from a sample taken evenly across all of the
+    /// runs, and each run is cut at each pivot, values less than the
+    /// pivot going to the earlier part.  The cut is found by
+    /// interpolation search (lintel::interpolationLowerBound) when the
+    /// values are arithmetic and Less is std::less, and by binary
+    /// search otherwise.  Merging
+    /// parts[0], parts[1], ... in turn and concatenating the output
+    /// gives the same result as merging the original runs.  Parts are
+    /// close to equal in size unless many values equal a pivot.
+    template<class Iter, class Less>
+    std::vector<std::vector<std::pair<Iter, Iter> > >
+    splitRuns(const std::vector<std::pair<Iter, Iter> > &runs, unsigned nparts,
+	      const Less &less) {
+	typedef typename std::iterator_traits<Iter>::value_type T;
+	INVARIANT(nparts > 0, "splitRuns: need at least one part");
+	static const size_t samples_per_part = 64;
+
+	size_t total = 0;
+	for(size_t i = 0; i < runs.size(); ++i) {
+	    total += runs[i].second - runs[i].first;
+	}
+	size_t stride = std::max(static_cast<size_t>(1), total / (nparts * samples_per_part));
+	std::vector<T> samples;
+	for(size_t i = 0; i < runs.size(); ++i) {
+	    size_t len = runs[i].second - runs[i].first;
+	    for(size_t j = stride / 2; j < len; j += stride) {
+		samples.push_back(runs[i].first[j]);
+	    }
+	}
+	std::sort(samples.begin(), samples.end(), less);
+
+	std::vector<std::vector<std::pair<Iter, Iter> > > parts(nparts);
+	std::vector<Iter> starts;
+	starts.reserve(runs.size());
+	for(size_t i = 0; i < runs.size(); ++i) {
+	    starts.push_back(runs[i].first);
+	}
+	for(unsigned p = 0; p < nparts; ++p) {
+	    parts[p].reserve(runs.size());
+	    for(size_t i = 0; i < runs.size(); ++i) {
+		Iter cut = runs[i].second;
+		if (p + 1 < nparts && !samples.empty()) {
+		    const T &pivot = samples[(p + 1) * samples.size() / nparts];
+		    cut = detail::splitPoint(starts[i], runs[i].second, pivot, less);
+		}
+		parts[p].push_back(std::make_pair(starts[i], cut));
+		starts[i] = cut;
+	    }
+	}
+	return parts;
+    }
+
+    /// \cond SEMI_INTERNAL_CLASSES
+    namespace detail {
+	template<class Iter, class Out, class Less> class MergeWorker : public PThreadNoSignals {
+	public:
+	    MergeWorker(const std::vector<std::pair<Iter, Iter> > &runs, Out out,
+			const Less &less)
+		: runs(runs), out(out), less(less) { }
+
+	    virtual void *run() {
+		multiwayMerge(runs, out, less);
+		return NULL;
+	    }
+
+	private:
+	    std::vector<std::pair<Iter, Iter> > runs;
+	    Out out;
+	    Less less;
+	};
+    }
+    /// \endcond
+
+    /// Merge the sorted ranges into the random access iterator out
+    /// using nthreads threads, each merging one part from splitRuns()
+    /// into its own slice of the output.  Returns the end of the output.
+    template<class Iter, class Out, class Less>
+    Out parallelMultiwayMerge(const std::vector<std::pair<Iter, Iter> > &runs, Out out,
+			      unsigned nthreads, const Less &less) {
+	typedef detail::MergeWorker<Iter, Out, Less> Worker;
+	INVARIANT(nthreads > 0, "parallelMultiwayMerge: need at least one thread");
+	if (nthreads == 1) {
+	    return multiwayMerge(runs, out, less);
+	}
+	std::vector<std::vector<std::pair<Iter, Iter> > > parts
+	    = splitRuns(runs, nthreads, less);
+	std::vector<Worker *> workers;
+	for(unsigned p = 0; p < nthreads; ++p) {
+	    workers.push_back(new Worker(parts[p], out, less));
+	    for(size_t i = 0; i < parts[p].size(); ++i) {
+		out += parts[p][i].second - parts[p][i].first;
+	    }
+	}
+	for(unsigned p = 0; p < nthreads; ++p) {
+	    workers[p]->start();
+	}
+	for(unsigned p = 0; p < nthreads; ++p) {
+	    workers[p]->join();
+	    delete workers[p];
+	}
+	return out;
+    }
+
+    template<class Iter, class Out>
+    Out parallelMultiwayMerge(const std::vector<std::pair<Iter, Iter> > &runs, Out out,
+			      unsigned nthreads) {
+	return parallelMultiwayMerge(runs, out, nthreads,
+				     std::less<typename std::iterator_traits<Iter>::value_type>());
+    }
+}
+
+#endif
@@ -0,0 +1,266 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief Multi-threaded versions of StatsCube::cube() and StatsCube::zeroCube()
+*/
+
+#ifndef LINTEL_PARALLEL_STATS_CUBE_HPP
+#define LINTEL_PARALLEL_STATS_CUBE_HPP
+
+#include <vector>
+
+#include <Lintel/PThread.hpp>
+#include <Lintel/StatsCube.hpp>
+
+// The base rows are split between the threads, and each thread builds
+// a partial cube, itself split into one map per thread by a hash of
+// the partial key.  Each thread then merges its share of the key space
+// from all of the partial cubes using StatsT::add(const Stats &), and
+// finally the merged maps are moved into the cube.  The result is the
+// same as the single threaded version provided that merging two
+// partial StatsT's gives the same answer as adding all of the base
+// rows to one, which is true for the StatsCubeFns add functions.
+
+namespace lintel {
+    /// \cond SEMI_INTERNAL_CLASSES
+    namespace detail {
+	template<class Cube, class OptionalCubeFnT, class CubeStatsAddFnT>
+	class ParallelCubeWorker : public PThread {
+	public:
+	    typedef typename Cube::MyAny MyAny;
+	    typedef typename Cube::PartialTupleCubeMap PartialTupleCubeMap;
+	    typedef typename Cube::PTCMIterator PTCMIterator;
+	    typedef typename Cube::HashUniqueTuple HashUniqueTuple;
+	    typedef typename Cube::BaseData BaseData;
+	    typedef typename BaseData::const_iterator BaseIterator;
+	    typedef typename Cube::StatsFactoryFn StatsFactoryFn;
+
+	    ParallelCubeWorker(const StatsFactoryFn &factory, unsigned nparts,
+			       const OptionalCubeFnT &optional_fn, const CubeStatsAddFnT &add_fn)
+		: factory(factory), parts(nparts), optional_fn(optional_fn), add_fn(add_fn),
+		  rows(NULL), rows_begin(0), rows_end(0), zero_data(NULL), count_zeros(false),
+		  merge_from(NULL), merge_part(0), value(NULL) { }
+
+	    virtual ~ParallelCubeWorker() {
+		for(unsigned i = 0; i < parts.size(); ++i) {
+		    for(PTCMIterator j = parts[i].begin(); j != parts[i].end(); ++j) {
+			delete j->second;
+		    }
+		}
+	    }
+
+	    /// Cube rows [begin, end).
+	    void setRows(const std::vector<const typename BaseData::HTSMap::value_type *> &r,
+			 size_t begin, size_t end) {
+		rows = &r;
+		rows_begin = begin;
+		rows_end = end;
+	    }
+
+	    /// Cube the zero walk of data over hut.
+	    void setZeroWalk(const BaseData &data, const HashUniqueTuple &h, bool count) {
+		zero_data = &data;
+		zero_hut = h;
+		count_zeros = count;
+	    }
+
+	    /// Merge part of each of the other workers into our part.
+	    void setMerge(const std::vector<ParallelCubeWorker *> &from, unsigned part) {
+		merge_from = &from;
+		merge_part = part;
+	    }
+
+	    virtual void *run() {
+		if (merge_from != NULL) {
+		    merge();
+		} else if (zero_data != NULL) {
+		    zero_data->walkZeros(boost::bind(&ParallelCubeWorker::zeroRow, this, _1, _2),
+					 zero_hut, count_zeros);
+		} else {
+		    for(size_t i = rows_begin; i < rows_end; ++i) {
+			value = (*rows)[i]->second;
+			Cube::forEachPartial((*rows)[i]->first, *this);
+		    }
+		}
+		return NULL;
+	    }
+
+	    void operator()(const MyAny &partial, bool had_any) {
+		if (optional_fn(had_any, partial)) {
+		    add_fn(entry(parts[partOf(partial, parts.size())], partial), *value);
+		}
+	    }
+
+	    static unsigned partOf(const MyAny &key, size_t nparts) {
+		// use the high bits; the hash table uses the low ones.
+		uint64_t hash = HashMap_hash<const MyAny>()(key);
+		return static_cast<unsigned>((hash * nparts) >> 32);
+	    }
+
+	    PartialTupleCubeMap &part(unsigned i) {
+		return parts[i];
+	    }
+
+	private:
+	    typename Cube::StatsType &entry(PartialTupleCubeMap &map, const MyAny &key) {
+		typename Cube::StatsType * &v = map[key];
+		if (v == NULL) {
+		    v = factory();
+		}
+		return *v;
+	    }
+
+	    void zeroRow(const typename Cube::TupleType &key, typename Cube::BaseStatsType &row) {
+		value = &row;
+		Cube::forEachPartial(key, *this);
+	    }
+
+	    void merge() {
+		PartialTupleCubeMap &into = parts[merge_part];
+		for(unsigned i = 0; i < merge_from->size(); ++i) {
+		    if ((*merge_from)[i] == this) {
+			continue;
+		    }
+		    PartialTupleCubeMap &from = (*merge_from)[i]->part(merge_part);
+		    for(PTCMIterator j = from.begin(); j != from.end(); ++j) {
+			typename Cube::StatsType * &v = into[j->first];
+			if (v == NULL) {
+			    v = j->second;
+			} else {
+			    v->add(*j->second);
+			    delete j->second;
+			}
+		    }
+		    from.clear();
+		}
+	    }
+
+	    StatsFactoryFn factory;
+	    std::vector<PartialTupleCubeMap> parts;
+	    OptionalCubeFnT optional_fn;
+	    CubeStatsAddFnT add_fn;
+
+	    const std::vector<const typename BaseData::HTSMap::value_type *> *rows;
+	    size_t rows_begin, rows_end;
+
+	    const BaseData *zero_data;
+	    HashUniqueTuple zero_hut;
+	    bool count_zeros;
+
+	    const std::vector<ParallelCubeWorker *> *merge_from;
+	    unsigned merge_part;
+
+	    const typename Cube::BaseStatsType *value; // base row being cubed
+	};
+
+	template<class Worker> void runWorkers(const std::vector<Worker *> &workers) {
+	    for(unsigned i = 0; i < workers.size(); ++i) {
+		workers[i]->start();
+	    }
+	    for(unsigned i = 0; i < workers.size(); ++i) {
+		workers[i]->join();
+	    }
+	}
+
+	template<class Cube, class Worker>
+	void mergeWorkers(Cube &cube, const std::vector<Worker *> &workers) {
+	    for(unsigned i = 0; i < workers.size(); ++i) {
+		workers[i]->setMerge(workers, i);
+	    }
+	    runWorkers(workers);
+	    for(unsigned i = 0; i < workers.size(); ++i) {
+		cube.mergeCube(workers[i]->part(i));
+		delete workers[i];
+	    }
+	}
+    }
+    /// \endcond
+
+    /// Cube the rows of hts into cube using nthreads threads, calling
+    /// optional_fn and add_fn as in StatsCube::cube(hts, optional_fn,
+    /// add_fn).  Each thread gets its own copy of the functions.
+    template<class Tuple, class StatsT, class BaseStatsT,
+	     class OptionalCubeFnT, class CubeStatsAddFnT>
+    void parallelCube(StatsCube<Tuple, StatsT, BaseStatsT> &cube,
+		      const HashTupleStats<Tuple, BaseStatsT> &hts, unsigned nthreads,
+		      const OptionalCubeFnT &optional_fn, const CubeStatsAddFnT &add_fn) {
+	typedef StatsCube<Tuple, StatsT, BaseStatsT> Cube;
+	typedef detail::ParallelCubeWorker<Cube, OptionalCubeFnT, CubeStatsAddFnT> Worker;
+	INVARIANT(nthreads > 0, "parallelCube: need at least one thread");
+
+	std::vector<const typename HashTupleStats<Tuple, BaseStatsT>::HTSMap::value_type *> rows;
+	rows.reserve(hts.size());
+	for(typename HashTupleStats<Tuple, BaseStatsT>::const_iterator i = hts.begin();
+	    i != hts.end(); ++i) {
+	    rows.push_back(&*i);
+	}
+
+	std::vector<Worker *> workers;
+	for(unsigned i = 0; i < nthreads; ++i) {
+	    workers.push_back(new Worker(cube.getStatsFactoryFn(), nthreads, optional_fn, add_fn));
+	    workers.back()->setRows(rows, rows.size() * i / nthreads,
+				    rows.size() * (i + 1) / nthreads);
+	}
+	detail::runWorkers(workers);
+	detail::mergeWorkers(cube, workers);
+    }
+
+    /// Cube the internal base data of cube using nthreads threads
+    /// and the functions set in the cube's constructor.
+    template<class Tuple, class StatsT, class BaseStatsT>
+    void parallelCube(StatsCube<Tuple, StatsT, BaseStatsT> &cube, unsigned nthreads) {
+	parallelCube(cube, cube.base_data, nthreads,
+		     cube.getOptionalCubeFn(), cube.getCubeStatsAddFn());
+    }
+
+    /// As StatsCube::zeroCube(hts, hut, count_zeros) using nthreads
+    /// threads; the values of the first tuple position in hut are
+    /// split between the threads.
+    template<class Tuple, class StatsT, class BaseStatsT,
+	     class OptionalCubeFnT, class CubeStatsAddFnT>
+    void parallelZeroCube(StatsCube<Tuple, StatsT, BaseStatsT> &cube,
+			  const HashTupleStats<Tuple, BaseStatsT> &hts,
+			  const typename StatsCube<Tuple, StatsT, BaseStatsT>::HashUniqueTuple &hut,
+			  bool count_zeros, unsigned nthreads,
+			  const OptionalCubeFnT &optional_fn, const CubeStatsAddFnT &add_fn) {
+	typedef StatsCube<Tuple, StatsT, BaseStatsT> Cube;
+	typedef detail::ParallelCubeWorker<Cube, OptionalCubeFnT, CubeStatsAddFnT> Worker;
+	typedef typename Cube::HashUniqueTuple::head_type FirstUnique;
+	INVARIANT(nthreads > 0, "parallelZeroCube: need at least one thread");
+
+	std::vector<Worker *> workers;
+	typename Cube::HashUniqueTuple share(hut);
+	for(unsigned i = 0; i < nthreads; ++i) {
+	    share.get_head().clear();
+	    unsigned n = 0;
+	    for(typename FirstUnique::const_iterator j = hut.get_head().begin();
+		j != hut.get_head().end(); ++j, ++n) {
+		if (n % nthreads == i) {
+		    share.get_head().add(*j);
+		}
+	    }
+	    workers.push_back(new Worker(cube.getStatsFactoryFn(), nthreads, optional_fn, add_fn));
+	    workers.back()->setZeroWalk(hts, share, count_zeros);
+	}
+	detail::runWorkers(workers);
+	detail::mergeWorkers(cube, workers);
+    }
+
+    /// Zero cube the internal base data of cube using nthreads threads
+    /// and the functions set in the cube's constructor.
+    template<class Tuple, class StatsT, class BaseStatsT>
+    void parallelZeroCube(StatsCube<Tuple, StatsT, BaseStatsT> &cube, unsigned nthreads,
+			  bool count_zeros = false) {
+	typename StatsCube<Tuple, StatsT, BaseStatsT>::HashUniqueTuple hut;
+	cube.base_data.fillHashUniqueTuple(hut);
+	parallelZeroCube(cube, cube.base_data, hut, count_zeros, nthreads,
+			 cube.getOptionalCubeFn(), cube.getCubeStatsAddFn());
+    }
+}
+
+#endif
@@ -13,7 +13,12 @@
 #define LINTEL_PRIORITY_QUEUE_HPP
 
 #include <stdint.h>
+#include <stdlib.h>
 
+#include <functional>
+#include <new>
+
+#include <boost/static_assert.hpp>
 #include <boost/utility.hpp>
 
 #include <Lintel/AssertBoost.hpp>
@@ -48,24 +53,38 @@
 /// 
 /// The net effect of the above will be to return the data from smallest
 /// key value to largest key value from the priority queue.
-template<class T, class LessImportant = std::less_equal<T> > 
+
+/// Arity is the number of children of each node.  Wider heaps are
+/// shallower, so pop() and replaceTop() touch fewer levels, at the
+/// cost of more comparisons per level.  The array is cache line
+/// aligned with the root placed so that the children of every node
+/// start on a multiple of Arity entries; when Arity * sizeof(T) is
+/// the cache line size (e.g. Arity 8 of 8 byte entries) all the
+/// children of a node are in one line, so each level of a large
+/// queue costs at most one miss.  In the hold model timing in
+/// src/tests/priority_queue.cpp, 4-ary was ~1.5x faster than binary
+/// up to 100k entries, and all three were close at 1M; with a large
+/// L3 cache binary was still best at 4M, so measure before picking
+/// a wider heap for a big queue.
+template<class T, class LessImportant = std::less_equal<T>, unsigned Arity = 2> 
 class PriorityQueue : boost::noncopyable {
 public:
     PriorityQueue(int initial_size = 1024/sizeof(T)) 
-	: size_available(initial_size), pq_size(0) {
-	pq = new T[initial_size];
+	: size_available(0), pq_size(0), storage(NULL), pq(NULL) {
+	allocate(initial_size);
     }
 
     PriorityQueue(const LessImportant &li, int initial_size = 1024/sizeof(T)) 
-	: lessimportant(li), size_available(initial_size), pq_size(0) {
-	pq = new T[initial_size];
+	: lessimportant(li), size_available(0), pq_size(0), storage(NULL), pq(NULL) {
+	allocate(initial_size);
     }
 
     ~PriorityQueue() {
-	delete [] pq;
-	pq = NULL;
+	release();
     }
-    typedef PriorityQueue<T, LessImportant> mytype;
+    typedef PriorityQueue<T, LessImportant, Arity> mytype;
+
+    static const size_t cache_line_size = 64;
 
     T &top() { DEBUG_SINVARIANT(!empty()); return pq[0]; }
     const T &top() const { DEBUG_SINVARIANT(!empty()); return pq[0]; }
@@ -74,25 +93,8 @@ public:
 	DEBUG_SINVARIANT(pq_size > 0);
 	--pq_size;
 	if (pq_size > 0) {
-	    uint32_t cur_pos = 0;
-	    while(1) {
-		uint32_t down_left = 2*cur_pos + 1;
-		if (down_left >= pq_size)
-		    break;
-		uint32_t down_right = down_left + 1;
-		
-		uint32_t smaller_down = down_left;
-		if (down_right < pq_size &&
-		    !lessimportant(pq[down_right],pq[down_left])) {
-		    smaller_down = down_right;
-		}
-		if (!lessimportant(pq[pq_size],pq[smaller_down])) {
-		    break; // done, down moving value less than both children
-		}
-		pq[cur_pos] = pq[smaller_down];
-		cur_pos = smaller_down;
-	    }
-	    pq[cur_pos] = pq[pq_size];
+	    // pq[pq_size] is past the end, so siftDown won't overwrite it
+	    siftDown(pq[pq_size]);
 	}
     }
 
@@ -110,25 +112,21 @@ public:
 	uint32_t down = 1;
 
 	while(down < pq_size) {
-	    if (down + 1 == pq_size || lessimportant(pq[down+1], pq[down])) { 
-		// one child, or rhs < lhs, so pick lhs
-	    } else { // rhs bubbles up
-		++down;
-	    } 
+	    down = mostImportantChild(down, pq_size);
 	    pq[hole] = pq[down];
 	    hole = down; 
-	    down = 2*down + 1;
+	    down = Arity*down + 1;
 	}
 
 	T &back(pq[pq_size - 1]);
 	if (hole > 0) {
 	    SINVARIANT(lessimportant(back, back)); // make sure loop below will terminate
 
-	    uint32_t up = (hole - 1) / 2;
+	    uint32_t up = (hole - 1) / Arity;
 	    while (!lessimportant(back, pq[up])) { // back more important, move hole up
 		pq[hole] = pq[up];
 		hole = up;
-		up = (hole - 1) / 2;
+		up = (hole - 1) / Arity;
 	    }
 	}
 
@@ -142,7 +140,7 @@ public:
 	}
 	int end_pos = pq_size;
 	while(end_pos > 0) {
-	    int up_pos = (end_pos - 1)/2;
+	    int up_pos = (end_pos - 1)/Arity;
 	    if (!lessimportant(val,pq[up_pos])) {
 		pq[end_pos] = pq[up_pos];
 		end_pos = up_pos;
@@ -157,27 +155,8 @@ public:
     /// equivalent to this->pop(), this->push(val), but roughly 2x as
     /// efficient
     void replaceTop(const T &val) {
-	uint32_t cur_pos = 0;
-	while(1) {
-	    uint32_t down_left = 2*cur_pos + 1;
-	    if (down_left >= pq_size)
-		break;
-	    uint32_t down_right = down_left + 1;
-
-	    // First decide which side we would swap with
-	    uint32_t more_important_down = down_left;
-	    if (down_right < pq_size && lessimportant(pq[down_left], pq[down_right])) {
-		more_important_down = down_right;
-	    }
-	    if (lessimportant(val, pq[more_important_down])) {
-		pq[cur_pos] = pq[more_important_down];
-		cur_pos = more_important_down;
-	    } else {
-		break; // at final position
-	    }
-	}
-	DEBUG_SINVARIANT(cur_pos < pq_size);
-	pq[cur_pos] = val;
+	DEBUG_SINVARIANT(pq_size > 0);
+	siftDown(val);
     }
 	
     uint32_t size() const {
@@ -195,21 +174,15 @@ public:
     void reserve(uint32_t amt) {
 	INVARIANT(empty(), "Lame implementation only able to reserve empty priority queue");
 		  
-	if (amt > pq_size) {
-	    delete [] pq;
-	    pq = new T[amt];
-	    size_available = amt;
+	if (amt > size_available) {
+	    release();
+	    allocate(amt);
 	}
     }
 	
     void selfVerify() {
-	for(uint32_t i = 0; i < pq_size; ++i) {
-	    uint32_t down_left = 2 * i + 1;
-	    if (down_left >= pq_size) break;
-	    SINVARIANT(!lessimportant(pq[i], pq[down_left]));
-	    uint32_t down_right = down_left + 1;
-	    if (down_right >= pq_size) break;
-	    SINVARIANT(!lessimportant(pq[i], pq[down_right]));
+	for(uint32_t i = 1; i < pq_size; ++i) {
+	    SINVARIANT(!lessimportant(pq[(i - 1) / Arity], pq[i]));
 	}
     }
 
@@ -217,19 +190,101 @@ public:
     T *PQ_Begin() { return pq; };
     T *PQ_End() { return pq + pq_size; }
 private:
+    // Arity 1 would be a sorted list with O(n) operations
+    BOOST_STATIC_ASSERT(Arity >= 2);
+
     LessImportant lessimportant;
+
+    /// the most important of the children in [first, min(first + Arity, end))
+    uint32_t mostImportantChild(uint32_t first, uint32_t end) {
+	uint32_t ret = first;
+	if (Arity == 2) {
+	    // branches measured faster than selects for binary heaps larger than cache
+	    if (first + 1 < end && lessimportant(pq[first], pq[first + 1])) {
+		ret = first + 1;
+	    }
+	} else if (first + Arity <= end) { // all children present; fixed trip count
+	    // written as selects so they compile to conditional moves;
+	    // the branches are unpredictable and there are Arity - 1 of them
+	    const T *best = pq + first;
+	    for(uint32_t i = 1; i < Arity; ++i) {
+		const T *next = pq + first + i;
+		best = lessimportant(*best, *next) ? next : best;
+	    }
+	    ret = best - pq;
+	} else {
+	    for(uint32_t i = first + 1; i < end; ++i) {
+		if (lessimportant(pq[ret], pq[i])) {
+		    ret = i;
+		}
+	    }
+	}
+	return ret;
+    }
+
+    /// Move val into the hole at the top, moving more important
+    /// children up as needed.
+    void siftDown(const T &val) {
+	uint32_t cur_pos = 0;
+	while(1) {
+	    uint32_t first_down = Arity*cur_pos + 1;
+	    if (first_down >= pq_size)
+		break;
+	    uint32_t more_important_down = mostImportantChild(first_down, pq_size);
+	    if (lessimportant(val, pq[more_important_down])) {
+		pq[cur_pos] = pq[more_important_down];
+		cur_pos = more_important_down;
+	    } else {
+		break; // at final position
+	    }
+	}
+	DEBUG_SINVARIANT(cur_pos < pq_size);
+	pq[cur_pos] = val;
+    }
+
+    /// Allocate space for amt entries; the children of i, at Arity*i
+    /// + 1 .. Arity*i + Arity, are at Arity*(i+1) .. in storage.
+    void allocate(uint32_t amt) {
+	amt = amt < 1 ? 1 : amt;
+	size_t entries = amt + Arity - 1;
+	void *mem;
+	INVARIANT(posix_memalign(&mem, cache_line_size, entries * sizeof(T)) == 0,
+		  "posix_memalign failed");
+	storage = static_cast<T *>(mem);
+	for(size_t i = 0; i < entries; ++i) {
+	    new (storage + i) T();
+	}
+	pq = storage + Arity - 1;
+	size_available = amt;
+    }
+
+    void release() {
+	if (storage != NULL) {
+	    for(size_t i = 0; i < size_available + Arity - 1; ++i) {
+		storage[i].~T();
+	    }
+	    free(storage);
+	}
+	storage = pq = NULL;
+    }
+
     void double_size() {
-	T *pq_new = new T[size_available * 2];
-	for(unsigned i=0;i<size_available;i++) {
-	    pq_new[i] = pq[i];
+	T *old_storage = storage, *old_pq = pq;
+	uint32_t old_size = size_available;
+	allocate(size_available * 2);
+	for(unsigned i=0;i<old_size;i++) {
+	    pq[i] = old_pq[i];
+	}
+	for(size_t i = 0; i < old_size + Arity - 1; ++i) {
+	    old_storage[i].~T();
 	}
-	delete [] pq;
-	pq = pq_new;
-	size_available = size_available * 2;
+	free(old_storage);
     }
     uint32_t size_available;
     uint32_t pq_size;
-    T *pq;
+    T *storage;
+    T *pq; // storage + Arity - 1
+    // For Arity 2:
     // 0 -> 1,2
     // 1 -> 3,4
     // 2 -> 5,6
@@ -238,6 +293,7 @@ private:
     // j -> (j-1) / 2
     // -- could leave position 0 empty to make the rules 2*i, 2*i + 1
     // -- and j -> j / 2
+    // In general i -> Arity*i + 1 .. Arity*i + Arity, j -> (j-1) / Arity
 };
 
 void PriorityQueueTest();
@@ -16,6 +16,7 @@
 #include <boost/program_options.hpp>
 
 #include <Lintel/AssertBoost.hpp>
+#include <Lintel/StringUtil.hpp>
 
 /** @file
  
@@ -88,6 +89,11 @@ namespace lintel {
         template<> inline std::string defaultValueString<char>(const char &def_val) {
             return str(boost::format("[\'\\%03d\']") % static_cast<int>(def_val));
         }
+        // boost::format prints doubles with 6 significant digits, which
+        // can show a default different from the actual value.
+        template<> inline std::string defaultValueString<double>(const double &def_val) {
+            return "[" + formatDouble(def_val) + "]";
+        }
         // Helper to pretty print default values of vector program options
         template<typename T> std::string defaultValueString(const std::vector<T> &def_vector) {
             std::string vdesc = "[";
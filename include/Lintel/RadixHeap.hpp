@@ -0,0 +1,147 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief Monotone priority queue for unsigned integer keys
+*/
+
+#ifndef LINTEL_RADIX_HEAP_HPP
+#define LINTEL_RADIX_HEAP_HPP
+
+#include <stdint.h>
+
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <boost/static_assert.hpp>
+#include <boost/utility.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+
+namespace lintel {
+    /** \brief Radix heap: a min priority queue for monotone unsigned keys
+
+	Keys pushed must be no smaller than the last key popped (or
+	looked at with top()), as with the Clock::Tfrac times of an
+	event simulator, where each new event is scheduled at or after
+	the current one.  Under that restriction push() is O(1) and
+	pop() amortized O(log C) for keys spanning a range of C, with
+	no comparisons between entries and sequential memory access,
+	which beats a comparison heap by a large factor.
+
+	Bucket 0 holds the entries whose key equals last, the most
+	recent minimum; bucket i > 0 those whose highest bit that
+	differs from last is bit i-1.  When bucket 0 runs out, the
+	first non-empty bucket is scanned for its minimum, which
+	becomes last, and its entries are spread into lower buckets.
+	Since keys only move to lower buckets, each entry moves at
+	most once per bit.
+
+	The surface is that of PriorityQueue, with top() the entry
+	with the smallest key.  Entries with equal keys come out in
+	no particular order.
+    */
+    template<class Key, class Value> class RadixHeap : boost::noncopyable {
+    public:
+	BOOST_STATIC_ASSERT(std::numeric_limits<Key>::is_integer
+			    && !std::numeric_limits<Key>::is_signed);
+	// bucketOf() works on the key as a uint64_t
+	BOOST_STATIC_ASSERT(std::numeric_limits<Key>::digits <= 64);
+
+	typedef std::pair<Key, Value> value_type;
+	static const unsigned key_bits = std::numeric_limits<Key>::digits;
+
+	RadixHeap() : last(0), count(0) { }
+
+	/// key must be >= the last key popped or returned by top()
+	void push(Key key, const Value &value) {
+	    INVARIANT(key >= last, "RadixHeap: keys must not decrease");
+	    buckets[bucketOf(key)].push_back(value_type(key, value));
+	    ++count;
+	}
+
+	void push(const value_type &v) {
+	    push(v.first, v.second);
+	}
+
+	/// The entry with the smallest key
+	const value_type &top() {
+	    DEBUG_SINVARIANT(!empty());
+	    refill();
+	    return buckets[0].back();
+	}
+
+	Key topKey() {
+	    return top().first;
+	}
+
+	void pop() {
+	    DEBUG_SINVARIANT(!empty());
+	    refill();
+	    buckets[0].pop_back();
+	    --count;
+	}
+
+	size_t size() const {
+	    return count;
+	}
+
+	bool empty() const {
+	    return count == 0;
+	}
+
+	/// Remove all entries, and allow any keys again
+	void clear() {
+	    for(unsigned i = 0; i <= key_bits; ++i) {
+		buckets[i].clear();
+	    }
+	    last = 0;
+	    count = 0;
+	}
+
+	/// The last minimum; pushed keys must be at least this
+	Key lastKey() const {
+	    return last;
+	}
+
+    private:
+	unsigned bucketOf(Key key) const {
+	    uint64_t diff = static_cast<uint64_t>(key ^ last);
+	    return diff == 0 ? 0 : 64 - __builtin_clzll(diff);
+	}
+
+	void refill() {
+	    if (!buckets[0].empty()) {
+		return;
+	    }
+	    unsigned i = 1;
+	    while (buckets[i].empty()) {
+		++i;
+		DEBUG_SINVARIANT(i <= key_bits);
+	    }
+	    std::vector<value_type> &from = buckets[i];
+	    Key new_last = from[0].first;
+	    for(size_t j = 1; j < from.size(); ++j) {
+		new_last = from[j].first < new_last ? from[j].first : new_last;
+	    }
+	    last = new_last;
+	    for(size_t j = 0; j < from.size(); ++j) {
+		buckets[bucketOf(from[j].first)].push_back(from[j]);
+	    }
+	    from.clear();
+	}
+
+	std::vector<value_type> buckets[key_bits + 1];
+	Key last;
+	size_t count;
+    };
+
+    template<class Key, class Value> const unsigned RadixHeap<Key, Value>::key_bits;
+}
+
+#endif
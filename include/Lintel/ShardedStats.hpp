@@ -0,0 +1,173 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief Per-thread sharded statistics with uncontended adds
+*/
+
+#ifndef LINTEL_SHARDEDSTATS_HPP
+#define LINTEL_SHARDEDSTATS_HPP
+
+#include <stdlib.h>
+
+#include <new>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/utility.hpp>
+
+#include <Lintel/CompilerMarkup.hpp>
+#include <Lintel/PThread.hpp>
+#include <Lintel/Stats.hpp>
+
+namespace lintel {
+
+    namespace detail {
+	/// Process-wide unique id for a ShardedStats; ids are never
+	/// reused so a stale per-thread entry can never be found by a
+	/// newer ShardedStats that happens to land at the same address.
+	uint64_t shardedStatsNewId();
+	/// The calling thread's shard for ShardedStats id, or NULL.
+	void *shardedStatsFindLocal(uint64_t id);
+	void shardedStatsSetLocal(uint64_t id, void *shard);
+    }
+
+    /// \brief Stats collector where each thread adds to its own private copy
+    ///
+    /// Each thread that calls add() gets its own StatsT, created on
+    /// first use by that thread through the factory, and registered
+    /// so that snapshot() can merge all of the copies using
+    /// add(const Stats &).  After the first add from a thread, add()
+    /// touches only that thread's shard: the StatsT and a mutex that
+    /// no other thread takes except snapshot(), so the lock is almost
+    /// never contended.  Each shard is allocated aligned and padded to
+    /// whole cache lines, so the StatsT objects of different threads
+    /// never share a line; storage a StatsT allocates for itself, e.g.
+    /// StatsQuantile's buffers, is allocated by the adding thread but
+    /// is not padded.  Shards outlive their threads, so values added
+    /// by threads that have exited are still included in snapshots.
+    ///
+    /// snapshot() may run concurrently with add(); it holds each
+    /// shard's lock while merging it, so this works for any StatsT
+    /// whose add(const Stats &) accepts another StatsT, e.g. Stats,
+    /// StatsHistogramUniform, StatsHistogramLog, StatsHistogramHdr and
+    /// StatsQuantile, including those that allocate or grow as values
+    /// are added.
+    template<class StatsT> class ShardedStats : boost::noncopyable {
+    public:
+	/// Constructs a StatsT in mem, which is sizeof(StatsT) bytes
+	/// aligned for any type, and returns it; usually
+	/// return new (mem) StatsT(...).
+	typedef boost::function<StatsT *(void *mem)> Factory;
+
+	explicit ShardedStats(const Factory &factory = &defaultNew)
+	    : factory(factory), id(detail::shardedStatsNewId()) { }
+
+	~ShardedStats() {
+	    PThreadScopedLock lock(mutex);
+	    for (typename std::vector<Shard *>::iterator i = shards.begin();
+		 i != shards.end(); ++i) {
+		(*i)->stats->~StatsT();
+		(*i)->~Shard();
+		free(*i);
+	    }
+	}
+
+	/// Add a value to the calling thread's shard.
+	void add(const double value) {
+	    Shard &shard = localShard();
+	    PThreadScopedLock lock(shard.mutex);
+	    shard.stats->add(value);
+	}
+
+	/// Merge all of the shards into into; into is not reset first.
+	void snapshot(Stats &into) const {
+	    PThreadScopedLock lock(mutex);
+	    for (typename std::vector<Shard *>::const_iterator i = shards.begin();
+		 i != shards.end(); ++i) {
+		PThreadScopedLock shard_lock((*i)->mutex);
+		into.add(*(*i)->stats);
+	    }
+	}
+
+	/// Returns a new StatsT with all of the shards merged; caller
+	/// owns the result, and frees it with delete.
+	StatsT *snapshot() const {
+	    StatsT *ret = factory(::operator new(sizeof(StatsT)));
+	    snapshot(*ret);
+	    return ret;
+	}
+
+	/// Reset all of the shards.
+	void reset() {
+	    PThreadScopedLock lock(mutex);
+	    for (typename std::vector<Shard *>::iterator i = shards.begin();
+		 i != shards.end(); ++i) {
+		PThreadScopedLock shard_lock((*i)->mutex);
+		(*i)->stats->reset();
+	    }
+	}
+
+	/// Number of threads that have added values.
+	size_t nShards() const {
+	    PThreadScopedLock lock(mutex);
+	    return shards.size();
+	}
+
+    private:
+	static StatsT *defaultNew(void *mem) {
+	    return new (mem) StatsT();
+	}
+
+	static const size_t cache_line_size = 64;
+
+	static size_t roundUp(size_t size) {
+	    return (size + cache_line_size - 1) & ~(cache_line_size - 1);
+	}
+
+	// Allocated as one block of whole cache lines: the Shard, then
+	// the StatsT on the next line boundary.
+	struct Shard {
+	    Shard() : stats(NULL) { }
+	    PThreadMutex mutex;
+	    StatsT *stats;
+	};
+
+	Shard &localShard() {
+	    void *shard = detail::shardedStatsFindLocal(id);
+	    if (UNLIKELY(shard == NULL)) {
+		shard = newShard();
+	    }
+	    return *static_cast<Shard *>(shard);
+	}
+
+	Shard *newShard() {
+	    void *mem;
+	    size_t offset = roundUp(sizeof(Shard));
+	    INVARIANT(posix_memalign(&mem, cache_line_size, offset + roundUp(sizeof(StatsT))) == 0,
+		      "posix_memalign failed");
+	    // Created in the adding thread, so the allocator will usually
+	    // keep anything the StatsT allocates away from the other
+	    // threads' copies.
+	    Shard *shard = new (mem) Shard();
+	    shard->stats = factory(static_cast<char *>(mem) + offset);
+	    {
+		PThreadScopedLock lock(mutex);
+		shards.push_back(shard);
+	    }
+	    detail::shardedStatsSetLocal(id, shard);
+	    return shard;
+	}
+
+	const Factory factory;
+	const uint64_t id;
+	mutable PThreadMutex mutex; // protects shards, not their contents
+	std::vector<Shard *> shards;
+    };
+}
+
+#endif
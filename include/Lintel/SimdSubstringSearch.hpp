@@ -0,0 +1,123 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief Substring search using SIMD first/last byte filtering
+*/
+
+#ifndef LINTEL_SIMD_SUBSTRING_SEARCH_HPP
+#define LINTEL_SIMD_SUBSTRING_SEARCH_HPP
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+namespace lintel {
+    class BoyerMooreHorspool;
+
+    /** \brief Find a fixed needle in haystacks, picking the fastest method available
+
+	The SIMD strategies compare the first and last bytes of the
+	needle against 16 (SSE2) or 32 (AVX2) haystack positions at a
+	time, and only compare the rest of the needle at positions
+	where both match; for most needles and haystacks that is rare,
+	so the search runs at close to memory bandwidth, several times
+	faster than BoyerMooreHorspool even for long needles.  Auto
+	uses memchr for single bytes, otherwise the widest SIMD
+	version the running CPU supports, falling back to
+	BoyerMooreHorspool on machines without SSE2.
+    */
+    class SimdSubstringSearch : boost::noncopyable {
+    public:
+	enum Strategy { Auto, Memchr, Horspool, SSE2, AVX2 };
+
+	/** Constructs a search for the needle, which is copied.
+
+	    @param needle the search data for this class
+	    @param needle_length the length of the search data; must be > 0
+	    @param strategy how to search; anything other than Auto
+	    must be available on this machine.
+	*/
+	SimdSubstringSearch(const void *needle, size_t needle_length, Strategy strategy = Auto);
+
+	/** Constructs a search for the needle, which is copied. */
+	explicit SimdSubstringSearch(const std::string &needle, Strategy strategy = Auto);
+
+	~SimdSubstringSearch();
+
+	/** Returns true if and only if needle is a substring of @param haystack\.
+	    @param hay_len the length of the data to match against
+	*/
+	bool matches(const void *haystack, size_t hay_len) const {
+	    return find(haystack, hay_len) != npos;
+	}
+
+	/** Returns the offset of the first match in haystack, or npos. */
+	size_t find(const void *haystack, size_t hay_len) const {
+	    return find(haystack, hay_len, 0);
+	}
+
+	/** Returns the offset of the first match in haystack at or
+	    after start, or npos. */
+	size_t find(const void *haystack, size_t hay_len, size_t start) const;
+
+	/** Append the offsets of all the matches in haystack to
+	    offsets, including overlapping ones. */
+	void findAll(const void *haystack, size_t hay_len, std::vector<size_t> &offsets) const;
+
+	/// \brief Iterate over the matches in a haystack, including overlapping ones
+	///
+	/// for(MatchIterator i(search, hay, len); i.valid(); ++i) { use(i.offset()); }
+	class MatchIterator {
+	public:
+	    MatchIterator(const SimdSubstringSearch &search, const void *haystack, size_t hay_len)
+		: search(search), haystack(haystack), hay_len(hay_len),
+		  cur(search.find(haystack, hay_len, 0)) { }
+
+	    bool valid() const { return cur != npos; }
+	    size_t offset() const { return cur; }
+	    MatchIterator &operator++() {
+		cur = search.find(haystack, hay_len, cur + 1);
+		return *this;
+	    }
+
+	private:
+	    const SimdSubstringSearch &search;
+	    const void *haystack;
+	    size_t hay_len;
+	    size_t cur;
+	};
+
+	/// The strategy in use; never Auto.
+	Strategy strategy() const { return chosen; }
+
+	size_t needleLength() const { return needle_length; }
+
+	/// Can strategy be used on this machine?
+	static bool strategyAvailable(Strategy strategy);
+
+	/// Printable name for strategy.
+	static const char *strategyName(Strategy strategy);
+
+	/// value returned for no match, same as for string::find
+	static const size_t npos = static_cast<size_t>(-1);
+
+    private:
+	void init(Strategy strategy);
+
+	uint8_t *needle;
+	size_t needle_length;
+	Strategy chosen;
+	BoyerMooreHorspool *horspool;
+    };
+}
+
+#endif
@@ -17,6 +17,8 @@
 #include <iostream>
 #include <fstream>
 
+namespace lintel { class ByteBuffer; }
+
 /// \brief Base statistics class, mostly virtual interface.
 class StatsBase {
 protected:
@@ -74,8 +76,8 @@ public:
     // ----Query functions (not inherited from StatsBase):
     unsigned long count()  const { return (unsigned long)number; };
     unsigned long long countll() const { return number; };
-    double total()  const { return sum; };
-    double total_sq()  const { return sumsq; };
+    virtual double total()  const { return sum; };
+    virtual double total_sq()  const { return sumsq; };
 
     // ----Query functions (inherited from StatsBase):
     virtual double min()	 const { return min_value; };
@@ -100,6 +102,42 @@ public:
     }
 
     virtual Stats *another_new() const;
+
+    //----Binary serialization
+
+    /// Type tags written at the start of a serialized value; only
+    /// ever append to this list so old encodings stay readable.
+    enum SerialType { SerialStats = 1, SerialQuantile, SerialHistogramUniform,
+		      SerialHistogramLog, SerialHistogramUniformAccum,
+		      SerialHistogramLogAccum, SerialHistogramHdr, SerialEMA,
+		      SerialSeries, SerialSequence, SerialHashTupleStats,
+		      SerialStatsCube };
+
+    /// Append a compact, versioned binary encoding of this statistic
+    /// to buf.  The encoding is in host byte order; see
+    /// Lintel/BinarySerialize.hpp.  Subclasses that do not override
+    /// this will fail rather than silently lose their extra state.
+    virtual void serialize(lintel::ByteBuffer &buf) const;
+
+    /// Replace the contents of this statistic with one consumed from
+    /// the front of buf.  This must be the same class, constructed
+    /// with the same parameters, as the one that was serialized, so
+    /// the usual way to merge summaries from many sources is to
+    /// deserialize each into a scratch object from the same factory
+    /// and add() that into the total.
+    virtual void deserialize(lintel::ByteBuffer &buf);
+
+    /// Write the type and version header used by serialize().
+    static void serializeHeader(lintel::ByteBuffer &buf, SerialType type, unsigned version);
+    /// Consume a header, verifying the type and that the version is
+    /// at most max_version; returns the version.
+    static unsigned deserializeHeader(lintel::ByteBuffer &buf, SerialType type,
+				      unsigned max_version);
+
+protected:
+    /// The fields of this class, without a header, for use by subclasses.
+    void serializeStats(lintel::ByteBuffer &buf) const;
+    void deserializeStats(lintel::ByteBuffer &buf);
 };
 
 
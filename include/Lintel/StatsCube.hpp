@@ -7,6 +7,12 @@
 #ifndef LINTEL_STATS_CUBE_HPP
 #define LINTEL_STATS_CUBE_HPP
 
+#include <algorithm>
+
+#include <boost/mpl/bool.hpp>
+#include <boost/mpl/int.hpp>
+
+#include <Lintel/BinarySerialize.hpp>
 #include <Lintel/HashTupleStats.hpp>
 #include <Lintel/Tuples.hpp>
 
@@ -15,6 +21,21 @@
 */
 
 namespace lintel {
+    /// BitsetAnyTuple keys are written as the any bits followed by the tuple.
+    template<class Tuple>
+    inline void binaryWrite(ByteBuffer &buf, const tuples::BitsetAnyTuple<Tuple> &v) {
+	binaryWrite(buf, static_cast<uint64_t>(v.any.to_ulong()));
+	binaryWrite(buf, v.data);
+    }
+
+    template<class Tuple>
+    inline void binaryRead(ByteBuffer &buf, tuples::BitsetAnyTuple<Tuple> &v) {
+	uint64_t any;
+	binaryRead(buf, any);
+	v.any = typename tuples::BitsetAnyTuple<Tuple>::AnyT(static_cast<unsigned long>(any));
+	binaryRead(buf, v.data);
+    }
+
     /// \brief Functions for use in StatsCube
     namespace StatsCubeFns {
 	inline bool cubeAll() {
@@ -32,6 +53,44 @@ namespace lintel {
 	inline void addMean(Stats &into, const Stats &val) {
 	    into.add(val.mean());
 	}
+
+	// Functor versions of the above for the templated cube
+	// functions, which the compiler can inline into the inner loop.
+
+	struct CubeAll {
+	    template<class Any> bool operator()(bool, const Any &) const {
+		return true;
+	    }
+	};
+
+	struct CubeHadAny {
+	    template<class Any> bool operator()(bool had_any, const Any &) const {
+		return had_any;
+	    }
+	};
+
+	struct AddFullStats {
+	    void operator()(Stats &into, const Stats &val) const {
+		into.add(val);
+	    }
+	};
+
+	struct AddMean {
+	    void operator()(Stats &into, const Stats &val) const {
+		into.add(val.mean());
+	    }
+	};
+
+	/// Iceberg condition keeping cells with at least min_count values.
+	struct MinCount {
+	    explicit MinCount(uint64_t min_count) : min_count(min_count) { }
+
+	    template<class Any> bool operator()(const Any &, const Stats &cell) const {
+		return cell.countll() >= min_count;
+	    }
+
+	    uint64_t min_count;
+	};
     }
 
     /** \brief The cube operator
@@ -59,10 +118,16 @@ namespace lintel {
     */
     template<class Tuple, class StatsT = Stats, class BaseStatsT = StatsT> class StatsCube {
     public:
+	typedef Tuple TupleType;
+	typedef StatsT StatsType;
+	typedef BaseStatsT BaseStatsType;
+	typedef HashTupleStats<Tuple, BaseStatsT> BaseData;
+
 	// partial tuple types
 	typedef tuples::BitsetAnyTuple<Tuple> MyAny;
 	typedef HashMap<MyAny, StatsT *> PartialTupleCubeMap;
 	typedef typename PartialTupleCubeMap::iterator PTCMIterator;
+	typedef typename PartialTupleCubeMap::const_iterator PTCMconst_iterator;
 	typedef std::vector<typename PartialTupleCubeMap::value_type> PTCMValueVector;
 	typedef typename PTCMValueVector::iterator PTCMVVIterator;
 
@@ -76,6 +141,8 @@ namespace lintel {
 	typedef boost::function<bool (bool had_any, const MyAny &)> OptionalCubeFn;
 	typedef boost::function<void (StatsT &into, const BaseStatsT &val)> CubeStatsAddFn;
 	typedef boost::function<bool (const MyAny &partial)> PruneFn;
+	/// Return true to keep a cell in an iceberg cube.
+	typedef boost::function<bool (const MyAny &key, const StatsT &cell)> IcebergFn;
 
 	explicit 
 	StatsCube(const OptionalCubeFn &fn1 = boost::bind(&StatsCubeFns::cubeHadAny, _1),
@@ -125,8 +192,24 @@ namespace lintel {
 	/// cube unless a row containing the values was present in the
 	/// base data.  If you want the full cross-product of all the
 	/// values that would be zero, use zeroCube.
-	void cube(const HashTupleStats<Tuple, StatsT> &hts) {
-	    hts.walk(boost::bind(&StatsCube<Tuple, StatsT>::addToCube, this, _1, _2));
+	void cube(const HashTupleStats<Tuple, BaseStatsT> &hts) {
+	    cube(hts, optional_cube_partial_fn, cube_stats_add_fn);
+	}
+
+	/// As cube(hts), but using optional_fn and add_fn in place of the
+	/// functions set in the constructor.  Each base row generates
+	/// 2^k partial keys, so passing functors (e.g. those in
+	/// StatsCubeFns) rather than boost::functions lets the compiler
+	/// inline the per-key work.  See also ParallelStatsCube.hpp.
+	template<class OptionalCubeFnT, class CubeStatsAddFnT>
+	void cube(const HashTupleStats<Tuple, BaseStatsT> &hts,
+		  OptionalCubeFnT optional_fn, CubeStatsAddFnT add_fn) {
+	    typedef typename HashTupleStats<Tuple, BaseStatsT>::const_iterator iterator;
+	    for(iterator i = hts.begin(); i != hts.end(); ++i) {
+		AddPartial<OptionalCubeFnT, CubeStatsAddFnT> 
+		    add_partial(*this, optional_fn, add_fn, *i->second);
+		forEachPartial(i->first, add_partial);
+	    }
 	}
 
 	typedef detail::TupleToHashUniqueTuple<Tuple> HUTConvert;
@@ -142,7 +225,7 @@ namespace lintel {
 	/// generating the set of unique values for each position in
 	/// the tuple.  If the base data is sparse, this will generate
 	/// a very big cube.
-	void zeroCube(const HashTupleStats<Tuple, StatsT> &hts, bool count_zeros = false) {
+	void zeroCube(const HashTupleStats<Tuple, BaseStatsT> &hts, bool count_zeros = false) {
 	    HashUniqueTuple hut;
 	    hts.fillHashUniqueTuple(hut);
 	    zeroCube(hts, hut, count_zeros);
@@ -154,22 +237,72 @@ namespace lintel {
 	/// removing values from hut.  For example, if you clear out
 	/// one of the hut tuple entries, it is the equivalent of
 	/// requiring that value to be any.
-	void zeroCube(const HashTupleStats<Tuple, StatsT> &hts, const HashUniqueTuple &hut,
+	void zeroCube(const HashTupleStats<Tuple, BaseStatsT> &hts, const HashUniqueTuple &hut,
 		      bool count_zeros = false) {
-	    hts.walkZeros(boost::bind(&StatsCube<Tuple, StatsT>::addToCube, this, _1, _2), hut,
+	    hts.walkZeros(boost::bind(&StatsCube::addToCube, this, _1, _2), hut,
 			  count_zeros);
 	}
 
+	/// Cube the internal base data, keeping only the cells that
+	/// have at least min_count values.
+	void icebergCube(uint64_t min_count) {
+	    icebergCube(base_data, min_count);
+	}
+
+	/// Cube hts keeping only the cells with at least min_count values.
+	void icebergCube(const HashTupleStats<Tuple, BaseStatsT> &hts, uint64_t min_count) {
+	    icebergCube(hts, StatsCubeFns::MinCount(min_count), 
+			optional_cube_partial_fn, cube_stats_add_fn);
+	}
+
+	/// Cube hts keeping only the cells for which keep returns true.
+	void icebergCube(const HashTupleStats<Tuple, BaseStatsT> &hts, const IcebergFn &keep) {
+	    icebergCube(hts, keep, optional_cube_partial_fn, cube_stats_add_fn);
+	}
+
+	/// Compute an iceberg cube of hts bottom-up (BUC, from "Bottom-Up
+	/// Computation of Sparse and Iceberg CUBEs," by Kevin Beyer and
+	/// Raghu Ramakrishnan, SIGMOD 1999).  Starting from the all-any
+	/// cell, the rows of each cell are sorted on the next position
+	/// and split into one child cell per value; a cell is built in a
+	/// scratch StatsT and is only stored, and its children only
+	/// visited, if keep(key, cell) is true.  Unlike cube() followed
+	/// by prune(), cells that fail keep are never materialized, so
+	/// with high-cardinality positions the memory use is bounded by
+	/// the cells kept.  keep must be anti-monotone: if it is false for
+	/// a cell, it must be false for any cell with more non-any
+	/// positions, as is true for a minimum count.  optional_fn still
+	/// chooses which kept cells are stored, and cells that are
+	/// already in the cube are combined with StatsT::add(const
+	/// Stats &), but keep only sees the values from hts.
+	template<class IcebergFnT, class OptionalCubeFnT, class CubeStatsAddFnT>
+	void icebergCube(const HashTupleStats<Tuple, BaseStatsT> &hts, IcebergFnT keep,
+			 OptionalCubeFnT optional_fn, CubeStatsAddFnT add_fn) {
+	    Iceberg<IcebergFnT, OptionalCubeFnT, CubeStatsAddFnT> 
+		iceberg(*this, keep, optional_fn, add_fn);
+	    iceberg.run(hts);
+	}
+
 	/// Add a key, value pair into the cube; normally you would
 	/// call add, and separately call cube, but if you have no
 	/// duplicates, calling this may be slightly more efficient.
 	/// You will probably want to set the optional cube function
 	/// to cubeAll so that the base data is not discarded.  Note
 	/// that if you use this, then you can't do a zeroCube.
-	void addToCube(const Tuple &key, StatsT &value) {
+	void addToCube(const Tuple &key, BaseStatsT &value) {
+	    AddPartial<OptionalCubeFn, CubeStatsAddFn>
+		add_partial(*this, optional_cube_partial_fn, cube_stats_add_fn, value);
+	    forEachPartial(key, add_partial);
+	}
+
+	/// Call fn(const MyAny &partial, bool had_any) for each of the
+	/// 2^k partial keys generated from key; had_any is true if any
+	/// position in partial is any.  This is the inner loop of
+	/// cubing, exposed for building cubes in other ways.
+	template<class Function> static void forEachPartial(const Tuple &key, Function &fn) {
 	    MyAny tmp_key(key);
 
-	    cubeAddOne(tmp_key, 0, false, value);
+	    forEachPartial(tmp_key, 0, false, fn);
 	}
 
 	/// Walk over all the entries in the cube in a pseudo-random
@@ -184,24 +317,17 @@ namespace lintel {
 	/// where "any" sorts after an actual value, calling the walk
 	/// function for each one.  This function uses much more
 	/// memory than walk since it has to first sort the list of
-	/// keys.
+	/// keys.  If all of the tuple elements are numbers (see
+	/// TupleRadixSortable), the keys are radix sorted, otherwise
+	/// they are sorted with std::sort.
 	void walkOrdered(const WalkFn fn) {
-	    PTCMValueVector sorted;
-
-	    for(PTCMIterator i = cube_data.begin(); i != cube_data.end(); ++i) {
-		sorted.push_back(*i);
-	    }
-	    sort(sorted.begin(), sorted.end());
-
-	    for(PTCMVVIterator i = sorted.begin(); i != sorted.end(); ++i) {
-		fn(i->first, *i->second);
-	    }
+	    walkOrdered(fn, boost::mpl::bool_<TupleRadixSortable<Tuple>::value>());
 	}
 
 	/// Get a particular cube entry as specifies by key; create it
 	/// if it does not exist.
-	Stats &getCubeEntry(const MyAny &key) {
-	    Stats * &v = cube_data[key];
+	StatsT &getCubeEntry(const MyAny &key) {
+	    StatsT * &v = cube_data[key];
 
 	    if (v == NULL) {
 		v = stats_factory_fn();
@@ -230,6 +356,35 @@ namespace lintel {
 	    }
 	}
 
+	/// Merge the entries in partial into the cube, taking ownership
+	/// of partial's StatsT's; entries already in the cube are
+	/// combined with StatsT::add(const Stats &).  partial is left
+	/// empty.
+	void mergeCube(PartialTupleCubeMap &partial) {
+	    for(PTCMIterator i = partial.begin(); i != partial.end(); ++i) {
+		StatsT * &v = cube_data[i->first];
+		if (v == NULL) {
+		    v = i->second;
+		} else {
+		    v->add(*i->second);
+		    delete i->second;
+		}
+	    }
+	    partial.clear();
+	}
+
+	const OptionalCubeFn &getOptionalCubeFn() const {
+	    return optional_cube_partial_fn;
+	}
+
+	const CubeStatsAddFn &getCubeStatsAddFn() const {
+	    return cube_stats_add_fn;
+	}
+
+	const StatsFactoryFn &getStatsFactoryFn() const {
+	    return stats_factory_fn;
+	}
+
 	/// Clear out the cube, and by default clear out the base data
 	/// as well; optionally skip clearing the base data so that it
 	/// could be cubed in multiple ways, or partially pruned and
@@ -244,6 +399,45 @@ namespace lintel {
 	    cube_data.clear();
 	}
 
+	/// Append the base data and then the cube to buf, in the
+	/// same format as HashTupleStats::serialize().
+	void serialize(ByteBuffer &buf) const {
+	    Stats::serializeHeader(buf, Stats::SerialStatsCube, 1);
+	    base_data.serialize(buf);
+	    binaryWrite(buf, static_cast<uint64_t>(cube_data.size()));
+	    for(PTCMconst_iterator i = cube_data.begin(); i != cube_data.end(); ++i) {
+		binaryWrite(buf, i->first);
+		i->second->serialize(buf);
+	    }
+	}
+
+	/// Merge the base data and cube consumed from buf into this
+	/// one; as with HashTupleStats::deserialize(), cubes from many
+	/// sources can be aggregated by deserializing them all into one.
+	void deserialize(ByteBuffer &buf) {
+	    Stats::deserializeHeader(buf, Stats::SerialStatsCube, 1);
+	    base_data.deserialize(buf);
+	    uint64_t nentries;
+	    binaryRead(buf, nentries);
+	    StatsT *scratch = NULL;
+	    MyAny key;
+	    for(uint64_t i = 0; i < nentries; ++i) {
+		binaryRead(buf, key);
+		StatsT * &v = cube_data[key];
+		if (v == NULL) {
+		    v = stats_factory_fn();
+		    v->deserialize(buf);
+		} else {
+		    if (scratch == NULL) {
+			scratch = stats_factory_fn();
+		    }
+		    scratch->deserialize(buf);
+		    v->add(*scratch);
+		}
+	    }
+	    delete scratch;
+	}
+
 	/// Estimate the memory usage of the cube; likely to be
 	/// somewhat inaccurate.
 	size_t memoryUsage() const {
@@ -256,17 +450,162 @@ namespace lintel {
 	/// returns it.
 	HashTupleStats<Tuple, BaseStatsT> base_data;
     private:
-	void cubeAddOne(MyAny &key, size_t pos, bool had_any, const StatsT &value) {
-	    if (pos == key.length) {
-		if (optional_cube_partial_fn(had_any, key)) {
-		    cube_stats_add_fn(getCubeEntry(key), value);
+	struct RadixKeyOf {
+	    typedef Tuple TupleType;
+	    static const bool has_any = true;
+	    const Tuple &tuple(const typename PartialTupleCubeMap::value_type *v) const {
+		return v->first.data;
+	    }
+	    bool any(const typename PartialTupleCubeMap::value_type *v, int pos) const {
+		return v->first.any[pos];
+	    }
+	};
+
+	void walkOrdered(const WalkFn &fn, boost::mpl::true_) {
+	    std::vector<const typename PartialTupleCubeMap::value_type *> sorted;
+
+	    sorted.reserve(cube_data.size());
+	    for(PTCMIterator i = cube_data.begin(); i != cube_data.end(); ++i) {
+		sorted.push_back(&*i);
+	    }
+	    radixSortTuples(sorted, RadixKeyOf());
+	    for(size_t i = 0; i < sorted.size(); ++i) {
+		fn(sorted[i]->first, *sorted[i]->second);
+	    }
+	}
+
+	void walkOrdered(const WalkFn &fn, boost::mpl::false_) {
+	    PTCMValueVector sorted;
+
+	    for(PTCMIterator i = cube_data.begin(); i != cube_data.end(); ++i) {
+		sorted.push_back(*i);
+	    }
+	    sort(sorted.begin(), sorted.end());
+
+	    for(PTCMVVIterator i = sorted.begin(); i != sorted.end(); ++i) {
+		fn(i->first, *i->second);
+	    }
+	}
+
+	template<class OptionalCubeFnT, class CubeStatsAddFnT> struct AddPartial {
+	    AddPartial(StatsCube &cube, OptionalCubeFnT &optional_fn,
+		       CubeStatsAddFnT &add_fn, const BaseStatsT &value)
+		: cube(cube), optional_fn(optional_fn), add_fn(add_fn), value(value) { }
+
+	    void operator()(const MyAny &partial, bool had_any) {
+		if (optional_fn(had_any, partial)) {
+		    add_fn(cube.getCubeEntry(partial), value);
+		}
+	    }
+
+	    StatsCube &cube;
+	    OptionalCubeFnT &optional_fn;
+	    CubeStatsAddFnT &add_fn;
+	    const BaseStatsT &value;
+	};
+
+	template<class IcebergFnT, class OptionalCubeFnT, class CubeStatsAddFnT> 
+	class Iceberg {
+	public:
+	    typedef const typename BaseData::HTSMap::value_type *Row;
+	    typedef boost::mpl::int_<boost::tuples::length<Tuple>::value> End;
+
+	    Iceberg(StatsCube &cube, IcebergFnT &keep, OptionalCubeFnT &optional_fn,
+		    CubeStatsAddFnT &add_fn)
+		: cube(cube), keep(keep), optional_fn(optional_fn), add_fn(add_fn),
+		  scratch(cube.stats_factory_fn()) { }
+
+	    ~Iceberg() {
+		delete scratch;
+	    }
+
+	    void run(const HashTupleStats<Tuple, BaseStatsT> &hts) {
+		rows.reserve(hts.size());
+		for(typename BaseData::const_iterator i = hts.begin(); i != hts.end(); ++i) {
+		    rows.push_back(&*i);
+		}
+		if (rows.empty()) {
+		    return;
 		}
+		key.data = rows[0]->first;
+		key.any.set();
+		if (cell(0, rows.size())) {
+		    expand(0, rows.size(), boost::mpl::int_<0>());
+		}
+	    }
+
+	private:
+	    template<int Pos> struct LessAt {
+		bool operator()(Row a, Row b) const {
+		    return boost::tuples::get<Pos>(a->first) < boost::tuples::get<Pos>(b->first);
+		}
+	    };
+
+	    /// Build the cell for key from rows [begin, end); returns
+	    /// true if it passed keep.
+	    bool cell(size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i) {
+		    add_fn(*scratch, *rows[i]->second);
+		}
+		if (!keep(static_cast<const MyAny &>(key), static_cast<const StatsT &>(*scratch))) {
+		    scratch->reset();
+		    return false;
+		}
+		if (optional_fn(key.any.any(), static_cast<const MyAny &>(key))) {
+		    StatsT * &v = cube.cube_data[key];
+		    if (v == NULL) {
+			v = scratch;
+			scratch = cube.stats_factory_fn();
+			return true;
+		    }
+		    v->add(*scratch);
+		}
+		scratch->reset();
+		return true;
+	    }
+
+	    /// Visit the children of key that make one of positions
+	    /// Pos.. non-any, with rows [begin, end) being key's rows.
+	    template<int Pos> void expand(size_t begin, size_t end, boost::mpl::int_<Pos>) {
+		LessAt<Pos> less;
+		std::sort(rows.begin() + begin, rows.begin() + end, less);
+		key.any[Pos] = false;
+		for(size_t group = begin; group < end; ) {
+		    size_t group_end = group + 1;
+		    while (group_end < end && !less(rows[group], rows[group_end])) {
+			++group_end;
+		    }
+		    boost::tuples::get<Pos>(key.data) = boost::tuples::get<Pos>(rows[group]->first);
+		    if (cell(group, group_end)) {
+			expand(group, group_end, boost::mpl::int_<Pos + 1>());
+		    }
+		    group = group_end;
+		}
+		key.any[Pos] = true;
+		expand(begin, end, boost::mpl::int_<Pos + 1>());
+	    }
+
+	    void expand(size_t, size_t, End) { }
+
+	    StatsCube &cube;
+	    IcebergFnT &keep;
+	    OptionalCubeFnT &optional_fn;
+	    CubeStatsAddFnT &add_fn;
+	    StatsT *scratch;
+	    std::vector<Row> rows;
+	    MyAny key;
+	};
+
+	template<class Function>
+	static void forEachPartial(MyAny &key, size_t pos, bool had_any, Function &fn) {
+	    if (pos == key.length) {
+		fn(key, had_any);
 	    } else {
 		DEBUG_SINVARIANT(pos < key.length);
 		key.any[pos] = false;
-		cubeAddOne(key, pos + 1, had_any, value);
+		forEachPartial(key, pos + 1, had_any, fn);
 		key.any[pos] = true;
-		cubeAddOne(key, pos + 1, true, value);
+		forEachPartial(key, pos + 1, true, fn);
 	    }
 	}
 
@@ -43,6 +43,10 @@ public:
     double getEMA(unsigned ema_num = 0);
     double minEMA();
     double maxEMA();
+
+    /// deserialize() requires the same decay rates.
+    virtual void serialize(lintel::ByteBuffer &buf) const;
+    virtual void deserialize(lintel::ByteBuffer &buf);
 private:
     void init(const std::vector<double> &decay_rates);
     void updateEMA(unsigned ema_num, const double value) {
@@ -117,6 +117,10 @@ protected:
 
     unsigned sampleBin(const double x) const;
 
+    // The fields of this class, without a header, for use by subclasses.
+    void serializeUniform(lintel::ByteBuffer &buf) const;
+    void deserializeUniform(lintel::ByteBuffer &buf);
+
 public:
     StatsHistogramUniform(const unsigned bins_in,
 		   const double   low_in,
@@ -130,7 +134,8 @@ public:
     //----Record a new value
     virtual void add(const double value);
     virtual void add(const double index_value, const double data_value);
-    using StatsHistogram::add;
+    /// Only merging with a histogram with identical bins is supported.
+    virtual void add(const Stats &stat);
 
     //----Histogram-wide access functions
     double binWidth() const { return bin_width; }
@@ -157,6 +162,11 @@ public:
     virtual const std::string getType() const { return std::string("uniform");}
     virtual void printRome(int depth, std::ostream &out) const;
 
+    /// A growable histogram may be deserialized from one that has
+    /// grown; otherwise the bins must be the same size.
+    virtual void serialize(lintel::ByteBuffer &buf) const;
+    virtual void deserialize(lintel::ByteBuffer &buf);
+
     //----Sometimes we want another one of these, just like this one, but fresh.
     virtual Stats *another_new() const;
 };
@@ -175,6 +185,10 @@ protected:
     unsigned sampleBin(double x) const;
     double binOffset(double index) const;
 
+    // The fields of this class, without a header, for use by subclasses.
+    void serializeLog(lintel::ByteBuffer &buf) const;
+    void deserializeLog(lintel::ByteBuffer &buf);
+
 public:
     StatsHistogramLog(const unsigned bins_in,
 		   const double   low_in,
@@ -187,7 +201,8 @@ public:
     //----Record a new value
     virtual void add(const double value);
     virtual void add(const double index_value, const double data_value);
-    using StatsHistogram::add;
+    /// Only merging with a histogram with identical bins is supported.
+    virtual void add(const Stats &stat);
 
     //----Histogram-wide access functions
     double binWidth() const { return binOffset(1.0); }
@@ -211,6 +226,8 @@ public:
 
     virtual const std::string getType() const { return std::string("log");}
     virtual void printRome(int depth, std::ostream &out) const;
+    virtual void serialize(lintel::ByteBuffer &buf) const;
+    virtual void deserialize(lintel::ByteBuffer &buf);
     //----Sometimes we want another one of these, just like this one, but fresh.
     virtual Stats *another_new() const;
 };
@@ -242,13 +259,15 @@ public:
     //----Record a new value
     virtual void add(const double value);
     virtual void add(const double index_value, const double data_value);
-    using StatsHistogram::add;
+    virtual void add(const Stats &stat);
 
     //----Histogram-wide access functions
     double value(unsigned index) const;	// value in a particular bin
 
     //----Value-access functions
     virtual void printRome(int depth, std::ostream &out) const;
+    virtual void serialize(lintel::ByteBuffer &buf) const;
+    virtual void deserialize(lintel::ByteBuffer &buf);
 
     //----Sometimes we want another one of these, just like this one, but fresh.
     virtual Stats *another_new() const;
@@ -287,13 +306,15 @@ public:
     //----Record a new value
     virtual void add(const double value);
     virtual void add(const double index_value, const double data_value);
-    using StatsHistogramUniform::add;
+    virtual void add(const Stats &stat);
 
     //----Histogram-wide access functions
     double value(unsigned index) const;	// value in a particular bin
 
     //----Value-access functions
     virtual void printRome(int depth, std::ostream &out) const;
+    virtual void serialize(lintel::ByteBuffer &buf) const;
+    virtual void deserialize(lintel::ByteBuffer &buf);
 
     //----Sometimes we want another one of these, just like this one, but fresh.
     virtual Stats *another_new() const;
@@ -0,0 +1,147 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief Log-linear histogram with fixed relative precision and lock-free recording
+*/
+
+#ifndef LINTEL_STATSHISTOGRAMHDR_HPP
+#define LINTEL_STATSHISTOGRAMHDR_HPP
+
+#include <inttypes.h>
+
+#include <Lintel/AtomicCounter.hpp>
+#include <Lintel/StatsHistogram.hpp>
+
+/// \brief Histogram statistics class, log-linear bins with fixed relative precision
+///
+/// Values are first converted to an integer number of units (the
+/// lowest discernible value), then binned in the style of
+/// HdrHistogram: values below 2^(significant_bits+1) units each get
+/// their own bin, and above that every power of two is split into
+/// 2^significant_bits equal bins.  The relative error of any bin is
+/// therefore at most 2^-significant_bits, and the bin for a value is
+/// found with a leading-zero count and a shift rather than a call to
+/// log().  The bins never rescale or grow; values above the highest
+/// trackable value are counted in the top bin.
+///
+/// add(double) is lock-free and may be called concurrently from
+/// multiple threads: the bin counters, count, min and max are updated
+/// with atomic operations.  Queries may run concurrently with adds,
+/// but only see a point-in-time view if the adds have stopped; reset()
+/// and merging should not run concurrently with adds.  Only count(),
+/// min() and max() are exact; mean(), variance() and percentile() are
+/// computed from the bins and so are within the relative precision,
+/// as are total() and total_sq(), which Stats::add(const Stats &) uses
+/// when a StatsHistogramHdr is merged into another Stats.
+class StatsHistogramHdr : public StatsHistogram {
+public:
+    /// Values are tracked as integer multiples of lowest_discernible,
+    /// in the range [0 .. highest_trackable].  significant_bits sets
+    /// the precision; the default of 7 gives a relative error < 0.8%.
+    StatsHistogramHdr(const double   lowest_discernible,
+		      const double   highest_trackable,
+		      const unsigned significant_bits = 7);
+    virtual ~StatsHistogramHdr();
+    virtual void reset();	// Put everything back to initial values
+
+    //----Record a new value
+    virtual void add(const double value);
+    virtual void add(const double index_value, const double data_value);
+    /// Only merging with another StatsHistogramHdr with identical
+    /// parameters is supported.
+    virtual void add(const Stats &stat);
+
+    //----Query functions that are derived from the bins
+    virtual double total() const;
+    virtual double total_sq() const;
+    virtual double min() const;
+    virtual double max() const;
+    virtual double mean() const;
+    virtual double variance() const;
+    virtual double conf95() const;
+
+    //----Histogram-wide access functions
+    double binWidth() const { return unit; }
+    double binWidth(unsigned index) const { return unit * binUnitsWidth(index); }
+    double low() const { return 0; }
+    double binlow(unsigned index) const { return unit * binUnitsLow(index); }
+    double bincenter(unsigned index) const {
+	return unit * (binUnitsLow(index) + 0.5 * binUnitsWidth(index));
+    }
+    double high() const { return binhigh(num_bins - 1); }
+    double binhigh(unsigned index) const {
+	return unit * (binUnitsLow(index) + binUnitsWidth(index));
+    }
+    unsigned numBins() const { return num_bins; }
+    unsigned numRescales() const { return 0; }
+    unsigned numGrows() const { return 0; }
+    bool isScalable() const { return false; }
+    bool isGrowable() const { return false; }
+    double lowestDiscernible() const { return unit; }
+    unsigned significantBits() const { return sub_bucket_bits; }
+    double mode() const;
+    double percentile(double p) const;   // 0.0 <= p <= 1.0
+    unsigned long operator[](unsigned index) const; // Count in a particular bin
+
+    //----Value-access functions
+    virtual std::string debugString() const;
+
+    virtual const std::string getType() const { return std::string("hdr"); }
+    virtual void printRome(int depth, std::ostream &out) const;
+    virtual void printTabular(int depth, std::ostream &out) const;
+
+    /// Only the non-empty bins are written, as (index, count) pairs;
+    /// deserialize() requires identical parameters.  Neither is safe
+    /// to call concurrently with adds.
+    virtual void serialize(lintel::ByteBuffer &buf) const;
+    virtual void deserialize(lintel::ByteBuffer &buf);
+
+    //----Sometimes we want another one of these, just like this one, but fresh.
+    virtual Stats *another_new() const;
+
+    /// Bin index for a value of units, exposed for testing.
+    unsigned unitsBin(uint64_t units) const {
+	// msb of units|1 so that 0 stays in bin 0; below 2^(bits+1)
+	// the shift is 0 and the bin is the value itself.
+	unsigned msb = 63 - leadingZeros(units | 1);
+	unsigned shift = msb > sub_bucket_bits ? msb - sub_bucket_bits : 0;
+	uint64_t bin = (static_cast<uint64_t>(shift) << sub_bucket_bits) + (units >> shift);
+	return bin < num_bins ? static_cast<unsigned>(bin) : num_bins - 1;
+    }
+
+private:
+    static unsigned leadingZeros(uint64_t v) {
+#if defined(__GNUC__)
+	return __builtin_clzll(v);
+#else
+	unsigned ret = 0;
+	for (uint64_t bit = static_cast<uint64_t>(1) << 63; (v & bit) == 0; bit >>= 1) {
+	    ++ret;
+	}
+	return ret;
+#endif
+    }
+
+    uint64_t binUnitsLow(unsigned index) const;
+    uint64_t binUnitsWidth(unsigned index) const;
+    uint64_t binCount(unsigned index) const { return bins[index].load(); }
+
+    typedef lintel::Atomic<uint64_t> Counter;
+
+    const double unit;		// value of one unit (lowest discernible value)
+    const double inverse_unit;	// 1/unit, multiplication is cheaper
+    const double highest_trackable;
+    const unsigned sub_bucket_bits; // log2(bins per power of two)
+    unsigned num_bins;
+    Counter *bins;		// array of bin-counters
+    // min and max are kept as the bit patterns of non-negative
+    // doubles, which order the same way as the values.
+    Counter min_bits, max_bits;
+};
+
+#endif
@@ -125,6 +125,12 @@ public:
     /// How much memory will this StatsQuantile use? 
     size_t memoryUsage() const;
 
+    /// Serializes the filled part of the buffers, so the encoding is
+    /// at most about memoryUsage() bytes.  deserialize() requires the
+    /// same number and size of buffers.
+    virtual void serialize(lintel::ByteBuffer &buf) const;
+    virtual void deserialize(lintel::ByteBuffer &buf);
+
     /// this function is only here for some of the regression testing,
     /// the previous one should probably always be used.  The
     /// type_disambiguate string is only there because otherwise a call
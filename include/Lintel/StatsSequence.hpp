@@ -33,6 +33,11 @@ public:
     unsigned int maxSeqNum();
     int getPointsPerBucket() const;
 
+    /// deserialize() requires the same max_retain; the merge mode
+    /// and interval width are taken from the serialized value.
+    virtual void serialize(lintel::ByteBuffer &buf) const;
+    virtual void deserialize(lintel::ByteBuffer &buf);
+
 private:
     unsigned long max_retain;
     mode merge_mode;
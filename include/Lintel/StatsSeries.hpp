@@ -49,6 +49,10 @@ public:
   
     virtual std::string debugString() const;
     virtual Stats *another_new() const;
+
+    /// deserialize() requires the same maxlag.
+    virtual void serialize(lintel::ByteBuffer &buf) const;
+    virtual void deserialize(lintel::ByteBuffer &buf);
 };
 
 #endif /* _LINTEL_STATSSERIES_H_INCLUDED */
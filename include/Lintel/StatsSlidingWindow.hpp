@@ -0,0 +1,160 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief Statistics over a sliding time window
+*/
+
+#ifndef LINTEL_STATSSLIDINGWINDOW_HPP
+#define LINTEL_STATSSLIDINGWINDOW_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/utility.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/Clock.hpp>
+#include <Lintel/Stats.hpp>
+
+/// \brief Stats over the most recent window of time, e.g. p99 latency over the last 60s
+///
+/// The window is divided into nslots sub-windows, each with its own
+/// StatsT; a value is added to the slot for its time, so add() is
+/// O(1) except when time moves into a new slot, at which point the
+/// expired slots are reset and reused.  window() returns the merge of
+/// the live slots, i.e. the values added in the current slot and the
+/// nslots-1 slots before it, so it covers between (nslots-1)/nslots
+/// and all of window_width of history.  The merge of the completed
+/// slots is only redone when the slots rotate, so a query after an
+/// add costs two merges and repeated queries cost nothing.
+///
+/// StatsT needs a working add(const Stats &) for another StatsT,
+/// e.g. Stats, StatsQuantile or a StatsHistogram with fixed bins.
+/// Values older than the window are ignored, and counted in
+/// nExpired().  Not thread safe.
+template<class StatsT = Stats> class StatsSlidingWindow : boost::noncopyable {
+public:
+    typedef boost::function<StatsT *()> Factory;
+
+    StatsSlidingWindow(Clock::Tfrac window_width, unsigned nslots,
+		       const Factory &factory = &defaultNew)
+	: slot_width((window_width + nslots - 1) / nslots), cur_epoch(0),
+	  n_expired(0), factory(factory), closed(NULL), result(NULL),
+	  closed_valid(false), result_valid(false)
+    {
+	INVARIANT(nslots > 0, "StatsSlidingWindow: need at least one slot");
+	INVARIANT(slot_width > 0, "StatsSlidingWindow: window too small for slot count");
+	slots.reserve(nslots);
+	for (unsigned i = 0; i < nslots; ++i) {
+	    slots.push_back(factory());
+	}
+	closed = factory();
+	result = factory();
+    }
+
+    ~StatsSlidingWindow() {
+	for (typename std::vector<StatsT *>::iterator i = slots.begin(); i != slots.end(); ++i) {
+	    delete *i;
+	}
+	delete closed;
+	delete result;
+    }
+
+    /// Add a value observed at time now.
+    void add(Clock::Tfrac now, double value) {
+	uint64_t epoch = now / slot_width;
+	if (epoch > cur_epoch) {
+	    advance(epoch);
+	} else if (epoch < cur_epoch) {
+	    if (cur_epoch - epoch >= slots.size()) {
+		++n_expired;
+		return;
+	    }
+	    closed_valid = false; // a late value went into a completed slot
+	}
+	slots[epoch % slots.size()]->add(value);
+	result_valid = false;
+    }
+
+    /// Add a value observed at the current time of day.
+    void add(double value) {
+	add(Clock::todTfrac(), value);
+    }
+
+    /// Stats for the live slots as of time now; the reference is
+    /// valid until the next call to add(), window() or reset().
+    const StatsT &window(Clock::Tfrac now) {
+	uint64_t epoch = now / slot_width;
+	if (epoch > cur_epoch) {
+	    advance(epoch);
+	}
+	if (!closed_valid) {
+	    closed->reset();
+	    for (unsigned i = 0; i < slots.size(); ++i) {
+		if (i != cur_epoch % slots.size()) {
+		    closed->add(*slots[i]);
+		}
+	    }
+	    closed_valid = true;
+	}
+	if (!result_valid) {
+	    result->reset();
+	    result->add(*closed);
+	    result->add(*slots[cur_epoch % slots.size()]);
+	    result_valid = true;
+	}
+	return *result;
+    }
+
+    /// Stats for the live slots as of the current time of day.
+    const StatsT &window() {
+	return window(Clock::todTfrac());
+    }
+
+    void reset() {
+	for (typename std::vector<StatsT *>::iterator i = slots.begin(); i != slots.end(); ++i) {
+	    (*i)->reset();
+	}
+	cur_epoch = 0;
+	n_expired = 0;
+	closed_valid = result_valid = false;
+    }
+
+    Clock::Tfrac slotWidth() const { return slot_width; }
+    unsigned nSlots() const { return slots.size(); }
+    /// Number of values that were ignored because they were older than the window.
+    uint64_t nExpired() const { return n_expired; }
+
+private:
+    static StatsT *defaultNew() {
+	return new StatsT();
+    }
+
+    /// Move the current slot forward to epoch, resetting the slots we
+    /// pass over; at most nslots resets no matter how far we move.
+    void advance(uint64_t epoch) {
+	uint64_t nreset = std::min(epoch - cur_epoch, static_cast<uint64_t>(slots.size()));
+	for (uint64_t i = 1; i <= nreset; ++i) {
+	    slots[(cur_epoch + i) % slots.size()]->reset();
+	}
+	cur_epoch = epoch;
+	closed_valid = result_valid = false;
+    }
+
+    const Clock::Tfrac slot_width;
+    uint64_t cur_epoch; // now / slot_width for the most recent time we have seen
+    uint64_t n_expired;
+    const Factory factory;
+    std::vector<StatsT *> slots; // slot for epoch e is slots[e % nslots]
+    StatsT *closed; // merge of all the slots other than the current one
+    StatsT *result; // closed + the current slot
+    bool closed_valid, result_valid;
+};
+
+#endif
@@ -11,58 +11,133 @@
 #ifndef LINTEL_STRINGID_HPP
 #define LINTEL_STRINGID_HPP
 
+#include <stdint.h>
+
 #include <string>
-#include <map>
+#include <vector>
 
-#include <Lintel/HashTable.hpp>
+#include <boost/utility.hpp>
 
-/// \brief String to small integer mapping
-class StringId {
-public:
-    StringId();
-    unsigned int getId(const std::string &str);
-    const std::string &getString(unsigned int id);
-    unsigned int maxId() { return nextid; }
-
-    /// \cond SEMI_INTERNAL_CLASSES
-    struct HTE {
-	const std::string *str;
-	unsigned int id;
-	HTE(const std::string &_str) : str(&_str), id(0) {}
-	HTE(const unsigned int _id) : id(_id) {}
-    };
-    class HTEHashStr {
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/StringUtil.hpp>
+
+/// \cond SEMI_INTERNAL_CLASSES
+namespace lintel { namespace detail {
+    /// Bump allocator for the bytes of the strings in a StringId; the
+    /// bytes are freed when the arena is destroyed.
+    class StringIdArena : boost::noncopyable {
     public:
-	unsigned int operator()(const HTE &k) {
-	    return HashTable_hashbytes(k.str->data(),k.str->size());
-	}
+	StringIdArena() : cur(NULL), remaining(0), allocated(0) { }
+	~StringIdArena();
+
+	const char *copy(const char *data, size_t size);
+	size_t bytesAllocated() const { return allocated; }
+
+    private:
+	std::vector<char *> chunks;
+	char *cur;
+	size_t remaining, allocated;
     };
-    class HTEEqualStr {
-    public:
-	bool operator()(const HTE &a, const HTE &b) {
-	    return *(a.str) == *(b.str);
-	}
+
+    struct StringIdEntry {
+	const char *data;
+	uint32_t size;
+	uint32_t hash;
     };
-    class HTEHashId {
-    public:
-	unsigned int operator()(const HTE &k) {
-	    return k.id;
+} }
+/// \endcond
+
+/// \brief String to small integer mapping
+///
+/// Ids are handed out densely, starting from 1, in the order the
+/// strings are first seen, so they can be used as dictionary codes.
+/// The bytes of the strings are copied into large shared chunks,
+/// the string to id map is an open addressing table of ids, and the
+/// id to string map is a vector indexed by id.  Not thread safe; see
+/// ConcurrentStringId.
+class StringId : boost::noncopyable {
+public:
+    StringId();
+
+    /// The id for str, assigning the next one if str is new.
+    unsigned int getId(const char *data, size_t size);
+    unsigned int getId(const std::string &str) { return getId(str.data(), str.size()); }
+    unsigned int getId(const StringRange &str) { return getId(str.data, str.size); }
+
+    /// Append the ids of the strings (std::string or StringRange) in
+    /// [begin, end) to ids.
+    template<class Iter> void getIds(Iter begin, Iter end, std::vector<unsigned int> &ids) {
+	for(; begin != end; ++begin) {
+	    ids.push_back(getId(*begin));
 	}
-    };
-    class HTEEqualId {
-    public:
-	bool operator()(const HTE &a, const HTE &b) {
-	    return a.id == b.id;
+    }
+
+    /// The id for the string, or 0 if it has not been seen.
+    unsigned int findId(const char *data, size_t size) const;
+
+    /// The bytes of string id; valid until the StringId is destroyed.
+    StringRange getStringRange(unsigned int id) const {
+	INVARIANT(id > 0 && id < entries.size(), boost::format("invalid StringId id %u") % id);
+	return StringRange(entries[id].data, entries[id].size);
+    }
+
+    std::string getString(unsigned int id) const { return getStringRange(id).str(); }
+
+    /// One more than the largest id handed out.
+    unsigned int maxId() const { return entries.size(); }
+
+    /// Bytes used for the strings and both maps.
+    size_t memoryUsage() const;
+
+private:
+    void grow();
+
+    lintel::detail::StringIdArena arena;
+    std::vector<lintel::detail::StringIdEntry> entries; // by id; entry 0 is unused
+    std::vector<uint32_t> slots; // ids by hash, 0 for an empty slot
+};
+
+/// \brief Thread safe String to small integer mapping
+///
+/// The same mapping as StringId, but any number of threads can call
+/// any of the methods at once.  Looking up a string that already
+/// has an id, and getString() and getStringRange(), take no locks:
+/// entries are stored in segments that double in size and never
+/// move, and the string to id table is replaced by a larger copy
+/// when it fills, with the old copies kept until the
+/// ConcurrentStringId is destroyed.  Assigning a new id takes a
+/// spin lock.
+class ConcurrentStringId : boost::noncopyable {
+public:
+    ConcurrentStringId();
+    ~ConcurrentStringId();
+
+    unsigned int getId(const char *data, size_t size);
+    unsigned int getId(const std::string &str) { return getId(str.data(), str.size()); }
+    unsigned int getId(const StringRange &str) { return getId(str.data, str.size); }
+
+    template<class Iter> void getIds(Iter begin, Iter end, std::vector<unsigned int> &ids) {
+	for(; begin != end; ++begin) {
+	    ids.push_back(getId(*begin));
 	}
-    };
-    /// \endcond
+    }
+
+    /// The id for the string, or 0 if it has not been seen; may miss
+    /// a string that another thread is adding at the same time.
+    unsigned int findId(const char *data, size_t size) const;
+
+    StringRange getStringRange(unsigned int id) const;
+
+    std::string getString(unsigned int id) const { return getStringRange(id).str(); }
+
+    unsigned int maxId() const;
+
+    size_t memoryUsage() const;
 
 private:
-    HashTable<HTE, HTEHashStr, HTEEqualStr> idmap;
-    HashTable<HTE, HTEHashId, HTEEqualId> revmap;
+    struct Impl;
 
-    unsigned int nextid;
+    Impl *impl;
 };
 
 #endif
-
@@ -16,11 +16,14 @@
 #include <vector>
 #include <locale>
 #include <stdint.h>
+#include <string.h>
 
 #include <boost/lexical_cast.hpp>
 
 #include <Lintel/AssertBoost.hpp>
 
+namespace lintel { class ByteBuffer; }
+
 /** split instr into all of the separate strings separated by splitstr, and
     put the results into bits; alternately, and probably better, use
     boost::split from boost/algorithm/string.hpp */
@@ -35,6 +38,115 @@ split(const std::string &instr, const std::string &splitstr) {
     return ret;
 }
 
+/** \brief A view of size bytes starting at data; does not own or copy the data */
+struct StringRange {
+    StringRange() : data(NULL), size(0) { }
+    StringRange(const char *data, size_t size) : data(data), size(size) { }
+
+    std::string str() const {
+	return std::string(data, size);
+    }
+
+    bool operator==(const std::string &rhs) const {
+	return size == rhs.size() && memcmp(data, rhs.data(), size) == 0;
+    }
+
+    bool operator!=(const std::string &rhs) const {
+	return !(*this == rhs);
+    }
+
+    const char *data;
+    size_t size;
+};
+
+/** split the len bytes at instr at each splitstr, the same as split
+    into strings, but append (pointer, length) ranges into instr to
+    ranges rather than allocating a string per piece.  Reusing ranges
+    after a clear() means that no memory is allocated at all.  Single
+    character separators are found with memchr. */
+void split(const char *instr, size_t len, const std::string &splitstr,
+	   std::vector<StringRange> &ranges);
+
+/** as above; the ranges point into instr, so are only valid while it is */
+inline void split(const std::string &instr, const std::string &splitstr,
+		  std::vector<StringRange> &ranges) {
+    split(instr.data(), instr.size(), splitstr, ranges);
+}
+
+#if __cplusplus >= 201103L
+/** the ranges would point into a temporary that is gone by the time
+    they are used; bind the string to a variable first */
+void split(const std::string &&instr, const std::string &splitstr,
+	   std::vector<StringRange> &ranges) = delete;
+#endif
+
+/** \brief Lazily split data at each occurrence of a separator
+    
+    Returns the same pieces as split, one at a time, without
+    allocating, e.g.
+    for(SplitIterator i(line, ','); i.valid(); ++i) { use(i->data, i->size); }
+    The ranges point into the data, which must outlive the iterator. */
+class SplitIterator {
+public:
+    SplitIterator(const char *data, size_t len, char splitchar)
+	: splitstr(1, splitchar) {
+	init(data, len);
+    }
+
+    SplitIterator(const char *data, size_t len, const std::string &splitstr)
+	: splitstr(splitstr) {
+	init(data, len);
+    }
+
+    SplitIterator(const std::string &str, char splitchar) 
+	: splitstr(1, splitchar) {
+	init(str.data(), str.size());
+    }
+
+    SplitIterator(const std::string &str, const std::string &splitstr)
+	: splitstr(splitstr) {
+	init(str.data(), str.size());
+    }
+
+    /// split the readable bytes of buf
+    SplitIterator(const lintel::ByteBuffer &buf, char splitchar);
+
+    /// false once all of the pieces have been returned
+    bool valid() const {
+	return !done;
+    }
+
+    const StringRange &operator*() const {
+	return cur;
+    }
+
+    const StringRange *operator->() const {
+	return &cur;
+    }
+
+    SplitIterator &operator++() {
+	next();
+	return *this;
+    }
+
+private:
+    void init(const char *data, size_t len) {
+	SINVARIANT(splitstr.size() > 0);
+	pos = data;
+	end = data + len;
+	last = false;
+	done = false;
+	next();
+    }
+
+    void next();
+
+    std::string splitstr;
+    const char *pos, *end;
+    StringRange cur;
+    bool last, done;
+};
+
 /** join parts, each entry separated by joinstr */
 std::string join(const std::string &joinstr, const std::vector<std::string> &parts);
 
@@ -51,6 +163,12 @@ inline std::string mysqlEscape(const std::string &instr) {
     return mysqlEscape(instr.data(), instr.size());
 }
 
+/** as above, but append the escaped data to out.  The ByteBuffer
+    variants of the conversions below all append, and grow out
+    geometrically, so reusing one buffer avoids allocating a string
+    per call. */
+void mysqlEscape(const void *data, size_t datasize, lintel::ByteBuffer &out);
+
 /** convert data for size bytes into a hex string */
 std::string hexstring(const void *data, unsigned datasize);
 
@@ -59,6 +177,9 @@ inline std::string hexstring(const std::string &instr) {
     return hexstring(instr.data(), instr.size());
 }
 
+/** append the hex form of data for size bytes to out */
+void hexstring(const void *data, size_t datasize, lintel::ByteBuffer &out);
+
 /** convert two hex char into unsigned char*/
 unsigned char unpackhex(const char *ch);
 
@@ -71,19 +192,31 @@ std::string maybehexstring(const void *data, unsigned datasize);
 /** convert instr into a hex string if it contains non-printing characters */
 std::string maybehexstring(const std::string &instr);
 
+/** append data, converted to hex if it contains non-printing characters, to out */
+void maybehexstring(const void *data, size_t datasize, lintel::ByteBuffer &out);
+
 /** escape the unprintable things (fails ctype::isprint(c)) as %xx, and % as %%.  Leave everything
     else alone, which means that this is not standard URI escaping because it does not escape
     spaces. */
 std::string escapeUnprintable(const std::string &instr);
 
+/** append data, escaped as by escapeUnprintable, to out */
+void escapeUnprintable(const void *data, size_t datasize, lintel::ByteBuffer &out);
+
 FUNC_DEPRECATED_PREFIX std::string htmlEscapeUnprintable(const std::string &in) FUNC_DEPRECATED;
 
 /** convert instr into a CSV form as accepted by Excel */
 std::string toCSVform(const std::string &instr); 
 
+/** append data in CSV form to out */
+void toCSVform(const void *data, size_t datasize, lintel::ByteBuffer &out);
+
 /** convert n char into a raw string, abort if it contains non-hex characters */
 std::string hex2raw(const char *ch, uint32_t n);
 
+/** append n hex chars converted to raw bytes to out, abort if it contains non-hex characters */
+void hex2raw(const char *ch, size_t n, lintel::ByteBuffer &out);
+
 /** convert instr into a raw string, abort if it contains non-hex characters */
 std::string hex2raw(const std::string &instr);
 
@@ -106,6 +239,97 @@ uint32_t stringtoipv4(const std::string &str);
 /** same as strtod, but bails out if the string isn't valid */
 double stringToDouble(const std::string &str);
 
+/** parse the len characters at str, which must all be decimal digits,
+    into val without allocating; returns false if they aren't digits
+    or the value doesn't fit in 64 bits */
+bool parseDecimalUint64(const char *str, size_t len, uint64_t &val);
+
+/** parse the len characters at str as an optionally signed decimal
+    integer into val without allocating; returns false, leaving val
+    unchanged, if they are not one or the value doesn't fit in T */
+template<typename T>
+bool parseInteger(const char *str, size_t len, T &val) {
+    BOOST_STATIC_ASSERT(boost::is_integral<T>::value);
+    bool negative = false;
+    if (len > 0 && (*str == '-' || *str == '+')) {
+	negative = *str == '-';
+	++str;
+	--len;
+    }
+    uint64_t v;
+    if (!parseDecimalUint64(str, len, v)) {
+	return false;
+    }
+    if (negative) {
+	if (v == 0) {
+	    val = 0;
+	} else if (!std::numeric_limits<T>::is_signed
+		   || v - 1 > static_cast<uint64_t>(std::numeric_limits<T>::max())) {
+	    return false;
+	} else {
+	    val = -static_cast<T>(v - 1) - 1;
+	}
+    } else if (v > static_cast<uint64_t>(std::numeric_limits<T>::max())) {
+	return false;
+    } else {
+	val = static_cast<T>(v);
+    }
+    return true;
+}
+
+template<typename T>
+bool parseInteger(const std::string &str, T &val) {
+    return parseInteger(str.data(), str.size(), val);
+}
+
+/** parse the len characters at str as a double into val without
+    allocating, correctly rounded; returns false if they are not all
+    part of the number.  Plain decimal numbers are parsed directly,
+    anything else is handed to strtod, so the syntax is the same. */
+bool parseDouble(const char *str, size_t len, double &val);
+
+inline bool parseDouble(const std::string &str, double &val) {
+    return parseDouble(str.data(), str.size(), val);
+}
+
+/** maximum number of characters written by formatDouble */
+const size_t format_double_max = 25;
+
+/** write the shortest decimal form of val that parses back to exactly
+    val into out, which needs format_double_max characters of room;
+    returns the length, there is no trailing NUL.  The form is like
+    %g: 0.25, 1e+100, 1.5e-07, inf, nan; but with as many digits as
+    needed rather than 6. */
+size_t formatDouble(double val, char *out);
+
+std::string formatDouble(double val);
+
+/** append the formatDouble form of val to out */
+void formatDouble(double val, lintel::ByteBuffer &out);
+
+/** write val in decimal to out, which needs 20 characters of room;
+    returns the length, there is no trailing NUL */
+size_t formatUint64(uint64_t val, char *out);
+
+/** write val in decimal to out, which needs 21 characters of room;
+    returns the length, there is no trailing NUL */
+template<typename T>
+size_t formatInteger(T val, char *out) {
+    BOOST_STATIC_ASSERT(boost::is_integral<T>::value);
+    if (val < 0) {
+	*out = '-';
+	// negate in unsigned arithmetic so the minimum value works
+	return 1 + formatUint64(0 - static_cast<uint64_t>(val), out + 1);
+    }
+    return formatUint64(static_cast<uint64_t>(val), out);
+}
+
+template<typename T>
+std::string formatInteger(T val) {
+    char buf[21];
+    return std::string(buf, formatInteger(val, buf));
+}
+
 /** convert a string into the given integer type. Asserts out if given a
     bad string or value is too large to fit in given type */
 template<typename T>
@@ -113,6 +337,9 @@ T stringToInteger(const std::string &str, int base = 10) {
     BOOST_STATIC_ASSERT(boost::is_integral<T>::value);
     T ret = 0;
     if (base == 10) {
+	if (parseInteger(str, ret)) {
+	    return ret;
+	}
 	try {
 	    ret = boost::lexical_cast<T>(str);
 	}
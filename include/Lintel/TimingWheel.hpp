@@ -0,0 +1,515 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief Timer queues with O(1) insert and cancel: a hierarchical
+    timing wheel and a calendar queue
+*/
+
+#ifndef LINTEL_TIMING_WHEEL_HPP
+#define LINTEL_TIMING_WHEEL_HPP
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/utility.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/Clock.hpp>
+
+namespace lintel {
+    namespace detail {
+	/// Timers kept in doubly linked lists of indices into one
+	/// vector, so that any timer can be unlinked in O(1) given its
+	/// index, which is also its handle.
+	template<class T> class TimerLists {
+	public:
+	    static const uint32_t nil = 0xFFFFFFFFU;
+
+	    struct Node {
+		Clock::Tfrac when;
+		uint32_t next, prev;
+		uint32_t list; // nil for a free node
+		T val;
+	    };
+
+	    explicit TimerLists(uint32_t nlists) : free_head(nil), count(0) {
+		resetLists(nlists);
+	    }
+
+	    void resetLists(uint32_t nlists) {
+		List empty = { nil, nil };
+		lists.assign(nlists, empty);
+	    }
+
+	    uint32_t allocate(Clock::Tfrac when, const T &val) {
+		uint32_t idx;
+		if (free_head == nil) {
+		    INVARIANT(nodes.size() < nil, "too many timers");
+		    idx = nodes.size();
+		    nodes.push_back(Node());
+		} else {
+		    idx = free_head;
+		    free_head = nodes[idx].next;
+		}
+		Node &n = nodes[idx];
+		n.when = when;
+		n.val = val;
+		n.list = nil;
+		++count;
+		return idx;
+	    }
+
+	    void release(uint32_t idx) {
+		DEBUG_SINVARIANT(nodes[idx].list == nil);
+		nodes[idx].list = nil;
+		nodes[idx].next = free_head;
+		free_head = idx;
+		--count;
+	    }
+
+	    bool contains(uint32_t idx) const {
+		return idx < nodes.size() && nodes[idx].list != nil;
+	    }
+
+	    Node &node(uint32_t idx, const char *what) {
+		INVARIANT(contains(idx), boost::format("%s: handle %d is not queued")
+			  % what % idx);
+		return nodes[idx];
+	    }
+
+	    /// insert idx into list after the node after, or at the head if after is nil
+	    void insertAfter(uint32_t list, uint32_t after, uint32_t idx) {
+		Node &n = nodes[idx];
+		List &l = lists[list];
+		n.list = list;
+		n.prev = after;
+		n.next = after == nil ? l.head : nodes[after].next;
+		if (n.next == nil) {
+		    l.tail = idx;
+		} else {
+		    nodes[n.next].prev = idx;
+		}
+		if (after == nil) {
+		    l.head = idx;
+		} else {
+		    nodes[after].next = idx;
+		}
+	    }
+
+	    void pushBack(uint32_t list, uint32_t idx) {
+		insertAfter(list, lists[list].tail, idx);
+	    }
+
+	    void unlink(uint32_t idx) {
+		Node &n = nodes[idx];
+		List &l = lists[n.list];
+		if (n.prev == nil) {
+		    l.head = n.next;
+		} else {
+		    nodes[n.prev].next = n.next;
+		}
+		if (n.next == nil) {
+		    l.tail = n.prev;
+		} else {
+		    nodes[n.next].prev = n.prev;
+		}
+		n.list = nil;
+	    }
+
+	    /// Remove every node from list, returning the old head; the
+	    /// nodes stay chained through next.
+	    uint32_t takeAll(uint32_t list) {
+		uint32_t ret = lists[list].head;
+		lists[list].head = lists[list].tail = nil;
+		return ret;
+	    }
+
+	    uint32_t head(uint32_t list) const { return lists[list].head; }
+	    uint32_t tail(uint32_t list) const { return lists[list].tail; }
+	    bool listEmpty(uint32_t list) const { return lists[list].head == nil; }
+
+	    struct List {
+		uint32_t head, tail;
+	    };
+
+	    std::vector<Node> nodes;
+	    std::vector<List> lists;
+	    uint32_t free_head;
+	    uint32_t count;
+	};
+
+	template<class T> const uint32_t TimerLists<T>::nil;
+    }
+
+    /** \brief Hierarchical timing wheel for large numbers of timeouts
+
+	Times are Clock::Tfrac values, rounded up to a multiple of the
+	granularity given to the constructor; a timer is never
+	returned before its time, and is returned at most one
+	granularity late.  Timers due in the same granule come out in
+	insertion order.  insert() and cancel() are O(1), and
+	popExpired() is amortized O(1) per timer: each timer is moved
+	down at most once per level.
+
+	There are 11 levels of 64 slots.  A timer due at granule g
+	when the wheel is at granule cur goes in the level of the
+	highest 6 bit digit where g and cur differ, in the slot for
+	g's digit there; as the wheel advances to the start of a slot
+	the timers in it are spread into the lower levels.  A 64 bit
+	occupancy mask per level lets the wheel jump straight to the
+	next non-empty slot rather than stepping through empty ones,
+	so sparse timers far apart cost nothing extra.
+
+	Handles are small integers reused once their timer has been
+	returned or cancelled.  now must not decrease between calls
+	to popExpired().
+    */
+    template<class T> class TimingWheel : boost::noncopyable {
+    public:
+	typedef uint32_t Handle;
+	static const unsigned slot_bits = 6;
+	static const unsigned slots_per_level = 1U << slot_bits;
+	static const unsigned levels = (64 + slot_bits - 1) / slot_bits;
+
+	/// Start at time start; earlier timers are due immediately.
+	explicit TimingWheel(Clock::Tfrac granularity, Clock::Tfrac start = 0)
+	    : timers(levels * slots_per_level + 1), granularity_(granularity), cur(0) {
+	    INVARIANT(granularity > 0, "TimingWheel: granularity must be positive");
+	    cur = start / granularity;
+	    std::fill(occupied, occupied + levels, 0);
+	}
+
+	/// Add a timer for time when; the handle is valid until the
+	/// timer is returned by popExpired() or cancelled.
+	Handle insert(Clock::Tfrac when, const T &val) {
+	    uint32_t idx = timers.allocate(when, val);
+	    place(idx);
+	    return idx;
+	}
+
+	void cancel(Handle handle) {
+	    timers.node(handle, "TimingWheel");
+	    uint32_t list = timers.nodes[handle].list;
+	    timers.unlink(handle);
+	    if (list != ready && timers.listEmpty(list)) {
+		occupied[list / slots_per_level] &= ~(1ULL << (list % slots_per_level));
+	    }
+	    timers.release(handle);
+	}
+
+	bool contains(Handle handle) const {
+	    return timers.contains(handle);
+	}
+
+	const T &get(Handle handle) {
+	    return timers.node(handle, "TimingWheel").val;
+	}
+
+	Clock::Tfrac when(Handle handle) {
+	    return timers.node(handle, "TimingWheel").when;
+	}
+
+	/// If a timer is due at or before now, remove it, set when and
+	/// val to it and return true.
+	bool popExpired(Clock::Tfrac now, Clock::Tfrac &when, T &val) {
+	    uint64_t now_tick = now / granularity_;
+	    while (timers.listEmpty(ready)) {
+		unsigned level;
+		uint64_t tick;
+		if (!nextSlot(level, tick) || tick > now_tick) {
+		    return false;
+		}
+		cur = tick;
+		cascade(level);
+	    }
+	    uint32_t idx = timers.head(ready);
+	    timers.unlink(idx);
+	    when = timers.nodes[idx].when;
+	    val = timers.nodes[idx].val;
+	    timers.release(idx);
+	    return true;
+	}
+
+	uint32_t size() const { return timers.count; }
+	bool empty() const { return timers.count == 0; }
+	Clock::Tfrac granularity() const { return granularity_; }
+
+	/// The start of the earliest granule that may have a timer
+	/// due; false if there are no timers.
+	bool nextExpiry(Clock::Tfrac &when) const {
+	    if (!timers.listEmpty(ready)) {
+		when = cur * granularity_;
+		return true;
+	    }
+	    unsigned level;
+	    uint64_t tick;
+	    if (!nextSlot(level, tick)) {
+		return false;
+	    }
+	    when = tick * granularity_;
+	    return true;
+	}
+
+    private:
+	static const uint32_t ready = levels * slots_per_level;
+
+	uint64_t tickOf(Clock::Tfrac when) const {
+	    return when / granularity_ + (when % granularity_ != 0 ? 1 : 0);
+	}
+
+	void place(uint32_t idx) {
+	    uint64_t tick = tickOf(timers.nodes[idx].when);
+	    if (tick <= cur) {
+		timers.pushBack(ready, idx);
+	    } else {
+		unsigned level = (63 - __builtin_clzll(tick ^ cur)) / slot_bits;
+		unsigned slot = (tick >> (level * slot_bits)) % slots_per_level;
+		timers.pushBack(level * slots_per_level + slot, idx);
+		occupied[level] |= 1ULL << slot;
+	    }
+	}
+
+	// Timers in level k agree with cur above digit k and are after
+	// it in digit k, so the lowest occupied slot of the lowest
+	// non-empty level is the next one to reach.
+	bool nextSlot(unsigned &level, uint64_t &tick) const {
+	    for(level = 0; level < levels; ++level) {
+		if (occupied[level] != 0) {
+		    unsigned shift = level * slot_bits;
+		    uint64_t slot = __builtin_ctzll(occupied[level]);
+		    uint64_t above = shift + slot_bits >= 64 ? 0
+			: cur & ~((1ULL << (shift + slot_bits)) - 1);
+		    tick = above | (slot << shift);
+		    return true;
+		}
+	    }
+	    return false;
+	}
+
+	/// Spread the slot at level that cur has just reached into the lower levels.
+	void cascade(unsigned level) {
+	    unsigned slot = (cur >> (level * slot_bits)) % slots_per_level;
+	    occupied[level] &= ~(1ULL << slot);
+	    uint32_t idx = timers.takeAll(level * slots_per_level + slot);
+	    while (idx != timers.nil) {
+		uint32_t next = timers.nodes[idx].next;
+		place(idx);
+		idx = next;
+	    }
+	}
+
+	detail::TimerLists<T> timers;
+	const Clock::Tfrac granularity_;
+	uint64_t cur; // current granule
+	uint64_t occupied[levels];
+    };
+
+    template<class T> const unsigned TimingWheel<T>::slot_bits;
+    template<class T> const unsigned TimingWheel<T>::slots_per_level;
+    template<class T> const unsigned TimingWheel<T>::levels;
+    template<class T> const uint32_t TimingWheel<T>::ready;
+
+    /** \brief Calendar queue (Brown, CACM 1988): an exact time ordered
+	priority queue with O(1) expected operations
+
+	Timers are hashed by time into a ring of buckets, each
+	covering width() time units, with each bucket kept sorted;
+	popping scans forward from the current bucket for a timer in
+	the current "year" (one trip around the ring).  The ring is
+	doubled or halved to keep about one to two timers per bucket,
+	and the width re-estimated as the average separation of the
+	earliest quarter of a sample of the pending times, so the
+	expected cost per operation stays constant for stationary
+	distributions of increments.  Unlike TimingWheel, timers come
+	out in exact time order (insertion order for ties), like a
+	PriorityQueue keyed on time, and may be inserted at any time,
+	including before the last one popped.
+
+	Handles are small integers reused once their timer has been
+	popped or cancelled.
+    */
+    template<class T> class CalendarQueue : boost::noncopyable {
+    public:
+	typedef uint32_t Handle;
+	static const uint32_t min_buckets = 16;
+
+	/// width is the initial bucket width; it is re-estimated as the queue grows
+	explicit CalendarQueue(Clock::Tfrac width = 1)
+	    : timers(min_buckets), width_(std::max(width, static_cast<Clock::Tfrac>(1))),
+	      mask(min_buckets - 1), cur_bucket(0), bucket_top(width_) { }
+
+	Handle insert(Clock::Tfrac when, const T &val) {
+	    uint32_t idx = timers.allocate(when, val);
+	    // first timer, or before the current bucket; move to its bucket
+	    if (timers.count == 1 || when < bucket_top - width_) {
+		setCursor(when);
+	    }
+	    insertSorted(idx);
+	    if (timers.count > 2 * (mask + 1)) {
+		resize(2 * (mask + 1));
+	    }
+	    return idx;
+	}
+
+	void cancel(Handle handle) {
+	    timers.node(handle, "CalendarQueue");
+	    timers.unlink(handle);
+	    timers.release(handle);
+	    maybeShrink();
+	}
+
+	bool contains(Handle handle) const {
+	    return timers.contains(handle);
+	}
+
+	const T &get(Handle handle) {
+	    return timers.node(handle, "CalendarQueue").val;
+	}
+
+	Clock::Tfrac when(Handle handle) {
+	    return timers.node(handle, "CalendarQueue").when;
+	}
+
+	/// Time of the earliest timer
+	Clock::Tfrac topTime() {
+	    return timers.nodes[findMin()].when;
+	}
+
+	Handle topHandle() {
+	    return findMin();
+	}
+
+	/// Remove the earliest timer, setting when and val to it
+	void pop(Clock::Tfrac &when, T &val) {
+	    uint32_t idx = findMin();
+	    when = timers.nodes[idx].when;
+	    val = timers.nodes[idx].val;
+	    timers.unlink(idx);
+	    timers.release(idx);
+	    maybeShrink();
+	}
+
+	/// If the earliest timer is at or before now, pop it and return true.
+	bool popExpired(Clock::Tfrac now, Clock::Tfrac &when, T &val) {
+	    if (empty() || topTime() > now) {
+		return false;
+	    }
+	    pop(when, val);
+	    return true;
+	}
+
+	uint32_t size() const { return timers.count; }
+	bool empty() const { return timers.count == 0; }
+	Clock::Tfrac width() const { return width_; }
+	uint32_t nBuckets() const { return mask + 1; }
+
+    private:
+	uint32_t bucketOf(Clock::Tfrac when) const {
+	    return (when / width_) & mask;
+	}
+
+	void setCursor(Clock::Tfrac when) {
+	    cur_bucket = bucketOf(when);
+	    bucket_top = (when / width_ + 1) * width_;
+	}
+
+	/// after any timers with the same or earlier time, searching
+	/// from the back since new timers are usually the latest
+	void insertSorted(uint32_t idx) {
+	    uint32_t bucket = bucketOf(timers.nodes[idx].when);
+	    uint32_t after = timers.tail(bucket);
+	    while (after != timers.nil && timers.nodes[after].when > timers.nodes[idx].when) {
+		after = timers.nodes[after].prev;
+	    }
+	    timers.insertAfter(bucket, after, idx);
+	}
+
+	uint32_t findMin() {
+	    INVARIANT(!empty(), "CalendarQueue: empty");
+	    for(uint32_t i = 0; i <= mask; ++i) {
+		uint32_t head = timers.head(cur_bucket);
+		if (head != timers.nil && timers.nodes[head].when < bucket_top) {
+		    return head;
+		}
+		cur_bucket = (cur_bucket + 1) & mask;
+		bucket_top += width_;
+	    }
+	    // nothing in the next year; find the earliest directly
+	    uint32_t best = timers.nil;
+	    for(uint32_t b = 0; b <= mask; ++b) {
+		uint32_t head = timers.head(b);
+		if (head != timers.nil
+		    && (best == timers.nil || timers.nodes[head].when < timers.nodes[best].when)) {
+		    best = head;
+		}
+	    }
+	    setCursor(timers.nodes[best].when);
+	    return best;
+	}
+
+	void maybeShrink() {
+	    if (mask + 1 > min_buckets && timers.count < (mask + 1) / 2) {
+		resize((mask + 1) / 2);
+	    }
+	}
+
+	void resize(uint32_t nbuckets) {
+	    std::vector<uint32_t> all;
+	    all.reserve(timers.count);
+	    for(uint32_t b = 0; b <= mask; ++b) {
+		for(uint32_t idx = timers.head(b); idx != timers.nil; idx = timers.nodes[idx].next) {
+		    all.push_back(idx);
+		}
+	    }
+	    estimateWidth(all);
+	    mask = nbuckets - 1;
+	    timers.resetLists(nbuckets);
+	    Clock::Tfrac min_when = bucket_top - width_;
+	    for(uint32_t i = 0; i < all.size(); ++i) {
+		timers.nodes[all[i]].list = timers.nil;
+		insertSorted(all[i]);
+		min_when = i == 0 ? timers.nodes[all[i]].when
+		    : std::min(min_when, timers.nodes[all[i]].when);
+	    }
+	    setCursor(min_when);
+	}
+
+	void estimateWidth(const std::vector<uint32_t> &all) {
+	    static const size_t max_sample = 128;
+	    if (all.size() < 8) {
+		return;
+	    }
+	    size_t stride = std::max(all.size() / max_sample, static_cast<size_t>(1));
+	    std::vector<Clock::Tfrac> sample;
+	    for(size_t i = 0; i < all.size(); i += stride) {
+		sample.push_back(timers.nodes[all[i]].when);
+	    }
+	    std::sort(sample.begin(), sample.end());
+	    // The earliest quarter, nearest the head where the pops
+	    // are.  Brown uses 3x the separation, but with sorted
+	    // insertion walking a linked list, one timer per bucket
+	    // measured ~1.6x faster.
+	    Clock::Tfrac span = sample[sample.size() / 4] - sample[0];
+	    width_ = std::max(static_cast<Clock::Tfrac>(span / (all.size() / 4)),
+			      static_cast<Clock::Tfrac>(1));
+	}
+
+	detail::TimerLists<T> timers;
+	Clock::Tfrac width_;
+	uint32_t mask; // number of buckets - 1
+	uint32_t cur_bucket;
+	Clock::Tfrac bucket_top; // end of cur_bucket in the current year
+    };
+
+    template<class T> const uint32_t CalendarQueue<T>::min_buckets;
+}
+
+#endif
@@ -0,0 +1,211 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    \brief LSD radix sort of entries by a tuple key
+*/
+
+#ifndef LINTEL_TUPLE_RADIX_SORT_HPP
+#define LINTEL_TUPLE_RADIX_SORT_HPP
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/mpl/int.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/type_traits/is_signed.hpp>
+#include <boost/utility/enable_if.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+
+// Each tuple position is encoded into an unsigned integer whose
+// ordering matches operator< on the original value (for floating
+// point, apart from NaNs; see RadixKey<double>), and the entries
+// are sorted one byte at a time from the last tuple position to the
+// first, with a stable counting sort per byte.  Bytes that are the
+// same in every entry are skipped, so small values in wide types cost
+// little.  Only types with a fixed size encoding are supported
+// (integers, bool, float and double); TupleRadixSortable<Tuple>
+// says whether radixSortTuples() can be used.
+
+namespace lintel {
+    /// Order preserving encoding of T into the low bytes of a uint64_t;
+    /// supported is false for types without one.
+    template<class T, class Enable = void> struct RadixKey {
+	BOOST_STATIC_CONSTANT(bool, supported = false);
+    };
+
+    template<class T>
+    struct RadixKey<T, typename boost::enable_if<boost::is_integral<T> >::type> {
+	BOOST_STATIC_CONSTANT(bool, supported = true);
+	BOOST_STATIC_CONSTANT(unsigned, bytes = sizeof(T));
+
+	static uint64_t encode(T v) {
+	    uint64_t ret = static_cast<uint64_t>(v);
+	    if (bytes < 8) {
+		ret &= (static_cast<uint64_t>(1) << (8 * bytes)) - 1;
+	    }
+	    if (boost::is_signed<T>::value) {
+		ret ^= static_cast<uint64_t>(1) << (8 * bytes - 1);
+	    }
+	    return ret;
+	}
+    };
+
+    // Positive floats sort as their bits with the sign bit set,
+    // negative ones as the complement of their bits.  -0.0 is made
+    // 0.0 first, as they are equal under operator<.  NaNs, which
+    // operator< does not order, sort at the ends, negative NaNs first.
+    template<> struct RadixKey<double> {
+	BOOST_STATIC_CONSTANT(bool, supported = true);
+	BOOST_STATIC_CONSTANT(unsigned, bytes = 8);
+
+	static uint64_t encode(double v) {
+	    if (v == 0) {
+		v = 0; // -0.0
+	    }
+	    uint64_t bits;
+	    memcpy(&bits, &v, sizeof(bits));
+	    return (bits >> 63) ? ~bits : bits | (static_cast<uint64_t>(1) << 63);
+	}
+    };
+
+    template<> struct RadixKey<float> {
+	BOOST_STATIC_CONSTANT(bool, supported = true);
+	BOOST_STATIC_CONSTANT(unsigned, bytes = 4);
+
+	static uint64_t encode(float v) {
+	    if (v == 0) {
+		v = 0; // -0.0
+	    }
+	    uint32_t bits;
+	    memcpy(&bits, &v, sizeof(bits));
+	    return (bits >> 31) ? static_cast<uint32_t>(~bits) : bits | (1U << 31);
+	}
+    };
+
+    /// value is true if every element of the tuple has a RadixKey.
+    template<class Tuple> struct TupleRadixSortable {
+	BOOST_STATIC_CONSTANT(bool, value =
+			      (RadixKey<typename Tuple::head_type>::supported
+			       && TupleRadixSortable<typename Tuple::tail_type>::value));
+    };
+
+    template<> struct TupleRadixSortable<boost::tuples::null_type> {
+	BOOST_STATIC_CONSTANT(bool, value = true);
+    };
+
+    /// \cond SEMI_INTERNAL_CLASSES
+    namespace detail {
+	template<class Entry, class KeyOf> class TupleRadixSorter {
+	public:
+	    typedef typename KeyOf::TupleType Tuple;
+	    BOOST_STATIC_ASSERT(TupleRadixSortable<Tuple>::value);
+
+	    TupleRadixSorter(std::vector<Entry> &entries, const KeyOf &key_of)
+		: entries(entries), key_of(key_of), tmp(entries.size()),
+		  keys(entries.size()), tmp_keys(entries.size()) { }
+
+	    void sort() {
+		if (entries.size() > 1) {
+		    sortFrom(boost::mpl::int_<boost::tuples::length<Tuple>::value - 1>());
+		}
+	    }
+
+	private:
+	    template<int Pos> void sortFrom(boost::mpl::int_<Pos>) {
+		typedef RadixKey<typename boost::tuples::element<Pos, Tuple>::type> Key;
+		const size_t n = entries.size();
+
+		size_t counts[Key::bytes][256];
+		memset(counts, 0, sizeof(counts));
+		for(size_t i = 0; i < n; ++i) {
+		    // any sorts after every value, so its value is ignored
+		    uint64_t k = key_of.any(entries[i], Pos) ? 0
+			: Key::encode(boost::tuples::get<Pos>(key_of.tuple(entries[i])));
+		    keys[i] = k;
+		    for(unsigned b = 0; b < Key::bytes; ++b) {
+			++counts[b][(k >> (8 * b)) & 0xFF];
+		    }
+		}
+		for(unsigned b = 0; b < Key::bytes; ++b) {
+		    if (counts[b][(keys[0] >> (8 * b)) & 0xFF] == n) {
+			continue; // every entry has the same byte
+		    }
+		    size_t offset = 0;
+		    for(unsigned j = 0; j < 256; ++j) {
+			size_t c = counts[b][j];
+			counts[b][j] = offset;
+			offset += c;
+		    }
+		    for(size_t i = 0; i < n; ++i) {
+			size_t to = counts[b][(keys[i] >> (8 * b)) & 0xFF]++;
+			tmp[to] = entries[i];
+			tmp_keys[to] = keys[i];
+		    }
+		    entries.swap(tmp);
+		    keys.swap(tmp_keys);
+		}
+		if (KeyOf::has_any) {
+		    anyPass(Pos);
+		}
+		sortFrom(boost::mpl::int_<Pos - 1>());
+	    }
+
+	    void sortFrom(boost::mpl::int_<-1>) { }
+
+	    /// stably move the entries that are any at pos after the rest
+	    void anyPass(int pos) {
+		size_t nvalue = 0;
+		for(size_t i = 0; i < entries.size(); ++i) {
+		    if (!key_of.any(entries[i], pos)) {
+			++nvalue;
+		    }
+		}
+		if (nvalue == 0 || nvalue == entries.size()) {
+		    return;
+		}
+		size_t value_to = 0, any_to = nvalue;
+		for(size_t i = 0; i < entries.size(); ++i) {
+		    if (key_of.any(entries[i], pos)) {
+			tmp[any_to++] = entries[i];
+		    } else {
+			tmp[value_to++] = entries[i];
+		    }
+		}
+		entries.swap(tmp);
+	    }
+
+	    std::vector<Entry> &entries;
+	    const KeyOf &key_of;
+	    std::vector<Entry> tmp;
+	    std::vector<uint64_t> keys, tmp_keys;
+	};
+    }
+    /// \endcond
+
+    /// Sort entries by a tuple key with an LSD radix sort.  KeyOf
+    /// needs a TupleType typedef, a static bool has_any, and const
+    /// functions tuple(const Entry &) returning the key and
+    /// any(const Entry &, int pos) saying if position pos is "any",
+    /// which sorts after every value.  The result is the same as
+    /// std::stable_sort with the lexicographic tuple comparison,
+    /// except that keys containing NaN go to the ends of the order
+    /// where std::stable_sort's result would be unspecified.  The
+    /// temporary space is a copy of entries plus 16 bytes per entry.
+    template<class Entry, class KeyOf>
+    void radixSortTuples(std::vector<Entry> &entries, const KeyOf &key_of) {
+	detail::TupleRadixSorter<Entry, KeyOf> sorter(entries, key_of);
+	sorter.sort();
+    }
+}
+
+#endif
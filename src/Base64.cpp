@@ -0,0 +1,509 @@
+/* -*-C++-*-
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Implementation of the Base64 codec
+*/
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/Base64.hpp>
+#include <Lintel/ByteBuffer.hpp>
+
+// As in SimdSubstringSearch, the SIMD versions are compiled with
+// target attributes and only used if the CPU supports them.  Encoding
+// spreads each 3 bytes over 4 bytes with pshufb and moves the 6 bit
+// fields into place with two multiplies; decoding merges the fields
+// back with pmaddubsw/pmaddwd and compacts them with pshufb.  Each
+// alphabet is a few runs of consecutive characters, so the
+// translation between 6 bit values and characters is a compare and
+// add per run rather than a table lookup.
+
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__)) \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#    define LINTEL_BASE64_SIMD 1
+#    include <immintrin.h>
+#endif
+
+namespace lintel {
+    namespace {
+	struct AlphabetInfo {
+	    const char *chars;
+	    const uint8_t *decode; // 0xFF for characters not in the alphabet
+	    unsigned nruns;
+	    uint8_t run_start[5]; // value of the first character of each run
+	    
+	    unsigned runLength(unsigned run) const {
+		return (run + 1 < nruns ? run_start[run + 1] : 64) - run_start[run];
+	    }
+
+	    /// character minus value for the characters in run
+	    int8_t runOffset(unsigned run) const {
+		return static_cast<int8_t>(chars[run_start[run]] - run_start[run]);
+	    }
+	};
+
+	const uint8_t standard_decode[256] = {
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255, 255, 255,  63,
+	     52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255, 255, 255, 255,
+	    255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+	     15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255, 255,
+	    255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+	     41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255
+	};
+
+	const uint8_t url_safe_decode[256] = {
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255, 255,
+	     52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255, 255, 255, 255,
+	    255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+	     15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255,  63,
+	    255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+	     41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255
+	};
+
+	const uint8_t asciibetical_decode[256] = {
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,   0,   1, 255, 255, 255,
+	      2,   3,   4,   5,   6,   7,   8,   9,  10,  11, 255, 255, 255, 255, 255, 255,
+	    255,  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,
+	     27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37, 255, 255, 255, 255, 255,
+	    255,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,  52,
+	     53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255
+	};
+
+	// indexed by Base64::Alphabet
+	const AlphabetInfo alphabets[] = {
+	    { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/",
+	      standard_decode, 5, { 0, 26, 52, 62, 63 } },
+	    { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_",
+	      url_safe_decode, 5, { 0, 26, 52, 62, 63 } },
+	    { "+,0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz",
+	      asciibetical_decode, 5, { 0, 1, 2, 12, 38 } }
+	};
+
+	/// start of room for amt more bytes at the end of out, growing
+	/// it geometrically
+	uint8_t *writeRoom(ByteBuffer &out, size_t amt) {
+	    if (out.writeAvailable() < amt) {
+		out.resizeBuffer(std::max(2 * out.bufferSize(), out.readAvailable() + amt));
+	    }
+	    return out.writeStart(0);
+	}
+
+#if LINTEL_BASE64_SIMD
+	// Both return the number of input bytes converted, a multiple
+	// of 12 or 24, having written 4 characters per 3 bytes.
+
+	__attribute__((target("ssse3")))
+	size_t encodeSSSE3(const AlphabetInfo &a, const uint8_t *in, size_t size, char *out) {
+	    __m128i thresholds[5], deltas[5];
+	    for(unsigned k = 1; k < a.nruns; ++k) {
+		thresholds[k] = _mm_set1_epi8(a.run_start[k] - 1);
+		deltas[k] = _mm_set1_epi8(a.runOffset(k) - a.runOffset(k - 1));
+	    }
+	    const __m128i offset0 = _mm_set1_epi8(a.runOffset(0));
+	    const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+
+	    size_t i = 0;
+	    for(; i + 16 <= size; i += 12) {
+		__m128i v = _mm_shuffle_epi8
+		    (_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)), spread);
+		// each 32 bit lane holds bytes b1 b0 b2 b1; move the four 6
+		// bit fields to the low bits of the four bytes
+		__m128i t0 = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0FC0FC00)),
+					     _mm_set1_epi32(0x04000040));
+		__m128i t1 = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003F03F0)),
+					     _mm_set1_epi32(0x01000010));
+		__m128i values = _mm_or_si128(t0, t1);
+		__m128i chars = _mm_add_epi8(values, offset0);
+		for(unsigned k = 1; k < a.nruns; ++k) {
+		    chars = _mm_add_epi8(chars, _mm_and_si128(_mm_cmpgt_epi8(values, thresholds[k]),
+							      deltas[k]));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i / 3 * 4), chars);
+	    }
+	    return i;
+	}
+
+	__attribute__((target("avx2")))
+	size_t encodeAVX2(const AlphabetInfo &a, const uint8_t *in, size_t size, char *out) {
+	    __m256i thresholds[5], deltas[5];
+	    for(unsigned k = 1; k < a.nruns; ++k) {
+		thresholds[k] = _mm256_set1_epi8(a.run_start[k] - 1);
+		deltas[k] = _mm256_set1_epi8(a.runOffset(k) - a.runOffset(k - 1));
+	    }
+	    const __m256i offset0 = _mm256_set1_epi8(a.runOffset(0));
+	    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+						    1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+
+	    size_t i = 0;
+	    for(; i + 28 <= size; i += 24) {
+		__m256i v = _mm256_inserti128_si256
+		    (_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i))),
+		     _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i + 12)), 1);
+		v = _mm256_shuffle_epi8(v, spread);
+		__m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00)),
+						_mm256_set1_epi32(0x04000040));
+		__m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0)),
+						_mm256_set1_epi32(0x01000010));
+		__m256i values = _mm256_or_si256(t0, t1);
+		__m256i chars = _mm256_add_epi8(values, offset0);
+		for(unsigned k = 1; k < a.nruns; ++k) {
+		    chars = _mm256_add_epi8(chars, _mm256_and_si256
+					    (_mm256_cmpgt_epi8(values, thresholds[k]), deltas[k]));
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i / 3 * 4), chars);
+	    }
+	    return i;
+	}
+
+	// Both return the number of characters decoded, a multiple of
+	// 16 or 32, stopping early at a block with an invalid
+	// character.  Each block stores 4 or 8 bytes past its output,
+	// which the following characters overwrite, so they stop with
+	// at least 8 or 16 characters left.
+
+	__attribute__((target("ssse3")))
+	size_t decodeSSSE3(const AlphabetInfo &a, const char *in, size_t len, uint8_t *out) {
+	    __m128i firsts[5], limits[5], starts[5];
+	    for(unsigned k = 0; k < a.nruns; ++k) {
+		firsts[k] = _mm_set1_epi8(a.chars[a.run_start[k]]);
+		limits[k] = _mm_set1_epi8(a.runLength(k) - 1);
+		starts[k] = _mm_set1_epi8(a.run_start[k]);
+	    }
+	    const __m128i compact = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+						  -1, -1, -1, -1);
+
+	    size_t i = 0;
+	    for(; i + 24 <= len; i += 16) {
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		__m128i values = _mm_setzero_si128(), valid = _mm_setzero_si128();
+		for(unsigned k = 0; k < a.nruns; ++k) {
+		    __m128i offset = _mm_sub_epi8(c, firsts[k]);
+		    __m128i in_run = _mm_cmpeq_epi8(_mm_min_epu8(offset, limits[k]), offset);
+		    values = _mm_or_si128(values, _mm_and_si128(in_run, _mm_add_epi8(offset, starts[k])));
+		    valid = _mm_or_si128(valid, in_run);
+		}
+		if (_mm_movemask_epi8(valid) != 0xFFFF) {
+		    break;
+		}
+		__m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i / 4 * 3),
+				 _mm_shuffle_epi8(merged, compact));
+	    }
+	    return i;
+	}
+
+	__attribute__((target("avx2")))
+	size_t decodeAVX2(const AlphabetInfo &a, const char *in, size_t len, uint8_t *out) {
+	    __m256i firsts[5], limits[5], starts[5];
+	    for(unsigned k = 0; k < a.nruns; ++k) {
+		firsts[k] = _mm256_set1_epi8(a.chars[a.run_start[k]]);
+		limits[k] = _mm256_set1_epi8(a.runLength(k) - 1);
+		starts[k] = _mm256_set1_epi8(a.run_start[k]);
+	    }
+	    const __m256i compact = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+						     -1, -1, -1, -1,
+						     2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+						     -1, -1, -1, -1);
+	    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+	    size_t i = 0;
+	    for(; i + 48 <= len; i += 32) {
+		__m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+		__m256i values = _mm256_setzero_si256(), valid = _mm256_setzero_si256();
+		for(unsigned k = 0; k < a.nruns; ++k) {
+		    __m256i offset = _mm256_sub_epi8(c, firsts[k]);
+		    __m256i in_run = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, limits[k]), offset);
+		    values = _mm256_or_si256(values, _mm256_and_si256
+					     (in_run, _mm256_add_epi8(offset, starts[k])));
+		    valid = _mm256_or_si256(valid, in_run);
+		}
+		if (static_cast<uint32_t>(_mm256_movemask_epi8(valid)) != 0xFFFFFFFFU) {
+		    break;
+		}
+		__m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+		merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+		merged = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(merged, compact), lanes);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i / 4 * 3), merged);
+	    }
+	    return i;
+	}
+#endif
+    }
+
+    Base64::Base64(Alphabet alphabet, Strategy strategy)
+	: which(alphabet), pad(alphabet == Standard), chosen(Auto)
+    {
+	init(strategy);
+    }
+
+    Base64::Base64(Alphabet alphabet, bool pad, Strategy strategy)
+	: which(alphabet), pad(pad), chosen(Auto)
+    {
+	init(strategy);
+    }
+
+    void Base64::init(Strategy strategy) {
+	INVARIANT(which == Standard || which == URLSafe || which == ASCIIbetical,
+		  boost::format("invalid Base64 alphabet %d") % which);
+	if (strategy == Auto) {
+	    if (strategyAvailable(AVX2)) {
+		strategy = AVX2;
+	    } else if (strategyAvailable(SSSE3)) {
+		strategy = SSSE3;
+	    } else {
+		strategy = Scalar;
+	    }
+	}
+	INVARIANT(strategyAvailable(strategy),
+		  boost::format("Base64 strategy %s is not available") % strategyName(strategy));
+	chosen = strategy;
+    }
+
+    size_t Base64::encode(const void *data, size_t size, char *out) const {
+	const AlphabetInfo &a = alphabets[which];
+	const uint8_t *in = static_cast<const uint8_t *>(data);
+	size_t i = 0;
+#if LINTEL_BASE64_SIMD
+	if (chosen == AVX2) {
+	    i = encodeAVX2(a, in, size, out);
+	} else if (chosen == SSSE3) {
+	    i = encodeSSSE3(a, in, size, out);
+	}
+#endif
+	char *o = out + i / 3 * 4;
+	for(; i + 3 <= size; i += 3) {
+	    uint32_t v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+	    o[0] = a.chars[v >> 18];
+	    o[1] = a.chars[(v >> 12) & 0x3F];
+	    o[2] = a.chars[(v >> 6) & 0x3F];
+	    o[3] = a.chars[v & 0x3F];
+	    o += 4;
+	}
+	if (i + 1 == size) {
+	    *o++ = a.chars[in[i] >> 2];
+	    *o++ = a.chars[(in[i] & 0x3) << 4];
+	    if (pad) {
+		*o++ = '=';
+		*o++ = '=';
+	    }
+	} else if (i + 2 == size) {
+	    *o++ = a.chars[in[i] >> 2];
+	    *o++ = a.chars[((in[i] & 0x3) << 4) | (in[i + 1] >> 4)];
+	    *o++ = a.chars[(in[i + 1] & 0xF) << 2];
+	    if (pad) {
+		*o++ = '=';
+	    }
+	}
+	return o - out;
+    }
+
+    std::string Base64::encode(const void *data, size_t size) const {
+	std::string ret(encodedLength(size), '\0');
+	if (!ret.empty()) {
+	    encode(data, size, &ret[0]);
+	}
+	return ret;
+    }
+
+    void Base64::encode(const void *data, size_t size, ByteBuffer &out) const {
+	size_t len = encodedLength(size);
+	encode(data, size, reinterpret_cast<char *>(writeRoom(out, len)));
+	out.extend(len);
+    }
+
+    bool Base64::decodeImpl(const char *in, size_t len, uint8_t *out, size_t &out_len,
+			    bool allow_padding) const {
+	const AlphabetInfo &a = alphabets[which];
+	if (allow_padding && len > 0 && len % 4 == 0 && in[len - 1] == '=') {
+	    len -= in[len - 2] == '=' ? 2 : 1;
+	}
+	if (len % 4 == 1) {
+	    return false;
+	}
+
+	size_t i = 0;
+#if LINTEL_BASE64_SIMD
+	if (chosen == AVX2) {
+	    i = decodeAVX2(a, in, len, out);
+	} else if (chosen == SSSE3) {
+	    i = decodeSSSE3(a, in, len, out);
+	}
+#endif
+	uint8_t *o = out + i / 4 * 3;
+	const uint8_t *d = a.decode;
+	for(; i + 4 <= len; i += 4) {
+	    uint32_t c0 = d[static_cast<uint8_t>(in[i])], c1 = d[static_cast<uint8_t>(in[i + 1])];
+	    uint32_t c2 = d[static_cast<uint8_t>(in[i + 2])], c3 = d[static_cast<uint8_t>(in[i + 3])];
+	    if ((c0 | c1 | c2 | c3) > 63) {
+		return false;
+	    }
+	    uint32_t v = (c0 << 18) | (c1 << 12) | (c2 << 6) | c3;
+	    o[0] = v >> 16;
+	    o[1] = (v >> 8) & 0xFF;
+	    o[2] = v & 0xFF;
+	    o += 3;
+	}
+	if (i + 2 <= len) { // 2 or 3 characters left
+	    uint32_t c0 = d[static_cast<uint8_t>(in[i])], c1 = d[static_cast<uint8_t>(in[i + 1])];
+	    uint32_t c2 = i + 3 == len ? d[static_cast<uint8_t>(in[i + 2])] : 0;
+	    if ((c0 | c1 | c2) > 63) {
+		return false;
+	    }
+	    *o++ = (c0 << 2) | (c1 >> 4);
+	    if (i + 3 == len) {
+		*o++ = ((c1 & 0xF) << 4) | (c2 >> 2);
+	    }
+	}
+	out_len = o - out;
+	return true;
+    }
+
+    bool Base64::decode(const char *in, size_t len, void *out, size_t &out_len) const {
+	return decodeImpl(in, len, static_cast<uint8_t *>(out), out_len, true);
+    }
+
+    bool Base64::decode(const char *in, size_t len, std::string &out) const {
+	out.resize(maxDecodedLength(len));
+	size_t out_len = 0;
+	bool ok = decodeImpl(in, len, reinterpret_cast<uint8_t *>(&out[0]), out_len, true);
+	out.resize(out_len);
+	return ok;
+    }
+
+    bool Base64::decode(const char *in, size_t len, ByteBuffer &out) const {
+	size_t out_len = 0;
+	bool ok = decodeImpl(in, len, writeRoom(out, maxDecodedLength(len)), out_len, true);
+	out.extend(out_len);
+	return ok;
+    }
+
+    void Base64::Encoder::update(const void *data_v, size_t size, ByteBuffer &out) {
+	const uint8_t *data = static_cast<const uint8_t *>(data_v);
+	if (npending > 0) {
+	    for(; npending < 3 && size > 0; --size) {
+		pending[npending++] = *data++;
+	    }
+	    if (npending < 3) {
+		return;
+	    }
+	    codec.encode(pending, 3, out);
+	    npending = 0;
+	}
+	size_t whole = size - size % 3;
+	codec.encode(data, whole, out);
+	npending = size - whole;
+	memcpy(pending, data + whole, npending);
+    }
+
+    void Base64::Encoder::finish(ByteBuffer &out) {
+	codec.encode(pending, npending, out);
+	npending = 0;
+    }
+
+    // The last 1-4 characters are always held back, since they may be
+    // the padded end of the stream.
+    bool Base64::Decoder::update(const char *data, size_t len, ByteBuffer &out) {
+	for(; npending < 4 && len > 0; --len) {
+	    pending[npending++] = *data++;
+	}
+	if (len == 0) {
+	    return true;
+	}
+	size_t out_len = 0;
+	if (!codec.decodeImpl(pending, 4, writeRoom(out, 3), out_len, false)) {
+	    return false;
+	}
+	out.extend(out_len);
+	size_t keep = len % 4 == 0 ? 4 : len % 4;
+	size_t body = len - keep;
+	bool ok = codec.decodeImpl(data, body, writeRoom(out, maxDecodedLength(body)),
+				   out_len, false);
+	if (!ok) {
+	    return false;
+	}
+	out.extend(out_len);
+	memcpy(pending, data + body, keep);
+	npending = keep;
+	return true;
+    }
+
+    bool Base64::Decoder::finish(ByteBuffer &out) {
+	size_t out_len = 0;
+	bool ok = codec.decodeImpl(pending, npending, writeRoom(out, 3), out_len, true);
+	npending = 0;
+	if (ok) {
+	    out.extend(out_len);
+	}
+	return ok;
+    }
+
+    bool Base64::strategyAvailable(Strategy strategy) {
+	switch (strategy)
+	    {
+	    case Auto: case Scalar:
+		return true;
+	    case SSSE3:
+#if LINTEL_BASE64_SIMD
+		return __builtin_cpu_supports("ssse3");
+#else
+		return false;
+#endif
+	    case AVX2:
+#if LINTEL_BASE64_SIMD
+		return __builtin_cpu_supports("avx2");
+#else
+		return false;
+#endif
+	    }
+	return false;
+    }
+
+    const char *Base64::strategyName(Strategy strategy) {
+	switch (strategy)
+	    {
+	    case Auto: return "auto";
+	    case Scalar: return "scalar";
+	    case SSSE3: return "ssse3";
+	    case AVX2: return "avx2";
+	    }
+	return "unknown";
+    }
+}
@@ -0,0 +1,259 @@
+/* -*-C++-*-
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Implementation of ByteBufferChain
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include <algorithm>
+
+#include <Lintel/ByteBufferChain.hpp>
+
+namespace lintel {
+    const size_t ByteBufferChain::max_iov;
+
+    ByteBufferChain::ByteBufferChain(size_t block_size)
+	: front_offset(0), available(0), block_size(block_size), tail_owned(false),
+	  in_pipe(0) {
+	INVARIANT(block_size > 0, "ByteBufferChain: block_size must be positive");
+	pipe_fds[0] = pipe_fds[1] = -1;
+    }
+
+    ByteBufferChain::~ByteBufferChain() {
+	if (pipe_fds[0] >= 0) {
+	    ::close(pipe_fds[0]);
+	    ::close(pipe_fds[1]);
+	}
+    }
+
+    void ByteBufferChain::append(const ByteBuffer &buf) {
+	if (buf.empty()) {
+	    return;
+	}
+	buffers.push_back(buf);
+	available += buf.readAvailable();
+	tail_owned = false;
+    }
+
+    void ByteBufferChain::append(const void *data, size_t size) {
+	const uint8_t *from = static_cast<const uint8_t *>(data);
+	while (size > 0) {
+	    if (!tail_owned || buffers.back().writeAvailable() == 0) {
+		buffers.push_back(newBlock());
+		tail_owned = true;
+	    }
+	    size_t amt = std::min(size, buffers.back().writeAvailable());
+	    memcpy(buffers.back().writeStart(amt), from, amt);
+	    from += amt;
+	    size -= amt;
+	    available += amt;
+	}
+    }
+
+    void ByteBufferChain::consume(size_t amt) {
+	INVARIANT(amt <= available, boost::format("ByteBufferChain: can't consume %d of %d bytes")
+		  % amt % available);
+	available -= amt;
+	while (amt > 0) {
+	    size_t in_front = buffers.front().readAvailable() - front_offset;
+	    if (amt < in_front) {
+		front_offset += amt;
+		return;
+	    }
+	    amt -= in_front;
+	    buffers.pop_front();
+	    front_offset = 0;
+	}
+	if (buffers.empty()) {
+	    tail_owned = false;
+	}
+    }
+
+    void ByteBufferChain::clear() {
+	buffers.clear();
+	front_offset = available = 0;
+	tail_owned = false;
+    }
+
+    size_t ByteBufferChain::gather(struct iovec *iov, size_t max_iov, size_t max_bytes) const {
+	size_t n = 0, offset = front_offset;
+	for(std::deque<ByteBuffer>::const_iterator i = buffers.begin();
+	    i != buffers.end() && n < max_iov && max_bytes > 0; ++i) {
+	    size_t len = std::min(i->readAvailable() - offset, max_bytes);
+	    iov[n].iov_base = const_cast<uint8_t *>(i->readStart() + offset);
+	    iov[n].iov_len = len;
+	    max_bytes -= len;
+	    offset = 0;
+	    ++n;
+	}
+	return n;
+    }
+
+    std::string ByteBufferChain::asString() const {
+	std::string ret;
+	ret.reserve(available);
+	size_t offset = front_offset;
+	for(std::deque<ByteBuffer>::const_iterator i = buffers.begin(); i != buffers.end(); ++i) {
+	    ret.append(i->readStartAs<char>() + offset, i->readAvailable() - offset);
+	    offset = 0;
+	}
+	return ret;
+    }
+
+    ByteBuffer ByteBufferChain::newBlock() {
+	// copy on write in case the caller keeps a copy of a buffer that
+	// is still being filled
+	ByteBuffer ret(true);
+	ret.resizeBuffer(block_size);
+	return ret;
+    }
+
+    ssize_t ByteBufferChain::readFrom(int fd, size_t max_bytes) {
+	// readv(2) of nothing returns 0, which would look like end of file
+	INVARIANT(max_bytes > 0, "ByteBufferChain: readFrom of 0 bytes");
+	struct iovec iov[max_iov];
+	size_t n = 0, room = 0;
+	bool into_tail = tail_owned && buffers.back().writeAvailable() > 0;
+	if (into_tail) {
+	    ByteBuffer &tail = buffers.back();
+	    iov[0].iov_base = tail.writeStart(0);
+	    iov[0].iov_len = std::min(tail.writeAvailable(), max_bytes);
+	    room = iov[0].iov_len;
+	    n = 1;
+	}
+	size_t nspare = 0;
+	for(; room < max_bytes && n < max_iov; ++n, ++nspare) {
+	    if (nspare == spare.size()) {
+		spare.push_back(newBlock());
+	    }
+	    iov[n].iov_base = spare[nspare].writeStart(0);
+	    iov[n].iov_len = std::min(block_size, max_bytes - room);
+	    room += iov[n].iov_len;
+	}
+
+	ssize_t got = ::readv(fd, iov, n);
+	if (got <= 0) {
+	    return got;
+	}
+	available += got;
+	size_t left = got, i = 0;
+	if (into_tail) {
+	    size_t amt = std::min(left, iov[0].iov_len);
+	    buffers.back().extend(amt);
+	    left -= amt;
+	    i = 1;
+	}
+	size_t used = 0;
+	for(; left > 0; ++i, ++used) {
+	    size_t amt = std::min(left, iov[i].iov_len);
+	    spare[used].extend(amt);
+	    buffers.push_back(spare[used]);
+	    left -= amt;
+	}
+	if (used > 0) {
+	    spare.erase(spare.begin(), spare.begin() + used);
+	    tail_owned = true;
+	}
+	return got;
+    }
+
+    ssize_t ByteBufferChain::writeTo(int fd) {
+	struct iovec iov[max_iov];
+	size_t n = gather(iov, max_iov, available);
+	if (n == 0) {
+	    return 0;
+	}
+	ssize_t wrote = ::writev(fd, iov, n);
+	if (wrote > 0) {
+	    consume(wrote);
+	}
+	return wrote;
+    }
+
+    ssize_t ByteBufferChain::forward(int in_fd, int out_fd, size_t max_bytes) {
+	INVARIANT(max_bytes > 0, "ByteBufferChain: forward of 0 bytes");
+	if (!empty()) {
+	    return writeTo(out_fd);
+	}
+#ifdef __linux__
+	if (in_pipe > 0) {
+	    return drainPipe(out_fd);
+	}
+	struct stat in_stat;
+	if (fstat(in_fd, &in_stat) == 0 && S_ISREG(in_stat.st_mode)) {
+	    ssize_t ret = ::sendfile(out_fd, in_fd, NULL, max_bytes);
+	    if (ret >= 0 || (errno != EINVAL && errno != ENOSYS)) {
+		return ret;
+	    }
+	}
+	ssize_t ret = forwardSplice(in_fd, out_fd, max_bytes);
+	if (ret >= 0 || (errno != EINVAL && errno != ENOSYS)) {
+	    return ret;
+	}
+#endif
+	return forwardCopy(in_fd, out_fd, max_bytes);
+    }
+
+    ssize_t ByteBufferChain::forwardCopy(int in_fd, int out_fd, size_t max_bytes) {
+	ssize_t got = readFrom(in_fd, max_bytes);
+	if (got <= 0) {
+	    return got;
+	}
+	return writeTo(out_fd);
+    }
+
+#ifdef __linux__
+    ssize_t ByteBufferChain::forwardSplice(int in_fd, int out_fd, size_t max_bytes) {
+	if (pipe_fds[0] < 0) {
+	    // non-blocking so a splice into a full pipe can't hang; the
+	    // descriptors at either end keep their own blocking mode
+	    INVARIANT(pipe2(pipe_fds, O_NONBLOCK | O_CLOEXEC) == 0,
+		      boost::format("ByteBufferChain: pipe2 failed: %s") % strerror(errno));
+	}
+	ssize_t got = ::splice(in_fd, NULL, pipe_fds[1], NULL, max_bytes, SPLICE_F_MOVE);
+	if (got <= 0) {
+	    return got;
+	}
+	in_pipe = got;
+	return drainPipe(out_fd);
+    }
+
+    ssize_t ByteBufferChain::drainPipe(int out_fd) {
+	ssize_t wrote = ::splice(pipe_fds[0], NULL, out_fd, NULL, in_pipe, SPLICE_F_MOVE);
+	if (wrote > 0) {
+	    in_pipe -= wrote;
+	} else if (wrote < 0 && errno == EINVAL) {
+	    // out_fd can't be spliced to; copy out of the pipe instead
+	    while (in_pipe > 0) {
+		ssize_t got = readFrom(pipe_fds[0], in_pipe);
+		SINVARIANT(got > 0);
+		in_pipe -= got;
+	    }
+	    return writeTo(out_fd);
+	}
+	return wrote;
+    }
+#else
+    ssize_t ByteBufferChain::forwardSplice(int, int, size_t) {
+	errno = ENOSYS;
+	return -1;
+    }
+
+    ssize_t ByteBufferChain::drainPipe(int) {
+	errno = ENOSYS;
+	return -1;
+    }
+#endif
+}
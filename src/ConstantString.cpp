@@ -8,122 +8,222 @@
     Constant String implementation
 */
 
-// TODO: write a regression test; make sure to test strings that are C
-// strings and binary data that includes nulls; previous version of
-// code collided strings that were identical up to the first null.
-
-// TODO: switch this whole thing to having a ConstantStringPool
-// argument also.
-
 #include <iostream>
 #include <cstring>
 #include <cstdlib>
+
 #include <Lintel/AssertBoost.hpp>
+#include <Lintel/AtomicCounter.hpp>
 #include <Lintel/ConstantString.hpp>
+#include <Lintel/InternTable.hpp>
 
 using namespace std;
 using boost::format;
 
-int ConstantString::nstrings = 0;
-int ConstantString::string_bytes = 0;
-ConstantString::bufvect *ConstantString::buffers;
-ConstantString::CS_hashtable *ConstantString::hashtable;
-ConstantStringValue *ConstantString::empty_string_myptr;
+namespace {
+    const size_t buffer_size = 512*1024;
+    // larger strings get a buffer of their own rather than wasting the end of the shard's
+    const size_t max_shared_space = buffer_size / 64;
+    const uint32_t initial_table_size = 64;
 
-static char *init_buffer;
-static uint32_t init_buffer_len;
-static const bool enable_constant_folding = true;
+    // the string's length precedes it, and the string is followed by a null and padding so
+    // that the next length is aligned
+    size_t spaceFor(uint32_t slen) {
+	return sizeof(uint32_t) + ((slen + 1 + 3) & ~static_cast<size_t>(3));
+    }
+}
 
-void
-ConstantString::init(const void *s, uint32_t slen)
-{
-    if (buffers == NULL) {
-	buffers = new bufvect;
-	hashtable = new CS_hashtable;
+namespace {
+    struct PoolSlot {
+	uint32_t hash;
+	ConstantStringValue *value; // NULL if empty; set after hash and the string
+    };
+
+    struct PoolSlotTraits {
+	typedef PoolSlot Slot;
+
+	static bool empty(const PoolSlot &slot) {
+	    return lintel::unsafe::atomic_load(&slot.value) == NULL;
+	}
+	uint32_t hash(const PoolSlot &slot) const {
+	    return slot.hash;
+	}
+	static void publish(PoolSlot &to, const PoolSlot &from) {
+	    to.hash = from.hash;
+	    lintel::unsafe::atomic_store(&to.value, from.value);
+	}
+    };
+
+    struct PoolMatch {
+	PoolMatch(uint32_t hash, const void *s, uint32_t slen) : hash(hash), s(s), slen(slen) { }
+
+	bool operator()(const PoolSlot &slot) const {
+	    return slot.hash == hash && ConstantString_length(slot.value) == slen
+		&& memcmp(ConstantString_c_str(slot.value), s, slen) == 0;
+	}
+
+	uint32_t hash;
+	const void *s;
+	uint32_t slen;
+    };
+}
+
+struct ConstantStringPool::Shard {
+    Shard() : table(PoolSlotTraits(), initial_table_size), cur(NULL), remaining(0),
+	      nstrings(0), string_bytes(0), bytes_allocated(0) { }
+
+    ~Shard() {
+	for(size_t i = 0; i < buffers.size(); ++i) {
+	    delete [] buffers[i];
+	}
     }
-    if (slen == 0 && empty_string_myptr != NULL) {
-	myptr = empty_string_myptr;
-	return;
+
+    ConstantStringValue *find(uint32_t hash, const void *s, uint32_t slen) const {
+	const PoolSlot *slot = table.find(hash, PoolMatch(hash, s, slen));
+	return slot == NULL ? NULL : slot->value;
     }
-    if (enable_constant_folding) {
-	// TODO: update the hashtable code so that we can specify a
-	// key that is not in the stored data format; there was some
-	// other case where this would be useful, probably in
-	// accessing variable32 data in dataseries and wanting to do a
-	// lookup based on that without having to convert to a string
-	// first.
-	if (init_buffer_len < 5 + slen) {
-	    delete [] init_buffer;
-	    init_buffer = new char[5 + slen];
-	    init_buffer_len = 5 + slen;
+
+    char *allocate(size_t space) {
+	if (space > max_shared_space) {
+	    char *ret = new char[space];
+	    buffers.push_back(ret);
+	    bytes_allocated += space;
+	    return ret;
 	}
-	*reinterpret_cast<uint32_t *>(init_buffer) = slen;
-	memcpy(init_buffer + 4, s, slen);
-	init_buffer[4+slen] = '\0';
-	
-	ConstantStringValue *tmp = reinterpret_cast<ConstantStringValue *>(init_buffer + 4);
-	ConstantStringValue **ptr = hashtable->lookup(tmp);
-	if (ptr != NULL) {
-	    myptr = *ptr;
-	    return;
+	if (remaining < space) {
+	    cur = new char[buffer_size];
+	    remaining = buffer_size;
+	    buffers.push_back(cur);
+	    bytes_allocated += buffer_size;
 	}
+	char *ret = cur;
+	cur += space;
+	remaining -= space;
+	return ret;
     }
-    slen += 1; // "null at end of string"
-    ++nstrings;
-    string_bytes += slen;
-    int space_used = slen + ((4 - (slen % 4))%4) + sizeof(uint32_t);
-    slen -= 1;
-
-    for(unsigned int i = 0;i<buffers->size();i++) {
-	if (((*buffers)[i].size - (*buffers)[i].amt_used) >= space_used) {
-	    char *ptr = reinterpret_cast<char *>((*buffers)[i].data);
-	    ptr += (*buffers)[i].amt_used;
-	    *reinterpret_cast<uint32_t *>(ptr) = slen;
-	    ptr += 4;
-	    memcpy(ptr,s,slen);
-	    ptr[slen] = '\0';
-	    (*buffers)[i].amt_used += space_used;
-	    myptr = reinterpret_cast<ConstantStringValue *>(ptr);
-
-	    if (slen == 0) {
-		empty_string_myptr = myptr;
-	    }
-	    if (enable_constant_folding) {
-		SINVARIANT(c_str() == reinterpret_cast<const char *>(myptr));
-		hashtable->add(myptr);
-	    }
-	    return;
-	}
+
+    lintel::detail::InternTable<PoolSlotTraits> table; // holds the shard's lock
+    char *cur;
+    size_t remaining;
+    size_t nstrings, string_bytes, bytes_allocated;
+    vector<char *> buffers;
+    // keep each shard's lock on its own cache line
+    char padding[64];
+};
+
+ConstantStringPool::ConstantStringPool(uint32_t nshards)
+    : shards(NULL), shard_mask(0), empty_string(NULL)
+{
+    INVARIANT(nshards > 0 && nshards <= 256,
+	      format("ConstantStringPool: %d shards is not in [1..256]") % nshards);
+    uint32_t n = 1;
+    while (n < nshards) {
+	n *= 2;
     }
-    INVARIANT(space_used < buffer_size / 64,
-	      "Reduce possible badness by limiting max string size");
-
-    buffer new_buffer;
-    new_buffer.data = reinterpret_cast<ConstantStringValue *>(new char[buffer_size]);
-    new_buffer.size = buffer_size;
-    new_buffer.amt_used = 0;
-    buffers->push_back(new_buffer);
-    init(s,slen); // simpler than re-writing the alloc stuff
+    shards = new Shard[n];
+    shard_mask = n - 1;
+    empty_string = intern("", 0);
 }
 
-void
-ConstantString::dumpInfo()
-{
-    if (buffers == 0) {
-	cout << "CSInfo: never used\n";
-	return;
+ConstantStringPool::~ConstantStringPool() {
+    delete [] shards;
+}
+
+// The tables are indexed by the low bits of the hash.
+inline ConstantStringPool::Shard &ConstantStringPool::shardFor(uint32_t hash) const {
+    return shards[(hash >> 24) & shard_mask];
+}
+
+ConstantStringPool &ConstantStringPool::defaultPool() {
+    // Allocated so that it survives static destructors that still hold ConstantStrings.
+    static ConstantStringPool *pool = new ConstantStringPool();
+    return *pool;
+}
+
+ConstantStringValue *ConstantStringPool::find(const void *s, uint32_t slen) const {
+    uint32_t hash = lintel::hashBytes(s, slen);
+    return shardFor(hash).find(hash, s, slen);
+}
+
+ConstantStringValue *ConstantStringPool::intern(const void *s, uint32_t slen) {
+    uint32_t hash = lintel::hashBytes(s, slen);
+    Shard &shard = shardFor(hash);
+    ConstantStringValue *ret = shard.find(hash, s, slen);
+    if (ret != NULL) {
+	return ret;
+    }
+
+    shard.table.lock();
+    ret = shard.find(hash, s, slen);
+    if (ret == NULL) {
+	char *ptr = shard.allocate(spaceFor(slen));
+	*reinterpret_cast<uint32_t *>(ptr) = slen;
+	ptr += sizeof(uint32_t);
+	memcpy(ptr, s, slen);
+	ptr[slen] = '\0';
+	ret = reinterpret_cast<ConstantStringValue *>(ptr);
+
+	PoolSlot slot = { hash, ret };
+	shard.table.insert(hash, slot);
+	++shard.nstrings;
+	shard.string_bytes += slen + 1;
+    }
+    shard.table.unlock();
+    return ret;
+}
+
+size_t ConstantStringPool::nStrings() const {
+    size_t ret = 0;
+    for(uint32_t i = 0; i <= shard_mask; ++i) {
+	shards[i].table.lock();
+	ret += shards[i].nstrings;
+	shards[i].table.unlock();
+    }
+    return ret;
+}
+
+size_t ConstantStringPool::stringBytes() const {
+    size_t ret = 0;
+    for(uint32_t i = 0; i <= shard_mask; ++i) {
+	shards[i].table.lock();
+	ret += shards[i].string_bytes;
+	shards[i].table.unlock();
     }
-    int total_data = 0;
-    int total_used = 0;
-    for(unsigned int i=0;i<buffers->size();i++) {
-	total_data += (*buffers)[i].amt_used;
-	total_used += (*buffers)[i].size;
+    return ret;
+}
+
+size_t ConstantStringPool::bytesAllocated() const {
+    size_t ret = 0;
+    for(uint32_t i = 0; i <= shard_mask; ++i) {
+	Shard &shard = shards[i];
+	shard.table.lock();
+	ret += shard.bytes_allocated + shard.table.bytes();
+	shard.table.unlock();
     }
-    cout << format("CSInfo: %d strings, bytes: %d string, %d used, %d alloced\n")
-	% nstrings % string_bytes % total_data % total_used;
-    for(unsigned int i=0;i<buffers->size();i++) {
-	cout << format("CSInfo: buffer %d, %d/%d used\n")
-	    % i % (*buffers)[i].amt_used % (*buffers)[i].size;
+    return ret;
+}
+
+void ConstantStringPool::dumpInfo(ostream &to) const {
+    to << format("CSInfo: %d strings, bytes: %d string, %d alloced, %d shards\n")
+	% nStrings() % stringBytes() % bytesAllocated() % nShards();
+    for(uint32_t i = 0; i <= shard_mask; ++i) {
+	Shard &shard = shards[i];
+	shard.table.lock();
+	to << format("CSInfo: shard %d, %d strings, %d buffers, table %d/%d used\n")
+	    % i % shard.nstrings % shard.buffers.size() % shard.table.used()
+	    % shard.table.capacity();
+	shard.table.unlock();
     }
 }
 
+void
+ConstantString::init(const void *s, uint32_t slen)
+{
+    myptr = ConstantStringPool::defaultPool().intern(s, slen);
+}
+
+void
+ConstantString::dumpInfo()
+{
+    ConstantStringPool::defaultPool().dumpInfo(cout);
+}
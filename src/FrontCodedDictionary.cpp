@@ -0,0 +1,255 @@
+/* -*-C++-*-
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Implementation of FrontCodedDictionary
+*/
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <Lintel/FrontCodedDictionary.hpp>
+
+// Lengths are stored as LEB128 style variable length integers, 7
+// bits per byte with the high bit set on all but the last byte.
+
+namespace lintel {
+    namespace {
+	void putLength(std::vector<uint8_t> &out, size_t v) {
+	    while (v >= 0x80) {
+		out.push_back(static_cast<uint8_t>(v | 0x80));
+		v >>= 7;
+	    }
+	    out.push_back(static_cast<uint8_t>(v));
+	}
+
+	size_t getLength(const uint8_t *&p) {
+	    size_t ret = *p & 0x7F;
+	    for(unsigned shift = 7; *p++ & 0x80; shift += 7) {
+		ret |= static_cast<size_t>(*p & 0x7F) << shift;
+	    }
+	    return ret;
+	}
+
+	/// memcmp order, shorter strings first on a tie
+	int compareBytes(const uint8_t *a, size_t a_size, const char *b, size_t b_size) {
+	    int ret = memcmp(a, b, std::min(a_size, b_size));
+	    if (ret != 0) {
+		return ret;
+	    }
+	    return a_size < b_size ? -1 : (a_size > b_size ? 1 : 0);
+	}
+
+	/// Decode the entry at p following prev into prev; advances p.
+	void decodeNext(const uint8_t *&p, std::string &prev) {
+	    size_t shared = getLength(p);
+	    size_t suffix = getLength(p);
+	    prev.resize(shared);
+	    prev.append(reinterpret_cast<const char *>(p), suffix);
+	    p += suffix;
+	}
+
+	void decodeHead(const uint8_t *&p, std::string &out) {
+	    size_t len = getLength(p);
+	    out.assign(reinterpret_cast<const char *>(p), len);
+	    p += len;
+	}
+    }
+
+    const uint32_t FrontCodedDictionary::npos;
+    const uint32_t FrontCodedDictionary::default_block_size;
+
+    FrontCodedDictionary::Builder::Builder(uint32_t block_size)
+	: block_size(block_size), count(0)
+    {
+	INVARIANT(block_size > 0, "FrontCodedDictionary: block size must be positive");
+    }
+
+    void FrontCodedDictionary::Builder::add(const char *str, size_t size) {
+	INVARIANT(count < npos - 1, "FrontCodedDictionary: too many strings");
+	if (count % block_size == 0) {
+	    if (count > 0) {
+		INVARIANT(compareBytes(reinterpret_cast<const uint8_t *>(last.data()), last.size(),
+				       str, size) < 0,
+			  "FrontCodedDictionary: strings must be added in increasing order");
+	    }
+	    last.clear();
+	    block_starts.push_back(data.size());
+	    putLength(data, size);
+	} else {
+	    size_t limit = std::min(last.size(), size), shared = 0;
+	    while (shared < limit && last[shared] == str[shared]) {
+		++shared;
+	    }
+	    INVARIANT(shared < size && (shared == last.size()
+					|| static_cast<uint8_t>(last[shared])
+					   < static_cast<uint8_t>(str[shared])),
+		      "FrontCodedDictionary: strings must be added in increasing order");
+	    putLength(data, shared);
+	    putLength(data, size - shared);
+	    str += shared;
+	    size -= shared;
+	    last.resize(shared);
+	}
+	data.insert(data.end(), str, str + size);
+	last.append(str, size);
+	++count;
+    }
+
+    void FrontCodedDictionary::Builder::finish(FrontCodedDictionary &dict) {
+	dict.block_size = block_size;
+	dict.count = count;
+	dict.data.swap(data);
+	dict.block_starts.swap(block_starts);
+	// don't hold on to the slack from growing the vectors
+	std::vector<uint8_t>(dict.data).swap(dict.data);
+	std::vector<uint64_t>(dict.block_starts).swap(dict.block_starts);
+
+	count = 0;
+	data.clear();
+	block_starts.clear();
+	last.clear();
+    }
+
+    FrontCodedDictionary::Iterator::Iterator(const FrontCodedDictionary &dict, uint32_t start)
+	: dict(dict), cur_id(start), pos(NULL)
+    {
+	if (cur_id < dict.count) {
+	    uint32_t block = cur_id / dict.block_size;
+	    pos = &dict.data[0] + dict.block_starts[block];
+	    decodeHead(pos, cur);
+	    for(uint32_t i = block * dict.block_size; i < cur_id; ++i) {
+		decodeNext(pos, cur);
+	    }
+	}
+    }
+
+    FrontCodedDictionary::Iterator &FrontCodedDictionary::Iterator::operator++() {
+	++cur_id;
+	if (cur_id < dict.count) {
+	    if (cur_id % dict.block_size == 0) {
+		decodeHead(pos, cur);
+	    } else {
+		decodeNext(pos, cur);
+	    }
+	}
+	return *this;
+    }
+
+    FrontCodedDictionary::FrontCodedDictionary()
+	: block_size(default_block_size), count(0)
+    { }
+
+    FrontCodedDictionary::FrontCodedDictionary(const HashUnique<std::string> &strings,
+					       uint32_t block_size)
+	: block_size(block_size), count(0)
+    {
+	std::vector<std::string> sorted;
+	sorted.reserve(strings.size());
+	for(HashUnique<std::string>::const_iterator i = strings.begin(); i != strings.end(); ++i) {
+	    sorted.push_back(*i);
+	}
+	build(sorted);
+    }
+
+    FrontCodedDictionary::FrontCodedDictionary(const std::vector<std::string> &strings,
+					       uint32_t block_size)
+	: block_size(block_size), count(0)
+    {
+	std::vector<std::string> sorted(strings);
+	build(sorted);
+    }
+
+    void FrontCodedDictionary::build(std::vector<std::string> &sorted) {
+	// std::string's operator< is memcmp order
+	std::sort(sorted.begin(), sorted.end());
+	sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+	Builder builder(block_size);
+	for(std::vector<std::string>::iterator i = sorted.begin(); i != sorted.end(); ++i) {
+	    builder.add(*i);
+	}
+	builder.finish(*this);
+    }
+
+    uint32_t FrontCodedDictionary::search(const char *key, size_t key_size, bool &exact) const {
+	exact = false;
+	if (count == 0) {
+	    return 0;
+	}
+	// last block whose first string is <= key
+	size_t lo = 0, hi = block_starts.size();
+	while (hi - lo > 1) {
+	    size_t mid = lo + (hi - lo) / 2;
+	    const uint8_t *p = &data[0] + block_starts[mid];
+	    size_t len = getLength(p);
+	    int cmp = compareBytes(p, len, key, key_size);
+	    if (cmp == 0) {
+		exact = true;
+		return mid * block_size;
+	    } else if (cmp < 0) {
+		lo = mid;
+	    } else {
+		hi = mid;
+	    }
+	}
+
+	uint32_t id = lo * block_size;
+	uint32_t block_end = std::min(count, id + block_size);
+	const uint8_t *p = &data[0] + block_starts[lo];
+	std::string cur;
+	decodeHead(p, cur);
+	while (true) {
+	    int cmp = compareBytes(reinterpret_cast<const uint8_t *>(cur.data()), cur.size(),
+				   key, key_size);
+	    if (cmp >= 0) {
+		exact = cmp == 0;
+		return id;
+	    }
+	    ++id;
+	    if (id == block_end) {
+		return id;
+	    }
+	    decodeNext(p, cur);
+	}
+    }
+
+    uint32_t FrontCodedDictionary::find(const char *str, size_t size) const {
+	bool exact;
+	uint32_t ret = search(str, size, exact);
+	return exact ? ret : npos;
+    }
+
+    void FrontCodedDictionary::prefixRange(const std::string &prefix,
+					   uint32_t &begin, uint32_t &end) const {
+	begin = lowerBound(prefix);
+	// the smallest string greater than everything starting with prefix
+	std::string after(prefix);
+	while (!after.empty() && static_cast<uint8_t>(after[after.size() - 1]) == 0xFF) {
+	    after.resize(after.size() - 1);
+	}
+	if (after.empty()) {
+	    end = count;
+	} else {
+	    after[after.size() - 1] = static_cast<char>(after[after.size() - 1] + 1);
+	    end = lowerBound(after);
+	}
+    }
+
+    void FrontCodedDictionary::getString(uint32_t id, std::string &out) const {
+	INVARIANT(id < count, boost::format("FrontCodedDictionary: invalid id %u") % id);
+	uint32_t block = id / block_size;
+	const uint8_t *p = &data[0] + block_starts[block];
+	decodeHead(p, out);
+	for(uint32_t i = block * block_size; i < id; ++i) {
+	    decodeNext(p, out);
+	}
+    }
+
+    size_t FrontCodedDictionary::memoryUsage() const {
+	return sizeof(*this) + data.capacity() + block_starts.capacity() * sizeof(uint64_t);
+    }
+}
@@ -0,0 +1,166 @@
+/* -*-C++-*-
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Construction of the MultiPatternSearch automaton
+*/
+
+#include <string.h>
+
+#include <deque>
+
+#include <Lintel/MultiPatternSearch.hpp>
+
+// See "Efficient string matching: an aid to bibliographic search," by
+// Alfred Aho and Margaret Corasick, CACM 18(6), 1975.  We build the
+// trie, then in breadth first order fill in the missing transitions
+// from each state's failure state, giving a DFA, and merge the output
+// sets along the failure links.
+
+namespace lintel {
+    namespace {
+	struct CollectMatches {
+	    explicit CollectMatches(std::vector<MultiPatternSearch::Match> &matches)
+		: matches(matches) { }
+	    void operator()(uint32_t pattern, uint64_t offset) {
+		matches.push_back(MultiPatternSearch::Match(pattern, offset));
+	    }
+	    std::vector<MultiPatternSearch::Match> &matches;
+	};
+
+	static const uint32_t no_state = 0xFFFFFFFFU;
+    }
+
+    const uint32_t MultiPatternSearch::output_flag;
+
+    MultiPatternSearch::MultiPatternSearch()
+	: nclasses(0), start_row(0), compiled(false)
+    {
+	memset(byte_class, 0, sizeof(byte_class));
+    }
+
+    uint32_t MultiPatternSearch::addPattern(const void *pattern, size_t length) {
+	INVARIANT(!compiled, "MultiPatternSearch: can't add patterns after compile()");
+	INVARIANT(length > 0, "invalid to search for zero length pattern");
+	INVARIANT(lengths.size() < 0x7FFFFFFFU, "MultiPatternSearch: too many patterns");
+	patterns.push_back(std::string(static_cast<const char *>(pattern), length));
+	lengths.push_back(length);
+	return lengths.size() - 1;
+    }
+
+    void MultiPatternSearch::compile() {
+	INVARIANT(!compiled, "MultiPatternSearch: compile() called twice");
+
+	// column 0 is for bytes that are in no pattern
+	nclasses = 1;
+	for(size_t i = 0; i < patterns.size(); ++i) {
+	    for(size_t j = 0; j < patterns[i].size(); ++j) {
+		uint8_t c = patterns[i][j];
+		if (byte_class[c] == 0) {
+		    byte_class[c] = nclasses++;
+		}
+	    }
+	}
+
+	// trie; states are numbered in creation order, 0 is the root
+	std::vector<uint32_t> trie(nclasses, no_state);
+	std::vector<std::vector<uint32_t> > state_outputs(1);
+	for(size_t i = 0; i < patterns.size(); ++i) {
+	    uint32_t state = 0;
+	    for(size_t j = 0; j < patterns[i].size(); ++j) {
+		uint32_t cls = byte_class[static_cast<uint8_t>(patterns[i][j])];
+		if (trie[state * nclasses + cls] == no_state) {
+		    uint32_t new_state = state_outputs.size();
+		    INVARIANT(static_cast<uint64_t>(new_state + 1) * nclasses < output_flag,
+			      "MultiPatternSearch: automaton too large");
+		    trie[state * nclasses + cls] = new_state;
+		    trie.resize(trie.size() + nclasses, no_state);
+		    state_outputs.resize(new_state + 1);
+		}
+		state = trie[state * nclasses + cls];
+	    }
+	    state_outputs[state].push_back(i);
+	}
+	std::vector<std::string>().swap(patterns);
+
+	// breadth first: fill in the DFA transitions and merge outputs
+	const uint32_t nstates = state_outputs.size();
+	std::vector<uint32_t> fail(nstates, 0);
+	std::deque<uint32_t> queue;
+	for(uint32_t c = 0; c < nclasses; ++c) {
+	    uint32_t &next = trie[c];
+	    if (next == no_state) {
+		next = 0;
+	    } else {
+		fail[next] = 0;
+		queue.push_back(next);
+	    }
+	}
+	while (!queue.empty()) {
+	    uint32_t state = queue.front();
+	    queue.pop_front();
+	    const std::vector<uint32_t> &fail_outputs = state_outputs[fail[state]];
+	    state_outputs[state].insert(state_outputs[state].end(),
+					fail_outputs.begin(), fail_outputs.end());
+	    for(uint32_t c = 0; c < nclasses; ++c) {
+		uint32_t &next = trie[state * nclasses + c];
+		uint32_t fail_next = trie[fail[state] * nclasses + c];
+		if (next == no_state) {
+		    next = fail_next;
+		} else {
+		    fail[next] = fail_next;
+		    queue.push_back(next);
+		}
+	    }
+	}
+
+	output_start.resize(nstates + 1);
+	for(uint32_t s = 0; s < nstates; ++s) {
+	    output_start[s] = outputs.size();
+	    outputs.insert(outputs.end(), state_outputs[s].begin(), state_outputs[s].end());
+	}
+	output_start[nstates] = outputs.size();
+
+	delta.resize(trie.size());
+	for(size_t i = 0; i < trie.size(); ++i) {
+	    uint32_t next = trie[i];
+	    delta[i] = next * nclasses | (state_outputs[next].empty() ? 0 : output_flag);
+	}
+	start_row = 0;
+	compiled = true;
+    }
+
+    size_t MultiPatternSearch::memoryUsage() const {
+	return sizeof(*this) + (delta.capacity() + output_start.capacity()
+				+ outputs.capacity() + lengths.capacity()) * sizeof(uint32_t);
+    }
+
+    void MultiPatternSearch::findAll(const void *haystack, size_t hay_len,
+				     std::vector<Match> &matches) const {
+	CollectMatches collect(matches);
+	scan(haystack, hay_len, collect);
+    }
+
+    bool MultiPatternSearch::matchesAny(const void *haystack, size_t hay_len) const {
+	INVARIANT(compiled, "MultiPatternSearch: compile() before searching");
+	const uint8_t *p = static_cast<const uint8_t *>(haystack);
+	uint32_t row = start_row;
+	for(size_t i = 0; i < hay_len; ++i) {
+	    uint32_t next = delta[row + byte_class[p[i]]];
+	    if (next & output_flag) {
+		return true;
+	    }
+	    row = next;
+	}
+	return false;
+    }
+
+    void MultiPatternSearch::Stream::scan(const void *chunk, size_t len,
+					  std::vector<Match> &matches) {
+	CollectMatches collect(matches);
+	scan(chunk, len, collect);
+    }
+}
@@ -0,0 +1,79 @@
+/* -*-C++-*-
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Per-thread shard registry for ShardedStats
+*/
+
+#include <Lintel/AtomicCounter.hpp>
+#include <Lintel/HashMap.hpp>
+#include <Lintel/ShardedStats.hpp>
+
+namespace {
+    /// Each thread keeps a map from ShardedStats id to its shard, plus
+    /// a one entry cache since most threads add to one or two
+    /// ShardedStats in a tight loop.
+    struct ThreadShards {
+	ThreadShards() : last_id(0), last_shard(NULL) { }
+	uint64_t last_id;
+	void *last_shard;
+	HashMap<uint64_t, void *> shards;
+    };
+
+    pthread_once_t key_once = PTHREAD_ONCE_INIT;
+    pthread_key_t thread_shards_key;
+    lintel::Atomic<uint64_t> next_id(0);
+
+    // Only deletes the map; the shards belong to the ShardedStats.
+    void deleteThreadShards(void *v) {
+	delete static_cast<ThreadShards *>(v);
+    }
+
+    void makeKey() {
+	INVARIANT(pthread_key_create(&thread_shards_key, deleteThreadShards) == 0,
+		  "pthread_key_create failed");
+    }
+
+    ThreadShards &threadShards() {
+	pthread_once(&key_once, makeKey);
+	ThreadShards *ret = static_cast<ThreadShards *>(pthread_getspecific(thread_shards_key));
+	if (ret == NULL) {
+	    ret = new ThreadShards;
+	    INVARIANT(pthread_setspecific(thread_shards_key, ret) == 0,
+		      "pthread_setspecific failed");
+	}
+	return *ret;
+    }
+}
+
+namespace lintel { namespace detail {
+
+uint64_t shardedStatsNewId() {
+    return ++next_id; // 0 is never used, so it can mark an empty cache
+}
+
+void *shardedStatsFindLocal(uint64_t id) {
+    ThreadShards &ts = threadShards();
+    if (ts.last_id == id) {
+	return ts.last_shard;
+    }
+    void **shard = ts.shards.lookup(id);
+    if (shard == NULL) {
+	return NULL;
+    }
+    ts.last_id = id;
+    ts.last_shard = *shard;
+    return *shard;
+}
+
+void shardedStatsSetLocal(uint64_t id, void *shard) {
+    ThreadShards &ts = threadShards();
+    ts.shards[id] = shard;
+    ts.last_id = id;
+    ts.last_shard = shard;
+}
+
+} }
@@ -0,0 +1,221 @@
+/* -*-C++-*-
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Implementation of SimdSubstringSearch
+*/
+
+#include <string.h>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/BoyerMooreHorspool.hpp>
+#include <Lintel/SimdSubstringSearch.hpp>
+
+// The SIMD versions are the "generic SIMD" algorithm described by
+// Wojciech Mula at http://0x80.pl/articles/simd-strfind.html.  SSE2
+// is always present on x86-64; the AVX2 version is compiled with a
+// target attribute so the rest of the library does not need -mavx2,
+// and is only used if the CPU says it has AVX2.
+
+#if defined(__SSE2__)
+#    define LINTEL_SIMD_SEARCH_SSE2 1
+#    include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__)) \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#    define LINTEL_SIMD_SEARCH_AVX2 1
+#    include <immintrin.h>
+#endif
+
+namespace lintel {
+    namespace {
+	/// memchr for the first byte, then memcmp for the rest
+	size_t findScalar(const uint8_t *needle, size_t needle_length,
+			  const uint8_t *haystack, size_t hay_len, size_t start) {
+	    while (start + needle_length <= hay_len) {
+		const void *p = memchr(haystack + start, needle[0],
+				       hay_len - needle_length + 1 - start);
+		if (p == NULL) {
+		    return SimdSubstringSearch::npos;
+		}
+		size_t pos = static_cast<const uint8_t *>(p) - haystack;
+		if (memcmp(haystack + pos + 1, needle + 1, needle_length - 1) == 0) {
+		    return pos;
+		}
+		start = pos + 1;
+	    }
+	    return SimdSubstringSearch::npos;
+	}
+
+#if LINTEL_SIMD_SEARCH_SSE2
+	size_t findSSE2(const uint8_t *needle, size_t needle_length,
+			const uint8_t *haystack, size_t hay_len, size_t start) {
+	    const __m128i first = _mm_set1_epi8(needle[0]);
+	    const __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+	    const size_t middle = needle_length > 2 ? needle_length - 2 : 0;
+
+	    size_t i = start;
+	    // the load for the last byte reads [i + needle_length - 1, +16)
+	    for(; i + needle_length + 15 <= hay_len; i += 16) {
+		const __m128i block_first
+		    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i));
+		const __m128i block_last = _mm_loadu_si128
+		    (reinterpret_cast<const __m128i *>(haystack + i + needle_length - 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+								_mm_cmpeq_epi8(last, block_last)));
+		while (mask != 0) {
+		    unsigned bit = __builtin_ctz(mask);
+		    if (memcmp(haystack + i + bit + 1, needle + 1, middle) == 0) {
+			return i + bit;
+		    }
+		    mask &= mask - 1;
+		}
+	    }
+	    return findScalar(needle, needle_length, haystack, hay_len, i);
+	}
+#endif
+
+#if LINTEL_SIMD_SEARCH_AVX2
+	__attribute__((target("avx2")))
+	size_t findAVX2(const uint8_t *needle, size_t needle_length,
+			const uint8_t *haystack, size_t hay_len, size_t start) {
+	    const __m256i first = _mm256_set1_epi8(needle[0]);
+	    const __m256i last = _mm256_set1_epi8(needle[needle_length - 1]);
+	    const size_t middle = needle_length > 2 ? needle_length - 2 : 0;
+
+	    size_t i = start;
+	    for(; i + needle_length + 31 <= hay_len; i += 32) {
+		const __m256i block_first
+		    = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + i));
+		const __m256i block_last = _mm256_loadu_si256
+		    (reinterpret_cast<const __m256i *>(haystack + i + needle_length - 1));
+		uint32_t mask = _mm256_movemask_epi8
+		    (_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+				      _mm256_cmpeq_epi8(last, block_last)));
+		while (mask != 0) {
+		    unsigned bit = __builtin_ctz(mask);
+		    if (memcmp(haystack + i + bit + 1, needle + 1, middle) == 0) {
+			return i + bit;
+		    }
+		    mask &= mask - 1;
+		}
+	    }
+	    return findScalar(needle, needle_length, haystack, hay_len, i);
+	}
+#endif
+    }
+
+    SimdSubstringSearch::SimdSubstringSearch(const void *needle_v, size_t needle_len,
+					     Strategy strategy)
+	: needle(new uint8_t[needle_len]), needle_length(needle_len), chosen(Auto),
+	  horspool(NULL)
+    {
+	memcpy(needle, needle_v, needle_len);
+	init(strategy);
+    }
+
+    SimdSubstringSearch::SimdSubstringSearch(const std::string &needle_v, Strategy strategy)
+	: needle(new uint8_t[needle_v.size()]), needle_length(needle_v.size()), chosen(Auto),
+	  horspool(NULL)
+    {
+	memcpy(needle, needle_v.data(), needle_length);
+	init(strategy);
+    }
+
+    SimdSubstringSearch::~SimdSubstringSearch() {
+	delete horspool;
+	delete [] needle;
+    }
+
+    void SimdSubstringSearch::init(Strategy strategy) {
+	INVARIANT(needle_length > 0, "invalid to search for zero length string");
+	if (strategy == Auto) {
+	    if (needle_length == 1) {
+		strategy = Memchr;
+	    } else if (strategyAvailable(AVX2)) {
+		strategy = AVX2;
+	    } else if (strategyAvailable(SSE2)) {
+		strategy = SSE2;
+	    } else {
+		strategy = Horspool;
+	    }
+	}
+	INVARIANT(strategyAvailable(strategy),
+		  boost::format("SimdSubstringSearch strategy %s is not available")
+		  % strategyName(strategy));
+	chosen = strategy;
+	if (chosen == Horspool) {
+	    horspool = new BoyerMooreHorspool(needle, needle_length);
+	}
+    }
+
+    size_t SimdSubstringSearch::find(const void *hay_v, size_t hay_len, size_t start) const {
+	const uint8_t *haystack = reinterpret_cast<const uint8_t *>(hay_v);
+	if (start >= hay_len || hay_len - start < needle_length) {
+	    return npos;
+	}
+	switch (chosen)
+	    {
+	    case Memchr:
+		return findScalar(needle, needle_length, haystack, hay_len, start);
+	    case Horspool: {
+		size_t ret = horspool->find(haystack + start, hay_len - start);
+		return ret == npos ? npos : ret + start;
+	    }
+#if LINTEL_SIMD_SEARCH_SSE2
+	    case SSE2:
+		return findSSE2(needle, needle_length, haystack, hay_len, start);
+#endif
+#if LINTEL_SIMD_SEARCH_AVX2
+	    case AVX2:
+		return findAVX2(needle, needle_length, haystack, hay_len, start);
+#endif
+	    default:
+		FATAL_ERROR(boost::format("internal error, strategy %d") % chosen);
+	    }
+    }
+
+    void SimdSubstringSearch::findAll(const void *haystack, size_t hay_len,
+				      std::vector<size_t> &offsets) const {
+	for(MatchIterator i(*this, haystack, hay_len); i.valid(); ++i) {
+	    offsets.push_back(i.offset());
+	}
+    }
+
+    bool SimdSubstringSearch::strategyAvailable(Strategy strategy) {
+	switch (strategy)
+	    {
+	    case Auto: case Memchr: case Horspool:
+		return true;
+	    case SSE2:
+#if LINTEL_SIMD_SEARCH_SSE2
+		return true;
+#else
+		return false;
+#endif
+	    case AVX2:
+#if LINTEL_SIMD_SEARCH_AVX2
+		return __builtin_cpu_supports("avx2");
+#else
+		return false;
+#endif
+	    }
+	return false;
+    }
+
+    const char *SimdSubstringSearch::strategyName(Strategy strategy) {
+	switch (strategy)
+	    {
+	    case Auto: return "auto";
+	    case Memchr: return "memchr";
+	    case Horspool: return "horspool";
+	    case SSE2: return "sse2";
+	    case AVX2: return "avx2";
+	    }
+	return "unknown";
+    }
+}
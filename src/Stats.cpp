@@ -14,9 +14,12 @@
 #include <float.h>
 #include <string.h>
 
+#include <typeinfo>
+
 #include <boost/format.hpp>
 
 #include <Lintel/AssertBoost.hpp>
+#include <Lintel/BinarySerialize.hpp>
 #include <Lintel/Stats.hpp>
 #include <Lintel/Double.hpp>
 
@@ -100,16 +103,18 @@ void Stats::add(const double value) {
     }
 }
 
+// Through the accessors, as subclasses such as StatsHistogramHdr keep
+// these in their own form rather than in the fields.
 void Stats::add(const Stats &stat) {
-    number += stat.number;
-    sum += stat.sum;
-    sumsq += stat.sumsq;
+    number += stat.countll();
+    sum += stat.total();
+    sumsq += stat.total_sq();
 
-    if (stat.min_value < min_value) {
-	min_value = stat.min_value;
+    if (stat.min() < min_value) {
+	min_value = stat.min();
     }
-    if (stat.max_value > max_value) {
-	max_value = stat.max_value;
+    if (stat.max() > max_value) {
+	max_value = stat.max();
     }
 }
 
@@ -237,3 +242,52 @@ Stats *Stats::another_new() const {
 }
 
 
+
+void Stats::serialize(lintel::ByteBuffer &buf) const {
+    INVARIANT(typeid(*this) == typeid(Stats),
+	      boost::format("serialize is not implemented for %s") % typeid(*this).name());
+    serializeHeader(buf, SerialStats, 1);
+    serializeStats(buf);
+}
+
+void Stats::deserialize(lintel::ByteBuffer &buf) {
+    INVARIANT(typeid(*this) == typeid(Stats),
+	      boost::format("deserialize is not implemented for %s") % typeid(*this).name());
+    deserializeHeader(buf, SerialStats, 1);
+    deserializeStats(buf);
+}
+
+void Stats::serializeHeader(lintel::ByteBuffer &buf, SerialType type, unsigned version) {
+    DEBUG_SINVARIANT(version > 0 && version < 256);
+    lintel::binaryWrite(buf, static_cast<uint8_t>(type));
+    lintel::binaryWrite(buf, static_cast<uint8_t>(version));
+}
+
+unsigned Stats::deserializeHeader(lintel::ByteBuffer &buf, SerialType type, 
+				  unsigned max_version) {
+    uint8_t got_type, version;
+    lintel::binaryRead(buf, got_type);
+    lintel::binaryRead(buf, version);
+    INVARIANT(got_type == type, boost::format("expected serialized type %d, got %d")
+	      % static_cast<unsigned>(type) % static_cast<unsigned>(got_type));
+    INVARIANT(version > 0 && version <= max_version,
+	      boost::format("unsupported version %d for serialized type %d")
+	      % static_cast<unsigned>(version) % static_cast<unsigned>(type));
+    return version;
+}
+
+void Stats::serializeStats(lintel::ByteBuffer &buf) const {
+    lintel::binaryWrite(buf, number);
+    lintel::binaryWrite(buf, sum);
+    lintel::binaryWrite(buf, sumsq);
+    lintel::binaryWrite(buf, min_value);
+    lintel::binaryWrite(buf, max_value);
+}
+
+void Stats::deserializeStats(lintel::ByteBuffer &buf) {
+    lintel::binaryRead(buf, number);
+    lintel::binaryRead(buf, sum);
+    lintel::binaryRead(buf, sumsq);
+    lintel::binaryRead(buf, min_value);
+    lintel::binaryRead(buf, max_value);
+}
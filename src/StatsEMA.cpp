@@ -9,6 +9,7 @@
 */
 
 #include <Lintel/AssertBoost.hpp>
+#include <Lintel/BinarySerialize.hpp>
 #include <Lintel/StatsEMA.hpp>
 
 using namespace std;
@@ -102,3 +103,33 @@ StatsEMA::init(const std::vector<double> &_decay_rates)
     ema_values.resize(decay_rates.size(),0);
     count_low.resize(decay_rates.size(),true);
 }
+
+void StatsEMA::serialize(lintel::ByteBuffer &buf) const {
+    serializeHeader(buf, SerialEMA, 1);
+    serializeStats(buf);
+    lintel::binaryWrite(buf, static_cast<uint32_t>(decay_rates.size()));
+    lintel::binaryWriteArray(buf, &decay_rates[0], decay_rates.size());
+    lintel::binaryWriteArray(buf, &ema_values[0], ema_values.size());
+    for(unsigned i = 0; i < count_low.size(); ++i) {
+	lintel::binaryWrite(buf, static_cast<uint8_t>(count_low[i]));
+    }
+}
+
+void StatsEMA::deserialize(lintel::ByteBuffer &buf) {
+    deserializeHeader(buf, SerialEMA, 1);
+    deserializeStats(buf);
+    uint32_t nrates;
+    lintel::binaryRead(buf, nrates);
+    INVARIANT(nrates == decay_rates.size(), 
+	      boost::format("StatsEMA: serialized with %d decay rates, can't read into %d")
+	      % nrates % decay_rates.size());
+    vector<double> in_decay_rates(nrates);
+    lintel::binaryReadArray(buf, &in_decay_rates[0], nrates);
+    INVARIANT(in_decay_rates == decay_rates, "StatsEMA: serialized with different decay rates");
+    lintel::binaryReadArray(buf, &ema_values[0], nrates);
+    for(unsigned i = 0; i < nrates; ++i) {
+	uint8_t low;
+	lintel::binaryRead(buf, low);
+	count_low[i] = low != 0;
+    }
+}
@@ -14,6 +14,7 @@
 #include <limits>
 
 #include <Lintel/AssertBoost.hpp>
+#include <Lintel/BinarySerialize.hpp>
 #include <Lintel/StatsHistogram.hpp>
 #include <Lintel/Double.hpp>
 
@@ -182,6 +183,19 @@ void StatsHistogramUniform::add(const double index_value, const double data_valu
     this->add(index_value);
 }
 
+void StatsHistogramUniform::add(const Stats &stat) {
+    const StatsHistogramUniform *other = dynamic_cast<const StatsHistogramUniform *>(&stat);
+    INVARIANT(other != NULL,
+	      "StatsHistogramUniform: can only merge with another uniform histogram");
+    INVARIANT(other->num_bins == num_bins && other->bin_low == bin_low
+	      && other->bin_width == bin_width,
+	      "StatsHistogramUniform: can only merge histograms with the same bins");
+    Stats::add(stat);
+    for (unsigned bin = 0; bin < num_bins; ++bin) {
+	bins[bin] += other->bins[bin];
+    }
+}
+
 
 // The mode is the center of the most popular bin
 
@@ -335,6 +349,48 @@ Stats *StatsHistogramUniform::another_new() const {
 				     is_growable);
 }
 
+void StatsHistogramUniform::serialize(lintel::ByteBuffer &buf) const {
+    serializeHeader(buf, SerialHistogramUniform, 1);
+    serializeUniform(buf);
+}
+
+void StatsHistogramUniform::deserialize(lintel::ByteBuffer &buf) {
+    deserializeHeader(buf, SerialHistogramUniform, 1);
+    deserializeUniform(buf);
+}
+
+void StatsHistogramUniform::serializeUniform(lintel::ByteBuffer &buf) const {
+    serializeStats(buf);
+    lintel::binaryWrite(buf, static_cast<uint32_t>(num_bins));
+    lintel::binaryWrite(buf, bin_width);
+    lintel::binaryWrite(buf, bin_low);
+    lintel::binaryWrite(buf, bin_high);
+    lintel::binaryWrite(buf, static_cast<uint32_t>(num_rescales));
+    lintel::binaryWrite(buf, static_cast<uint32_t>(num_grows));
+    lintel::binaryWriteArray(buf, bins, num_bins);
+}
+
+void StatsHistogramUniform::deserializeUniform(lintel::ByteBuffer &buf) {
+    deserializeStats(buf);
+    uint32_t in_num_bins, in_num_rescales, in_num_grows;
+    lintel::binaryRead(buf, in_num_bins);
+    if (in_num_bins != num_bins) {
+	INVARIANT(is_growable, boost::format("StatsHistogramUniform: serialized with %d bins,"
+					     " can't read into %d") % in_num_bins % num_bins);
+	delete[] bins;
+	num_bins = in_num_bins;
+	bins = new unsigned long[num_bins];
+    }
+    lintel::binaryRead(buf, bin_width);
+    lintel::binaryRead(buf, bin_low);
+    lintel::binaryRead(buf, bin_high);
+    lintel::binaryRead(buf, in_num_rescales);
+    lintel::binaryRead(buf, in_num_grows);
+    num_rescales = in_num_rescales;
+    num_grows = in_num_grows;
+    lintel::binaryReadArray(buf, bins, num_bins);
+}
+
 
 
 
@@ -458,6 +514,18 @@ void StatsHistogramLog::add(const double index_value, const double data_value) {
     this->add(index_value);
 }
 
+void StatsHistogramLog::add(const Stats &stat) {
+    const StatsHistogramLog *other = dynamic_cast<const StatsHistogramLog *>(&stat);
+    INVARIANT(other != NULL, "StatsHistogramLog: can only merge with another log histogram");
+    INVARIANT(other->num_bins == num_bins && other->smallest_bin == smallest_bin
+	      && other->bin_scaling == bin_scaling,
+	      "StatsHistogramLog: can only merge histograms with the same bins");
+    Stats::add(stat);
+    for (unsigned bin = 0; bin < num_bins; ++bin) {
+	bins[bin] += other->bins[bin];
+    }
+}
+
 // The mode is the center of the most popular bin
 //
 double StatsHistogramLog::mode() const {
@@ -556,6 +624,40 @@ Stats * StatsHistogramLog::another_new() const {
 				 is_scalable);
 }
 
+void StatsHistogramLog::serialize(lintel::ByteBuffer &buf) const {
+    serializeHeader(buf, SerialHistogramLog, 1);
+    serializeLog(buf);
+}
+
+void StatsHistogramLog::deserialize(lintel::ByteBuffer &buf) {
+    deserializeHeader(buf, SerialHistogramLog, 1);
+    deserializeLog(buf);
+}
+
+void StatsHistogramLog::serializeLog(lintel::ByteBuffer &buf) const {
+    serializeStats(buf);
+    lintel::binaryWrite(buf, static_cast<uint32_t>(num_bins));
+    lintel::binaryWrite(buf, smallest_bin);
+    lintel::binaryWrite(buf, bin_high);
+    lintel::binaryWrite(buf, bin_scaling);
+    lintel::binaryWrite(buf, static_cast<uint32_t>(num_rescales));
+    lintel::binaryWriteArray(buf, bins, num_bins);
+}
+
+void StatsHistogramLog::deserializeLog(lintel::ByteBuffer &buf) {
+    deserializeStats(buf);
+    uint32_t in_num_bins, in_num_rescales;
+    lintel::binaryRead(buf, in_num_bins);
+    INVARIANT(in_num_bins == num_bins, boost::format("StatsHistogramLog: serialized with %d bins,"
+						     " can't read into %d") % in_num_bins % num_bins);
+    lintel::binaryRead(buf, smallest_bin);
+    lintel::binaryRead(buf, bin_high);
+    lintel::binaryRead(buf, bin_scaling);
+    lintel::binaryRead(buf, in_num_rescales);
+    num_rescales = in_num_rescales;
+    lintel::binaryReadArray(buf, bins, num_bins);
+}
+
 
 
 
@@ -639,6 +741,17 @@ void StatsHistogramUniformAccum::add(const double value) {
     add(value, value);
 }
 
+void StatsHistogramUniformAccum::add(const Stats &stat) {
+    const StatsHistogramUniformAccum *other 
+	= dynamic_cast<const StatsHistogramUniformAccum *>(&stat);
+    INVARIANT(other != NULL, "StatsHistogramUniformAccum: can only merge with another"
+	      " uniform accumulating histogram");
+    StatsHistogramUniform::add(stat);
+    for (unsigned bin = 0; bin < num_bins; ++bin) {
+	val_bins[bin] += other->val_bins[bin];
+    }
+}
+
 
 double StatsHistogramUniformAccum::value(unsigned index) const {
     SINVARIANT(checkInvariants());
@@ -705,6 +818,22 @@ Stats * StatsHistogramUniformAccum::another_new() const {
 				      is_growable);
 }
 
+void StatsHistogramUniformAccum::serialize(lintel::ByteBuffer &buf) const {
+    serializeHeader(buf, SerialHistogramUniformAccum, 1);
+    serializeUniform(buf);
+    lintel::binaryWriteArray(buf, val_bins, num_bins);
+}
+
+void StatsHistogramUniformAccum::deserialize(lintel::ByteBuffer &buf) {
+    deserializeHeader(buf, SerialHistogramUniformAccum, 1);
+    unsigned old_num_bins = num_bins;
+    deserializeUniform(buf);
+    // add() never grows val_bins, so neither can we.
+    INVARIANT(num_bins == old_num_bins,
+	      "StatsHistogramUniformAccum: serialized with a different number of bins");
+    lintel::binaryReadArray(buf, val_bins, num_bins);
+}
+
 
 
 
@@ -753,6 +882,16 @@ void StatsHistogramLogAccum::add(const double index_value, const double data_val
     val_bins[bin] += data_value;
 }
 
+void StatsHistogramLogAccum::add(const Stats &stat) {
+    const StatsHistogramLogAccum *other = dynamic_cast<const StatsHistogramLogAccum *>(&stat);
+    INVARIANT(other != NULL, "StatsHistogramLogAccum: can only merge with another"
+	      " log accumulating histogram");
+    StatsHistogramLog::add(stat);
+    for (unsigned bin = 0; bin < num_bins; ++bin) {
+	val_bins[bin] += other->val_bins[bin];
+    }
+}
+
 double StatsHistogramLogAccum::value(unsigned index) const {
     SINVARIANT(checkInvariants());
     SINVARIANT(index <= num_bins);
@@ -808,6 +947,18 @@ Stats *StatsHistogramLogAccum::another_new() const {
 				      bin_high);
 }
 
+void StatsHistogramLogAccum::serialize(lintel::ByteBuffer &buf) const {
+    serializeHeader(buf, SerialHistogramLogAccum, 1);
+    serializeLog(buf);
+    lintel::binaryWriteArray(buf, val_bins, num_bins);
+}
+
+void StatsHistogramLogAccum::deserialize(lintel::ByteBuffer &buf) {
+    deserializeHeader(buf, SerialHistogramLogAccum, 1);
+    deserializeLog(buf);
+    lintel::binaryReadArray(buf, val_bins, num_bins);
+}
+
 StatsHistogramGroup::StatsHistogramGroup(const StatsHistogram::HistMode mode, 
 					 const int buckets, 
 					 const std::vector<double> &_ranges)
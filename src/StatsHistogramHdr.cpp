@@ -0,0 +1,401 @@
+/* -*-C++-*-
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Log-linear (HdrHistogram style) histogram source code
+*/
+
+#include <float.h>
+#include <string.h>
+
+#include <boost/format.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/BinarySerialize.hpp>
+#include <Lintel/CompilerMarkup.hpp>
+#include <Lintel/Double.hpp>
+#include <Lintel/StatsHistogramHdr.hpp>
+
+static inline uint64_t doubleBits(double v) {
+    uint64_t ret;
+    memcpy(&ret, &v, sizeof(ret));
+    return ret;
+}
+
+static inline double bitsDouble(uint64_t v) {
+    double ret;
+    memcpy(&ret, &v, sizeof(ret));
+    return ret;
+}
+
+StatsHistogramHdr::StatsHistogramHdr(const double   lowest_discernible,
+				     const double   highest_trackable,
+				     const unsigned significant_bits)
+    : StatsHistogram(),
+      unit(lowest_discernible),
+      inverse_unit(1.0 / lowest_discernible),
+      highest_trackable(highest_trackable),
+      sub_bucket_bits(significant_bits),
+      num_bins(0),
+      bins(NULL)
+{
+    INVARIANT(lowest_discernible > 0.0,
+	      "StatsHistogramHdr: lowest discernible value must be > 0.0");
+    INVARIANT(highest_trackable >= 2 * lowest_discernible,
+	      "StatsHistogramHdr: highest trackable must be >= 2 * lowest discernible");
+    INVARIANT(significant_bits >= 1 && significant_bits <= 20,
+	      boost::format("StatsHistogramHdr: significant bits %d not in [1..20]")
+	      % significant_bits);
+    double max_units = ceil(highest_trackable * inverse_unit);
+    INVARIANT(max_units < 9.0e18, "StatsHistogramHdr: too many units between low and high");
+
+    // unitsBin() clamps to num_bins, so set it to the largest possible
+    // value while we work out the bin for the highest trackable value.
+    num_bins = ~0U;
+    num_bins = unitsBin(static_cast<uint64_t>(max_units)) + 1;
+    bins = new Counter[num_bins];
+    reset();
+}
+
+StatsHistogramHdr::~StatsHistogramHdr() {
+    delete[] bins;
+    bins = NULL;
+}
+
+void StatsHistogramHdr::reset() {
+    StatsHistogram::reset();	// This counts the resets for us
+    for (unsigned bin = 0; bin < num_bins; ++bin) {
+	bins[bin].store(0);
+    }
+    lintel::unsafe::atomic_store(&number, 0);
+    min_bits.store(doubleBits(Double::Inf));
+    max_bits.store(0);
+}
+
+uint64_t StatsHistogramHdr::binUnitsLow(unsigned index) const {
+    if (index < (2U << sub_bucket_bits)) {
+	return index;
+    } else {
+	unsigned shift = (index >> sub_bucket_bits) - 1;
+	uint64_t mantissa = index - (static_cast<uint64_t>(shift) << sub_bucket_bits);
+	return mantissa << shift;
+    }
+}
+
+uint64_t StatsHistogramHdr::binUnitsWidth(unsigned index) const {
+    if (index < (2U << sub_bucket_bits)) {
+	return 1;
+    } else {
+	return static_cast<uint64_t>(1) << ((index >> sub_bucket_bits) - 1);
+    }
+}
+
+void StatsHistogramHdr::add(const double value) {
+    INVARIANT(value >= 0.0, "values must be >= 0 for hdr histogram");
+    // -0.0 passes the check, but its sign bit would order it above
+    // every positive value in min_bits and max_bits
+    const double nonneg = value + 0.0;
+
+    unsigned bin;
+    if (LIKELY(nonneg < highest_trackable)) {
+	bin = unitsBin(static_cast<uint64_t>(nonneg * inverse_unit));
+    } else {
+	bin = num_bins - 1;
+    }
+    bins[bin].fetch_add(1);
+    lintel::unsafe::atomic_fetch_add(&number, 1);
+
+    // Updating the extremes is rare once we have seen a few values,
+    // so check before trying the compare and swap.
+    uint64_t bits = doubleBits(nonneg);
+    uint64_t cur = min_bits.load();
+    while (bits < cur && !min_bits.compare_exchange_strong(&cur, bits)) {
+	// cur was reloaded, try again
+    }
+    cur = max_bits.load();
+    while (bits > cur && !max_bits.compare_exchange_strong(&cur, bits)) {
+	// cur was reloaded, try again
+    }
+}
+
+void StatsHistogramHdr::add(const double index_value, const double data_value) {
+    INVARIANT(index_value == data_value,
+	      "StatsHistogramHdr: attempted to add non-index value.");
+    this->add(index_value);
+}
+
+void StatsHistogramHdr::add(const Stats &stat) {
+    const StatsHistogramHdr *other = dynamic_cast<const StatsHistogramHdr *>(&stat);
+    INVARIANT(other != NULL, "StatsHistogramHdr: can only merge with another StatsHistogramHdr");
+    INVARIANT(other->unit == unit && other->sub_bucket_bits == sub_bucket_bits
+	      && other->num_bins == num_bins,
+	      "StatsHistogramHdr: can only merge histograms with the same parameters");
+    for (unsigned bin = 0; bin < num_bins; ++bin) {
+	uint64_t count = other->binCount(bin);
+	if (count > 0) {
+	    bins[bin].fetch_add(count);
+	}
+    }
+    lintel::unsafe::atomic_fetch_add(&number, other->countll());
+
+    uint64_t bits = other->min_bits.load();
+    uint64_t cur = min_bits.load();
+    while (bits < cur && !min_bits.compare_exchange_strong(&cur, bits)) { }
+    bits = other->max_bits.load();
+    cur = max_bits.load();
+    while (bits > cur && !max_bits.compare_exchange_strong(&cur, bits)) { }
+}
+
+unsigned long StatsHistogramHdr::operator[](unsigned index) const {
+    SINVARIANT(index < num_bins);
+    return static_cast<unsigned long>(binCount(index));
+}
+
+double StatsHistogramHdr::min() const {
+    return bitsDouble(min_bits.load());
+}
+
+double StatsHistogramHdr::max() const {
+    if (countll() == 0) {
+	return -Double::Inf;
+    }
+    return bitsDouble(max_bits.load());
+}
+
+double StatsHistogramHdr::mean() const {
+    uint64_t n = 0;
+    double sum = 0;
+    for (unsigned bin = 0; bin < num_bins; ++bin) {
+	uint64_t count = binCount(bin);
+	if (count > 0) {
+	    n += count;
+	    sum += count * bincenter(bin);
+	}
+    }
+    return n == 0 ? 0.0 : sum / n;
+}
+
+double StatsHistogramHdr::variance() const {
+    uint64_t n = 0;
+    double sum = 0, sumsq = 0;
+    for (unsigned bin = 0; bin < num_bins; ++bin) {
+	uint64_t count = binCount(bin);
+	if (count > 0) {
+	    double center = bincenter(bin);
+	    n += count;
+	    sum += count * center;
+	    sumsq += count * center * center;
+	}
+    }
+    if (n == 0) {
+	return 0.0;
+    }
+    double m = sum / n;
+    return sumsq / n - m * m;
+}
+
+double StatsHistogramHdr::conf95() const {
+    if (countll() == 0) {
+	return DBL_MAX;
+    }
+    return 1.96 * stddev() / sqrt(static_cast<double>(countll()));
+}
+
+double StatsHistogramHdr::total() const {
+    return mean() * countll();
+}
+
+double StatsHistogramHdr::total_sq() const {
+    double m = mean();
+    return (variance() + m * m) * countll();
+}
+
+// The mode is the center of the most popular bin
+//
+double StatsHistogramHdr::mode() const {
+    uint64_t max = binCount(0);
+    unsigned maxpos = 0;
+    for (unsigned i = 1; i < num_bins; ++i) {
+	uint64_t count = binCount(i);
+	if (max < count) {
+	    maxpos = i;
+	    max = count;
+	}
+    }
+    return bincenter(maxpos);
+}
+
+double StatsHistogramHdr::percentile(double p) const {
+    INVARIANT(0.0 <= p && p <= 1.0, "argument is outside range");
+
+    // Use the sum of the bins rather than count() so that we are
+    // consistent with the bins if adds are happening concurrently.
+    uint64_t n = 0;
+    for (unsigned bin = 0; bin < num_bins; ++bin) {
+	n += binCount(bin);
+    }
+    if (n == 0) {
+	return 0;
+    }
+
+    double targetnumber = p * n;
+    uint64_t lowend = 0;
+    uint64_t highend = binCount(0);
+    unsigned bin = 0;
+    while (targetnumber > highend && bin + 1 < num_bins) {
+	lowend = highend;
+	highend += binCount(++bin);
+    }
+
+    // interpolate linearly within the bin, as the uniform histogram does.
+    if (highend == lowend) {
+	SINVARIANT(bin == 0);
+	return 0;
+    }
+    return binlow(bin) + binWidth(bin) * (targetnumber - lowend) / (highend - lowend);
+}
+
+//----------------------------------------------------------------
+// Printing functions
+//----------------------------------------------------------------
+
+std::string StatsHistogramHdr::debugString() const {
+    if (countll() == 0) {
+	return "count 0";
+    }
+
+    return str(boost::format("count %d mean %G stddev %G var %G 95%%conf %G rel95%%conf %G"
+			     " min %G max %G bins %u unit %G bits %u high %G mode %G")
+	       % countll() % mean() % stddev() % variance() % conf95() % relconf95()
+	       % min() % max() % num_bins % unit % sub_bucket_bits % high() % mode());
+}
+
+void StatsHistogramHdr::printRome(int depth, std::ostream &out) const {
+    std::string spaces;
+    for(int i = 0; i < depth; i++) {
+	spaces += " ";
+    }
+
+    // Stats::printRome would use the (empty) sums in the base class.
+    out << spaces << "{ count " << countll() << " }\n";
+    if (countll() > 0) {
+	out << spaces << "{ min " << min() << " }\n";
+	out << spaces << "{ max " << max() << " }\n";
+	out << spaces << "{ mean " << mean() << " }\n";
+	out << spaces << "{ stddev " << stddev() << " }\n";
+	out << spaces << "{ variance " << variance() << " }\n";
+	out << spaces << "{ conf95 " << conf95() << " }\n";
+	out << spaces << "{ total " << total() << " }\n";
+	out << spaces << "{ total_sq " << total_sq() << " }\n";
+    }
+    out << spaces << "{ histogram {\n";
+    out << spaces << "  { type hdr }\n";
+    out << spaces << "  { low " << low() << " }\n";
+    out << spaces << "  { high " << high() << " }\n";
+    out << spaces << "  { bins " << numBins() << " }\n";
+    out << spaces << "  { binwidth " << binWidth() << " }\n";
+    out << spaces << "  { significantbits " << significantBits() << " }\n";
+    out << spaces <<             "  { binCounts (";
+    for(unsigned int j = 0; j < numBins(); j++) {
+	if ((j % 10) == 0 && j > 0) {
+	    out << "\n" << spaces << "               ";
+	} else if (j > 0) {
+	    out << " ";
+	}
+	out << (*this)[j];
+    }
+    out << " ) } } }\n";
+}
+
+void StatsHistogramHdr::printTabular(int, std::ostream &out) const {
+    out << "histogram begin\n";
+    out << "count " << countll() << "\n";
+    out << "min " << min() << "\n";
+    out << "max " << max() << "\n";
+    out << "mean " << mean() << "\n";
+    out << "stddev " << stddev() << "\n";
+    out << "variance " << variance() << "\n";
+    out << "conf95 " << (countll() > 0 ? conf95() : 0) << "\n";
+    out << "total " << total() << "\n";
+    out << "total_sq " << total_sq() << "\n";
+    out << "type " << getType() << "\n";
+    out << "low " << low() << "\n";
+    out << "high " << high() << "\n";
+    out << "bins " << numBins() << "\n";
+    out << "binCounts begin "
+	<< "(low items sumitems %items(pdf) %total(cdf) binwidth)\n";
+    uint64_t sum = 0;
+    double n = static_cast<double>(countll());
+    for(unsigned int j = 0; j < numBins(); j++) {
+	uint64_t count = binCount(j);
+	sum += count;
+	out << binhigh(j) << " " << count << " " << sum << " "
+	    << (count / n) << " " << (sum / n) << " "
+	    << binWidth(j) << std::endl;
+    }
+    out << "binCounts end\n";
+    out << "histogram end\n";
+}
+
+Stats *StatsHistogramHdr::another_new() const {
+    return new StatsHistogramHdr(unit, highest_trackable, sub_bucket_bits);
+}
+
+void StatsHistogramHdr::serialize(lintel::ByteBuffer &buf) const {
+    serializeHeader(buf, SerialHistogramHdr, 1);
+    lintel::binaryWrite(buf, unit);
+    lintel::binaryWrite(buf, static_cast<uint32_t>(sub_bucket_bits));
+    lintel::binaryWrite(buf, static_cast<uint32_t>(num_bins));
+    lintel::binaryWrite(buf, static_cast<uint64_t>(countll()));
+    lintel::binaryWrite(buf, min_bits.load());
+    lintel::binaryWrite(buf, max_bits.load());
+
+    uint32_t nonzero = 0;
+    for (unsigned bin = 0; bin < num_bins; ++bin) {
+	if (binCount(bin) > 0) {
+	    ++nonzero;
+	}
+    }
+    lintel::binaryWrite(buf, nonzero);
+    for (uint32_t bin = 0; bin < num_bins; ++bin) {
+	uint64_t count = binCount(bin);
+	if (count > 0) {
+	    lintel::binaryWrite(buf, bin);
+	    lintel::binaryWrite(buf, count);
+	}
+    }
+}
+
+void StatsHistogramHdr::deserialize(lintel::ByteBuffer &buf) {
+    deserializeHeader(buf, SerialHistogramHdr, 1);
+    double in_unit;
+    uint32_t in_sub_bucket_bits, in_num_bins;
+    lintel::binaryRead(buf, in_unit);
+    lintel::binaryRead(buf, in_sub_bucket_bits);
+    lintel::binaryRead(buf, in_num_bins);
+    INVARIANT(in_unit == unit && in_sub_bucket_bits == sub_bucket_bits
+	      && in_num_bins == num_bins,
+	      "StatsHistogramHdr: can only deserialize a histogram with the same parameters");
+    reset();
+
+    uint64_t count, bits;
+    lintel::binaryRead(buf, count);
+    lintel::unsafe::atomic_store(&number, count);
+    lintel::binaryRead(buf, bits);
+    min_bits.store(bits);
+    lintel::binaryRead(buf, bits);
+    max_bits.store(bits);
+
+    uint32_t nonzero;
+    lintel::binaryRead(buf, nonzero);
+    for (uint32_t i = 0; i < nonzero; ++i) {
+	uint32_t bin;
+	lintel::binaryRead(buf, bin);
+	INVARIANT(bin < num_bins, "StatsHistogramHdr: corrupt serialized bin");
+	lintel::binaryRead(buf, count);
+	bins[bin].store(count);
+    }
+}
@@ -15,6 +15,7 @@
 #include <boost/format.hpp>
 
 #include <Lintel/AssertBoost.hpp>
+#include <Lintel/BinarySerialize.hpp>
 #include <Lintel/Double.hpp>
 #include <Lintel/HashMap.hpp>
 #include <Lintel/LintelLog.hpp>
@@ -776,3 +777,61 @@ size_t StatsQuantile::memoryUsage() const {
 		      + sizeof(double) + sizeof(int)) // secondary
 	+ sizeof(StatsQuantile);
 }
+
+void StatsQuantile::serialize(lintel::ByteBuffer &buf) const {
+    serializeHeader(buf, SerialQuantile, 1);
+    serializeStats(buf);
+    lintel::binaryWrite(buf, static_cast<int32_t>(nbuffers));
+    lintel::binaryWrite(buf, static_cast<int32_t>(buffer_size));
+    lintel::binaryWrite(buf, static_cast<int32_t>(cur_buffer));
+    lintel::binaryWrite(buf, static_cast<int32_t>(cur_buffer_pos));
+    lintel::binaryWrite(buf, static_cast<uint8_t>(collapse_even_low));
+    // Buffers after cur_buffer are unused; the tail of cur_buffer is garbage.
+    for (int i = 0; i <= cur_buffer; ++i) {
+	lintel::binaryWrite(buf, buffer_weight[i]);
+	lintel::binaryWrite(buf, static_cast<int32_t>(buffer_level[i]));
+	lintel::binaryWrite(buf, static_cast<uint8_t>(buffer_sorted[i]));
+	int used = i < cur_buffer ? buffer_size : std::min(cur_buffer_pos, buffer_size);
+	lintel::binaryWriteArray(buf, all_buffers[i], used);
+    }
+}
+
+void StatsQuantile::deserialize(lintel::ByteBuffer &buf) {
+    deserializeHeader(buf, SerialQuantile, 1);
+    init_buffers();
+    deserializeStats(buf);
+
+    int32_t in_nbuffers, in_buffer_size, in_cur_buffer, in_cur_buffer_pos;
+    uint8_t in_collapse_even_low;
+    lintel::binaryRead(buf, in_nbuffers);
+    lintel::binaryRead(buf, in_buffer_size);
+    INVARIANT(in_nbuffers == nbuffers && in_buffer_size == buffer_size,
+	      format("StatsQuantile: serialized with %d buffers of %d, can't read into %d of %d")
+	      % in_nbuffers % in_buffer_size % nbuffers % buffer_size);
+    lintel::binaryRead(buf, in_cur_buffer);
+    lintel::binaryRead(buf, in_cur_buffer_pos);
+    lintel::binaryRead(buf, in_collapse_even_low);
+    INVARIANT(in_cur_buffer >= -1 && in_cur_buffer < nbuffers, "StatsQuantile: corrupt buffer");
+    cur_buffer = in_cur_buffer;
+    cur_buffer_pos = in_cur_buffer_pos;
+    collapse_even_low = in_collapse_even_low != 0;
+
+    for (int i = 0; i <= cur_buffer; ++i) {
+	int32_t level;
+	uint8_t sorted;
+	lintel::binaryRead(buf, buffer_weight[i]);
+	lintel::binaryRead(buf, level);
+	lintel::binaryRead(buf, sorted);
+	buffer_level[i] = level;
+	buffer_sorted[i] = sorted != 0;
+	if (all_buffers[i] == NULL) {
+	    all_buffers[i] = new double[buffer_size];
+	}
+	int used = i < cur_buffer ? buffer_size : std::min(cur_buffer_pos, buffer_size);
+	lintel::binaryReadArray(buf, all_buffers[i], used);
+	// getQuantile() leaves a sorted partial buffer padded with Inf's
+	for (int j = used; j < buffer_size; ++j) {
+	    all_buffers[i][j] = Double::Inf;
+	}
+    }
+}
@@ -11,6 +11,7 @@
 #include <math.h>
 
 #include <Lintel/AssertBoost.hpp>
+#include <Lintel/BinarySerialize.hpp>
 #include <Lintel/StatsSequence.hpp>
 
 StatsSequence::StatsSequence(unsigned long _max_retain, mode _merge_mode)
@@ -170,3 +171,50 @@ StatsSequence::getPointsPerBucket() const
 {
     return points_per_bucket;
 }
+
+void
+StatsSequence::serialize(lintel::ByteBuffer &buf) const
+{
+    serializeHeader(buf, SerialSequence, 1);
+    serializeStats(buf);
+    lintel::binaryWrite(buf, static_cast<uint64_t>(max_retain));
+    lintel::binaryWrite(buf, static_cast<uint8_t>(merge_mode));
+    lintel::binaryWrite(buf, intervalWidth);
+    lintel::binaryWrite(buf, new_value);
+    lintel::binaryWrite(buf, static_cast<int32_t>(points_per_bucket));
+    lintel::binaryWrite(buf, static_cast<int32_t>(points_remain_new_bucket));
+    lintel::binaryWrite(buf, static_cast<uint32_t>(values.size()));
+    if (!values.empty()) {
+	lintel::binaryWriteArray(buf, &values[0], values.size());
+    }
+}
+
+void
+StatsSequence::deserialize(lintel::ByteBuffer &buf)
+{
+    deserializeHeader(buf, SerialSequence, 1);
+    deserializeStats(buf);
+    uint64_t in_max_retain;
+    uint8_t in_merge_mode;
+    int32_t in_points_per_bucket, in_points_remain;
+    uint32_t nvalues;
+    lintel::binaryRead(buf, in_max_retain);
+    INVARIANT(in_max_retain == max_retain,
+	      boost::format("StatsSequence: serialized with max_retain %d, can't read into %d")
+	      % in_max_retain % max_retain);
+    lintel::binaryRead(buf, in_merge_mode);
+    INVARIANT(in_merge_mode <= MergeMax, "StatsSequence: corrupt merge mode");
+    merge_mode = static_cast<mode>(in_merge_mode);
+    lintel::binaryRead(buf, intervalWidth);
+    lintel::binaryRead(buf, new_value);
+    lintel::binaryRead(buf, in_points_per_bucket);
+    lintel::binaryRead(buf, in_points_remain);
+    points_per_bucket = in_points_per_bucket;
+    points_remain_new_bucket = in_points_remain;
+    lintel::binaryRead(buf, nvalues);
+    INVARIANT(nvalues <= max_retain, "StatsSequence: corrupt value count");
+    values.resize(nvalues);
+    if (nvalues > 0) {
+	lintel::binaryReadArray(buf, &values[0], nvalues);
+    }
+}
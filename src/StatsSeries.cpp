@@ -12,6 +12,7 @@
 #include <stdio.h>
 
 #include <Lintel/AssertBoost.hpp>
+#include <Lintel/BinarySerialize.hpp>
 #include <Lintel/StatsSeries.hpp>
 
 // The code for this time series analysis was derived from _Time
@@ -187,3 +188,31 @@ StatsSeries::another_new() const
     return new StatsSeries(max_lag); 
 }
 
+void
+StatsSeries::serialize(lintel::ByteBuffer &buf) const
+{
+  serializeHeader(buf, SerialSeries, 1);
+  serializeStats(buf);
+  lintel::binaryWrite(buf, static_cast<uint32_t>(max_lag));
+  lintel::binaryWrite(buf, static_cast<uint32_t>(sampleno));
+  lintel::binaryWriteArray(buf, samples, max_lag+1);
+  lintel::binaryWriteArray(buf, product, max_lag+1);
+  lintel::binaryWriteArray(buf, firstsamples, max_lag+1);
+}
+
+void
+StatsSeries::deserialize(lintel::ByteBuffer &buf)
+{
+  deserializeHeader(buf, SerialSeries, 1);
+  deserializeStats(buf);
+  uint32_t in_max_lag, in_sampleno;
+  lintel::binaryRead(buf, in_max_lag);
+  INVARIANT(in_max_lag == max_lag,
+	    boost::format("StatsSeries: serialized with maxlag %d, can't read into %d")
+	    % in_max_lag % max_lag);
+  lintel::binaryRead(buf, in_sampleno);
+  sampleno = in_sampleno;
+  lintel::binaryReadArray(buf, samples, max_lag+1);
+  lintel::binaryReadArray(buf, product, max_lag+1);
+  lintel::binaryReadArray(buf, firstsamples, max_lag+1);
+}
@@ -8,57 +8,272 @@
     String to small integer mapping
 */
 
+#include <string.h>
+
 #include <Lintel/AssertBoost.hpp>
+#include <Lintel/AtomicCounter.hpp>
+#include <Lintel/HashFns.hpp>
+#include <Lintel/InternTable.hpp>
 #include <Lintel/StringId.hpp>
 
+using lintel::detail::StringIdArena;
+using lintel::detail::StringIdEntry;
+
+namespace {
+    const size_t chunk_size = 64*1024;
+    const uint32_t initial_table_size = 64;
+    // entries in the first ConcurrentStringId segment; segment k has segment_base << k
+    const uint32_t segment_base = 1024;
+    const unsigned max_segments = 32;
+
+    bool entryMatches(const StringIdEntry &e, uint32_t hash, const char *data, size_t size) {
+	return e.hash == hash && e.size == size && memcmp(e.data, data, size) == 0;
+    }
+}
+
+namespace lintel { namespace detail {
+    StringIdArena::~StringIdArena() {
+	for(size_t i = 0; i < chunks.size(); ++i) {
+	    delete [] chunks[i];
+	}
+    }
+
+    const char *StringIdArena::copy(const char *data, size_t size) {
+	char *ret;
+	if (size > chunk_size / 16) { // don't waste the end of the current chunk
+	    ret = new char[size];
+	    chunks.push_back(ret);
+	    allocated += size;
+	} else {
+	    if (remaining < size) {
+		cur = new char[chunk_size];
+		remaining = chunk_size;
+		chunks.push_back(cur);
+		allocated += chunk_size;
+	    }
+	    ret = cur;
+	    cur += size;
+	    remaining -= size;
+	}
+	memcpy(ret, data, size);
+	return ret;
+    }
+} }
+
 StringId::StringId()
-    : revmap(4.0) // equal is very fast, so use longer chains
+    : entries(1), slots(initial_table_size, 0)
+{ }
+
+unsigned int
+StringId::findId(const char *data, size_t size) const
 {
-    nextid = 1;
+    uint32_t hash = lintel::hashBytes(data, size);
+    const uint32_t mask = slots.size() - 1;
+    for(uint32_t i = hash & mask; slots[i] != 0; i = (i + 1) & mask) {
+	if (entryMatches(entries[slots[i]], hash, data, size)) {
+	    return slots[i];
+	}
+    }
+    return 0;
 }
 
 unsigned int
-StringId::getId(const std::string &str)
+StringId::getId(const char *data, size_t size)
 {
-#if 0
-    unsigned int tmp = idmap[str];
-    if (tmp > 0)
-	return tmp;
-    idmap[str] = nextid;
-    revmap[nextid] = str;
-    tmp = nextid;
-    nextid += 1;
-    return tmp;
-#else
-    HTE ent(str);
-    const HTE *d = idmap.lookup(ent);
-    if (d == NULL) {
-	std::string *alloc = new std::string(str);
-	ent.str = alloc;
-	ent.id = nextid;
-	idmap.add(ent);
-	revmap.add(ent);
-	nextid += 1;
+    INVARIANT(size <= 0xFFFFFFFFU, "StringId: string too long");
+    uint32_t hash = lintel::hashBytes(data, size);
+    uint32_t mask = slots.size() - 1;
+    uint32_t i = hash & mask;
+    for(; slots[i] != 0; i = (i + 1) & mask) {
+	if (entryMatches(entries[slots[i]], hash, data, size)) {
+	    return slots[i];
+	}
+    }
+
+    INVARIANT(entries.size() < 0xFFFFFFFFU, "StringId: out of ids");
+    StringIdEntry e;
+    e.data = arena.copy(data, size);
+    e.size = size;
+    e.hash = hash;
+    uint32_t id = entries.size();
+    entries.push_back(e);
+    if (2 * entries.size() > slots.size()) {
+	grow();
     } else {
-	ent.id = d->id;
+	slots[i] = id;
     }
-    return ent.id;
-#endif
+    return id;
 }
 
-const std::string &
-StringId::getString(unsigned int id)
+// doubles the table and reinserts every id, including the one just added
+void
+StringId::grow()
 {
-#if 0    
-    SINVARIANT(id < nextid);
-    return revmap[id];
-#else
-    HTE ent(id);
-    const HTE *d = revmap.lookup(ent);
-    INVARIANT(d != NULL,
-	      boost::format("internal error id %u has no std::string?!") % id);
-    return *(d->str);
-#endif
+    std::vector<uint32_t> bigger(2 * slots.size(), 0);
+    const uint32_t mask = bigger.size() - 1;
+    for(uint32_t id = 1; id < entries.size(); ++id) {
+	uint32_t i = entries[id].hash & mask;
+	while (bigger[i] != 0) {
+	    i = (i + 1) & mask;
+	}
+	bigger[i] = id;
+    }
+    slots.swap(bigger);
+}
 
+size_t
+StringId::memoryUsage() const
+{
+    return sizeof(*this) + arena.bytesAllocated() + entries.capacity() * sizeof(StringIdEntry)
+	+ slots.capacity() * sizeof(uint32_t);
 }
 
+struct ConcurrentStringId::Impl {
+    // slots hold ids, 0 for an empty slot; set after the entry
+    struct IdSlotTraits {
+	typedef uint32_t Slot;
+
+	explicit IdSlotTraits(const Impl *impl) : impl(impl) { }
+
+	static bool empty(const uint32_t &id) {
+	    return lintel::unsafe::atomic_load(&id) == 0;
+	}
+	uint32_t hash(uint32_t id) const {
+	    return impl->entry(id).hash;
+	}
+	static void publish(uint32_t &to, uint32_t id) {
+	    lintel::unsafe::atomic_store(&to, id);
+	}
+
+	const Impl *impl;
+    };
+
+    struct IdMatch {
+	IdMatch(const Impl &impl, uint32_t hash, const char *data, size_t size)
+	    : impl(impl), hash(hash), data(data), size(size) { }
+
+	bool operator()(uint32_t id) const {
+	    return entryMatches(impl.entry(id), hash, data, size);
+	}
+
+	const Impl &impl;
+	uint32_t hash;
+	const char *data;
+	size_t size;
+    };
+
+    Impl() : next_id(1), table(IdSlotTraits(this), initial_table_size) {
+	memset(segments, 0, sizeof(segments));
+    }
+
+    ~Impl() {
+	for(unsigned k = 0; k < max_segments; ++k) {
+	    delete [] segments[k];
+	}
+    }
+
+    static unsigned segmentOf(uint32_t id) {
+	return 31 - __builtin_clz(id / segment_base + 1);
+    }
+
+    static uint32_t segmentStart(unsigned k) {
+	return segment_base * ((1U << k) - 1);
+    }
+
+    const StringIdEntry &entry(uint32_t id) const {
+	unsigned k = segmentOf(id);
+	return lintel::unsafe::atomic_load(&segments[k])[id - segmentStart(k)];
+    }
+
+    uint32_t find(uint32_t hash, const char *data, size_t size) const {
+	const uint32_t *slot = table.find(hash, IdMatch(*this, hash, data, size));
+	return slot == NULL ? 0 : *slot;
+    }
+
+    // Called with the lock held.
+    uint32_t add(uint32_t hash, const char *data, size_t size) {
+	uint32_t id = next_id;
+	INVARIANT(id < 0xFFFFFFFFU, "ConcurrentStringId: out of ids");
+	unsigned k = segmentOf(id);
+	if (segments[k] == NULL) {
+	    lintel::unsafe::atomic_store(&segments[k], new StringIdEntry[segment_base << k]);
+	}
+	StringIdEntry &e = segments[k][id - segmentStart(k)];
+	e.data = arena.copy(data, size);
+	e.size = size;
+	e.hash = hash;
+
+	// publish the id before the slot so that anyone who finds it can use it
+	next_id = id + 1;
+	table.insert(hash, id);
+	return id;
+    }
+
+    lintel::Atomic<uint32_t> next_id;
+    lintel::detail::InternTable<IdSlotTraits> table; // holds the lock
+    StringIdEntry *segments[max_segments];
+    StringIdArena arena;
+};
+
+ConcurrentStringId::ConcurrentStringId()
+    : impl(new Impl())
+{ }
+
+ConcurrentStringId::~ConcurrentStringId()
+{
+    delete impl;
+}
+
+unsigned int
+ConcurrentStringId::findId(const char *data, size_t size) const
+{
+    uint32_t hash = lintel::hashBytes(data, size);
+    return impl->find(hash, data, size);
+}
+
+unsigned int
+ConcurrentStringId::getId(const char *data, size_t size)
+{
+    INVARIANT(size <= 0xFFFFFFFFU, "ConcurrentStringId: string too long");
+    uint32_t hash = lintel::hashBytes(data, size);
+    uint32_t id = impl->find(hash, data, size);
+    if (id != 0) {
+	return id;
+    }
+    impl->table.lock();
+    id = impl->find(hash, data, size);
+    if (id == 0) {
+	id = impl->add(hash, data, size);
+    }
+    impl->table.unlock();
+    return id;
+}
+
+StringRange
+ConcurrentStringId::getStringRange(unsigned int id) const
+{
+    INVARIANT(id > 0 && id < maxId(), boost::format("invalid ConcurrentStringId id %u") % id);
+    const StringIdEntry &e = impl->entry(id);
+    return StringRange(e.data, e.size);
+}
+
+unsigned int
+ConcurrentStringId::maxId() const
+{
+    return impl->next_id.load();
+}
+
+size_t
+ConcurrentStringId::memoryUsage() const
+{
+    impl->table.lock();
+    size_t ret = sizeof(*this) + sizeof(Impl) + impl->arena.bytesAllocated()
+	+ impl->table.bytes();
+    for(unsigned k = 0; k < max_segments; ++k) {
+	if (impl->segments[k] != NULL) {
+	    ret += (segment_base << k) * sizeof(StringIdEntry);
+	}
+    }
+    impl->table.unlock();
+    return ret;
+}
@@ -29,6 +29,11 @@
 #include <winsock2.h>
 #endif
 
+#if defined(__SSE2__)
+#define LINTEL_STRINGUTIL_SSE2 1
+#include <emmintrin.h>
+#endif
+
 #include <boost/bind.hpp>
 #include <boost/static_assert.hpp>
 #include <boost/integer_traits.hpp>
@@ -36,6 +41,7 @@
 
 #include <Lintel/StringUtil.hpp>
 #include <Lintel/AssertBoost.hpp>
+#include <Lintel/ByteBuffer.hpp>
 
 using namespace std;
 using boost::format;
@@ -57,6 +63,69 @@ void split(const string &instr, const string &splitstr, vector<string> &bits) {
     }
 }
 
+namespace {
+    const char *findSeparator(const char *data, size_t len, const string &splitstr) {
+	if (len < splitstr.size()) {
+	    return NULL; // also keeps an empty ByteBuffer's NULL from memchr
+	}
+	if (splitstr.size() == 1) {
+	    return static_cast<const char *>(memchr(data, splitstr[0], len));
+	}
+	const char *end = data + len;
+	while (static_cast<size_t>(end - data) >= splitstr.size()) {
+	    data = static_cast<const char *>
+		(memchr(data, splitstr[0], end - data - splitstr.size() + 1));
+	    if (data == NULL) {
+		return NULL;
+	    }
+	    if (memcmp(data + 1, splitstr.data() + 1, splitstr.size() - 1) == 0) {
+		return data;
+	    }
+	    ++data;
+	}
+	return NULL;
+    }
+}
+
+void split(const char *instr, size_t len, const string &splitstr, vector<StringRange> &ranges) {
+    SINVARIANT(splitstr.length() > 0);
+    const char *end = instr + len;
+    while(true) {
+	const char *found = findSeparator(instr, end - instr, splitstr);
+	if (found == NULL) {
+	    ranges.push_back(StringRange(instr, end - instr));
+	    return;
+	}
+	ranges.push_back(StringRange(instr, found - instr));
+	instr = found + splitstr.size();
+    }
+}
+
+SplitIterator::SplitIterator(const lintel::ByteBuffer &buf, char splitchar) 
+    : splitstr(1, splitchar) 
+{
+    if (buf.readAvailable() == 0) {
+	init(NULL, 0);
+    } else {
+	init(buf.readStartAs<char>(), buf.readAvailable());
+    }
+}
+
+void SplitIterator::next() {
+    if (last) {
+	done = true;
+	return;
+    }
+    const char *found = findSeparator(pos, end - pos, splitstr);
+    if (found == NULL) {
+	cur = StringRange(pos, end - pos);
+	last = true;
+    } else {
+	cur = StringRange(pos, found - pos);
+	pos = found + splitstr.size();
+    }
+}
+
 string join(const string &joinstr, const vector<string> &bits) {
     string ret;
 
@@ -112,115 +181,311 @@ static unsigned char mysql_escape_table[256] =
           0,    0,    0,    0,    0,    0,    0,    0,    0,    0, // 24
           0,    0,    0,    0,    0,    0 } ;                      // 25
 
-string mysqlEscape(const void * _data, unsigned datasize) {
-    const unsigned char *data = reinterpret_cast<const unsigned char *>(_data);
-    int to_escape = 0;
-    for(unsigned int i=0; i<datasize; ++i) {
-	if (mysql_escape_table[data[i]]!=0) {
-	    ++to_escape;
+static const char hextable[] = { '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f' };
+
+// The encoders and escapers below skip over runs of bytes that need no
+// work 16 at a time with SSE2 compares, and copy those runs with
+// memcpy.  Each class of bytes says which bytes are special one at a
+// time and 16 at a time, and how to write out a special byte.  The
+// vector test may be a superset of the scalar one, escape() copies
+// bytes that turn out not to be special.  SSE2 is always available on
+// x86-64, so there is no need for run time checks.
+
+namespace {
+#if LINTEL_STRINGUTIL_SSE2
+    /// 0xFF in each byte that is (unsigned) <= limit
+    inline __m128i bytesAtMost(__m128i v, uint8_t limit) {
+	return _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(limit)), v);
+    }
+
+    inline __m128i bytesEqual(__m128i v, char c) {
+	return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+    }
+#endif
+
+    struct UnprintableBytes {
+	// ok, openbsd considers 0xbf printable, but not ascii, so we
+	// don't use isprint
+	static bool special(uint8_t c) {
+	    return c < 0x20 || c >= 0x7F;
+	}
+#if LINTEL_STRINGUTIL_SSE2
+	static __m128i special(__m128i v) {
+	    // signed compare, so bytes >= 0x80 are also < 0x20
+	    return _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(0x20)), bytesEqual(v, 0x7F));
+	}
+#endif
+    };
+
+    struct EscapeUnprintableBytes {
+	static const size_t max_expansion = 3;
+	static bool special(uint8_t c) {
+	    return UnprintableBytes::special(c) || c == '%';
+	}
+#if LINTEL_STRINGUTIL_SSE2
+	static __m128i special(__m128i v) {
+	    return _mm_or_si128(UnprintableBytes::special(v), bytesEqual(v, '%'));
+	}
+#endif
+	static size_t escape(uint8_t c, char *out) {
+	    out[0] = '%';
+	    if (c == '%') {
+		out[1] = '%';
+		return 2;
+	    }
+	    out[1] = hextable[c >> 4];
+	    out[2] = hextable[c & 0xF];
+	    return 3;
+	}
+    };
+
+    struct MysqlEscapeBytes {
+	static const size_t max_expansion = 2;
+	static bool special(uint8_t c) {
+	    return mysql_escape_table[c] != 0;
+	}
+#if LINTEL_STRINGUTIL_SSE2
+	static __m128i special(__m128i v) {
+	    // the control characters that need escaping are all <= 26
+	    return _mm_or_si128(_mm_or_si128(bytesAtMost(v, 26), bytesEqual(v, '"')),
+				_mm_or_si128(bytesEqual(v, '\''), bytesEqual(v, '\\')));
+	}
+#endif
+	static size_t escape(uint8_t c, char *out) {
+	    if (mysql_escape_table[c] == 0) {
+		out[0] = c;
+		return 1;
+	    }
+	    out[0] = '\\';
+	    out[1] = mysql_escape_table[c];
+	    return 2;
+	}
+    };
+
+    struct CSVCommaBytes {
+	static bool special(uint8_t c) {
+	    return c == ',';
+	}
+#if LINTEL_STRINGUTIL_SSE2
+	static __m128i special(__m128i v) {
+	    return bytesEqual(v, ',');
+	}
+#endif
+    };
+
+    struct CSVQuoteBytes {
+	static const size_t max_expansion = 2;
+	static bool special(uint8_t c) {
+	    return c == '"';
+	}
+#if LINTEL_STRINGUTIL_SSE2
+	static __m128i special(__m128i v) {
+	    return bytesEqual(v, '"');
+	}
+#endif
+	static size_t escape(uint8_t, char *out) {
+	    out[0] = '"';
+	    out[1] = '"';
+	    return 2;
+	}
+    };
+
+    /// length of the prefix of data with no special bytes
+    template<class Bytes> size_t plainPrefix(const uint8_t *data, size_t size) {
+	size_t i = 0;
+#if LINTEL_STRINGUTIL_SSE2
+	for(; i + 16 <= size; i += 16) {
+	    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+	    unsigned mask = _mm_movemask_epi8(Bytes::special(v));
+	    if (mask != 0) {
+		return i + __builtin_ctz(mask);
+	    }
+	}
+#endif
+	for(; i < size && !Bytes::special(data[i]); ++i) { }
+	return i;
+    }
+
+    /// escape data into out, which must have room for
+    /// Bytes::max_expansion * size bytes; returns the bytes written
+    template<class Bytes> size_t escapeBytes(const uint8_t *data, size_t size, char *out) {
+	char *to = out;
+	for(size_t i = 0; i < size; ) {
+	    size_t plain = plainPrefix<Bytes>(data + i, size - i);
+	    memcpy(to, data + i, plain);
+	    to += plain;
+	    i += plain;
+	    if (i < size) {
+		to += Bytes::escape(data[i], to);
+		++i;
+	    }
 	}
+	return to - out;
     }
 
-    string ret;
-    ret.reserve(datasize+to_escape);
-    for(unsigned int i=0; i<datasize; ++i) {
-	if (mysql_escape_table[data[i]]!=0) {
-	    ret.push_back('\\');
-	    ret.push_back(mysql_escape_table[data[i]]);
-	} else {
-	    ret.push_back(data[i]);
+    // Escape in chunks so the worst case expansion only needs a small
+    // buffer.
+    const size_t escape_chunk = 4096;
+
+    template<class Bytes> string escapedString(const void *data_v, size_t size) {
+	const uint8_t *data = static_cast<const uint8_t *>(data_v);
+	size_t plain = plainPrefix<Bytes>(data, size);
+	string ret(reinterpret_cast<const char *>(data), plain);
+	if (plain < size) {
+	    ret.reserve(size + size / 8);
+	    char buf[Bytes::max_expansion * escape_chunk];
+	    for(size_t i = plain; i < size; i += escape_chunk) {
+		size_t n = min(escape_chunk, size - i);
+		ret.append(buf, escapeBytes<Bytes>(data + i, n, buf));
+	    }
+	}
+	return ret;
+    }
+
+    /// start of room for amt more bytes at the end of out; ByteBuffer's
+    /// own append only grows the buffer to the exact size needed, so
+    /// repeated appends would copy the buffer every time.
+    char *writeRoom(lintel::ByteBuffer &out, size_t amt) {
+	if (out.writeAvailable() < amt) {
+	    out.resizeBuffer(max(2 * out.bufferSize(), out.readAvailable() + amt));
+	}
+	return out.writeStartAs<char>(0);
+    }
+
+    template<class Bytes> void appendEscaped(lintel::ByteBuffer &out, const void *data_v,
+					     size_t size) {
+	const uint8_t *data = static_cast<const uint8_t *>(data_v);
+	for(size_t i = 0; i < size; i += escape_chunk) {
+	    size_t n = min(escape_chunk, size - i);
+	    char *to = writeRoom(out, Bytes::max_expansion * n);
+	    out.extend(escapeBytes<Bytes>(data + i, n, to));
+	}
+    }
+
+    void hexEncode(const uint8_t *data, size_t size, char *out) {
+	size_t i = 0;
+#if LINTEL_STRINGUTIL_SSE2
+	// '0' + nibble, plus the gap from '9' to 'a' for nibbles > 9
+	const __m128i low_nibble = _mm_set1_epi8(0x0F);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i zero_char = _mm_set1_epi8('0');
+	const __m128i letter_gap = _mm_set1_epi8('a' - '0' - 10);
+	for(; i + 16 <= size; i += 16) {
+	    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+	    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble);
+	    __m128i lo = _mm_and_si128(v, low_nibble);
+	    hi = _mm_add_epi8(_mm_add_epi8(hi, zero_char),
+			      _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letter_gap));
+	    lo = _mm_add_epi8(_mm_add_epi8(lo, zero_char),
+			      _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letter_gap));
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i),
+			     _mm_unpacklo_epi8(hi, lo));
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16),
+			     _mm_unpackhi_epi8(hi, lo));
+	}
+#endif
+	for(; i < size; ++i) {
+	    out[2 * i] = hextable[data[i] >> 4];
+	    out[2 * i + 1] = hextable[data[i] & 0xF];
+	}
+    }
+
+#if LINTEL_STRINGUTIL_SSE2
+    /// values of 16 hex digits; false if any of them is not a hex digit
+    inline bool hexDigitValues(__m128i v, __m128i &values) {
+	__m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+	__m128i is_digit = bytesAtMost(digit, 9);
+	__m128i letter = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i is_letter = bytesAtMost(letter, 5);
+	values = _mm_or_si128(_mm_and_si128(is_digit, digit),
+			      _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+	return _mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) == 0xFFFF;
+    }
+
+    /// combine pairs of digit values into bytes in the low half of each
+    /// 16 bit lane; the first (high) digit is in the low byte of the lane
+    inline __m128i hexDigitPairs(__m128i values) {
+	return _mm_or_si128(_mm_and_si128(_mm_slli_epi16(values, 4), _mm_set1_epi16(0xF0)),
+			    _mm_srli_epi16(values, 8));
+    }
+#endif
+
+    /// decode the 2 * size hex digits at in into size bytes at out
+    void hexDecode(const char *in, size_t size, uint8_t *out) {
+	size_t i = 0;
+#if LINTEL_STRINGUTIL_SSE2
+	for(; i + 16 <= size; i += 16) {
+	    __m128i a, b;
+	    bool ok_a = hexDigitValues
+		(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * i)), a);
+	    bool ok_b = hexDigitValues
+		(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * i + 16)), b);
+	    if (!(ok_a && ok_b)) {
+		break; // let unpackhex report the bad character
+	    }
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+			     _mm_packus_epi16(hexDigitPairs(a), hexDigitPairs(b)));
+	}
+#endif
+	for(; i < size; ++i) {
+	    out[i] = unpackhex(in + 2 * i);
 	}
     }
-    return ret;
 }
 
-// TODO: try a hextable with 255 2 character entries, and see if using
-// .append(pair, 2) runs faster than two .push_back's another option
-// is to build an 8-16 character buffer and append the whole thing in
-// one go.
+string mysqlEscape(const void *data, unsigned datasize) {
+    return escapedString<MysqlEscapeBytes>(data, datasize);
+}
 
-static char hextable[] = { '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f' };
+void mysqlEscape(const void *data, size_t datasize, lintel::ByteBuffer &out) {
+    appendEscaped<MysqlEscapeBytes>(out, data, datasize);
+}
 
-string hexstring(const void *_data, unsigned datasize) {
-    const unsigned char *data = reinterpret_cast<const unsigned char *>(_data);
-    string ret;
-    ret.reserve(datasize*2);
-    for(unsigned int i=0;i<datasize;++i) {
-        unsigned int c = (unsigned char)(data[i]);
-        ret.push_back(hextable[(c >> 4) & 0xF]);
-        ret.push_back(hextable[c & 0xF]);
+string hexstring(const void *data, unsigned datasize) {
+    string ret(2 * static_cast<size_t>(datasize), '\0');
+    if (datasize > 0) {
+	hexEncode(static_cast<const uint8_t *>(data), datasize, &ret[0]);
     }
     return ret;
 }
 
+void hexstring(const void *data, size_t datasize, lintel::ByteBuffer &out) {
+    hexEncode(static_cast<const uint8_t *>(data), datasize, writeRoom(out, 2 * datasize));
+    out.extend(2 * datasize);
+}
+
 string maybehexstring(const void *_data, unsigned datasize) {
-    const unsigned char *data = reinterpret_cast<const unsigned char *>(_data);
-    for(unsigned int i=0;i<datasize;i++) {
-	if (!isprint(data[i])) {
-	    return hexstring(data, datasize);
-	}
+    const uint8_t *data = static_cast<const uint8_t *>(_data);
+    if (plainPrefix<UnprintableBytes>(data, datasize) < datasize) {
+	return hexstring(data, datasize);
     }
-    string ret((const char *)_data, datasize);
-    return ret;
+    return string(reinterpret_cast<const char *>(data), datasize);
 }
 
 string maybehexstring(const string &a) {
-    for(unsigned int i=0;i<a.size();++i) {
-        if (isprint(a[i]) && isascii(a[i])) {
-            // ok, openbsd considers 0xbf printable, but not ascii
-        } else {
-	    return hexstring(a);
-	}
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(a.data());
+    if (plainPrefix<UnprintableBytes>(data, a.size()) < a.size()) {
+	return hexstring(a);
     }
     return a;
 }
 
-namespace {
-    inline bool eu_escape(char c) {
-        return !(isprint(c) && isascii(c)) || c == '%';
+void maybehexstring(const void *_data, size_t datasize, lintel::ByteBuffer &out) {
+    const uint8_t *data = static_cast<const uint8_t *>(_data);
+    if (plainPrefix<UnprintableBytes>(data, datasize) < datasize) {
+	hexstring(data, datasize, out);
+    } else {
+	memcpy(writeRoom(out, datasize), data, datasize);
+	out.extend(datasize);
     }
 }
 
 string escapeUnprintable(const string &a) {
-    string ret;
-    // ~990 nanos/call -> ~720 nanos/call w/ limit = rand(5)
-    // ~1580 -> ~1180 w/limit = rand(20)
-
-    // Explicitly calculating the size is a performance disaster
-    // Simple testing:
-    // limit5, size+0 --> 630 nanos
-    // limit5, size+10 --> 530 nanos
-    // limit5, size+20 --> 506 nanos
-    // limit20, size+0 --> 1004 nanos
-    // limit20, size+10 --> 907 nanos
-    // limit20, size+20 --> 858 nanos
-    if (a.size() <= 12) {
-        // Short string, only give 2 escapeable things for free
-        ret.reserve(a.size() + 6);
-    } else {
-        // Decide on size + 12, give people 4 escapeable things for free
-        ret.reserve(a.size() + 12); 
-    }
-    string::const_iterator end = a.end();
-    for (string::const_iterator i = a.begin(); i != end; ) {
-        string::const_iterator j(i); // next unprintable character
-        for (; j != end && !eu_escape(*j); ++j) { }
-        ret.append(i,j);
-        if (j != end) { // something to escape
-            unsigned c = static_cast<unsigned char>(*j); // For correctness in shifts below
-            ret.push_back('%');
-            if (c == '%') {
-                ret.push_back('%');
-            } else {
-                ret.push_back(hextable[(c >> 4) & 0xF]);
-                ret.push_back(hextable[c & 0xF]);
-            }
-            ++j;
-        } 
-        i = j;
-    }
+    return escapedString<EscapeUnprintableBytes>(a.data(), a.size());
+}
 
-    return ret;
+void escapeUnprintable(const void *data, size_t datasize, lintel::ByteBuffer &out) {
+    appendEscaped<EscapeUnprintableBytes>(out, data, datasize);
 }
 
 string htmlEscapeUnprintable(const string &in) {
@@ -231,22 +496,30 @@ string htmlEscapeUnprintable(const string &in) {
 // if the string has commas then we need to use "" around the string
 // if the string has " then we need to double the existent quotes 
 string toCSVform(const string &s) {
-    string ret(s);
-    int pos = -1; 
-
-    if ((pos = ret.find(",",0)) >= 0){
-	ret.insert(0,"\"");
-	pos = 1;
-	while ((pos = ret.find("\"",pos)) >= 0){
-	    ret.insert(pos,"\"");
-	    pos = pos + 2;
-	}
-	ret.append("\"");
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(s.data());
+    if (plainPrefix<CSVCommaBytes>(data, s.size()) == s.size()) {
+	return s;
     }
-
+    string ret("\"");
+    ret.append(escapedString<CSVQuoteBytes>(data, s.size()));
+    ret.push_back('"');
     return ret;
 }
 
+void toCSVform(const void *_data, size_t datasize, lintel::ByteBuffer &out) {
+    const uint8_t *data = static_cast<const uint8_t *>(_data);
+    if (plainPrefix<CSVCommaBytes>(data, datasize) == datasize) {
+	memcpy(writeRoom(out, datasize), data, datasize);
+	out.extend(datasize);
+    } else {
+	*writeRoom(out, 1) = '"';
+	out.extend(1);
+	appendEscaped<CSVQuoteBytes>(out, data, datasize);
+	*writeRoom(out, 1) = '"';
+	out.extend(1);
+    }
+}
+
 static int unpackhexchar(const char v) {
     if (v >= '0' && v <= '9')
 	return v - '0';
@@ -267,14 +540,20 @@ unsigned char unpackhex(const char *v) {
 string hex2raw(const char *ch, uint32_t n) {
     INVARIANT((n % 2) == 0, 
 	      format("can't convert string to hex, not an even number of %d digits") % n);
-    string out;
-    out.resize(n/2);
-    for(uint32_t i = 0; i < n/2; ++i) {
-	out[i] = unpackhex(ch + 2*i);
+    string out(n/2, '\0');
+    if (n > 0) {
+	hexDecode(ch, n/2, reinterpret_cast<uint8_t *>(&out[0]));
     }
     return out;
 }
 
+void hex2raw(const char *ch, size_t n, lintel::ByteBuffer &out) {
+    INVARIANT((n % 2) == 0, 
+	      format("can't convert string to hex, not an even number of %d digits") % n);
+    hexDecode(ch, n/2, reinterpret_cast<uint8_t *>(writeRoom(out, n/2)));
+    out.extend(n/2);
+}
+
 string hex2raw(const string &in) {
     return hex2raw(in.c_str(), in.size());
 }
@@ -327,11 +606,10 @@ uint32_t stringtoipv4(const string &val) {
 #endif // SYS_POSIX
 
 double stringToDouble(const string &str) {
-    char *endptr = NULL;
     INVARIANT(str.size() > 0, 
 	      "zero length string not valid in conversion to double");
-    double ret = strtod(str.c_str(),&endptr);
-    INVARIANT(*endptr == '\0',
+    double ret;
+    INVARIANT(parseDouble(str, ret),
 	      boost::format("didn't parse all of '%s' as a double") % str);
     return ret;
 }
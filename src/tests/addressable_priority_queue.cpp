@@ -0,0 +1,200 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for AddressablePriorityQueue
+*/
+
+#include <string.h>
+
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include <Lintel/AddressablePriorityQueue.hpp>
+#include <Lintel/Clock.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/PriorityQueue.hpp>
+#include <Lintel/TestUtil.hpp>
+
+using namespace std;
+using boost::format;
+
+typedef AddressablePriorityQueue<int> IntQueue;
+
+void checkTop(const IntQueue &queue, const map<IntQueue::Handle, int> &live) {
+    SINVARIANT(queue.size() == live.size());
+    if (live.empty()) {
+	SINVARIANT(queue.empty());
+	return;
+    }
+    int max_val = live.begin()->second;
+    for (map<IntQueue::Handle, int>::const_iterator i = live.begin(); i != live.end(); ++i) {
+	max_val = max(max_val, i->second);
+    }
+    SINVARIANT(queue.top() == max_val && queue.get(queue.topHandle()) == max_val);
+}
+
+// random push, pop, update and erase against a map of the live values;
+// small values so there are lots of ties
+void testRandom() {
+    MersenneTwisterRandom mt(1933);
+    IntQueue queue;
+    map<IntQueue::Handle, int> live;
+    vector<IntQueue::Handle> handles;
+
+    for (unsigned i = 0; i < 20000; ++i) {
+	unsigned op = mt.randInt(10);
+	if (op < 4 || live.empty()) {
+	    int v = mt.randInt(1000);
+	    IntQueue::Handle h = queue.push(v);
+	    SINVARIANT(live.find(h) == live.end());
+	    live[h] = v;
+	    handles.push_back(h);
+	} else {
+	    // pick a live handle; drop dead ones as we find them
+	    size_t j = mt.randInt(handles.size());
+	    while (!queue.contains(handles[j])) {
+		handles[j] = handles.back();
+		handles.pop_back();
+		j = mt.randInt(handles.size());
+	    }
+	    IntQueue::Handle h = handles[j];
+	    SINVARIANT(queue.get(h) == live[h]);
+	    if (op < 7) {
+		int v = mt.randInt(1000);
+		queue.update(h, v);
+		live[h] = v;
+	    } else if (op < 9) {
+		queue.erase(h);
+		live.erase(h);
+	    } else {
+		live.erase(queue.topHandle());
+		queue.pop();
+	    }
+	}
+	if (i % 97 == 0) {
+	    queue.selfVerify();
+	}
+	checkTop(queue, live);
+    }
+    queue.selfVerify();
+
+    int prev = queue.top();
+    while (!queue.empty()) {
+	SINVARIANT(queue.top() <= prev);
+	prev = queue.top();
+	queue.pop();
+    }
+    cout << "random test passed.\n";
+}
+
+void testHandles() {
+    IntQueue queue;
+    IntQueue::Handle a = queue.push(5), b = queue.push(7), c = queue.push(6);
+    SINVARIANT(queue.topHandle() == b);
+    queue.update(a, 10);
+    SINVARIANT(queue.topHandle() == a);
+    queue.update(a, 0);
+    SINVARIANT(queue.topHandle() == b);
+    queue.erase(b);
+    SINVARIANT(!queue.contains(b) && queue.topHandle() == c && queue.size() == 2);
+    TEST_INVARIANT_MSG1(queue.erase(b), "AddressablePriorityQueue: handle 1 is not queued");
+    TEST_INVARIANT_MSG1(queue.get(17), "AddressablePriorityQueue: handle 17 is not queued");
+    // freed handles are reused
+    SINVARIANT(queue.push(1) == b);
+    queue.clear();
+    SINVARIANT(queue.empty() && !queue.contains(a));
+    cout << "handle test passed.\n";
+}
+
+// A timer wheel style workload: n timers, each step either fires the
+// earliest and re-arms it, or reschedules a random timer.  Compare to
+// the lazy approach with a PriorityQueue, pushing a new copy on each
+// reschedule and skipping stale copies when they reach the top.
+struct LazyEntry {
+    LazyEntry() : when(0), timer(0), version(0) { }
+    LazyEntry(uint64_t when, uint32_t timer, uint32_t version)
+	: when(when), timer(timer), version(version) { }
+    uint64_t when;
+    uint32_t timer, version;
+};
+
+struct LazyEntryGeq {
+    bool operator()(const LazyEntry &a, const LazyEntry &b) const {
+	return a.when >= b.when;
+    }
+};
+
+void timeReschedule(uint32_t n, uint32_t steps) {
+    MersenneTwisterRandom mt(42);
+    vector<uint64_t> initial(n);
+    for (uint32_t i = 0; i < n; ++i) {
+	initial[i] = mt.randInt();
+    }
+
+    AddressablePriorityQueue<uint64_t, std::greater_equal<uint64_t> > queue;
+    vector<uint32_t> handles(n);
+    for (uint32_t i = 0; i < n; ++i) {
+	handles[i] = queue.push(initial[i]);
+    }
+    MersenneTwisterRandom mt1(7);
+    Clock::Tfrac start = Clock::todTfrac();
+    for (uint32_t i = 0; i < steps; ++i) {
+	uint64_t now = queue.top();
+	if (mt1.randInt(4) == 0) {
+	    queue.update(queue.topHandle(), now + mt1.randInt());
+	} else {
+	    uint32_t t = mt1.randInt(n);
+	    queue.update(handles[t], now + mt1.randInt());
+	}
+    }
+    double addressable = Clock::TfracToDouble(Clock::todTfrac() - start);
+
+    PriorityQueue<LazyEntry, LazyEntryGeq> lazy;
+    vector<uint32_t> versions(n, 0);
+    for (uint32_t i = 0; i < n; ++i) {
+	lazy.push(LazyEntry(initial[i], i, 0));
+    }
+    MersenneTwisterRandom mt2(7);
+    size_t max_size = 0;
+    start = Clock::todTfrac();
+    for (uint32_t i = 0; i < steps; ++i) {
+	while (lazy.top().version != versions[lazy.top().timer]) {
+	    lazy.pop();
+	}
+	uint64_t now = lazy.top().when;
+	uint32_t t;
+	if (mt2.randInt(4) == 0) {
+	    t = lazy.top().timer;
+	    lazy.pop();
+	} else {
+	    t = mt2.randInt(n);
+	}
+	lazy.push(LazyEntry(now + mt2.randInt(), t, ++versions[t]));
+	max_size = max(max_size, static_cast<size_t>(lazy.size()));
+    }
+    double lazy_time = Clock::TfracToDouble(Clock::todTfrac() - start);
+
+    cout << format("%d timers, %d reschedules: addressable %.1f ns each, %d entries; "
+		   "lazy %.1f ns each, up to %d entries\n")
+	% n % steps % (1.0e9 * addressable / steps) % queue.size()
+	% (1.0e9 * lazy_time / steps) % max_size;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "long") == 0) {
+	timeReschedule(10000, 2000000);
+	timeReschedule(1000000, 2000000);
+	return 0;
+    }
+    testRandom();
+    testHandles();
+    return 0;
+}
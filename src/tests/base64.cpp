@@ -1,19 +1,200 @@
+#include <string.h>
+
 #include <iostream>
 #include <Lintel/Base64.hpp>
+#include <Lintel/ByteBuffer.hpp>
+#include <Lintel/Clock.hpp>
 #include <Lintel/LintelLog.hpp>
 #include <Lintel/MersenneTwisterRandom.hpp>
 #include <Lintel/TestUtil.hpp>
 
 using namespace std;
 using lintel::ASCIIbeticalB64;
+using lintel::Base64;
+using lintel::ByteBuffer;
 using boost::format;
 
+namespace {
+    const Base64::Alphabet alphabets[] = { Base64::Standard, Base64::URLSafe,
+                                           Base64::ASCIIbetical };
+    const Base64::Strategy strategies[] = { Base64::Scalar, Base64::SSSE3, Base64::AVX2 };
+
+    string randomBytes(MersenneTwisterRandom &rand, size_t size) {
+        string ret(size, '\0');
+        for (size_t i = 0; i < size; ++i) {
+            ret[i] = static_cast<char>(rand.randInt(256));
+        }
+        return ret;
+    }
+}
+
+void testRFC4648() {
+    static const char *vectors[][2] = {
+        { "", "" }, { "f", "Zg==" }, { "fo", "Zm8=" }, { "foo", "Zm9v" },
+        { "foob", "Zm9vYg==" }, { "fooba", "Zm9vYmE=" }, { "foobar", "Zm9vYmFy" }
+    };
+    Base64 standard, unpadded(Base64::Standard, false);
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i) {
+        string in(vectors[i][0]), expected(vectors[i][1]), out;
+        SINVARIANT(standard.encode(in) == expected);
+        SINVARIANT(standard.decode(expected, out) && out == in);
+        string bare(expected.substr(0, expected.find('=')));
+        SINVARIANT(unpadded.encode(in) == bare);
+        SINVARIANT(standard.decode(bare, out) && out == in);
+    }
+
+    // the two alphabets differ only in the last two characters
+    string special("\xfb\xff\xbf", 3);
+    SINVARIANT(standard.encode(special) == "+/+/");
+    SINVARIANT(Base64(Base64::URLSafe).encode(special) == "-_-_");
+    SINVARIANT(Base64(Base64::URLSafe, true).encode("f") == "Zg==");
+    SINVARIANT(Base64(Base64::URLSafe).encode("f") == "Zg");
+    LintelLog::info("RFC 4648 test vectors passed");
+}
+
+void testInvalid() {
+    Base64 standard;
+    string out;
+    SINVARIANT(!standard.decode(string("Zm9v!"), out));
+    SINVARIANT(!standard.decode(string("Z"), out));
+    SINVARIANT(!standard.decode(string("Zm9vY"), out));
+    SINVARIANT(!standard.decode(string("Zm 9v"), out));
+    SINVARIANT(standard.decode(string("Zg=="), out) && out == "f");
+    SINVARIANT(!standard.decode(string("Z==="), out));
+    SINVARIANT(!standard.decode(string("Zg=a"), out));
+    SINVARIANT(!standard.decode(string("-_-_"), out));
+    SINVARIANT(!Base64(Base64::URLSafe).decode(string("+/+/"), out));
+
+    // invalid characters at every position of a long input, so the
+    // vector loops see them too
+    MersenneTwisterRandom rand;
+    for (size_t s = 0; s < sizeof(strategies) / sizeof(strategies[0]); ++s) {
+        if (!Base64::strategyAvailable(strategies[s])) {
+            continue;
+        }
+        Base64 codec(Base64::Standard, strategies[s]);
+        string good = codec.encode(randomBytes(rand, 300));
+        SINVARIANT(codec.decode(good, out));
+        for (size_t i = 0; i < good.size() - 2; ++i) {
+            string bad(good);
+            bad[i] = "!*\n\x80"[rand.randInt(4)];
+            SINVARIANT(!codec.decode(bad, out));
+        }
+    }
+    LintelLog::info("invalid input test passed");
+}
+
+void testRandom() {
+    MersenneTwisterRandom rand;
+    for (size_t a = 0; a < sizeof(alphabets) / sizeof(alphabets[0]); ++a) {
+        Base64 scalar(alphabets[a], false, Base64::Scalar);
+        for (size_t s = 0; s < sizeof(strategies) / sizeof(strategies[0]); ++s) {
+            if (!Base64::strategyAvailable(strategies[s])) {
+                LintelLog::info(format("skipping unavailable strategy %s")
+                                % Base64::strategyName(strategies[s]));
+                continue;
+            }
+            for (int pad = 0; pad < 2; ++pad) {
+                Base64 codec(alphabets[a], pad == 1, strategies[s]);
+                SINVARIANT(codec.strategy() == strategies[s]);
+                for (size_t size = 0; size < 400; ++size) {
+                    string data = randomBytes(rand, size);
+                    string encoded = codec.encode(data);
+                    SINVARIANT(encoded.size() == codec.encodedLength(size));
+                    if (alphabets[a] == Base64::ASCIIbetical && pad == 0) {
+                        SINVARIANT(encoded == ASCIIbeticalB64::encode(data.data(), size, 0));
+                    }
+                    if (pad == 0) {
+                        SINVARIANT(encoded == scalar.encode(data));
+                    }
+                    string decoded;
+                    SINVARIANT(codec.decode(encoded, decoded) && decoded == data);
+
+                    ByteBuffer buf;
+                    buf.append(string("x"));
+                    codec.encode(data.data(), size, buf);
+                    SINVARIANT(buf.asString() == "x" + encoded);
+                    buf.consume(1);
+                    ByteBuffer out;
+                    SINVARIANT(codec.decode(buf.readStartAs<char>(), buf.readAvailable(), out));
+                    SINVARIANT(out.asString() == data);
+                }
+            }
+        }
+    }
+    LintelLog::info("random round trip test passed");
+}
+
+void testStreaming() {
+    MersenneTwisterRandom rand;
+    for (size_t a = 0; a < sizeof(alphabets) / sizeof(alphabets[0]); ++a) {
+        Base64 codec(alphabets[a]);
+        Base64::Encoder encoder(codec);
+        Base64::Decoder decoder(codec);
+        for (int rep = 0; rep < 200; ++rep) {
+            string data = randomBytes(rand, rand.randInt(2000));
+            string expected = codec.encode(data);
+
+            ByteBuffer encoded;
+            for (size_t i = 0; i < data.size(); ) {
+                size_t amt = min<size_t>(rand.randInt(100), data.size() - i);
+                encoder.update(data.data() + i, amt, encoded);
+                i += amt;
+            }
+            encoder.finish(encoded);
+            SINVARIANT(encoded.asString() == expected);
+
+            ByteBuffer decoded;
+            for (size_t i = 0; i < expected.size(); ) {
+                size_t amt = min<size_t>(rand.randInt(100), expected.size() - i);
+                SINVARIANT(decoder.update(expected.data() + i, amt, decoded));
+                i += amt;
+            }
+            SINVARIANT(decoder.finish(decoded));
+            SINVARIANT(decoded.asString() == data);
+        }
+
+        // an error in the middle of the stream
+        string bad = codec.encode(randomBytes(rand, 600));
+        bad[300] = '!';
+        ByteBuffer decoded;
+        bool ok = decoder.update(bad.data(), 200, decoded)
+            && decoder.update(bad.data() + 200, bad.size() - 200, decoded)
+            && decoder.finish(decoded);
+        SINVARIANT(!ok);
+    }
+    LintelLog::info("streaming test passed");
+}
+
+void speedTest() {
+    MersenneTwisterRandom rand;
+    string data = randomBytes(rand, 4 << 20);
+    for (size_t s = 0; s < sizeof(strategies) / sizeof(strategies[0]); ++s) {
+        if (!Base64::strategyAvailable(strategies[s])) {
+            continue;
+        }
+        Base64 codec(Base64::Standard, strategies[s]);
+        string encoded, decoded;
+        Clock::Tfrac start = Clock::todTfrac();
+        encoded = codec.encode(data);
+        Clock::Tfrac mid = Clock::todTfrac();
+        SINVARIANT(codec.decode(encoded, decoded));
+        Clock::Tfrac stop = Clock::todTfrac();
+        SINVARIANT(decoded == data);
+        LintelLog::info(format("%s: encode %.0f MB/s, decode %.0f MB/s")
+                        % Base64::strategyName(strategies[s])
+                        % (data.size() / Clock::TfracToDouble(mid - start) / 1.0e6)
+                        % (data.size() / Clock::TfracToDouble(stop - mid) / 1.0e6));
+    }
+}
+
 // Simple test added to verify Base64 basic encode, decode interface are working. There was a
 // bug(typo) due to which this test is added.
 int main(int argv, char *argc[]) {
     LintelLog::info("ASCIIbeticalB64 encoding decoding test starts");
     string data;
-    if (argv == 1) {
+    bool long_run = argv == 2 && strcmp(argc[1], "long") == 0;
+    if (argv == 1 || long_run) {
         MersenneTwisterRandom rand;
         const static string hex_string = "0123456789abcde";
         uint32_t length = rand.randInt(64);
@@ -36,4 +217,14 @@ int main(int argv, char *argc[]) {
 
     SINVARIANT(data == decoded_data);
     LintelLog::info("Test passed");
+
+    if (argv == 1 || long_run) {
+        testRFC4648();
+        testInvalid();
+        testRandom();
+        testStreaming();
+    }
+    if (long_run) {
+        speedTest();
+    }
 }
@@ -0,0 +1,158 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for ColumnarHashTupleStats
+*/
+
+#include <string.h>
+
+#include <iostream>
+#include <vector>
+
+#include <Lintel/Clock.hpp>
+#include <Lintel/ColumnarHashTupleStats.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+
+using namespace std;
+using boost::format;
+using lintel::ColumnarHashTupleStats;
+using lintel::HashTupleStats;
+
+typedef boost::tuple<int32_t, int32_t> Tuple2;
+typedef ColumnarHashTupleStats<Tuple2> Columnar;
+typedef HashTupleStats<Tuple2> Rows;
+
+struct Entry {
+    Entry(const Tuple2 &key, const Stats &stats) 
+	: key(key), count(stats.countll()), total(stats.total()),
+	  min(stats.min()), max(stats.max()), mean(stats.mean()) { }
+    Tuple2 key;
+    uint64_t count;
+    double total, min, max, mean;
+};
+
+void collect(vector<Entry> &entries, const Tuple2 &key, const Stats &value) {
+    entries.push_back(Entry(key, value));
+}
+
+void sameEntries(const vector<Entry> &a, const vector<Entry> &b) {
+    INVARIANT(a.size() == b.size(), format("%d != %d entries") % a.size() % b.size());
+    for (unsigned i = 0; i < a.size(); ++i) {
+	SINVARIANT(a[i].key == b[i].key);
+	SINVARIANT(a[i].count == b[i].count);
+	SINVARIANT(a[i].min == b[i].min && a[i].max == b[i].max);
+	SINVARIANT(Double::eq(a[i].total, b[i].total));
+	SINVARIANT(Double::eq(a[i].mean, b[i].mean));
+    }
+}
+
+void sameAs(const Columnar &columnar, const Rows &rows) {
+    vector<Entry> ea, eb;
+    columnar.walkOrdered(boost::bind(collect, boost::ref(ea), _1, _2));
+    rows.walkOrdered(boost::bind(collect, boost::ref(eb), _1, _2));
+    sameEntries(ea, eb);
+}
+
+bool oddFirst(const Tuple2 &key) {
+    return (key.get<0>() & 1) == 1;
+}
+
+void testBasic() {
+    MersenneTwisterRandom rand(1776);
+    Columnar columnar;
+    Rows rows;
+    for (unsigned i = 0; i < 100000; ++i) {
+	Tuple2 key(rand.randInt(100), rand.randInt(50));
+	double value = rand.randDouble();
+	columnar.add(key, value);
+	rows.add(key, value);
+    }
+    SINVARIANT(columnar.size() == rows.size());
+    sameAs(columnar, rows);
+
+    // group ids are dense and in first-added order
+    vector<Entry> walked;
+    columnar.walk(boost::bind(collect, boost::ref(walked), _1, _2));
+    for (uint32_t i = 0; i < walked.size(); ++i) {
+	uint32_t id;
+	SINVARIANT(columnar.lookupGroupId(walked[i].key, id) && id == i);
+	SINVARIANT(columnar.count(id) == walked[i].count);
+	SINVARIANT(Double::eq(columnar.mean(id), walked[i].mean));
+	Stats stats;
+	columnar.getStats(id, stats);
+	SINVARIANT(stats.countll() == walked[i].count && stats.min() == walked[i].min);
+    }
+    uint32_t id;
+    SINVARIANT(!columnar.lookupGroupId(Tuple2(-1, -1), id));
+
+    columnar.prune(oddFirst);
+    rows.prune(oddFirst);
+    sameAs(columnar, rows);
+    for (uint32_t i = 0; i < columnar.size(); ++i) {
+	SINVARIANT(columnar.lookupGroupId(columnar.key(i), id) && id == i);
+    }
+
+    // merging Stats, and filling a HashTupleStats
+    Columnar merged;
+    Stats one, empty;
+    one.add(3);
+    one.add(5);
+    merged.add(Tuple2(1, 1), one);
+    merged.add(Tuple2(1, 1), empty);
+    merged.add(Tuple2(1, 1), 4);
+    Rows filled;
+    merged.fill(filled);
+    Stats &got = filled[Tuple2(1, 1)];
+    SINVARIANT(got.countll() == 3 && got.min() == 3 && got.max() == 5 && got.mean() == 4);
+
+    columnar.clear();
+    SINVARIANT(columnar.size() == 0);
+    cout << "columnar basic test passed.\n";
+}
+
+// Compare adding to many groups; just prints the numbers.  Note that
+// HashTupleStats::memoryUsage() leaves out the malloc overhead of the
+// per-group Stats, and that vector growth leaves the columns up to
+// half empty.
+void testManyGroups(unsigned ngroups) {
+    MersenneTwisterRandom rand(1812);
+    vector<Tuple2> keys;
+    for (unsigned i = 0; i < 4 * ngroups; ++i) {
+	keys.push_back(Tuple2(rand.randInt(ngroups), rand.randInt(4)));
+    }
+
+    Clock::Tfrac start = Clock::todTfrac();
+    Columnar columnar;
+    for (unsigned i = 0; i < keys.size(); ++i) {
+	columnar.add(keys[i], i);
+    }
+    Clock::Tfrac columnar_done = Clock::todTfrac();
+    Rows rows;
+    for (unsigned i = 0; i < keys.size(); ++i) {
+	rows.add(keys[i], i);
+    }
+    Clock::Tfrac rows_done = Clock::todTfrac();
+
+    cout << format("%d adds to %d groups: columnar %.3fs %.1fMB, HashTupleStats %.3fs %.1fMB\n")
+	% keys.size() % columnar.size() 
+	% Clock::TfracToDouble(columnar_done - start) % (columnar.memoryUsage() / 1.0e6)
+	% Clock::TfracToDouble(rows_done - columnar_done) % (rows.memoryUsage() / 1.0e6);
+    SINVARIANT(columnar.size() == rows.size());
+    sameAs(columnar, rows);
+    cout << "columnar many groups test passed.\n";
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "long") == 0) {
+	testManyGroups(1000 * 1000);
+	return 0;
+    }
+    testBasic();
+    testManyGroups(10 * 1000);
+    return 0;
+}
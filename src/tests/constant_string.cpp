@@ -0,0 +1,174 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for ConstantString and ConstantStringPool
+*/
+
+#include <string.h>
+
+#include <iostream>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include <Lintel/Clock.hpp>
+#include <Lintel/ConstantString.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/PThread.hpp>
+
+using namespace std;
+using boost::format;
+
+static const unsigned num_threads = 8;
+
+void testBasic() {
+    ConstantString a("hello"), b(string("hello")), c("hellp"), empty;
+    SINVARIANT(a == b && a.c_str() == b.c_str());
+    SINVARIANT(a != c && a < c && c > a);
+    SINVARIANT(a.size() == 5 && a.c_str()[5] == '\0' && a.str() == "hello");
+    SINVARIANT(empty.empty() && empty == ConstantString("") && empty == ConstantString(""));
+
+    // binary data, including strings that are the same up to a null
+    ConstantString n1("a\0b", 3), n2("a\0c", 3), n3("a", 1), n4("a\0", 2);
+    SINVARIANT(n1 != n2 && n1 != n3 && n3 != n4 && n1 != n4);
+    SINVARIANT(n1 == ConstantString("a\0b", 3) && n1.size() == 3);
+
+    // larger than the shared buffers handle
+    string big(100000, 'x');
+    ConstantString big1(big), big2(big);
+    SINVARIANT(big1 == big2 && big1.str() == big);
+
+    // copies and assignment share the pointer
+    ConstantString d(a);
+    c = a;
+    SINVARIANT(d == a && c == a);
+    cout << "basic test passed.\n";
+}
+
+void testPools() {
+    ConstantStringPool pool(1);
+    ConstantString a("hello", pool), b("hello");
+    SINVARIANT(a.str() == b.str() && a != b);
+    SINVARIANT(a == ConstantString(string("hello"), pool));
+    SINVARIANT(pool.find("hello", 5) == pool.intern("hello", 5));
+    SINVARIANT(pool.find("goodbye", 7) == NULL);
+
+    // enough strings to grow the single shard's table several times
+    vector<ConstantStringValue *> values;
+    for (unsigned i = 0; i < 100000; ++i) {
+	string s = (format("string-%d") % i).str();
+	values.push_back(pool.intern(s.data(), s.size()));
+    }
+    for (unsigned i = 0; i < 100000; ++i) {
+	string s = (format("string-%d") % i).str();
+	SINVARIANT(pool.find(s.data(), s.size()) == values[i]);
+	SINVARIANT(ConstantString_length(values[i]) == s.size());
+	SINVARIANT(memcmp(ConstantString_c_str(values[i]), s.data(), s.size()) == 0);
+    }
+    // "", "hello" and the numbered strings
+    SINVARIANT(pool.nStrings() == 100002);
+    SINVARIANT(pool.bytesAllocated() > pool.stringBytes());
+
+    ConstantStringPool sharded(10);
+    SINVARIANT(sharded.nShards() == 16);
+    cout << "pool test passed.\n";
+}
+
+class InternThread : public PThread {
+public:
+    InternThread(ConstantStringPool &pool, const vector<string> &strings, unsigned seed)
+	: pool(pool), strings(strings), seed(seed), values(strings.size()) { }
+
+    virtual void *run() {
+	// every thread interns all of the strings, in a different order
+	MersenneTwisterRandom rand(seed);
+	vector<size_t> order(strings.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+	    order[i] = i;
+	}
+	MT_random_shuffle(order.begin(), order.end(), rand);
+	Clock::Tfrac start = Clock::todTfrac();
+	for (size_t i = 0; i < order.size(); ++i) {
+	    const string &s = strings[order[i]];
+	    values[order[i]] = pool.intern(s.data(), s.size());
+	}
+	elapsed = Clock::TfracToDouble(Clock::todTfrac() - start);
+	return NULL;
+    }
+
+    ConstantStringPool &pool;
+    const vector<string> &strings;
+    unsigned seed;
+    vector<ConstantStringValue *> values;
+    double elapsed;
+};
+
+// returns the mean seconds per intern
+double runThreads(ConstantStringPool &pool, const vector<string> &strings, unsigned nthreads) {
+    vector<InternThread *> threads;
+    for (unsigned i = 0; i < nthreads; ++i) {
+	threads.push_back(new InternThread(pool, strings, i + 1));
+	threads.back()->start();
+    }
+    double total = 0;
+    for (unsigned i = 0; i < nthreads; ++i) {
+	threads[i]->join();
+	total += threads[i]->elapsed;
+	SINVARIANT(threads[i]->values == threads[0]->values);
+    }
+    for (size_t i = 0; i < strings.size(); ++i) {
+	const ConstantStringValue *v = threads[0]->values[i];
+	SINVARIANT(ConstantString_length(v) == strings[i].size());
+	SINVARIANT(memcmp(ConstantString_c_str(v), strings[i].data(), strings[i].size()) == 0);
+    }
+    for (unsigned i = 0; i < nthreads; ++i) {
+	delete threads[i];
+    }
+    return total / (nthreads * strings.size());
+}
+
+vector<string> makeStrings(size_t count) {
+    vector<string> ret;
+    for (size_t i = 0; i < count; ++i) {
+	ret.push_back((format("%x.example.com/path/%d") % (i * 2654435761U) % i).str());
+    }
+    return ret;
+}
+
+void testThreads() {
+    vector<string> strings(makeStrings(50000));
+    ConstantStringPool pool;
+    runThreads(pool, strings, num_threads);
+    SINVARIANT(pool.nStrings() == strings.size() + 1);
+    cout << "threaded test passed.\n";
+}
+
+// Each run interns the same strings from every thread into a new pool, so most interns from
+// the later threads find the string already there.
+void benchmark() {
+    vector<string> strings(makeStrings(100000));
+    for (unsigned shards = 1; shards <= 16; shards *= 16) {
+	for (unsigned nthreads = 1; nthreads <= num_threads; nthreads *= 2) {
+	    ConstantStringPool pool(shards);
+	    double secs = runThreads(pool, strings, nthreads);
+	    cout << format("%2d shards, %d threads: %.0f ns/intern\n")
+		% shards % nthreads % (secs * 1.0e9);
+	}
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "long") == 0) {
+	benchmark();
+	return 0;
+    }
+    testBasic();
+    testPools();
+    testThreads();
+    return 0;
+}
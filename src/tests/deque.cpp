@@ -9,13 +9,16 @@
     test for deque
 */
 
-// TODO: add performance comparison to this test
 #include <iostream>
 #include <inttypes.h>
+#include <string.h>
 #include <deque>
 
+#include <Lintel/Clock.hpp>
 #include <Lintel/Deque.hpp>
 #include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/TestUtil.hpp>
+
 using namespace std;
 using boost::format;
 
@@ -70,7 +73,7 @@ void testPushBack() {
 
     SINVARIANT(deque.empty());
     deque.reserve(8);
-    SINVARIANT(deque.empty() && deque.capacity() == 8);
+    SINVARIANT(deque.empty() && deque.capacity() == 15); // capacities are 2^k - 1
     for(int i = 0; i < 5; ++i) {
 	deque.push_back(i);
 	SINVARIANT(deque.back() == i);
@@ -204,6 +207,37 @@ void testSorting() {
     }
 }
 
+// searching and indexing on a sorted deque that wraps around the end of its buffer
+void testRandomAccess() {
+    Deque<int> deque(64);
+    for (int i = 0; i < 40; ++i) {
+        deque.push_back(-1);
+    }
+    MersenneTwisterRandom rng(7);
+    vector<int> sorted;
+    for (int i = 0; i < 50; ++i) {
+        if (!deque.empty() && deque.front() == -1) {
+            deque.pop_front();
+        }
+        int v = rng.randInt(100);
+        deque.push_back(v);
+        sorted.push_back(v);
+    }
+    SINVARIANT(deque.size() == sorted.size() && deque.capacity() == 63);
+    sort(deque.begin(), deque.end());
+    sort(sorted.begin(), sorted.end());
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        SINVARIANT(deque.begin()[i] == sorted[i] && *(i + deque.begin()) == sorted[i]);
+    }
+    for (int v = -1; v <= 100; ++v) {
+        SINVARIANT(lower_bound(deque.begin(), deque.end(), v) - deque.begin() 
+                   == lower_bound(sorted.begin(), sorted.end(), v) - sorted.begin());
+        SINVARIANT(binary_search(deque.begin(), deque.end(), v) 
+                   == binary_search(sorted.begin(), sorted.end(), v));
+    }
+    SINVARIANT((deque.end() - 1)[0] == sorted.back());
+}
+
 void testIteratorOperations() {
     Deque<int> deque;
     MersenneTwisterRandom rng;
@@ -271,13 +305,244 @@ void testIteratorOperations() {
     SINVARIANT(dist_from_finish == 0);
 }
 
-int main(int, char **) {
+struct Counted {
+    Counted(int v) : v(v) { ++count; }
+    Counted(const Counted &from) : v(from.v) { ++count; }
+    ~Counted() { --count; }
+    Counted &operator =(const Counted &from) { v = from.v; return *this; }
+    bool operator ==(const Counted &rhs) const { return v == rhs.v; }
+
+    int v;
+    static int count;
+};
+
+int Counted::count;
+
+// random bulk and single operations against std::deque; T is constructed from int
+template<class T> void performBulkTest(int seed) {
+    MersenneTwisterRandom rng(seed);
+    deque<T> std_deq;
+    Deque<T> lintel_deq(2);
+    vector<T> buf;
+    int next = 0;
+    for (int i = 0; i < 2000; ++i) {
+        size_t count = rng.randInt(40);
+        switch(rng.randInt(4)) 
+            {
+            case 0: 
+                buf.clear();
+                for (size_t j = 0; j < count; ++j, ++next) {
+                    buf.push_back(T(next));
+                    std_deq.push_back(T(next));
+                }
+                lintel_deq.push_back(buf.empty() ? NULL : &buf[0], buf.size());
+                break;
+            case 1:
+                count = min(count, std_deq.size());
+                buf.assign(count + 1, T(-1));
+                lintel_deq.pop_front(&buf[0], count);
+                for (size_t j = 0; j < count; ++j) {
+                    SINVARIANT(buf[j] == std_deq.front());
+                    std_deq.pop_front();
+                }
+                SINVARIANT(buf[count] == T(-1));
+                break;
+            case 2:
+                if (!std_deq.empty()) {
+                    SINVARIANT(lintel_deq.front() == std_deq.front());
+                    std_deq.pop_front();
+                    lintel_deq.pop_front();
+                }
+                break;
+            case 3:
+                // grow with the contents wrapped around the end
+                if (rng.randInt(10) == 0) {
+                    lintel_deq.reserve(lintel_deq.size() + count);
+                    SINVARIANT(lintel_deq.capacity() >= lintel_deq.size() + count
+                               && lintel_deq.capacity() < 2 * (lintel_deq.size() + count));
+                }
+                std_deq.push_back(T(next));
+                lintel_deq.push_back(T(next));
+                ++next;
+                break;
+            }
+        SINVARIANT(lintel_deq.size() == std_deq.size());
+    }
+    for (size_t i = 0; i < std_deq.size(); ++i) {
+        SINVARIANT(lintel_deq.at(i) == std_deq[i]);
+    }
+}
+
+void testBulk() {
+    for (int seed = 1; seed < 20; ++seed) {
+        performBulkTest<int>(seed);
+        performBulkTest<Counted>(seed);
+        SINVARIANT(Counted::count == 0);
+    }
+
+    // reserve keeps wrapped contents in order, and can shrink to fit
+    Deque<int> deque(8);
+    for (int i = 0; i < 6; ++i) {
+        deque.push_back(i);
+    }
+    for (int i = 0; i < 4; ++i) {
+        deque.pop_front();
+        deque.push_back(6 + i);
+    }
+    deque.reserve(100);
+    SINVARIANT(deque.capacity() == 127 && deque.size() == 6);
+    deque.reserve(6);
+    SINVARIANT(deque.capacity() == 7);
+    for (int i = 0; i < 6; ++i) {
+        SINVARIANT(deque.at(i) == 4 + i);
+    }
+    TEST_INVARIANT_MSG1(deque.reserve(5), "Can not reserve less than the current size");
+    int out[7];
+    TEST_INVARIANT_MSG1(deque.pop_front(out, 7), 
+                        "pop_front() of more values than are in the deque");
+}
+
+#if __cplusplus >= 201103L
+struct MoveOnly {
+    explicit MoveOnly(int v, int w = 0) : v(new int(v + w)) { }
+    MoveOnly(MoveOnly &&from) : v(from.v) { from.v = NULL; }
+    ~MoveOnly() { delete v; }
+    MoveOnly &operator =(MoveOnly &&from) { 
+        delete v; 
+        v = from.v; 
+        from.v = NULL; 
+        return *this;
+    }
+
+    int *v;
+};
+
+void testMove() {
+    Deque<MoveOnly> deque(2);
+    for (int i = 0; i < 100; ++i) {
+        if (i % 2 == 0) {
+            deque.push_back(MoveOnly(i));
+        } else {
+            deque.emplace_back(i - 1, 1);
+        }
+        if (i % 3 == 0) {
+            SINVARIANT(*deque.front().v == i / 3);
+            deque.pop_front();
+        }
+    }
+    deque.reserve(200);
+    MoveOnly out[10] = { MoveOnly(0), MoveOnly(0), MoveOnly(0), MoveOnly(0), MoveOnly(0), 
+                         MoveOnly(0), MoveOnly(0), MoveOnly(0), MoveOnly(0), MoveOnly(0) };
+    deque.pop_front(out, 10);
+    for (int i = 0; i < 10; ++i) {
+        SINVARIANT(*out[i].v == 34 + i);
+    }
+    SINVARIANT(*deque.front().v == 44 && *deque.back().v == 99);
+}
+#else
+void testMove() { }
+#endif
+
+template<class D> double timeElementwise(D &deque, const vector<int> &vals, size_t batch) {
+    Clock::Tfrac start = Clock::todTfrac();
+    for (size_t i = 0; i < vals.size(); i += batch) {
+        for (size_t j = i; j < i + batch; ++j) {
+            deque.push_back(vals[j]);
+        }
+        for (size_t j = i; j < i + batch; ++j) {
+            SINVARIANT(deque.front() == vals[j]);
+            deque.pop_front();
+        }
+    }
+    return Clock::TfracToDouble(Clock::todTfrac() - start);
+}
+
+void timeDeques() {
+    const size_t batch = 1000;
+    vector<int> vals(10 * 1000 * 1000);
+    for (size_t i = 0; i < vals.size(); ++i) {
+        vals[i] = i;
+    }
+    deque<int> std_deq;
+    double std_time = timeElementwise(std_deq, vals, batch);
+    Deque<int> lintel_deq;
+    double elementwise_time = timeElementwise(lintel_deq, vals, batch);
+
+    Deque<int> bulk_deq;
+    vector<int> out(batch);
+    Clock::Tfrac start = Clock::todTfrac();
+    for (size_t i = 0; i < vals.size(); i += batch) {
+        bulk_deq.push_back(&vals[i], batch);
+        bulk_deq.pop_front(&out[0], batch);
+        SINVARIANT(out[batch - 1] == vals[i + batch - 1]);
+    }
+    double bulk_time = Clock::TfracToDouble(Clock::todTfrac() - start);
+
+    double ns = 1.0e9 / vals.size();
+    cout << format("push+pop of %d ints in batches of %d: std::deque %.2f ns/int, "
+                   "Deque %.2f ns/int, Deque bulk %.2f ns/int\n")
+        % vals.size() % batch % (std_time * ns) % (elementwise_time * ns) % (bulk_time * ns);
+}
+
+// steady state queue of queue_size entries, touching each end and one
+// other entry per step; the pattern of an event queue.
+template<class D> double timeSteadyState(D &deque, size_t queue_size, size_t steps) {
+    for (size_t i = 0; i < queue_size; ++i) {
+        deque.push_back(i);
+    }
+    MersenneTwisterRandom rng(17);
+    vector<size_t> offsets(1024);
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        offsets[i] = rng.randInt(queue_size);
+    }
+    int64_t sum = 0;
+    Clock::Tfrac start = Clock::todTfrac();
+    for (size_t i = 0; i < steps; ++i) {
+        sum += deque.front() + deque.back() + deque.at(offsets[i % 1024]) + deque.size();
+        deque.pop_front();
+        deque.push_back(i);
+    }
+    double ret = Clock::TfracToDouble(Clock::todTfrac() - start);
+    SINVARIANT(sum != 0);
+    return ret;
+}
+
+void timeAccess() {
+    const size_t steps = 20 * 1000 * 1000;
+    deque<int> std_deq;
+    double std_time = timeSteadyState(std_deq, 1000, steps);
+    Deque<int> lintel_deq;
+    double lintel_time = timeSteadyState(lintel_deq, 1000, steps);
+    cout << format("steady state front+back+at+size+pop_front+push_back: "
+                   "std::deque %.2f ns/step, Deque %.2f ns/step\n")
+        % (1.0e9 * std_time / steps) % (1.0e9 * lintel_time / steps);
+
+    Deque<int> sort_deq;
+    MersenneTwisterRandom rng(3);
+    for (size_t i = 0; i < 1000 * 1000; ++i) {
+        sort_deq.push_back(rng.randInt());
+    }
+    Clock::Tfrac start = Clock::todTfrac();
+    sort(sort_deq.begin(), sort_deq.end());
+    cout << format("std::sort of %d ints in a Deque: %.2f ms\n") % sort_deq.size()
+        % (1.0e3 * Clock::TfracToDouble(Clock::todTfrac() - start));
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "long") == 0) {
+	timeDeques();
+	timeAccess();
+	return 0;
+    }
     testPushBack();
     testNoDefaultConstructor();
     testAssign();
     testDestroy();
     testSorting();
     testIteratorOperations();
+    testRandomAccess();
+    testBulk();
+    testMove();
     cout << "deque tests passed.\n";
 }
 
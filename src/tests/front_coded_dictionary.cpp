@@ -0,0 +1,178 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for FrontCodedDictionary
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include <Lintel/FrontCodedDictionary.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/StringId.hpp>
+#include <Lintel/TestUtil.hpp>
+
+using namespace std;
+using boost::format;
+using lintel::FrontCodedDictionary;
+
+MersenneTwisterRandom rng;
+
+string randomUrl() {
+    static const char *hosts[] = { "www.example.com", "www.example.org", "static.example.com",
+				   "images.example.net" };
+    static const char *dirs[] = { "/", "/a/", "/articles/2012/", "/users/profile/",
+				  "/search?q=" };
+    string ret = string("http://") + hosts[rng.randInt(4)] + dirs[rng.randInt(5)];
+    for (unsigned i = 0, n = rng.randInt(12); i < n; ++i) {
+	ret.push_back("abcdefghijklmnopqrstuvwxyz0123456789"[rng.randInt(36)]);
+    }
+    return ret;
+}
+
+void checkDictionary(const FrontCodedDictionary &dict, const vector<string> &sorted,
+		     const vector<string> &probes) {
+    SINVARIANT(dict.size() == sorted.size());
+    uint32_t id = 0;
+    for (FrontCodedDictionary::Iterator i(dict); i.valid(); ++i, ++id) {
+	SINVARIANT(i.id() == id && *i == sorted[id]);
+    }
+    SINVARIANT(id == sorted.size());
+    for (id = 0; id < sorted.size(); ++id) {
+	SINVARIANT(dict.getString(id) == sorted[id]);
+	SINVARIANT(dict.find(sorted[id]) == id);
+    }
+    if (!sorted.empty()) {
+	uint32_t start = rng.randInt(sorted.size());
+	FrontCodedDictionary::Iterator i(dict, start);
+	SINVARIANT(i.valid() && *i == sorted[start]);
+    }
+    SINVARIANT(!FrontCodedDictionary::Iterator(dict, sorted.size()).valid());
+
+    for (vector<string>::const_iterator p = probes.begin(); p != probes.end(); ++p) {
+	uint32_t lower = lower_bound(sorted.begin(), sorted.end(), *p) - sorted.begin();
+	uint32_t upper = upper_bound(sorted.begin(), sorted.end(), *p) - sorted.begin();
+	SINVARIANT(dict.lowerBound(*p) == lower);
+	SINVARIANT(dict.upperBound(*p) == upper);
+	SINVARIANT(dict.find(*p) == (lower == upper ? FrontCodedDictionary::npos : lower));
+
+	uint32_t begin, end;
+	dict.prefixRange(*p, begin, end);
+	SINVARIANT(begin == lower);
+	for (id = begin; id < end; ++id) {
+	    SINVARIANT(sorted[id].compare(0, p->size(), *p) == 0);
+	}
+	SINVARIANT(end == sorted.size() || sorted[end].compare(0, p->size(), *p) != 0);
+    }
+}
+
+void testRandom() {
+    HashUnique<string> unique;
+    vector<string> all;
+    for (unsigned i = 0; i < 20000; ++i) {
+	string url = randomUrl();
+	unique.add(url);
+	all.push_back(url);
+    }
+    unique.add("");
+    all.push_back("");
+    vector<string> sorted(unique.begin(), unique.end());
+    sort(sorted.begin(), sorted.end());
+
+    vector<string> probes;
+    for (unsigned i = 0; i < 2000; ++i) {
+	string s = sorted[rng.randInt(sorted.size())];
+	probes.push_back(s);
+	probes.push_back(s.substr(0, rng.randInt(s.size() + 1)));
+	probes.push_back(randomUrl());
+    }
+    probes.push_back("");
+    probes.push_back("http://");
+    probes.push_back("zzz");
+    probes.push_back("\xff\xff");
+
+    uint32_t block_sizes[] = { 1, 2, 16, 64 };
+    for (unsigned b = 0; b < 4; ++b) {
+	FrontCodedDictionary from_unique(unique, block_sizes[b]);
+	SINVARIANT(from_unique.blockSize() == block_sizes[b]);
+	checkDictionary(from_unique, sorted, probes);
+	// duplicates are removed
+	FrontCodedDictionary from_vector(all, block_sizes[b]);
+	checkDictionary(from_vector, sorted, probes);
+    }
+    cout << "random test passed.\n";
+}
+
+void testEdgeCases() {
+    FrontCodedDictionary empty;
+    SINVARIANT(empty.empty() && empty.find("a") == FrontCodedDictionary::npos);
+    SINVARIANT(empty.lowerBound("a") == 0 && !FrontCodedDictionary::Iterator(empty).valid());
+    uint32_t begin, end;
+    empty.prefixRange("", begin, end);
+    SINVARIANT(begin == 0 && end == 0);
+
+    // bytes above 0x7f sort after ASCII, and prefixes before longer strings
+    vector<string> strs;
+    strs.push_back("a");
+    strs.push_back(string("a\0", 2));
+    strs.push_back("ab");
+    strs.push_back("a\xff");
+    strs.push_back("a\xff\xff");
+    strs.push_back("b");
+    strs.push_back(string(1000, 'q')); // lengths take two bytes
+    FrontCodedDictionary::Builder builder(3);
+    for (size_t i = 0; i < strs.size(); ++i) {
+	builder.add(strs[i]);
+    }
+    FrontCodedDictionary dict;
+    builder.finish(dict);
+    vector<string> probes(strs);
+    probes.push_back("a\xff\x01");
+    probes.push_back("a\xfe");
+    checkDictionary(dict, strs, probes);
+    dict.prefixRange("a\xff", begin, end);
+    SINVARIANT(begin == 3 && end == 5);
+
+    // the builder is reset by finish
+    builder.add("z");
+    builder.finish(dict);
+    SINVARIANT(dict.size() == 1 && dict.getString(0) == "z");
+
+    FrontCodedDictionary::Builder bad(4);
+    bad.add("b");
+    TEST_INVARIANT_MSG1(bad.add("a"), "FrontCodedDictionary: strings must be added in increasing order");
+    TEST_INVARIANT_MSG1(bad.add("b"), "FrontCodedDictionary: strings must be added in increasing order");
+    cout << "edge case test passed.\n";
+}
+
+void testMemory() {
+    HashUnique<string> unique;
+    StringId string_id;
+    size_t bytes = 0;
+    while (unique.size() < 100000) {
+	string url = randomUrl();
+	if (unique.add(url)) {
+	    string_id.getId(url);
+	    bytes += url.size();
+	}
+    }
+    FrontCodedDictionary dict(unique);
+    cout << format("%d URLs, %d bytes: front coded %d bytes, StringId %d bytes\n")
+	% unique.size() % bytes % dict.memoryUsage() % string_id.memoryUsage();
+    SINVARIANT(dict.memoryUsage() * 2 < bytes);
+}
+
+int main(int, char **) {
+    testRandom();
+    testEdgeCases();
+    testMemory();
+    return 0;
+}
@@ -0,0 +1,212 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing and benchmark for MultiPatternSearch
+*/
+
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/BoyerMooreHorspool.hpp>
+#include <Lintel/Clock.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/MultiPatternSearch.hpp>
+#include <Lintel/TestUtil.hpp>
+
+using namespace std;
+using boost::format;
+using lintel::BoyerMooreHorspool;
+using lintel::ByteBuffer;
+using lintel::MultiPatternSearch;
+
+typedef vector<MultiPatternSearch::Match> Matches;
+
+// Every occurrence of every pattern, by brute force.
+Matches naive(const vector<string> &patterns, const string &hay) {
+    Matches ret;
+    for (uint32_t p = 0; p < patterns.size(); ++p) {
+	for (size_t i = hay.find(patterns[p]); i != string::npos; 
+	     i = hay.find(patterns[p], i + 1)) {
+	    ret.push_back(MultiPatternSearch::Match(p, i));
+	}
+    }
+    sort(ret.begin(), ret.end());
+    return ret;
+}
+
+void check(const vector<string> &patterns, const string &hay) {
+    MultiPatternSearch search;
+    for (uint32_t p = 0; p < patterns.size(); ++p) {
+	SINVARIANT(search.addPattern(patterns[p]) == p);
+    }
+    search.compile();
+    Matches expected(naive(patterns, hay)), got;
+    search.findAll(hay.data(), hay.size(), got);
+    sort(got.begin(), got.end());
+    INVARIANT(got == expected, format("%d matches, expected %d") % got.size() % expected.size());
+    SINVARIANT(search.matchesAny(hay.data(), hay.size()) == !expected.empty());
+
+    // the same thing in random sized chunks, some through a ByteBuffer
+    MersenneTwisterRandom rand(hay.size());
+    MultiPatternSearch::Stream stream(search);
+    Matches streamed;
+    for (size_t pos = 0; pos < hay.size(); ) {
+	size_t len = min(hay.size() - pos, static_cast<size_t>(rand.randInt(20)));
+	if (rand.randInt(2) == 0) {
+	    stream.scan(hay.data() + pos, len, streamed);
+	} else {
+	    ByteBuffer buf;
+	    buf.append(hay.data() + pos, len);
+	    stream.scan(buf, streamed);
+	}
+	pos += len;
+    }
+    SINVARIANT(stream.streamPosition() == hay.size());
+    sort(streamed.begin(), streamed.end());
+    SINVARIANT(streamed == expected);
+}
+
+void simpleTests() {
+    vector<string> patterns;
+    patterns.push_back("he");
+    patterns.push_back("she");
+    patterns.push_back("his");
+    patterns.push_back("hers");
+    patterns.push_back("he"); // duplicates are reported separately
+    check(patterns, "ushers said she and his hen were here");
+    check(patterns, "");
+    check(patterns, "xyz");
+
+    MultiPatternSearch search;
+    search.addPattern("abc");
+    search.addPattern("bc");
+    search.compile();
+    Matches got;
+    search.findAll("xabcx", 5, got);
+    SINVARIANT(got.size() == 2);
+    SINVARIANT(got[0] == MultiPatternSearch::Match(0, 1));
+    SINVARIANT(got[1] == MultiPatternSearch::Match(1, 2));
+
+    // a match spanning chunks is reported with its stream offset
+    MultiPatternSearch::Stream stream(search);
+    got.clear();
+    stream.scan("xxa", 3, got);
+    SINVARIANT(got.empty());
+    stream.scan("bc", 2, got);
+    SINVARIANT(got.size() == 2 && got[0] == MultiPatternSearch::Match(0, 2));
+    stream.reset();
+    got.clear();
+    stream.scan("bc", 2, got);
+    SINVARIANT(got.size() == 1 && got[0] == MultiPatternSearch::Match(1, 0));
+
+    MultiPatternSearch empty;
+    vector<MultiPatternSearch::Match> none;
+    TEST_INVARIANT_MSG1(empty.findAll("abc", 3, none),
+			"MultiPatternSearch: compile() before searching");
+    TEST_INVARIANT_MSG1(empty.matchesAny("abc", 3),
+			"MultiPatternSearch: compile() before searching");
+    empty.compile();
+    SINVARIANT(!empty.matchesAny("abc", 3));
+    cout << "simple tests passed.\n";
+}
+
+void randomTests(MersenneTwisterRandom &rand, unsigned alphabet) {
+    for (unsigned rep = 0; rep < 100; ++rep) {
+	string hay(rand.randInt(3000), ' ');
+	for (size_t i = 0; i < hay.size(); ++i) {
+	    hay[i] = 'a' + rand.randInt(alphabet);
+	}
+	vector<string> patterns;
+	unsigned npatterns = rand.randInt(50) + 1;
+	for (unsigned p = 0; p < npatterns; ++p) {
+	    size_t len = rand.randInt(8) + 1;
+	    if (rand.randInt(2) == 0 && hay.size() > len) {
+		patterns.push_back(hay.substr(rand.randInt(hay.size() - len), len));
+	    } else {
+		string pattern(len, ' ');
+		for (size_t i = 0; i < len; ++i) {
+		    pattern[i] = 'a' + rand.randInt(alphabet);
+		}
+		patterns.push_back(pattern);
+	    }
+	}
+	check(patterns, hay);
+    }
+    cout << format("random tests with %d letters passed.\n") % alphabet;
+}
+
+// Compare one pass with MultiPatternSearch to one BoyerMooreHorspool
+// pass per pattern over a log-like buffer.
+void benchmark(MersenneTwisterRandom &rand) {
+    static const char *words[] = {
+	"GET", "POST", "/index.html", "/api/v1/items", "200", "404", "500", "client",
+	"server", "timeout", "connection", "reset", "user", "session", "cache", "miss"
+    };
+    static const unsigned nwords = sizeof(words) / sizeof(words[0]);
+    string hay;
+    while (hay.size() < 32 * 1024 * 1024) {
+	hay.append(words[rand.randInt(nwords)]);
+	hay.push_back(rand.randInt(20) == 0 ? '\n' : ' ');
+    }
+
+    vector<string> patterns;
+    for (unsigned i = 0; i < 48; ++i) {
+	// mostly absent, a few present
+	patterns.push_back(i % 8 == 0 ? string(words[i % nwords]) + " " + words[(i + 3) % nwords]
+			   : (format("ERROR-%d") % i).str());
+    }
+
+    MultiPatternSearch search;
+    for (unsigned i = 0; i < patterns.size(); ++i) {
+	search.addPattern(patterns[i]);
+    }
+    search.compile();
+
+    Clock::Tfrac start = Clock::todTfrac();
+    Matches got;
+    search.findAll(hay.data(), hay.size(), got);
+    Clock::Tfrac multi_done = Clock::todTfrac();
+    size_t nfound = 0;
+    for (unsigned i = 0; i < patterns.size(); ++i) {
+	BoyerMooreHorspool bmh(patterns[i]);
+	for (size_t pos = 0; pos < hay.size(); ) {
+	    size_t at = bmh.find(hay.data() + pos, hay.size() - pos);
+	    if (at == BoyerMooreHorspool::npos) {
+		break;
+	    }
+	    ++nfound;
+	    pos += at + 1;
+	}
+    }
+    Clock::Tfrac bmh_done = Clock::todTfrac();
+    SINVARIANT(nfound == got.size());
+    double mib = hay.size() / (1024.0 * 1024.0);
+    cout << format("%d patterns over %.0f MiB, %d matches, %d states, %d bytes:"
+		   " one pass %.0f MiB/s, BoyerMooreHorspool per pattern %.0f MiB/s\n")
+	% patterns.size() % mib % got.size() % search.nStates() % search.memoryUsage()
+	% (mib / Clock::TfracToDouble(multi_done - start))
+	% (mib / Clock::TfracToDouble(bmh_done - multi_done));
+}
+
+int main(int argc, char *argv[]) {
+    MersenneTwisterRandom rand;
+    if (argc == 2 && strcmp(argv[1], "long") == 0) {
+	benchmark(rand);
+	return 0;
+    }
+    simpleTests();
+    randomTests(rand, 2);
+    randomTests(rand, 4);
+    randomTests(rand, 26);
+    return 0;
+}
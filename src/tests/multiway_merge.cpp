@@ -0,0 +1,323 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for MultiwayMerge, splitRuns and parallelMultiwayMerge
+*/
+
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include <Lintel/Clock.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/MultiwayMerge.hpp>
+#include <Lintel/PriorityQueue.hpp>
+#include <Lintel/TestUtil.hpp>
+
+using namespace std;
+using boost::format;
+using lintel::IteratorRun;
+using lintel::MultiwayMerge;
+
+MersenneTwisterRandom rng;
+
+// key, then where it came from, so stability can be checked
+struct Item {
+    Item() : key(0), origin(0) { }
+    Item(uint32_t key, uint32_t origin) : key(key), origin(origin) { }
+    bool operator==(const Item &other) const {
+	return key == other.key && origin == other.origin;
+    }
+    uint32_t key, origin;
+};
+
+struct ItemLess {
+    bool operator()(const Item &a, const Item &b) const {
+	return a.key < b.key;
+    }
+};
+
+typedef vector<Item>::const_iterator ItemIter;
+typedef vector<pair<ItemIter, ItemIter> > ItemRuns;
+
+// nruns sorted runs of random lengths up to max_len, keys below max_key;
+// some runs are empty
+vector<vector<Item> > makeRuns(unsigned nruns, uint32_t max_len, uint32_t max_key) {
+    vector<vector<Item> > runs(nruns);
+    uint32_t origin = 0;
+    for(unsigned i = 0; i < nruns; ++i) {
+	uint32_t len = rng.randInt(5) == 0 ? 0 : rng.randInt(max_len + 1);
+	for(uint32_t j = 0; j < len; ++j) {
+	    runs[i].push_back(Item(rng.randInt(max_key), 0));
+	}
+	sort(runs[i].begin(), runs[i].end(), ItemLess());
+	for(uint32_t j = 0; j < len; ++j) {
+	    runs[i][j].origin = origin++;
+	}
+    }
+    return runs;
+}
+
+ItemRuns ranges(const vector<vector<Item> > &runs) {
+    ItemRuns ret;
+    for(size_t i = 0; i < runs.size(); ++i) {
+	ret.push_back(make_pair(runs[i].begin(), runs[i].end()));
+    }
+    return ret;
+}
+
+// a stable sort of the concatenated runs is the expected merge
+vector<Item> expected(const vector<vector<Item> > &runs) {
+    vector<Item> all;
+    for(size_t i = 0; i < runs.size(); ++i) {
+	all.insert(all.end(), runs[i].begin(), runs[i].end());
+    }
+    stable_sort(all.begin(), all.end(), ItemLess());
+    return all;
+}
+
+struct Collect {
+    Collect(vector<Item> &into) : into(into) { }
+    void operator()(const Item &v) { into.push_back(v); }
+    vector<Item> &into;
+};
+
+void testMerge() {
+    for(unsigned nruns = 0; nruns <= 40; ++nruns) {
+	for(unsigned rep = 0; rep < 10; ++rep) {
+	    vector<vector<Item> > runs = makeRuns(nruns, 200, rep % 2 == 0 ? 50 : 1000000);
+	    vector<Item> want(expected(runs));
+
+	    vector<IteratorRun<ItemIter> > cursors;
+	    for(size_t i = 0; i < runs.size(); ++i) {
+		cursors.push_back(IteratorRun<ItemIter>(runs[i].begin(), runs[i].end()));
+	    }
+	    MultiwayMerge<IteratorRun<ItemIter>, ItemLess> merge(cursors);
+	    SINVARIANT(merge.nRuns() == nruns);
+	    vector<Item> got;
+	    size_t count = merge.mergeTo(Collect(got));
+	    SINVARIANT(count == want.size() && got == want && merge.empty());
+
+	    vector<Item> out(want.size());
+	    SINVARIANT(lintel::multiwayMerge(ranges(runs), out.begin(), ItemLess()) == out.end());
+	    SINVARIANT(out == want);
+	}
+    }
+    cout << "merge test passed.\n";
+}
+
+// A run read from a stream, as from a sorted trace file
+class StreamRun {
+public:
+    typedef int value_type;
+
+    StreamRun(istream *in) : in(in), at_end(false) { advance(); }
+
+    bool atEnd() const { return at_end; }
+    const int &current() const { return value; }
+    void advance() {
+	if (!(*in >> value)) {
+	    at_end = true;
+	}
+    }
+private:
+    istream *in;
+    bool at_end;
+    int value;
+};
+
+void testStreams() {
+    istringstream a("1 4 4 9"), b(""), c("2 3 4 10 11"), d("0");
+    vector<StreamRun> runs;
+    runs.push_back(StreamRun(&a));
+    runs.push_back(StreamRun(&b));
+    runs.push_back(StreamRun(&c));
+    runs.push_back(StreamRun(&d));
+    MultiwayMerge<StreamRun> merge(runs);
+    int want[] = { 0, 1, 2, 3, 4, 4, 4, 9, 10, 11 };
+    unsigned from[] = { 3, 0, 2, 2, 0, 0, 2, 0, 2, 2 };
+    for(unsigned i = 0; i < sizeof(want) / sizeof(want[0]); ++i) {
+	SINVARIANT(!merge.empty() && merge.top() == want[i] && merge.topRun() == from[i]);
+	merge.pop();
+    }
+    SINVARIANT(merge.empty() && merge.run(0).atEnd());
+    cout << "stream test passed.\n";
+}
+
+void testParallel() {
+    for(unsigned rep = 0; rep < 40; ++rep) {
+	// duplicate-heavy, distinct, and one huge run
+	uint32_t max_key = rep % 3 == 0 ? 3 : 1000000000;
+	vector<vector<Item> > runs = makeRuns(1 + rng.randInt(50), rep % 4 == 0 ? 20000 : 2000, max_key);
+	vector<Item> want(expected(runs));
+	ItemRuns in(ranges(runs));
+	for(unsigned nthreads = 1; nthreads <= 5; ++nthreads) {
+	    vector<vector<pair<ItemIter, ItemIter> > > parts
+		= lintel::splitRuns(in, nthreads, ItemLess());
+	    SINVARIANT(parts.size() == nthreads);
+	    size_t total = 0;
+	    for(unsigned p = 0; p < nthreads; ++p) {
+		SINVARIANT(parts[p].size() == in.size());
+		for(size_t i = 0; i < in.size(); ++i) {
+		    total += parts[p][i].second - parts[p][i].first;
+		}
+	    }
+	    SINVARIANT(total == want.size());
+
+	    vector<Item> out(want.size());
+	    SINVARIANT(lintel::parallelMultiwayMerge(in, out.begin(), nthreads, ItemLess())
+		       == out.end());
+	    SINVARIANT(out == want);
+	}
+    }
+    ItemRuns none;
+    TEST_INVARIANT_MSG1(lintel::splitRuns(none, 0, ItemLess()), "splitRuns: need at least one part");
+    cout << "parallel test passed.\n";
+}
+
+// splitRuns with std::less on arithmetic values cuts the runs with
+// interpolation search; check the parts are in order and cover
+// everything, for signed values spanning the whole range, duplicates
+// and doubles.
+template<class T> void checkArithmeticSplit(const vector<vector<T> > &runs) {
+    typedef typename vector<T>::const_iterator Iter;
+    vector<pair<Iter, Iter> > in;
+    vector<T> want;
+    for(size_t i = 0; i < runs.size(); ++i) {
+	in.push_back(make_pair(runs[i].begin(), runs[i].end()));
+	want.insert(want.end(), runs[i].begin(), runs[i].end());
+    }
+    sort(want.begin(), want.end());
+    for(unsigned nparts = 1; nparts <= 7; ++nparts) {
+	vector<vector<pair<Iter, Iter> > > parts = lintel::splitRuns(in, nparts, less<T>());
+	vector<T> got;
+	for(unsigned p = 0; p < nparts; ++p) {
+	    vector<T> part(want.size());
+	    part.resize(lintel::multiwayMerge(parts[p], part.begin()) - part.begin());
+	    SINVARIANT(got.empty() || part.empty() || !(part.front() < got.back()));
+	    got.insert(got.end(), part.begin(), part.end());
+	}
+	SINVARIANT(got == want);
+	vector<T> out(want.size());
+	lintel::parallelMultiwayMerge(in, out.begin(), nparts);
+	SINVARIANT(out == want);
+    }
+}
+
+void testArithmeticSplit() {
+    for(unsigned rep = 0; rep < 20; ++rep) {
+	vector<vector<int64_t> > wide(1 + rng.randInt(20));
+	vector<vector<int32_t> > dups(wide.size());
+	vector<vector<double> > doubles(wide.size());
+	for(size_t i = 0; i < wide.size(); ++i) {
+	    uint32_t len = rng.randInt(rep % 2 == 0 ? 100 : 5000);
+	    for(uint32_t j = 0; j < len; ++j) {
+		wide[i].push_back(static_cast<int64_t>(rng.randLongLong()));
+		dups[i].push_back(static_cast<int32_t>(rng.randInt(5)) - 2);
+		doubles[i].push_back(rng.randDouble() * 2 - 1);
+	    }
+	    sort(wide[i].begin(), wide[i].end());
+	    sort(dups[i].begin(), dups[i].end());
+	    sort(doubles[i].begin(), doubles[i].end());
+	}
+	checkArithmeticSplit(wide);
+	checkArithmeticSplit(dups);
+	checkArithmeticSplit(doubles);
+    }
+    // infinite ends make the interpolation NaN
+    vector<vector<double> > infinite(2);
+    infinite[0].push_back(-numeric_limits<double>::infinity());
+    for(int i = 1; i < 5000; ++i) {
+	infinite[0].push_back(i);
+    }
+    infinite[0].push_back(numeric_limits<double>::infinity());
+    infinite[1].push_back(0.5);
+    checkArithmeticSplit(infinite);
+    infinite[1].push_back(numeric_limits<double>::infinity());
+    infinite[1].insert(infinite[1].begin(), -numeric_limits<double>::infinity());
+    checkArithmeticSplit(infinite);
+    cout << "arithmetic split test passed.\n";
+}
+
+// The merge this replaces: a PriorityQueue of (value, run) with replaceTop()
+typedef pair<uint64_t, uint32_t> Head;
+
+size_t heapMerge(const vector<vector<uint64_t> > &runs, vector<uint64_t> &out) {
+    PriorityQueue<Head, greater_equal<Head> > heads(runs.size());
+    vector<size_t> pos(runs.size(), 0);
+    for(uint32_t i = 0; i < runs.size(); ++i) {
+	if (!runs[i].empty()) {
+	    heads.push(Head(runs[i][0], i));
+	}
+    }
+    size_t n = 0;
+    while (!heads.empty()) {
+	uint32_t r = heads.top().second;
+	out[n++] = heads.top().first;
+	if (++pos[r] < runs[r].size()) {
+	    heads.replaceTop(Head(runs[r][pos[r]], r));
+	} else {
+	    heads.pop();
+	}
+    }
+    return n;
+}
+
+void timeMerge(uint32_t nruns, uint32_t total) {
+    typedef vector<uint64_t>::const_iterator Iter;
+    vector<vector<uint64_t> > runs(nruns);
+    vector<pair<Iter, Iter> > in;
+    for(uint32_t i = 0; i < nruns; ++i) {
+	for(uint32_t j = 0; j < total / nruns; ++j) {
+	    runs[i].push_back(rng.randLongLong());
+	}
+	sort(runs[i].begin(), runs[i].end());
+	in.push_back(make_pair(runs[i].begin(), runs[i].end()));
+    }
+    size_t n = (total / nruns) * nruns;
+    vector<uint64_t> heap_out(n), tree_out(n), parallel_out(n);
+
+    Clock::Tfrac start = Clock::todTfrac();
+    SINVARIANT(heapMerge(runs, heap_out) == n);
+    double heap_time = Clock::TfracToDouble(Clock::todTfrac() - start);
+
+    start = Clock::todTfrac();
+    lintel::multiwayMerge(in, tree_out.begin());
+    double tree_time = Clock::TfracToDouble(Clock::todTfrac() - start);
+
+    start = Clock::todTfrac();
+    lintel::parallelMultiwayMerge(in, parallel_out.begin(), 4);
+    double parallel_time = Clock::TfracToDouble(Clock::todTfrac() - start);
+
+    SINVARIANT(heap_out == tree_out && tree_out == parallel_out);
+    cout << format("%d runs, %d values, ns per value: PriorityQueue %.1f, "
+		   "loser tree %.1f, 4 threads %.1f\n")
+	% nruns % n % (1.0e9 * heap_time / n) % (1.0e9 * tree_time / n)
+	% (1.0e9 * parallel_time / n);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "long") == 0) {
+	timeMerge(8, 8000000);
+	timeMerge(64, 8000000);
+	timeMerge(512, 8000000);
+	return 0;
+    }
+    testMerge();
+    testStreams();
+    testParallel();
+    testArithmeticSplit();
+    timeMerge(64, 100000); // checks the three merges agree
+    return 0;
+}
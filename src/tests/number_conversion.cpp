@@ -0,0 +1,339 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Tests and benchmark for the number parsing and formatting in
+    StringUtil; the benchmark runs with an argument of long, optionally
+    followed by the number of values to convert per measurement, e.g.
+    long 10000000.
+*/
+
+#define __STDC_LIMIT_MACROS
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/ByteBuffer.hpp>
+#include <Lintel/Clock.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/StringUtil.hpp>
+
+using namespace std;
+using boost::format;
+
+uint64_t doubleBits(double v) {
+    uint64_t ret;
+    memcpy(&ret, &v, sizeof(ret));
+    return ret;
+}
+
+double bitsDouble(uint64_t bits) {
+    double ret;
+    memcpy(&ret, &bits, sizeof(ret));
+    return ret;
+}
+
+template<typename T> void checkInteger(const string &str, bool valid, T expected = 0) {
+    T val = 0;
+    bool ok = parseInteger(str, val);
+    INVARIANT(ok == valid && (!ok || val == expected),
+              format("parseInteger('%s') got %s %d") % str % ok % val);
+}
+
+template<typename T> void checkIntegerLimits() {
+    T min_val = numeric_limits<T>::min(), max_val = numeric_limits<T>::max();
+    string min_str = str(format("%d") % static_cast<int64_t>(min_val));
+    string max_str = str(format("%d") % static_cast<uint64_t>(max_val));
+    checkInteger<T>(min_str, true, min_val);
+    checkInteger<T>(max_str, true, max_val);
+    SINVARIANT(formatInteger(min_val) == min_str && formatInteger(max_val) == max_str);
+    if (numeric_limits<T>::is_signed) {
+        // one below the minimum
+        string below(min_str);
+        ++below[below.size() - 1];
+        checkInteger<T>(below, false);
+    }
+    string above(max_str);
+    ++above[above.size() - 1];
+    checkInteger<T>(above, false);
+}
+
+void testIntegers(MersenneTwisterRandom &rand) {
+    checkInteger<int32_t>("0", true, 0);
+    checkInteger<int32_t>("-0", true, 0);
+    checkInteger<uint32_t>("-0", true, 0);
+    checkInteger<int32_t>("+17", true, 17);
+    checkInteger<int32_t>("0000000000000000000000000000012", true, 12);
+    checkInteger<int32_t>("", false);
+    checkInteger<int32_t>("-", false);
+    checkInteger<int32_t>("+", false);
+    checkInteger<int32_t>("12a", false);
+    checkInteger<int32_t>(" 12", false);
+    checkInteger<int32_t>("12 ", false);
+    checkInteger<int32_t>("1234567:", false);
+    checkInteger<int64_t>("1234567:12345678", false);
+    checkInteger<uint32_t>("-1", false);
+    checkInteger<uint64_t>("18446744073709551615", true, UINT64_MAX);
+    checkInteger<uint64_t>("18446744073709551616", false);
+    checkInteger<uint64_t>("99999999999999999999", false);
+    checkInteger<uint64_t>("184467440737095516150", false);
+    checkIntegerLimits<int8_t>();
+    checkIntegerLimits<uint8_t>();
+    checkIntegerLimits<int16_t>();
+    checkIntegerLimits<uint16_t>();
+    checkIntegerLimits<int32_t>();
+    checkIntegerLimits<uint32_t>();
+    checkIntegerLimits<int64_t>();
+    checkIntegerLimits<uint64_t>();
+    SINVARIANT(formatInteger(0) == "0" && formatInteger(-7) == "-7");
+
+    for(unsigned i = 0; i < 100000; ++i) {
+        // spread over all the lengths
+        int64_t v = static_cast<int64_t>(rand.randLongLong()) >> rand.randInt(64);
+        string s = str(format("%d") % v);
+        checkInteger<int64_t>(s, true, v);
+        SINVARIANT(formatInteger(v) == s);
+        uint64_t u = rand.randLongLong() >> rand.randInt(64);
+        s = str(format("%d") % u);
+        checkInteger<uint64_t>(s, true, u);
+        SINVARIANT(formatInteger(u) == s);
+        if (s.size() > 1) {
+            s[rand.randInt(s.size())] = "/:a. "[rand.randInt(5)];
+            checkInteger<uint64_t>(s, false);
+        }
+    }
+
+    SINVARIANT(stringToInteger<int32_t>("-2133324") == -2133324);
+    SINVARIANT(stringToInteger<uint32_t>("4000000000") == 4000000000U);
+    cout << "integer tests passed.\n";
+}
+
+void checkDouble(const string &str) {
+    char *endptr;
+    errno = 0;
+    double expect = strtod(str.c_str(), &endptr);
+    bool expect_ok = !str.empty() && *endptr == '\0';
+    double val = 0;
+    bool ok = parseDouble(str, val);
+    INVARIANT(ok == expect_ok && (!ok || doubleBits(val) == doubleBits(expect)
+                                  || (val != val && expect != expect)),
+              format("parseDouble('%s') got %s %.17g, strtod got %s %.17g")
+              % str % ok % val % expect_ok % expect);
+}
+
+/// the number of significant digits needed to round trip v
+int shortestDigits(double v) {
+    char buf[64];
+    for(int precision = 1; precision < 17; ++precision) {
+        snprintf(buf, sizeof(buf), "%.*e", precision - 1, v);
+        if (strtod(buf, NULL) == v) {
+            return precision;
+        }
+    }
+    return 17;
+}
+
+int significantDigits(const string &s) {
+    int ret = 0;
+    bool leading = true;
+    for(size_t i = 0; i < s.size() && s[i] != 'e'; ++i) {
+        if (s[i] >= '1' && s[i] <= '9') {
+            leading = false;
+        }
+        if (!leading && s[i] >= '0' && s[i] <= '9') {
+            ++ret;
+        }
+    }
+    return ret;
+}
+
+void checkFormat(double v) {
+    string s = formatDouble(v);
+    SINVARIANT(s.size() < format_double_max);
+    double back = strtod(s.c_str(), NULL);
+    INVARIANT(doubleBits(back) == doubleBits(v), format("%.17g formatted as %s") % v % s);
+    if (v == 0) {
+        return;
+    }
+    // trailing zeros before the point are not significant
+    string mantissa = s.substr(0, s.find('e'));
+    if (mantissa.find('.') == string::npos) {
+        while (mantissa.size() > 1 && mantissa[mantissa.size() - 1] == '0') {
+            mantissa.resize(mantissa.size() - 1);
+        }
+    }
+    INVARIANT(significantDigits(mantissa) == shortestDigits(v),
+              format("%.17g formatted as %s, not %d digits") % v % s % shortestDigits(v));
+}
+
+string printDouble(const char *fmt, int precision, double v) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), fmt, precision, v);
+    return buf;
+}
+
+void testDoubles(MersenneTwisterRandom &rand) {
+    const char *cases[] = {
+        "0", "-0", "+0", "0.0", ".5", "5.", "1e10", "1E10", "1e+10", "1e-10", "-1.5e-3",
+        "0.1", "0.3", "1e23", "8.98846567431158e307", "1.7976931348623157e308",
+        "1.7976931348623158e308", "1.7976931348623159e308", "1e309", "-1e400", "2e-400",
+        "4.9e-324", "5e-324", "2.4703282292062327e-324", "2.4703282292062328e-324",
+        "2.2250738585072011e-308", "2.2250738585072014e-308", "2.225073858507201136057409796709131975934819546351645648e-308",
+        "9007199254740992", "9007199254740993", "9007199254740994", "9007199254740995",
+        "18014398509481985", "1152921504606846977", "12345678901234567890123",
+        "0.000000000000000000000000000000000000000000001",
+        "3.14159265358979323846264338327950288419716939937510",
+        "00000000000000000000000000001.5", "1.00000000000000000000000000001",
+        "7.2057594037927933e16", "1e-5", "123456789e-300", "1e0000000000000000000001",
+        "1e-99999999999999", "1e99999999999999",
+        "", "-", "+", ".", "e5", "1e", "1e+", "1e-", "1.2.3", "1e5e5", "--1", "1 ", " 1",
+        "0x1p3", "inf", "-inf", "nan", "infinity", "1,5", "1d5"
+    };
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        checkDouble(cases[i]);
+    }
+
+    for(unsigned i = 0; i < 50000; ++i) {
+        double v = bitsDouble(rand.randLongLong());
+        if (v != v) {
+            continue;
+        }
+        checkDouble(str(format("%.17g") % v));
+        checkDouble(printDouble("%.*g", 1 + rand.randInt(25), v));
+        checkFormat(v);
+        // numbers as they appear in data files
+        double d = rand.randDoubleOpen53() * 1000;
+        checkDouble(printDouble("%.*f", rand.randInt(8), d));
+        checkFormat(d);
+        checkFormat(static_cast<double>(rand.randInt(100000)));
+        // random digit strings, including more than 19 digits
+        string s;
+        unsigned ndigits = 1 + rand.randInt(30);
+        for(unsigned j = 0; j < ndigits; ++j) {
+            s.push_back('0' + rand.randInt(10));
+        }
+        s.insert(rand.randInt(ndigits + 1), ".");
+        if (rand.randBool()) {
+            s.append(str(format("e%d") % (static_cast<int>(rand.randInt(700)) - 350)));
+        }
+        checkDouble(s);
+    }
+    // halfway between adjacent doubles, which needs more than 17 digits
+    for(unsigned i = 0; i < 10000; ++i) {
+        double v = bitsDouble(rand.randLongLong() & 0x7FFFFFFFFFFFFFFFULL);
+        double next = bitsDouble(doubleBits(v) + 1);
+        if (next != next || v != v || next > 1.7e308) {
+            continue;
+        }
+        checkDouble(str(format("%.40e") % ((static_cast<long double>(v) + next) / 2)));
+    }
+
+    SINVARIANT(formatDouble(0.1) == "0.1" && formatDouble(1) == "1" && formatDouble(100) == "100");
+    SINVARIANT(formatDouble(-0.0) == "-0" && formatDouble(0.0001) == "0.0001");
+    SINVARIANT(formatDouble(1.5e-7) == "1.5e-07" && formatDouble(1e16) == "1e+16");
+    SINVARIANT(formatDouble(123.456) == "123.456" && formatDouble(1e15) == "1000000000000000");
+    SINVARIANT(formatDouble(5e-324) == "5e-324");
+    SINVARIANT(formatDouble(1.7976931348623157e308) == "1.7976931348623157e+308");
+    SINVARIANT(formatDouble(bitsDouble(0x7FF0000000000000ULL)) == "inf");
+    SINVARIANT(formatDouble(bitsDouble(0xFFF0000000000000ULL)) == "-inf");
+    SINVARIANT(formatDouble(bitsDouble(0x7FF8000000000000ULL)) == "nan");
+    for(uint64_t bits = 1; bits < 1000; ++bits) { // subnormals
+        checkFormat(bitsDouble(bits));
+    }
+    for(int e = -324; e <= 308; ++e) {
+        checkFormat(strtod(str(format("1e%d") % e).c_str(), NULL));
+    }
+
+    lintel::ByteBuffer buf;
+    formatDouble(0.25, buf);
+    formatDouble(-3, buf);
+    SINVARIANT(buf.asString() == "0.25-3");
+
+    SINVARIANT(stringToDouble("2.5") == 2.5 && stringToDouble(" 2.5") == 2.5);
+    cout << "double tests passed.\n";
+}
+
+void benchmark(MersenneTwisterRandom &rand, unsigned count) {
+    vector<double> doubles;
+    vector<string> double_strs, int_strs;
+    for(unsigned i = 0; i < count; ++i) {
+        // mix of data file style and full precision values
+        doubles.push_back(i % 2 == 0 ? rand.randInt(1000000) / 100.0
+                          : rand.randDoubleOpen53() * 1e6);
+        double_strs.push_back(str(format("%.17g") % doubles.back()));
+        int_strs.push_back(str(format("%d") % (static_cast<int64_t>(rand.randLongLong())
+                                                >> rand.randInt(64))));
+    }
+
+    double sum_strtod = 0, sum_parse = 0;
+    Clock::Tfrac start = Clock::todTfrac();
+    for(unsigned i = 0; i < count; ++i) {
+        sum_strtod += strtod(double_strs[i].c_str(), NULL);
+    }
+    Clock::Tfrac t_strtod = Clock::todTfrac();
+    for(unsigned i = 0; i < count; ++i) {
+        double v;
+        parseDouble(double_strs[i], v);
+        sum_parse += v;
+    }
+    Clock::Tfrac t_parse_double = Clock::todTfrac();
+    SINVARIANT(sum_strtod == sum_parse);
+
+    int64_t isum_strtoll = 0, isum_parse = 0;
+    for(unsigned i = 0; i < count; ++i) {
+        isum_strtoll += strtoll(int_strs[i].c_str(), NULL, 10);
+    }
+    Clock::Tfrac t_strtoll = Clock::todTfrac();
+    for(unsigned i = 0; i < count; ++i) {
+        int64_t v;
+        parseInteger(int_strs[i], v);
+        isum_parse += v;
+    }
+    Clock::Tfrac t_parse_int = Clock::todTfrac();
+    SINVARIANT(isum_strtoll == isum_parse);
+
+    char buf[64];
+    size_t len_snprintf = 0, len_format = 0;
+    for(unsigned i = 0; i < count; ++i) {
+        len_snprintf += snprintf(buf, sizeof(buf), "%.17g", doubles[i]);
+    }
+    Clock::Tfrac t_snprintf = Clock::todTfrac();
+    for(unsigned i = 0; i < count; ++i) {
+        len_format += formatDouble(doubles[i], buf);
+    }
+    Clock::Tfrac t_format = Clock::todTfrac();
+
+    double ns = 1.0e9 / count;
+    cout << format("parse double: strtod %.1f ns, parseDouble %.1f ns\n")
+        % (ns * Clock::TfracToDouble(t_strtod - start))
+        % (ns * Clock::TfracToDouble(t_parse_double - t_strtod));
+    cout << format("parse integer: strtoll %.1f ns, parseInteger %.1f ns\n")
+        % (ns * Clock::TfracToDouble(t_strtoll - t_parse_double))
+        % (ns * Clock::TfracToDouble(t_parse_int - t_strtoll));
+    cout << format("format double: snprintf %%.17g %.1f ns (%d bytes), formatDouble %.1f ns"
+                   " (%d bytes)\n")
+        % (ns * Clock::TfracToDouble(t_snprintf - t_parse_int)) % len_snprintf
+        % (ns * Clock::TfracToDouble(t_format - t_snprintf)) % len_format;
+}
+
+int main(int argc, char *argv[]) {
+    MersenneTwisterRandom rand;
+    if (argc >= 2 && strcmp(argv[1], "long") == 0) {
+	benchmark(rand, argc > 2 ? strtoul(argv[2], NULL, 0) : 100000);
+	return 0;
+    }
+    testIntegers(rand);
+    testDoubles(rand);
+    return 0;
+}
@@ -0,0 +1,107 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for parallelCube and parallelZeroCube
+*/
+
+#include <iostream>
+#include <vector>
+
+#include <Lintel/Clock.hpp>
+#include <Lintel/Double.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/ParallelStatsCube.hpp>
+
+using namespace std;
+using boost::format;
+using lintel::StatsCube;
+namespace StatsCubeFns = lintel::StatsCubeFns;
+
+typedef boost::tuple<int32_t, int32_t, int32_t, int32_t> Tuple4;
+typedef StatsCube<Tuple4> Cube4;
+typedef vector<Cube4::PartialTupleCubeMap::value_type> Entries;
+
+void collect(Entries &entries, const Cube4::MyAny &key, Stats &value) {
+    entries.push_back(make_pair(key, &value));
+}
+
+void sameCubes(Cube4 &a, Cube4 &b) {
+    Entries ea, eb;
+    a.walkOrdered(boost::bind(collect, boost::ref(ea), _1, _2));
+    b.walkOrdered(boost::bind(collect, boost::ref(eb), _1, _2));
+    INVARIANT(ea.size() == eb.size(), format("%d != %d entries") % ea.size() % eb.size());
+    for (unsigned i = 0; i < ea.size(); ++i) {
+	SINVARIANT(ea[i].first == eb[i].first);
+	SINVARIANT(ea[i].second->countll() == eb[i].second->countll());
+	SINVARIANT(ea[i].second->min() == eb[i].second->min());
+	SINVARIANT(ea[i].second->max() == eb[i].second->max());
+	SINVARIANT(Double::eq(ea[i].second->mean(), eb[i].second->mean()));
+    }
+}
+
+void fill(Cube4 &cube, unsigned nrows, unsigned range) {
+    MersenneTwisterRandom rand(1984);
+    for (unsigned i = 0; i < nrows; ++i) {
+	cube.add(Tuple4(rand.randInt(range), rand.randInt(range), rand.randInt(range),
+			rand.randInt(range)), rand.randDouble());
+    }
+}
+
+void testCube() {
+    Cube4 serial, parallel, functor;
+    fill(serial, 100000, 20);
+    fill(parallel, 100000, 20);
+    fill(functor, 100000, 20);
+
+    Clock::Tfrac start = Clock::todTfrac();
+    serial.cube();
+    Clock::Tfrac serial_done = Clock::todTfrac();
+    lintel::parallelCube(parallel, 4);
+    Clock::Tfrac parallel_done = Clock::todTfrac();
+    lintel::parallelCube(functor, functor.base_data, 4, StatsCubeFns::CubeHadAny(),
+			 StatsCubeFns::AddFullStats());
+    Clock::Tfrac functor_done = Clock::todTfrac();
+    cout << format("cube of %d rows to %d entries: serial %.3fs, 4 threads %.3fs,"
+		   " 4 threads with functors %.3fs\n")
+	% serial.base_data.size() % serial.size()
+	% Clock::TfracToDouble(serial_done - start)
+	% Clock::TfracToDouble(parallel_done - serial_done)
+	% Clock::TfracToDouble(functor_done - parallel_done);
+
+    sameCubes(serial, parallel);
+    sameCubes(serial, functor);
+
+    // Single threaded functor version, and more threads than rows.
+    Cube4 templated, tiny_serial, tiny_parallel;
+    fill(templated, 100000, 20);
+    templated.cube(templated.base_data, StatsCubeFns::CubeHadAny(), StatsCubeFns::AddFullStats());
+    sameCubes(serial, templated);
+
+    fill(tiny_serial, 3, 20);
+    fill(tiny_parallel, 3, 20);
+    tiny_serial.cube();
+    lintel::parallelCube(tiny_parallel, 8);
+    sameCubes(tiny_serial, tiny_parallel);
+    cout << "parallel cube test passed.\n";
+}
+
+void testZeroCube() {
+    Cube4 serial, parallel;
+    fill(serial, 1000, 6);
+    fill(parallel, 1000, 6);
+    serial.zeroCube(true);
+    lintel::parallelZeroCube(parallel, 3, true);
+    sameCubes(serial, parallel);
+    cout << "parallel zero cube test passed.\n";
+}
+
+int main(int, char **) {
+    testCube();
+    testZeroCube();
+    return 0;
+}
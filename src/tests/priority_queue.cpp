@@ -4,13 +4,19 @@
    See the file named COPYING for license details
 */
 
+#include <string.h>
+
 #include <iostream>
 #include <queue>
 
+#include <boost/format.hpp>
+
+#include <Lintel/Clock.hpp>
 #include <Lintel/MersenneTwisterRandom.hpp>
 #include <Lintel/PriorityQueue.hpp>
 
 using namespace std;
+using boost::format;
 
 template<class T, class U>
 void check(const T &queue_1, const U &queue_2) {
@@ -22,11 +28,11 @@ void check(const T &queue_1, const U &queue_2) {
     }
 }
 	   
-void test_basic() {
+template<class PQ> void test_basic() {
     MersenneTwisterRandom mt(1933);
 
     std::priority_queue<int> stl_queue;
-    PriorityQueue<int> lintel_queue;
+    PQ lintel_queue;
 
     for(unsigned i=0; i < 1000; ++i) {
 	uint32_t v = mt.randInt();
@@ -47,11 +53,11 @@ void test_basic() {
 }
 
 // interleave pushes and pops
-void test_random() {
+template<class PQ> void test_random() {
     MersenneTwisterRandom mt;
 
     std::priority_queue<int> stl_queue;
-    PriorityQueue<int> lintel_queue;
+    PQ lintel_queue;
 
     while (lintel_queue.size() < 10000) {
 	uint32_t v = mt.randInt();
@@ -76,11 +82,11 @@ void test_random() {
     check(stl_queue, lintel_queue);
 }
 
-void test_replaceTop() {
+template<class PQ> void test_replaceTop() {
     MersenneTwisterRandom mt;
 
-    PriorityQueue<int> lintel_queue;
-    PriorityQueue<int> replace_top_queue;
+    PQ lintel_queue;
+    PQ replace_top_queue;
 
     while (lintel_queue.size() < 1000) {
 	uint32_t v = mt.randInt();
@@ -118,6 +124,37 @@ void test_replaceTop() {
     check(lintel_queue, replace_top_queue);
 }
 
+// pop_bottom_up_heuristic against pop, interleaved with pushes
+template<class PQ> void test_popBottomUp() {
+    MersenneTwisterRandom mt;
+
+    PQ lintel_queue;
+    PQ bottom_up_queue;
+
+    while (lintel_queue.size() < 1000) {
+	uint32_t v = mt.randInt();
+
+	check(lintel_queue, bottom_up_queue);
+	if ((v & 0x3) == 0 && !lintel_queue.empty()) { // 1/4 chance
+	    lintel_queue.pop();
+	    bottom_up_queue.pop_bottom_up_heuristic();
+	} else {
+	    v = mt.randInt();
+	    lintel_queue.push(v);
+	    bottom_up_queue.push(v);
+	}
+	check(lintel_queue, bottom_up_queue);
+    }
+
+    bottom_up_queue.selfVerify();
+    while(!lintel_queue.empty()) {
+	check(lintel_queue, bottom_up_queue);
+	lintel_queue.pop();
+	bottom_up_queue.pop_bottom_up_heuristic();
+    }
+    check(lintel_queue, bottom_up_queue);
+}
+
 void test_clear() {
     PriorityQueue<int> test;
     test.push(5);
@@ -125,10 +162,69 @@ void test_clear() {
     SINVARIANT(test.empty());
 }
 
-int main() {
-    test_basic();
-    test_random();
-    test_replaceTop();
+template<unsigned Arity> void test_arity() {
+    typedef PriorityQueue<int, std::less_equal<int>, Arity> PQ;
+    test_basic<PQ>();
+    test_random<PQ>();
+    test_replaceTop<PQ>();
+    test_popBottomUp<PQ>();
+    // tiny initial size to exercise growth
+    PQ small(1);
+    for (int i = 0; i < 100; ++i) {
+	small.push((i * 37) % 100);
+    }
+    small.selfVerify();
+    SINVARIANT(small.size() == 100 && small.top() == 99);
+    // sibling groups start on a multiple of their size
+    size_t group_bytes = Arity * sizeof(int);
+    if (PQ::cache_line_size % group_bytes == 0) {
+	SINVARIANT(reinterpret_cast<size_t>(small.PQ_Begin() + 1) % group_bytes == 0);
+    }
+}
+
+// The hold model of an event simulator: a queue of n events, each
+// step takes the earliest and schedules a new one a random time later.
+template<unsigned Arity> double time_hold(uint32_t n, uint32_t steps) {
+    PriorityQueue<uint64_t, std::greater_equal<uint64_t>, Arity> queue;
+    MersenneTwisterRandom mt(42);
+    for (uint32_t i = 0; i < n; ++i) {
+	queue.push(mt.randLongLong() >> 24);
+    }
+    Clock::Tfrac start = Clock::todTfrac();
+    for (uint32_t i = 0; i < steps; ++i) {
+	uint64_t now = queue.top();
+	if (i % 2 == 0) {
+	    queue.replaceTop(now + (mt.randLongLong() >> 24));
+	} else {
+	    queue.pop();
+	    queue.push(now + (mt.randLongLong() >> 24));
+	}
+    }
+    return 1.0e9 * Clock::TfracToDouble(Clock::todTfrac() - start) / steps;
+}
+
+void time_arities() {
+    uint32_t sizes[] = { 1000, 100 * 1000, 1000 * 1000, 4 * 1000 * 1000 };
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+	uint32_t steps = 2 * 1000 * 1000;
+	double binary = time_hold<2>(sizes[i], steps);
+	double four = time_hold<4>(sizes[i], steps);
+	double eight = time_hold<8>(sizes[i], steps);
+	cout << format("%d uint64 entries, ns per pop+push or replaceTop: "
+		       "binary %.1f, 4-ary %.1f, 8-ary %.1f\n")
+	    % sizes[i] % binary % four % eight;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "long") == 0) {
+	time_arities();
+	return 0;
+    }
+    test_arity<2>();
+    test_arity<3>();
+    test_arity<4>();
+    test_arity<8>();
     test_clear();
     std::cout << "Test passed\n";
     return 0;
@@ -0,0 +1,206 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for RadixHeap, and timing against PriorityQueue on the
+    workloads from priority_queue.cpp
+*/
+
+#include <string.h>
+
+#include <iostream>
+#include <queue>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include <Lintel/Clock.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/PriorityQueue.hpp>
+#include <Lintel/RadixHeap.hpp>
+#include <Lintel/TestUtil.hpp>
+
+using namespace std;
+using boost::format;
+using lintel::RadixHeap;
+
+typedef pair<uint64_t, uint32_t> Event;
+typedef priority_queue<Event, vector<Event>, greater<Event> > Reference;
+
+// Only the keys are checked; equal keys may come out in either order.
+template<class Key> void checkTop(RadixHeap<Key, uint32_t> &heap, const Reference &ref) {
+    SINVARIANT(heap.size() == ref.size());
+    if (ref.empty()) {
+	SINVARIANT(heap.empty());
+    } else {
+	SINVARIANT(heap.topKey() == ref.top().first);
+    }
+}
+
+// Interleaved pushes and pops; each push is some delta past the
+// current minimum, drawn with the given shift so that ties, short and
+// long jumps all show up.  base starts the keys near the top of the
+// range.
+template<class Key> void testRandom(unsigned shift, uint64_t base) {
+    MersenneTwisterRandom mt(shift);
+    RadixHeap<Key, uint32_t> heap;
+    Reference ref;
+    uint64_t now = base;
+    uint64_t max_key = numeric_limits<Key>::max();
+
+    for (uint32_t i = 0; i < 100000; ++i) {
+	if (mt.randInt(4) == 0 && !ref.empty()) {
+	    now = ref.top().first;
+	    checkTop(heap, ref);
+	    heap.pop();
+	    ref.pop();
+	} else {
+	    if (!ref.empty()) {
+		now = ref.top().first; // checkTop() has looked at it
+	    }
+	    uint64_t delta = mt.randLongLong() >> shift;
+	    uint64_t key = delta > max_key - now ? max_key : now + delta;
+	    heap.push(static_cast<Key>(key), i);
+	    ref.push(Event(key, i));
+	}
+	checkTop(heap, ref);
+    }
+    while (!ref.empty()) {
+	checkTop(heap, ref);
+	heap.pop();
+	ref.pop();
+    }
+    checkTop(heap, ref);
+    cout << format("random %d-bit test, shift %d, base %x passed.\n")
+	% (8 * sizeof(Key)) % shift % base;
+}
+
+void testBasic() {
+    RadixHeap<uint64_t, int> heap;
+    heap.push(10, 1);
+    heap.push(3, 2);
+    heap.push(7, 3);
+    SINVARIANT(heap.size() == 3 && heap.top().first == 3 && heap.top().second == 2);
+    heap.pop();
+    SINVARIANT(heap.lastKey() == 3 && heap.topKey() == 7 && heap.lastKey() == 7);
+    heap.push(7, 4); // equal to the last key is fine
+    TEST_INVARIANT_MSG1(heap.push(6, 5), "RadixHeap: keys must not decrease");
+    heap.clear();
+    SINVARIANT(heap.empty() && heap.lastKey() == 0);
+    heap.push(0, 6);
+    SINVARIANT(heap.top().second == 6);
+    cout << "basic test passed.\n";
+}
+
+// The PriorityQueue being compared against, with the same surface
+class HeapQueue {
+public:
+    void push(uint64_t key, uint32_t val) {
+	queue.push(Event(key, val));
+    }
+    uint64_t topKey() {
+	return queue.top().first;
+    }
+    void pop() {
+	queue.pop();
+    }
+    size_t size() const {
+	return queue.size();
+    }
+private:
+    PriorityQueue<Event, std::greater_equal<Event>, 4> queue;
+};
+
+// test_basic from priority_queue.cpp: push n random keys, then drain
+template<class Queue> double fillDrain(uint32_t n) {
+    MersenneTwisterRandom mt(1933);
+    Queue queue;
+    Clock::Tfrac start = Clock::todTfrac();
+    for (uint32_t i = 0; i < n; ++i) {
+	queue.push(mt.randInt(), i);
+    }
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+	sum += queue.topKey();
+	queue.pop();
+    }
+    SINVARIANT(sum > 0 && queue.size() == 0);
+    return 1.0e9 * Clock::TfracToDouble(Clock::todTfrac() - start) / n;
+}
+
+// test_random from priority_queue.cpp: 3/4 push, 1/4 pop until the
+// queue holds n, then drain; pushed keys are past the last pop to keep
+// them monotone
+template<class Queue> double interleaved(uint32_t n) {
+    MersenneTwisterRandom mt(1933);
+    Queue queue;
+    uint64_t now = 0;
+    uint32_t ops = 0;
+    Clock::Tfrac start = Clock::todTfrac();
+    while (queue.size() < n) {
+	uint32_t v = mt.randInt();
+	if ((v & 0x3) == 0 && queue.size() > 0) {
+	    now = queue.topKey();
+	    queue.pop();
+	} else {
+	    queue.push(now + (v >> 2), ops);
+	}
+	++ops;
+    }
+    while (queue.size() > 0) {
+	queue.pop();
+	++ops;
+    }
+    return 1.0e9 * Clock::TfracToDouble(Clock::todTfrac() - start) / ops;
+}
+
+// time_hold from priority_queue.cpp: n events, each step takes the
+// earliest and schedules one a random time later
+template<class Queue> double hold(uint32_t n, uint32_t steps) {
+    MersenneTwisterRandom mt(42);
+    Queue queue;
+    for (uint32_t i = 0; i < n; ++i) {
+	queue.push(mt.randLongLong() >> 24, i);
+    }
+    Clock::Tfrac start = Clock::todTfrac();
+    for (uint32_t i = 0; i < steps; ++i) {
+	uint64_t now = queue.topKey();
+	queue.pop();
+	queue.push(now + (mt.randLongLong() >> 24), i);
+    }
+    return 1.0e9 * Clock::TfracToDouble(Clock::todTfrac() - start) / steps;
+}
+
+typedef RadixHeap<uint64_t, uint32_t> RadixQueue;
+
+void timeWorkloads() {
+    uint32_t sizes[] = { 1000, 100 * 1000, 1000 * 1000, 4 * 1000 * 1000 };
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+	uint32_t n = sizes[i];
+	cout << format("%d entries, ns per op, 4-ary PriorityQueue vs RadixHeap: "
+		       "fill+drain %.1f vs %.1f, interleaved %.1f vs %.1f, hold %.1f vs %.1f\n")
+	    % n % fillDrain<HeapQueue>(n) % fillDrain<RadixQueue>(n)
+	    % interleaved<HeapQueue>(n) % interleaved<RadixQueue>(n)
+	    % hold<HeapQueue>(n, 2000000) % hold<RadixQueue>(n, 2000000);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "long") == 0) {
+	timeWorkloads();
+	return 0;
+    }
+    testBasic();
+    for (unsigned shift = 8; shift <= 60; shift += 13) {
+	testRandom<uint64_t>(shift, 0);
+    }
+    testRandom<uint64_t>(20, 0xFFFFFFFFFF000000ULL);
+    testRandom<uint32_t>(40, 0);
+    testRandom<uint32_t>(60, 0xFFFFF000);
+    testRandom<uint16_t>(56, 0);
+    return 0;
+}
@@ -0,0 +1,146 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for ShardedStats
+*/
+
+#include <iostream>
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include <Lintel/Double.hpp>
+#include <Lintel/ShardedStats.hpp>
+#include <Lintel/StatsHistogram.hpp>
+#include <Lintel/StatsHistogramHdr.hpp>
+#include <Lintel/StatsQuantile.hpp>
+
+using namespace std;
+using boost::format;
+using lintel::ShardedStats;
+
+static const unsigned num_threads = 8;
+static const unsigned num_iters = 100000;
+
+// Thread i adds i*num_iters .. (i+1)*num_iters-1, scaled into [0..1)
+static double value(unsigned thread_num, unsigned i) {
+    return (thread_num * num_iters + i) / static_cast<double>(num_threads * num_iters);
+}
+
+template<class StatsT> class AddThread : public PThread {
+public:
+    AddThread(ShardedStats<StatsT> &stats, unsigned thread_num)
+	: stats(stats), thread_num(thread_num) { }
+
+    virtual void *run() {
+	for (unsigned i = 0; i < num_iters; ++i) {
+	    stats.add(value(thread_num, i));
+	}
+	return NULL;
+    }
+
+    ShardedStats<StatsT> &stats;
+    unsigned thread_num;
+};
+
+// Snapshots are taken while the threads add, so merging a shard races
+// with adds to it, including those that make StatsQuantile allocate
+// and StatsHistogramHdr grow.
+template<class StatsT> void runThreads(ShardedStats<StatsT> &stats) {
+    vector<AddThread<StatsT> *> threads;
+    for (unsigned i = 0; i < num_threads; ++i) {
+	threads.push_back(new AddThread<StatsT>(stats, i));
+	threads.back()->start();
+    }
+    unsigned long long last_count = 0;
+    for (unsigned i = 0; i < 100; ++i) {
+	Stats *snap = stats.snapshot();
+	SINVARIANT(snap->countll() >= last_count);
+	last_count = snap->countll();
+	delete snap;
+    }
+    for (unsigned i = 0; i < num_threads; ++i) {
+	threads[i]->join();
+	delete threads[i];
+    }
+    SINVARIANT(stats.nShards() == num_threads);
+}
+
+void testStats() {
+    ShardedStats<Stats> sharded;
+    runThreads(sharded);
+
+    Stats exact;
+    for (unsigned t = 0; t < num_threads; ++t) {
+	for (unsigned i = 0; i < num_iters; ++i) {
+	    exact.add(value(t, i));
+	}
+    }
+
+    Stats *snap = sharded.snapshot();
+    SINVARIANT(snap->countll() == exact.countll());
+    SINVARIANT(snap->min() == exact.min() && snap->max() == exact.max());
+    SINVARIANT(Double::eq(snap->mean(), exact.mean()));
+    delete snap;
+
+    sharded.reset();
+    Stats empty;
+    sharded.snapshot(empty);
+    SINVARIANT(empty.countll() == 0);
+    cout << "sharded Stats test passed.\n";
+}
+
+StatsHistogramUniform *newUniform(void *mem) {
+    return new (mem) StatsHistogramUniform(100, 0.0, 1.0);
+}
+
+StatsHistogramHdr *newHdr(void *mem) {
+    return new (mem) StatsHistogramHdr(1.0e-9, 1.0);
+}
+
+void testHistograms() {
+    ShardedStats<StatsHistogramUniform> uniform(&newUniform);
+    runThreads(uniform);
+    StatsHistogramUniform *snap = uniform.snapshot();
+    SINVARIANT(snap->countll() == num_threads * num_iters);
+    // values on a bin boundary can round into either neighbour
+    for (unsigned i = 0; i < snap->numBins(); ++i) {
+	INVARIANT(Double::abs((*snap)[i] - num_threads * num_iters / 100.0) <= 1,
+		  format("bin %d has %d") % i % (*snap)[i]);
+    }
+    delete snap;
+
+    ShardedStats<StatsHistogramHdr> hdr(&newHdr);
+    runThreads(hdr);
+    StatsHistogramHdr *hdr_snap = hdr.snapshot();
+    SINVARIANT(hdr_snap->countll() == num_threads * num_iters);
+    INVARIANT(Double::eq(hdr_snap->percentile(0.5), 0.5, 0.01),
+	      format("median %g") % hdr_snap->percentile(0.5));
+    delete hdr_snap;
+    cout << "sharded histogram test passed.\n";
+}
+
+void testQuantile() {
+    ShardedStats<StatsQuantile> sharded;
+    runThreads(sharded);
+    StatsQuantile *snap = sharded.snapshot();
+    SINVARIANT(snap->countll() == num_threads * num_iters);
+    for (unsigned i = 1; i < 10; ++i) {
+	double q = snap->getQuantile(i / 10.0);
+	INVARIANT(Double::eq(q, i / 10.0, 0.03), format("quantile %g is %g") % (i / 10.0) % q);
+    }
+    delete snap;
+    cout << "sharded quantile test passed.\n";
+}
+
+int main(int, char **) {
+    testStats();
+    testHistograms();
+    testQuantile();
+    return 0;
+}
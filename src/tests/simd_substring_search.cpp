@@ -0,0 +1,195 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing and throughput benchmark for SimdSubstringSearch; the
+    benchmark runs with an argument of long, optionally followed by the
+    number of MiB to search per measurement, e.g. long 4096 to search
+    4GiB.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/BoyerMooreHorspool.hpp>
+#include <Lintel/Clock.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/SimdSubstringSearch.hpp>
+
+using namespace std;
+using boost::format;
+using lintel::BoyerMooreHorspool;
+using lintel::SimdSubstringSearch;
+
+static const SimdSubstringSearch::Strategy strategies[] = {
+    SimdSubstringSearch::Auto, SimdSubstringSearch::Memchr, SimdSubstringSearch::Horspool,
+    SimdSubstringSearch::SSE2, SimdSubstringSearch::AVX2
+};
+static const unsigned nstrategies = sizeof(strategies) / sizeof(strategies[0]);
+
+size_t memmemFind(const void *hay, size_t hay_len, const void *needle, size_t needle_len,
+		  size_t start) {
+    if (start > hay_len) {
+	return SimdSubstringSearch::npos;
+    }
+    const char *hay_c = static_cast<const char *>(hay);
+    const void *res = memmem(hay_c + start, hay_len - start, needle, needle_len);
+    return res == NULL ? SimdSubstringSearch::npos : static_cast<const char *>(res) - hay_c;
+}
+
+void checkAll(const string &hay, const string &needle) {
+    vector<size_t> expected;
+    for (size_t i = memmemFind(hay.data(), hay.size(), needle.data(), needle.size(), 0);
+	 i != SimdSubstringSearch::npos; 
+	 i = memmemFind(hay.data(), hay.size(), needle.data(), needle.size(), i + 1)) {
+	expected.push_back(i);
+    }
+
+    for (unsigned s = 0; s < nstrategies; ++s) {
+	if (!SimdSubstringSearch::strategyAvailable(strategies[s])) {
+	    continue;
+	}
+	SimdSubstringSearch search(needle, strategies[s]);
+	size_t first = expected.empty() ? SimdSubstringSearch::npos : expected[0];
+	INVARIANT(search.find(hay.data(), hay.size()) == first,
+		  format("%s: %d != %d for needle length %d") 
+		  % SimdSubstringSearch::strategyName(search.strategy())
+		  % search.find(hay.data(), hay.size()) % first % needle.size());
+	SINVARIANT(search.matches(hay.data(), hay.size()) == !expected.empty());
+	vector<size_t> all;
+	search.findAll(hay.data(), hay.size(), all);
+	SINVARIANT(all == expected);
+    }
+}
+
+void simpleTests() {
+    checkAll("Does this algorithm really algorithm?", "algorithm");
+    checkAll("Does this algorithm really algorithm?", "Algorithm");
+    checkAll("xxxxxxxxxxihm?", "algorithm");
+    checkAll("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", "aaa");
+    checkAll("ab", "abc");
+    checkAll("abc", "c");
+    checkAll("", "c");
+    // matches right at the end of blocks and of the haystack
+    string hay(200, '.');
+    for (size_t i = 0; i < hay.size(); i += 15) {
+	hay[i] = 'x';
+    }
+    hay[hay.size() - 1] = 'x';
+    checkAll(hay, "x");
+    checkAll(hay, "x.");
+    checkAll(hay, ".x");
+    checkAll(hay, "x..............x");
+    checkAll(hay, string(32, '.') + "x");
+
+    SimdSubstringSearch search("ab");
+    const char *hay2 = "abxab";
+    SINVARIANT(search.find(hay2, 5, 1) == 3);
+    SINVARIANT(search.find(hay2, 5, 4) == SimdSubstringSearch::npos);
+    SINVARIANT(search.find(hay2, 5, 9) == SimdSubstringSearch::npos);
+    SimdSubstringSearch::MatchIterator i(search, hay2, 5);
+    SINVARIANT(i.valid() && i.offset() == 0);
+    ++i;
+    SINVARIANT(i.valid() && i.offset() == 3);
+    ++i;
+    SINVARIANT(!i.valid());
+    cout << "simple tests passed.\n";
+}
+
+void randomTests(MersenneTwisterRandom &rand, unsigned alphabet) {
+    for (unsigned rep = 0; rep < 200; ++rep) {
+	string hay(rand.randInt(5000), ' ');
+	for (size_t i = 0; i < hay.size(); ++i) {
+	    hay[i] = 'a' + rand.randInt(alphabet);
+	}
+	size_t nlen = rand.randInt(20) + 1;
+	if (rand.randInt(2) == 0 && hay.size() > nlen) {
+	    checkAll(hay, hay.substr(rand.randInt(hay.size() - nlen), nlen));
+	} else {
+	    string needle(nlen, ' ');
+	    for (size_t i = 0; i < nlen; ++i) {
+		needle[i] = 'a' + rand.randInt(alphabet);
+	    }
+	    checkAll(hay, needle);
+	}
+    }
+    cout << format("random tests with %d letters passed.\n") % alphabet;
+}
+
+// Search for a needle that is not in the haystack, so every
+// strategy has to look at the whole thing.
+void benchmark(MersenneTwisterRandom &rand, size_t total_mib) {
+    static const size_t hay_len = 16 * 1024 * 1024;
+    size_t reps = (total_mib * 1024 * 1024 + hay_len - 1) / hay_len;
+    string hay(hay_len, ' ');
+    for (size_t i = 0; i < hay_len; ++i) {
+	hay[i] = 'a' + rand.randInt(26); // like text, first/last bytes often match
+    }
+    static const size_t needle_lengths[] = { 2, 4, 8, 16, 32, 64, 256, 1024 };
+    cout << format("MiB/s searching %d MiB for a missing needle\n") % (reps * hay_len >> 20);
+    cout << "length     memmem        bmh";
+    for (unsigned s = 0; s < nstrategies; ++s) {
+	cout << format(" %10s") % SimdSubstringSearch::strategyName(strategies[s]);
+    }
+    cout << "\n";
+    for (unsigned n = 0; n < sizeof(needle_lengths) / sizeof(needle_lengths[0]); ++n) {
+	string needle(needle_lengths[n], ' ');
+	for (size_t i = 0; i < needle.size(); ++i) {
+	    needle[i] = 'a' + rand.randInt(26);
+	}
+	needle[needle.size() - 1] = '!';
+	cout << format("%6d") % needle.size();
+
+	Clock::Tfrac start = Clock::todTfrac();
+	for (size_t r = 0; r < reps; ++r) {
+	    SINVARIANT(memmem(hay.data(), hay_len, needle.data(), needle.size()) == NULL);
+	}
+	double elapsed = Clock::TfracToDouble(Clock::todTfrac() - start);
+	cout << format(" %10.0f") % (reps * hay_len / elapsed / (1024 * 1024));
+
+	BoyerMooreHorspool bmh(needle);
+	start = Clock::todTfrac();
+	for (size_t r = 0; r < reps; ++r) {
+	    SINVARIANT(!bmh.matches(hay.data(), hay_len));
+	}
+	elapsed = Clock::TfracToDouble(Clock::todTfrac() - start);
+	cout << format(" %10.0f") % (reps * hay_len / elapsed / (1024 * 1024));
+
+	for (unsigned s = 0; s < nstrategies; ++s) {
+	    if (!SimdSubstringSearch::strategyAvailable(strategies[s])) {
+		cout << format(" %10s") % "-";
+		continue;
+	    }
+	    SimdSubstringSearch search(needle, strategies[s]);
+	    start = Clock::todTfrac();
+	    for (size_t r = 0; r < reps; ++r) {
+		SINVARIANT(!search.matches(hay.data(), hay_len));
+	    }
+	    elapsed = Clock::TfracToDouble(Clock::todTfrac() - start);
+	    cout << format(" %10.0f") % (reps * hay_len / elapsed / (1024 * 1024));
+	}
+	cout << "\n";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    MersenneTwisterRandom rand;
+    if (argc >= 2 && strcmp(argv[1], "long") == 0) {
+	benchmark(rand, argc > 2 ? strtoul(argv[2], NULL, 0) : 64);
+	return 0;
+    }
+    simpleTests();
+    randomTests(rand, 2);
+    randomTests(rand, 26);
+    randomTests(rand, 256 - 'a');
+    return 0;
+}
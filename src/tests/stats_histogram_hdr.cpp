@@ -0,0 +1,190 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for StatsHistogramHdr
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <Lintel/Double.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/PThread.hpp>
+#include <Lintel/StatsHistogramHdr.hpp>
+
+using namespace std;
+using boost::format;
+
+// Bins must be contiguous, and every value must land in the bin that covers it.
+void testBinLayout() {
+    StatsHistogramHdr hist(1.0, 1.0e12, 5);
+
+    for (unsigned i = 1; i < hist.numBins(); ++i) {
+	INVARIANT(hist.binlow(i) == hist.binhigh(i-1), format("gap at bin %d") % i);
+	SINVARIANT(hist.binWidth(i) >= hist.binWidth(i-1));
+	SINVARIANT(hist.binWidth(i) <= hist.binlow(i) / 32.0 || hist.binWidth(i) == 1.0);
+    }
+
+    MersenneTwisterRandom rand(1933);
+    for (unsigned i = 0; i < 100000; ++i) {
+	uint64_t units = rand.randLongLong() >> rand.randInt(64);
+	if (units >= 1.0e12) {
+	    continue;
+	}
+	unsigned bin = hist.unitsBin(units);
+	INVARIANT(hist.binlow(bin) <= units && units < hist.binhigh(bin),
+		  format("%d not in bin %d [%g..%g)") % units % bin
+		  % hist.binlow(bin) % hist.binhigh(bin));
+    }
+    cout << "bin layout test passed.\n";
+}
+
+void testPercentiles() {
+    StatsHistogramHdr hist(1.0e-6, 100.0);
+    vector<double> values;
+
+    MersenneTwisterRandom rand(1776);
+    for (unsigned i = 0; i < 100000; ++i) {
+	double v = exp(8 * rand.randDouble()) * 1.0e-3;
+	values.push_back(v);
+	hist.add(v);
+    }
+    sort(values.begin(), values.end());
+
+    SINVARIANT(hist.count() == values.size());
+    SINVARIANT(hist.min() == values.front());
+    SINVARIANT(hist.max() == values.back());
+
+    double p[] = { 0.01, 0.1, 0.5, 0.9, 0.99, 0.999 };
+    for (unsigned i = 0; i < sizeof(p)/sizeof(double); ++i) {
+	double exact = values[static_cast<size_t>(p[i] * values.size()) - 1];
+	double approx = hist.percentile(p[i]);
+	INVARIANT(Double::eq(exact, approx, 1.0/128),
+		  format("percentile %g: %g != %g") % p[i] % exact % approx);
+    }
+
+    Stats exact;
+    for (vector<double>::iterator i = values.begin(); i != values.end(); ++i) {
+	exact.add(*i);
+    }
+    INVARIANT(Double::eq(exact.mean(), hist.mean(), 1.0/128),
+	      format("mean %g != %g") % exact.mean() % hist.mean());
+    INVARIANT(Double::eq(exact.stddev(), hist.stddev(), 1.0/64),
+	      format("stddev %g != %g") % exact.stddev() % hist.stddev());
+
+    // values above the highest trackable go into the top bin
+    hist.add(1.0e6);
+    SINVARIANT(hist[hist.numBins() - 1] == 1);
+    SINVARIANT(hist.max() == 1.0e6);
+
+    stringstream rome;
+    hist.printRome(2, rome);
+    SINVARIANT(rome.str().find("{ type hdr }") != string::npos);
+    cout << "percentile test passed.\n";
+}
+
+void testMerge() {
+    StatsHistogramHdr a(1.0, 1.0e9), b(1.0, 1.0e9), all(1.0, 1.0e9);
+
+    MersenneTwisterRandom rand(1812);
+    for (unsigned i = 0; i < 10000; ++i) {
+	double v = rand.randInt(1000000);
+	(rand.randInt(2) == 0 ? a : b).add(v);
+	all.add(v);
+    }
+    a.add(b);
+    SINVARIANT(a.count() == all.count());
+    SINVARIANT(a.min() == all.min() && a.max() == all.max());
+    for (unsigned i = 0; i < a.numBins(); ++i) {
+	SINVARIANT(a[i] == all[i]);
+    }
+
+    Stats *fresh = a.another_new();
+    SINVARIANT(fresh->count() == 0);
+    fresh->add(a);
+    SINVARIANT(fresh->count() == a.count());
+    delete fresh;
+
+    // into a plain Stats, which reads the totals and extremes through
+    // the accessors
+    Stats plain;
+    plain.add(1.0e6);
+    plain.add(a);
+    SINVARIANT(plain.countll() == a.countll() + 1);
+    SINVARIANT(plain.min() == a.min() && plain.max() == 1.0e6);
+    INVARIANT(Double::eq(plain.total(), a.total() + 1.0e6, 1.0e-9 * plain.total()),
+	      format("total %g vs %g") % plain.total() % (a.total() + 1.0e6));
+    INVARIANT(Double::eq(plain.mean(), (a.total() + 1.0e6) / (a.countll() + 1), 1.0),
+	      format("mean %g") % plain.mean());
+    SINVARIANT(plain.total_sq() > 0);
+    cout << "merge test passed.\n";
+}
+
+// -0.0 passes the value >= 0 check, and must count as 0.0 for min and max
+void testNegativeZero() {
+    StatsHistogramHdr hist(1.0, 1.0e9);
+    hist.add(-0.0);
+    hist.add(5);
+    hist.add(105);
+    INVARIANT(hist.min() == 0 && !signbit(hist.min()) && hist.max() == 105,
+	      format("min %g max %g") % hist.min() % hist.max());
+    SINVARIANT(hist[0] == 1);
+    cout << "negative zero test passed.\n";
+}
+
+class HdrAddThread : public PThread {
+public:
+    HdrAddThread(StatsHistogramHdr &hist, unsigned thread_num, unsigned num_iters)
+	: hist(hist), thread_num(thread_num), num_iters(num_iters) { }
+
+    virtual void *run() {
+	for (unsigned i = 0; i < num_iters; ++i) {
+	    hist.add(thread_num * num_iters + i);
+	}
+	return NULL;
+    }
+
+    StatsHistogramHdr &hist;
+    unsigned thread_num, num_iters;
+};
+
+void testConcurrentAdd() {
+    const unsigned num_threads = 8, num_iters = 250000;
+    StatsHistogramHdr hist(1.0, 1.0e9);
+
+    vector<HdrAddThread *> threads;
+    for (unsigned i = 0; i < num_threads; ++i) {
+	threads.push_back(new HdrAddThread(hist, i, num_iters));
+	threads.back()->start();
+    }
+    for (unsigned i = 0; i < num_threads; ++i) {
+	threads[i]->join();
+	delete threads[i];
+    }
+
+    uint64_t bin_total = 0;
+    for (unsigned i = 0; i < hist.numBins(); ++i) {
+	bin_total += hist[i];
+    }
+    INVARIANT(hist.countll() == num_threads * num_iters && bin_total == hist.countll(),
+	      format("lost adds: %d %d") % hist.countll() % bin_total);
+    SINVARIANT(hist.min() == 0);
+    SINVARIANT(hist.max() == num_threads * num_iters - 1);
+    cout << "concurrent add test passed.\n";
+}
+
+int main(int, char **) {
+    testBinLayout();
+    testPercentiles();
+    testMerge();
+    testNegativeZero();
+    testConcurrentAdd();
+    return 0;
+}
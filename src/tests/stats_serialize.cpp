@@ -0,0 +1,162 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for binary serialization of Stats, HashTupleStats and StatsCube
+*/
+
+#include <iostream>
+#include <sstream>
+
+#include <Lintel/ByteBuffer.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/StatsCube.hpp>
+#include <Lintel/StatsEMA.hpp>
+#include <Lintel/StatsHistogram.hpp>
+#include <Lintel/StatsHistogramHdr.hpp>
+#include <Lintel/StatsQuantile.hpp>
+#include <Lintel/StatsSequence.hpp>
+#include <Lintel/StatsSeries.hpp>
+
+using namespace std;
+using boost::format;
+using lintel::ByteBuffer;
+
+MersenneTwisterRandom rand_gen(1066);
+
+string rome(const Stats &stat) {
+    ostringstream out;
+    stat.printRome(0, out);
+    return out.str();
+}
+
+// Fill from with values, then check that a serialize, deserialize
+// round trip into into gives an identical printout and consumes
+// exactly what was written.
+void checkRoundTrip(Stats &from, Stats &into, unsigned nvalues) {
+    for (unsigned i = 0; i < nvalues; ++i) {
+	from.add(1 + 100 * rand_gen.randDouble());
+    }
+    ByteBuffer buf;
+    from.serialize(buf);
+    size_t size = buf.readAvailable();
+    into.deserialize(buf);
+    SINVARIANT(buf.readAvailable() == 0);
+    INVARIANT(rome(from) == rome(into), format("mismatch after round trip of %d bytes:\n%s\nvs\n%s")
+	      % size % rome(from) % rome(into));
+}
+
+void testRoundTrips() {
+    { Stats a, b; checkRoundTrip(a, b, 1000); }
+    { Stats a, b; checkRoundTrip(a, b, 0); }
+    { StatsQuantile a, b; checkRoundTrip(a, b, 0); }
+    { StatsQuantile a, b; checkRoundTrip(a, b, 100000); }
+    { StatsHistogramUniform a(50, 0, 100), b(50, 0, 100); checkRoundTrip(a, b, 1000); }
+    { StatsHistogramUniform a(50, 0, 10, false, true), b(50, 0, 10, false, true);
+	checkRoundTrip(a, b, 1000); SINVARIANT(b.numBins() > 50); }
+    { StatsHistogramLog a(50, 1, 100), b(50, 1, 100); checkRoundTrip(a, b, 1000); }
+    { StatsHistogramUniformAccum a(50, 0, 100), b(50, 0, 100); checkRoundTrip(a, b, 1000); }
+    { StatsHistogramLogAccum a(50, 1, 100), b(50, 1, 100); checkRoundTrip(a, b, 1000); }
+    { StatsHistogramHdr a(0.01, 1000), b(0.01, 1000); checkRoundTrip(a, b, 1000); }
+    { StatsSequence a(64), b(64); checkRoundTrip(a, b, 1000); }
+
+    StatsEMA ema_a(0.1), ema_b(0.1);
+    checkRoundTrip(ema_a, ema_b, 1000);
+    SINVARIANT(ema_a.getEMA() == ema_b.getEMA());
+
+    StatsSeries series_a(5), series_b(5);
+    checkRoundTrip(series_a, series_b, 1000);
+    for (unsigned lag = 0; lag <= 5; ++lag) {
+	SINVARIANT(series_a.autocovariance(lag) == series_b.autocovariance(lag));
+    }
+    cout << "round trip test passed.\n";
+}
+
+// The aggregator pattern: one serialized summary per node, merged
+// with a scratch deserialize plus add().
+void testMerge() {
+    StatsQuantile all, merged, scratch;
+    ByteBuffer buf;
+    for (unsigned node = 0; node < 10; ++node) {
+	StatsQuantile local;
+	for (unsigned i = 0; i < 10000; ++i) {
+	    double v = rand_gen.randDouble();
+	    local.add(v);
+	    all.add(v);
+	}
+	local.serialize(buf);
+    }
+    while (!buf.empty()) {
+	scratch.deserialize(buf);
+	merged.add(scratch);
+    }
+    SINVARIANT(merged.countll() == all.countll());
+    SINVARIANT(merged.min() == all.min() && merged.max() == all.max());
+    for (unsigned i = 1; i < 10; ++i) {
+	double q = merged.getQuantile(i / 10.0);
+	INVARIANT(fabs(q - all.getQuantile(i / 10.0)) < 0.02, format("quantile %g is %g")
+		  % (i / 10.0) % q);
+    }
+    cout << "merge test passed.\n";
+}
+
+typedef boost::tuple<int32_t, string> ISTuple;
+
+void checkEntry(lintel::HashTupleStats<ISTuple> &hts, int32_t i, const string &s,
+		unsigned count) {
+    INVARIANT(hts[ISTuple(i, s)].count() == count, format("(%d,%s) has %d not %d")
+	      % i % s % hts[ISTuple(i, s)].count() % count);
+}
+
+void testHashTupleStats() {
+    lintel::HashTupleStats<ISTuple> a, b, merged;
+    a.add(ISTuple(1, "x"), 1);
+    a.add(ISTuple(1, "x"), 2);
+    a.add(ISTuple(2, "y"), 3);
+    b.add(ISTuple(2, "y"), 4);
+    b.add(ISTuple(3, ""), 5);
+
+    ByteBuffer buf;
+    a.serialize(buf);
+    b.serialize(buf);
+    merged.deserialize(buf);
+    merged.deserialize(buf);
+    SINVARIANT(buf.empty());
+    SINVARIANT(merged.size() == 3);
+    checkEntry(merged, 1, "x", 2);
+    checkEntry(merged, 2, "y", 2);
+    checkEntry(merged, 3, "", 1);
+    SINVARIANT(merged[ISTuple(2, "y")].mean() == 3.5);
+
+    typedef lintel::StatsCube<ISTuple> ISCube;
+    ISCube cube_a, cube_b, cube_merged;
+    cube_a.add(ISTuple(1, "x"), 1);
+    cube_a.cube();
+    cube_b.add(ISTuple(1, "y"), 3);
+    cube_b.cube();
+    buf.reset();
+    cube_a.serialize(buf);
+    cube_b.serialize(buf);
+    cube_merged.deserialize(buf);
+    cube_merged.deserialize(buf);
+    SINVARIANT(buf.empty());
+    SINVARIANT(cube_merged.base_data.size() == 2);
+    // by default only the entries with an any are cubed: (1,*) (*,x) (*,y) (*,*)
+    SINVARIANT(cube_merged.size() == 4);
+    ISCube::MyAny all_any;
+    all_any.any.set();
+    SINVARIANT(cube_merged.getCubeEntry(all_any).count() == 2);
+    SINVARIANT(cube_merged.getCubeEntry(all_any).mean() == 2);
+    cout << "hash tuple stats test passed.\n";
+}
+
+int main(int, char **) {
+    testRoundTrips();
+    testMerge();
+    testHashTupleStats();
+    return 0;
+}
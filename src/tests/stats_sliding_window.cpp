@@ -0,0 +1,74 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for StatsSlidingWindow
+*/
+
+#include <iostream>
+
+#include <Lintel/Double.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/StatsQuantile.hpp>
+#include <Lintel/StatsSlidingWindow.hpp>
+
+using namespace std;
+using boost::format;
+
+const Clock::Tfrac one_second = Clock::secondsToTfrac(1.0);
+
+// One value per second, the value being the time in seconds; the
+// window should always contain exactly the last nslots seconds.
+void testExpiry() {
+    StatsSlidingWindow<> window(60 * one_second, 60);
+    SINVARIANT(window.slotWidth() == one_second);
+
+    for (unsigned t = 0; t < 300; ++t) {
+	window.add(t * one_second, t);
+	const Stats &s = window.window(t * one_second);
+	unsigned first = t < 59 ? 0 : t - 59;
+	INVARIANT(s.count() == t - first + 1, format("%d: count %d") % t % s.count());
+	SINVARIANT(s.min() == first && s.max() == t);
+	SINVARIANT(&window.window(t * one_second) == &s);
+    }
+
+    // Time passing without adds expires the old values.
+    SINVARIANT(window.window(330 * one_second).count() == 29);
+    SINVARIANT(window.window(1000 * one_second).count() == 0);
+
+    // Late values within the window are kept, older ones are dropped.
+    window.add(990 * one_second, 1);
+    window.add(900 * one_second, 2);
+    SINVARIANT(window.window(1000 * one_second).count() == 1);
+    SINVARIANT(window.nExpired() == 1);
+    cout << "expiry test passed.\n";
+}
+
+void testQuantile() {
+    StatsSlidingWindow<StatsQuantile> window(10 * one_second, 10);
+    MersenneTwisterRandom rand(1960);
+
+    // Old values are large, so if they leak into the window the
+    // quantiles will be wrong.
+    for (unsigned i = 0; i < 100000; ++i) {
+	window.add(i * one_second / 10000, 1000 + rand.randDouble());
+    }
+    for (unsigned i = 100000; i < 200000; ++i) {
+	window.add(i * one_second / 10000, rand.randDouble());
+    }
+    const StatsQuantile &s = window.window(200000 * one_second / 10000 - 1);
+    SINVARIANT(s.count() == 100000);
+    double median = s.getQuantile(0.5);
+    INVARIANT(Double::eq(median, 0.5, 0.05), format("median %g") % median);
+    cout << "quantile test passed.\n";
+}
+
+int main(int, char **) {
+    testExpiry();
+    testQuantile();
+    return 0;
+}
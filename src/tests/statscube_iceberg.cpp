@@ -0,0 +1,152 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for StatsCube::icebergCube
+*/
+
+#include <iostream>
+#include <vector>
+
+#include <Lintel/Clock.hpp>
+#include <Lintel/Double.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/StatsCube.hpp>
+
+using namespace std;
+using boost::format;
+using lintel::StatsCube;
+namespace StatsCubeFns = lintel::StatsCubeFns;
+
+typedef boost::tuple<int32_t, int32_t, int32_t, int32_t> Tuple4;
+typedef StatsCube<Tuple4> Cube4;
+typedef vector<Cube4::PartialTupleCubeMap::value_type> Entries;
+
+void collect(Entries &entries, const Cube4::MyAny &key, Stats &value) {
+    entries.push_back(make_pair(key, &value));
+}
+
+void sameCubes(Cube4 &a, Cube4 &b) {
+    Entries ea, eb;
+    a.walkOrdered(boost::bind(collect, boost::ref(ea), _1, _2));
+    b.walkOrdered(boost::bind(collect, boost::ref(eb), _1, _2));
+    INVARIANT(ea.size() == eb.size(), format("%d != %d entries") % ea.size() % eb.size());
+    for (unsigned i = 0; i < ea.size(); ++i) {
+	SINVARIANT(ea[i].first == eb[i].first);
+	SINVARIANT(ea[i].second->countll() == eb[i].second->countll());
+	SINVARIANT(ea[i].second->min() == eb[i].second->min());
+	SINVARIANT(ea[i].second->max() == eb[i].second->max());
+	SINVARIANT(Double::eq(ea[i].second->mean(), eb[i].second->mean()));
+    }
+}
+
+// Position 0 has few values, the others are high cardinality.
+void fill(Cube4 &cube, unsigned nrows) {
+    MersenneTwisterRandom rand(1984);
+    for (unsigned i = 0; i < nrows; ++i) {
+	cube.add(Tuple4(rand.randInt(4), rand.randInt(200), rand.randInt(1000),
+			rand.randInt(1000)), rand.randDouble());
+    }
+}
+
+bool belowCount(uint64_t min_count, Cube4 &cube, const Cube4::MyAny &key) {
+    return cube.getCubeEntry(key).countll() < min_count;
+}
+
+void testMinCount() {
+    static const uint64_t min_count = 20;
+    Cube4 full, iceberg;
+    fill(full, 50000);
+    fill(iceberg, 50000);
+
+    Clock::Tfrac start = Clock::todTfrac();
+    full.cube();
+    size_t full_size = full.size();
+    full.prune(boost::bind(belowCount, min_count, boost::ref(full), _1));
+    Clock::Tfrac full_done = Clock::todTfrac();
+    iceberg.icebergCube(min_count);
+    Clock::Tfrac iceberg_done = Clock::todTfrac();
+    cout << format("cube+prune %d -> %d entries in %.3fs; iceberg cube %d entries in %.3fs\n")
+	% full_size % full.size() % Clock::TfracToDouble(full_done - start)
+	% iceberg.size() % Clock::TfracToDouble(iceberg_done - full_done);
+
+    SINVARIANT(full.size() < full_size);
+    sameCubes(full, iceberg);
+
+    // min_count of 0 or 1 keeps everything
+    Cube4 all;
+    fill(all, 1000);
+    full.clear();
+    fill(full, 1000);
+    full.cube();
+    all.icebergCube(1);
+    sameCubes(full, all);
+    cout << "iceberg min count test passed.\n";
+}
+
+// An anti-monotone predicate that depends on the key as well as the cell.
+bool keepSmallFirst(const Cube4::MyAny &key, const Stats &cell) {
+    if (!key.any[0] && key.data.get<0>() >= 2) {
+	return false;
+    }
+    return cell.countll() >= 5;
+}
+
+bool pruneSmallFirst(Cube4 &cube, const Cube4::MyAny &key) {
+    return !keepSmallFirst(key, cube.getCubeEntry(key));
+}
+
+void testPredicate() {
+    Cube4 full(boost::bind(&StatsCubeFns::cubeAll));
+    Cube4 iceberg(boost::bind(&StatsCubeFns::cubeAll));
+    fill(full, 10000);
+    fill(iceberg, 10000);
+
+    full.cube();
+    full.prune(boost::bind(pruneSmallFirst, boost::ref(full), _1));
+    iceberg.icebergCube(iceberg.base_data, keepSmallFirst);
+    sameCubes(full, iceberg);
+
+    // functor version with the mean of each base row
+    Cube4 full_mean(boost::bind(&StatsCubeFns::cubeHadAny, _1),
+		    boost::bind(&StatsCubeFns::addMean, _1, _2));
+    Cube4 iceberg_mean;
+    fill(full_mean, 10000);
+    fill(iceberg_mean, 10000);
+    full_mean.cube();
+    full_mean.prune(boost::bind(belowCount, 3, boost::ref(full_mean), _1));
+    iceberg_mean.icebergCube(iceberg_mean.base_data, StatsCubeFns::MinCount(3),
+			     StatsCubeFns::CubeHadAny(), StatsCubeFns::AddMean());
+    sameCubes(full_mean, iceberg_mean);
+
+    // cells already in the cube are added to
+    Cube4 twice, once;
+    fill(twice, 1000);
+    fill(once, 1000);
+    twice.icebergCube(2);
+    twice.icebergCube(2);
+    once.icebergCube(2);
+    Entries ea, eb;
+    twice.walkOrdered(boost::bind(collect, boost::ref(ea), _1, _2));
+    once.walkOrdered(boost::bind(collect, boost::ref(eb), _1, _2));
+    SINVARIANT(ea.size() == eb.size());
+    for (unsigned i = 0; i < ea.size(); ++i) {
+	SINVARIANT(ea[i].first == eb[i].first);
+	SINVARIANT(ea[i].second->countll() == 2 * eb[i].second->countll());
+    }
+
+    Cube4 empty;
+    empty.icebergCube(1);
+    SINVARIANT(empty.size() == 0);
+    cout << "iceberg predicate test passed.\n";
+}
+
+int main(int, char **) {
+    testMinCount();
+    testPredicate();
+    return 0;
+}
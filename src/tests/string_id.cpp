@@ -0,0 +1,168 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for StringId and ConcurrentStringId
+*/
+
+#include <string.h>
+
+#include <iostream>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include <Lintel/Clock.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/PThread.hpp>
+#include <Lintel/StringId.hpp>
+#include <Lintel/StringUtil.hpp>
+
+using namespace std;
+using boost::format;
+
+static const unsigned num_threads = 8;
+
+vector<string> makeStrings(size_t count) {
+    vector<string> ret;
+    for (size_t i = 0; i < count; ++i) {
+	ret.push_back((format("%x-%d") % (i * 2654435761U) % i).str());
+    }
+    ret.push_back(string());
+    ret.push_back(string("a\0b", 3));
+    ret.push_back(string("a\0c", 3));
+    ret.push_back(string(100000, 'x'));
+    return ret;
+}
+
+template<class Dictionary> void checkSerial(Dictionary &dict) {
+    SINVARIANT(dict.maxId() == 1);
+    vector<string> strings(makeStrings(100000));
+    for (size_t i = 0; i < strings.size(); ++i) {
+	SINVARIANT(dict.getId(strings[i]) == i + 1);
+    }
+    SINVARIANT(dict.maxId() == strings.size() + 1);
+    for (size_t i = 0; i < strings.size(); ++i) {
+	SINVARIANT(dict.getId(strings[i]) == i + 1);
+	SINVARIANT(dict.findId(strings[i].data(), strings[i].size()) == i + 1);
+	SINVARIANT(dict.getString(i + 1) == strings[i]);
+	SINVARIANT(dict.getStringRange(i + 1) == strings[i]);
+    }
+    SINVARIANT(dict.findId("missing", 7) == 0);
+    SINVARIANT(dict.maxId() == strings.size() + 1);
+
+    // bulk lookups, from strings and from split ranges
+    vector<unsigned int> ids;
+    dict.getIds(strings.begin(), strings.begin() + 10, ids);
+    SINVARIANT(ids.size() == 10 && ids[0] == 1 && ids[9] == 10);
+    string line = strings[3] + "," + strings[1] + ",new-one," + strings[3];
+    vector<StringRange> ranges;
+    split(line.data(), line.size(), ",", ranges);
+    ids.clear();
+    dict.getIds(ranges.begin(), ranges.end(), ids);
+    SINVARIANT(ids.size() == 4 && ids[0] == 4 && ids[1] == 2 && ids[3] == 4);
+    SINVARIANT(ids[2] == strings.size() + 1 && dict.getString(ids[2]) == "new-one");
+    SINVARIANT(dict.memoryUsage() > 100000);
+}
+
+void testStringId() {
+    StringId dict;
+    checkSerial(dict);
+    cout << "StringId test passed.\n";
+}
+
+class IdThread : public PThread {
+public:
+    IdThread(ConcurrentStringId &dict, const vector<string> &strings, unsigned seed)
+	: dict(dict), strings(strings), seed(seed), ids(strings.size()) { }
+
+    virtual void *run() {
+	MersenneTwisterRandom rand(seed);
+	vector<size_t> order(strings.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+	    order[i] = i;
+	}
+	MT_random_shuffle(order.begin(), order.end(), rand);
+	for (size_t i = 0; i < order.size(); ++i) {
+	    const string &s = strings[order[i]];
+	    ids[order[i]] = dict.getId(s);
+	    // any id handed out so far can be looked up
+	    unsigned int other = 1 + rand.randInt(dict.maxId() - 1);
+	    SINVARIANT(dict.getStringRange(other).data != NULL
+		       || dict.getStringRange(other).size == 0);
+	}
+	return NULL;
+    }
+
+    ConcurrentStringId &dict;
+    const vector<string> &strings;
+    unsigned seed;
+    vector<unsigned int> ids;
+};
+
+void testConcurrentStringId() {
+    {
+	ConcurrentStringId dict;
+	checkSerial(dict);
+    }
+
+    vector<string> strings(makeStrings(50000));
+    ConcurrentStringId dict;
+    vector<IdThread *> threads;
+    for (unsigned i = 0; i < num_threads; ++i) {
+	threads.push_back(new IdThread(dict, strings, i + 1));
+	threads.back()->start();
+    }
+    for (unsigned i = 0; i < num_threads; ++i) {
+	threads[i]->join();
+	SINVARIANT(threads[i]->ids == threads[0]->ids);
+    }
+    SINVARIANT(dict.maxId() == strings.size() + 1);
+    vector<bool> seen(strings.size() + 1, false);
+    for (size_t i = 0; i < strings.size(); ++i) {
+	unsigned int id = threads[0]->ids[i];
+	SINVARIANT(id > 0 && id <= strings.size() && !seen[id]);
+	seen[id] = true;
+	SINVARIANT(dict.getString(id) == strings[i]);
+    }
+    for (unsigned i = 0; i < num_threads; ++i) {
+	delete threads[i];
+    }
+    cout << "ConcurrentStringId test passed.\n";
+}
+
+template<class Dictionary> void timeLookups(const string &name, const vector<string> &strings) {
+    Dictionary dict;
+    vector<unsigned int> ids;
+    Clock::Tfrac start = Clock::todTfrac();
+    dict.getIds(strings.begin(), strings.end(), ids);
+    Clock::Tfrac mid = Clock::todTfrac();
+    ids.clear();
+    dict.getIds(strings.begin(), strings.end(), ids);
+    Clock::Tfrac stop = Clock::todTfrac();
+    size_t total = 0;
+    for (size_t i = 0; i < ids.size(); ++i) {
+	total += dict.getStringRange(ids[i]).size;
+    }
+    Clock::Tfrac end = Clock::todTfrac();
+    cout << format("%s: %.0f ns/new id, %.0f ns/existing id, %.0f ns/getStringRange (%d)\n")
+	% name % (1.0e9 * Clock::TfracToDouble(mid - start) / strings.size())
+	% (1.0e9 * Clock::TfracToDouble(stop - mid) / strings.size())
+	% (1.0e9 * Clock::TfracToDouble(end - stop) / strings.size()) % total;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "long") == 0) {
+	vector<string> strings(makeStrings(500000));
+	timeLookups<StringId>("StringId", strings);
+	timeLookups<ConcurrentStringId>("ConcurrentStringId", strings);
+	return 0;
+    }
+    testStringId();
+    testConcurrentStringId();
+    return 0;
+}
@@ -13,6 +13,7 @@
 #include <boost/format.hpp>
  
 #include <Lintel/AssertBoost.hpp>
+#include <Lintel/ByteBuffer.hpp>
 #include <Lintel/Clock.hpp>
 #include <Lintel/LintelLog.hpp>
 #include <Lintel/MersenneTwisterRandom.hpp>
@@ -39,6 +40,111 @@ void test_splitjoin() {
     SINVARIANT(ojoin == "a/bcd//ef");
 }
 
+void checkSplitRanges(const string &in, const string &sep) {
+    vector<string> strings;
+    split(in, sep, strings);
+
+    vector<StringRange> ranges;
+    split(in, sep, ranges);
+    SINVARIANT(ranges.size() == strings.size());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        INVARIANT(ranges[i] == strings[i], format("'%s' != '%s' splitting '%s' at '%s'")
+                  % ranges[i].str() % strings[i] % in % sep);
+    }
+
+    size_t n = 0;
+    for (SplitIterator i(in, sep); i.valid(); ++i, ++n) {
+        SINVARIANT(n < strings.size() && *i == strings[n]);
+        SINVARIANT(i->data >= in.data() && i->data + i->size <= in.data() + in.size());
+    }
+    SINVARIANT(n == strings.size());
+}
+
+ProgramOption<uint32_t> po_split_speed_test_iterations
+  ("split-speed-test-iterations", "Number of iterations for the split speed test");
+
+void test_splitranges() {
+    vector<StringRange> ranges;
+    string dashed("a-bcd--ef");
+    split(dashed, "-", ranges);
+    SINVARIANT(ranges.size() == 4 && ranges[0] == "a" && ranges[1] == "bcd" &&
+               ranges[2] == "" && ranges[3] == "ef");
+
+    const char *strs[] = { "", "-", "--", "a", "a-", "-a", "a-b-c", "ab--cd----ef-",
+                           "x=y,z=w", "a--b", "a---b", "--a--" };
+    const char *seps[] = { "-", "--", "=", ",", "ab" };
+    for (size_t i = 0; i < sizeof(strs)/sizeof(strs[0]); ++i) {
+        for (size_t j = 0; j < sizeof(seps)/sizeof(seps[0]); ++j) {
+            checkSplitRanges(strs[i], seps[j]);
+        }
+    }
+
+    lintel::ByteBuffer buf;
+    buf.append(string("x,,yz"));
+    size_t n = 0;
+    for (SplitIterator i(buf, ','); i.valid(); ++i, ++n) {
+        SINVARIANT(n < 3 && *i == (n == 0 ? "x" : n == 1 ? "" : "yz"));
+    }
+    SINVARIANT(n == 3);
+
+    lintel::ByteBuffer empty;
+    SplitIterator e(empty, ',');
+    SINVARIANT(e.valid() && e->size == 0);
+    ++e;
+    SINVARIANT(!e.valid());
+
+    MersenneTwisterRandom rng;
+    for (uint32_t i = 0; i < 500; ++i) {
+        string in;
+        uint32_t len = rng.randInt(200);
+        for (uint32_t j = 0; j < len; ++j) {
+            in.push_back('a' + rng.randInt(3));
+        }
+        checkSplitRanges(in, "a");
+        checkSplitRanges(in, "ab");
+        checkSplitRanges(in, "bca");
+    }
+
+    uint32_t iters = po_split_speed_test_iterations.get(); 
+    if (iters == 0) {
+        return;
+    }
+    string line;
+    for (uint32_t i = 0; i < 20; ++i) {
+        line.append(str(format("%d,") % rng.randInt()));
+    }
+    line.append("end");
+
+    vector<string> strings;
+    size_t total_a = 0, total_b = 0, total_c = 0;
+    Clock::Tfrac start = Clock::todTfrac();
+    for (uint32_t i = 0; i < iters; ++i) {
+        strings.clear();
+        split(line, ",", strings);
+        total_a += strings.back().size();
+    }
+    Clock::Tfrac mid = Clock::todTfrac();
+    for (uint32_t i = 0; i < iters; ++i) {
+        ranges.clear();
+        split(line, ",", ranges);
+        total_b += ranges.back().size;
+    }
+    Clock::Tfrac mid2 = Clock::todTfrac();
+    for (uint32_t i = 0; i < iters; ++i) {
+        for (SplitIterator j(line, ','); j.valid(); ++j) {
+            total_c += j->size;
+        }
+    }
+    Clock::Tfrac stop = Clock::todTfrac();
+    SINVARIANT(total_a == total_b);
+    cout << format("split of %d byte line into %d parts: strings %.0f ns, ranges %.0f ns,"
+                   " iterator %.0f ns per call (checksum %d)\n")
+        % line.size() % strings.size() 
+        % (1.0e9 * Clock::TfracToDouble(mid - start) / iters) 
+        % (1.0e9 * Clock::TfracToDouble(mid2 - mid) / iters)
+        % (1.0e9 * Clock::TfracToDouble(stop - mid2) / iters) % total_c;
+}
+
 void test_stringtoint32() {
     SINVARIANT(stringToInteger<int32_t>("77737373") == 77737373);
     SINVARIANT(stringToInteger<int32_t>("-2133324") == -2133324);
@@ -212,6 +318,130 @@ void test_hexstring() {
     SINVARIANT(hexstring(helloworld)==helloworldhex && hex2raw(helloworldhex)==helloworld);
 }
 
+string hexstring_slow(const string &a) {
+    string ret;
+    for (size_t i = 0; i < a.size(); ++i) {
+        ret.append(str(format("%02x") % static_cast<unsigned>(static_cast<unsigned char>(a[i]))));
+    }
+    return ret;
+}
+
+string mysqlEscape_slow(const string &a) {
+    string ret;
+    for (size_t i = 0; i < a.size(); ++i) {
+        switch (a[i]) 
+            {
+            case 0: ret.append("\\0"); break;
+            case '\'': ret.append("\\\'"); break;
+            case '"': ret.append("\\\""); break;
+            case '\b': ret.append("\\b"); break;
+            case '\n': ret.append("\\n"); break;
+            case '\r': ret.append("\\r"); break;
+            case '\t': ret.append("\\t"); break;
+            case 26: ret.append("\\Z"); break;
+            case '\\': ret.append("\\\\"); break;
+            default: ret.push_back(a[i]);
+            }
+    }
+    return ret;
+}
+
+string toCSVform_slow(const string &a) {
+    if (a.find(',') == string::npos) {
+        return a;
+    }
+    string ret("\"");
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i] == '"') {
+            ret.push_back('"');
+        }
+        ret.push_back(a[i]);
+    }
+    ret.push_back('"');
+    return ret;
+}
+
+string randomBytes(MersenneTwisterRandom &rng, size_t size, uint32_t special_per_1000) {
+    static const char specials[] = { 0, 1, 26, 31, 127, '\xff', '\x80', '%', ',', '"', '\'', 
+                                     '\\', '\n', '\t' };
+    string ret;
+    for (size_t i = 0; i < size; ++i) {
+        if (rng.randInt(1000) < special_per_1000) {
+            ret.push_back(specials[rng.randInt(sizeof(specials))]);
+        } else {
+            ret.push_back(' ' + rng.randInt(95));
+        }
+    }
+    return ret;
+}
+
+ProgramOption<uint32_t> po_bulk_speed_test_mib
+  ("bulk-speed-test-mib", "MiB of data for the bulk hex and escaping speed test");
+
+void test_bulkconversions() {
+    MersenneTwisterRandom rng;
+    lintel::ByteBuffer buf;
+    for (uint32_t i = 0; i < 400; ++i) {
+        size_t size = i < 100 ? i : rng.randInt(i < 390 ? 100 : 10000);
+        string in = randomBytes(rng, size, rng.randInt(4) == 0 ? 0 : rng.randInt(500));
+        string hex = hexstring(in);
+        SINVARIANT(hex == hexstring_slow(in));
+        SINVARIANT(hex2raw(hex) == in && hex2raw(upcaseString(hex)) == in);
+        SINVARIANT(escapeUnprintable(in) == escapeUnprintable_slow(in));
+        SINVARIANT(mysqlEscape(in) == mysqlEscape_slow(in));
+        SINVARIANT(toCSVform(in) == toCSVform_slow(in));
+        bool printable = true;
+        for (size_t j = 0; j < in.size(); ++j) {
+            printable = printable && isprint(in[j]) && isascii(in[j]);
+        }
+        SINVARIANT(maybehexstring(in) == (printable ? in : hex));
+
+        // the ByteBuffer versions append
+        buf.reset();
+        buf.append("x", 1);
+        hexstring(in.data(), in.size(), buf);
+        hex2raw(hex.data(), hex.size(), buf);
+        escapeUnprintable(in.data(), in.size(), buf);
+        mysqlEscape(in.data(), in.size(), buf);
+        toCSVform(in.data(), in.size(), buf);
+        maybehexstring(in.data(), in.size(), buf);
+        SINVARIANT(buf.asString() == "x" + hex + in + escapeUnprintable(in) + mysqlEscape(in)
+                   + toCSVform(in) + maybehexstring(in));
+    }
+
+    string bad(hexstring(string(100, 'a')));
+    bad[77] = 'x';
+    TEST_INVARIANTMSG(hex2raw(bad), "bad hex character 120\n");
+
+    uint32_t mib = po_bulk_speed_test_mib.get();
+    if (mib == 0) {
+        return;
+    }
+    string in = randomBytes(rng, mib * 1024 * 1024, 1);
+    buf.reset();
+    Clock::Tfrac start = Clock::todTfrac();
+    hexstring(in.data(), in.size(), buf);
+    Clock::Tfrac t_hex = Clock::todTfrac();
+    lintel::ByteBuffer raw;
+    hex2raw(buf.readStartAs<char>(), buf.readAvailable(), raw);
+    Clock::Tfrac t_unhex = Clock::todTfrac();
+    SINVARIANT(raw.asString() == in);
+    buf.reset();
+    escapeUnprintable(in.data(), in.size(), buf);
+    Clock::Tfrac t_escape = Clock::todTfrac();
+    string slow = escapeUnprintable_slow(in);
+    Clock::Tfrac t_slow = Clock::todTfrac();
+    SINVARIANT(buf.asString() == slow);
+
+    double mb = mib * 1024.0 * 1024.0 / 1.0e6;
+    cout << format("bulk: hexstring %.0f MB/s, hex2raw %.0f MB/s, escapeUnprintable %.0f MB/s,"
+                   " byte at a time escape %.0f MB/s\n")
+        % (mb / Clock::TfracToDouble(t_hex - start)) 
+        % (mb / Clock::TfracToDouble(t_unhex - t_hex))
+        % (mb / Clock::TfracToDouble(t_escape - t_unhex))
+        % (mb / Clock::TfracToDouble(t_slow - t_escape));
+}
+
 void test_ucharstringadaptor() {
     string s("1234");
     const unsigned char *us = UCharStringAdaptor(s).udata();
@@ -226,6 +456,7 @@ int main(int argc, char *argv[]) {
     lintel::parseCommandLine(argc, argv);
 
     test_splitjoin();
+    test_splitranges();
     test_stringtoint32();
     test_caseconversion();
 // TODO: see if we can do something to support wstring on cygwin
@@ -235,6 +466,7 @@ int main(int argc, char *argv[]) {
 #endif
     test_mysqlEscape();
     test_hexstring();
+    test_bulkconversions();
     test_escapeUnprintable();
     test_ucharstringadaptor();
 
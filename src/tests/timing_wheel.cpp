@@ -0,0 +1,301 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for TimingWheel and CalendarQueue
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include <Lintel/AddressablePriorityQueue.hpp>
+#include <Lintel/Clock.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/PriorityQueue.hpp>
+#include <Lintel/TestUtil.hpp>
+#include <Lintel/TimingWheel.hpp>
+
+using namespace std;
+using boost::format;
+using lintel::CalendarQueue;
+using lintel::TimingWheel;
+
+MersenneTwisterRandom rng;
+
+// mostly near, some far, a few enormous or already past
+Clock::Tfrac randomDelay() {
+    switch(rng.randInt(8))
+	{
+	case 0: return 0;
+	case 1: return rng.randLongLong() >> 2;
+	case 2: return rng.randLongLong() >> 24;
+	case 3: return rng.randInt(1000 * 1000);
+	default: return rng.randInt(5000);
+	}
+}
+
+void testTimingWheel(Clock::Tfrac granularity) {
+    Clock::Tfrac now = rng.randLongLong() >> 8;
+    TimingWheel<uint32_t> wheel(granularity, now);
+    map<uint32_t, Clock::Tfrac> live; // handle -> when
+    vector<uint32_t> handles;
+    uint32_t popped = 0;
+
+    for (unsigned i = 0; i < 200000; ++i) {
+	unsigned op = rng.randInt(10);
+	if (op < 5) {
+	    Clock::Tfrac when = rng.randInt(20) == 0 ? now - rng.randInt(1000) : now + randomDelay();
+	    uint32_t h = wheel.insert(when, i);
+	    SINVARIANT(live.find(h) == live.end());
+	    live[h] = when;
+	    handles.push_back(h);
+	} else if (op < 7 && !handles.empty()) {
+	    size_t j = rng.randInt(handles.size());
+	    uint32_t h = handles[j];
+	    handles[j] = handles.back();
+	    handles.pop_back();
+	    if (wheel.contains(h)) {
+		SINVARIANT(wheel.when(h) == live[h]);
+		wheel.cancel(h);
+		live.erase(h);
+	    }
+	} else {
+	    now += rng.randInt(op == 9 ? 1000 * 1000 : 3000);
+	    Clock::Tfrac when;
+	    uint32_t val;
+	    while (wheel.popExpired(now, when, val)) {
+		SINVARIANT(when <= now); // never early
+		++popped;
+	    }
+	    // no later than the end of the granule
+	    uint64_t now_tick = now / granularity;
+	    for (vector<uint32_t>::iterator j = handles.begin(); j != handles.end(); ) {
+		if (wheel.contains(*j)) {
+		    SINVARIANT((live[*j] + granularity - 1) / granularity > now_tick);
+		    ++j;
+		} else {
+		    live.erase(*j);
+		    *j = handles.back();
+		    handles.pop_back();
+		}
+	    }
+	}
+	SINVARIANT(wheel.size() == live.size());
+    }
+    SINVARIANT(popped > 10000);
+    TEST_INVARIANT_MSG1(wheel.cancel(0xFFFFFF), "TimingWheel: handle 16777215 is not queued");
+    cout << format("TimingWheel granularity %d test passed, %d timers popped.\n")
+	% granularity % popped;
+}
+
+typedef multimap<Clock::Tfrac, uint32_t> Reference;
+
+// exact order against a multimap; ties come out in insertion order
+void testCalendarQueue(unsigned distribution) {
+    CalendarQueue<uint32_t> queue;
+    Reference ref;
+    map<uint32_t, Reference::iterator> by_handle;
+    Clock::Tfrac now = 0;
+    uint32_t max_buckets = 0;
+
+    for (unsigned i = 0; i < 200000; ++i) {
+	// grow to ~20000, then drain
+	unsigned op = rng.randInt(i < 120000 ? 10 : 4);
+	if (op >= 4) {
+	    Clock::Tfrac delay;
+	    switch(distribution)
+		{
+		case 0: delay = rng.randInt(1000000); break;
+		case 1: delay = static_cast<Clock::Tfrac>(-1.0e5 * log(rng.randDoubleOpen53() + 1e-300)); break;
+		case 2: delay = rng.randInt(100) == 0 ? rng.randLongLong() >> 20 : rng.randInt(100); break;
+		default: delay = 0; break;
+		}
+	    // occasionally before the last popped time
+	    Clock::Tfrac when = rng.randInt(50) == 0 && now > 1000 ? now - 1000 : now + delay;
+	    uint32_t h = queue.insert(when, i);
+	    by_handle[h] = ref.insert(make_pair(when, i));
+	} else if (op == 0 && !by_handle.empty()) {
+	    map<uint32_t, Reference::iterator>::iterator k = by_handle.lower_bound(rng.randInt());
+	    if (k == by_handle.end()) {
+		k = by_handle.begin();
+	    }
+	    SINVARIANT(queue.when(k->first) == k->second->first && queue.get(k->first) == k->second->second);
+	    queue.cancel(k->first);
+	    ref.erase(k->second);
+	    by_handle.erase(k);
+	} else if (!ref.empty()) {
+	    uint32_t h = queue.topHandle();
+	    Clock::Tfrac when;
+	    uint32_t val;
+	    queue.pop(when, val);
+	    INVARIANT(when == ref.begin()->first && val == ref.begin()->second,
+		      format("got %d/%d expected %d/%d") % when % val
+		      % ref.begin()->first % ref.begin()->second);
+	    ref.erase(ref.begin());
+	    by_handle.erase(h);
+	    now = when;
+	}
+	SINVARIANT(queue.size() == ref.size());
+	max_buckets = max(max_buckets, queue.nBuckets());
+    }
+    while (!ref.empty()) {
+	Clock::Tfrac when;
+	uint32_t val;
+	SINVARIANT(queue.popExpired(ref.begin()->first, when, val));
+	SINVARIANT(when == ref.begin()->first && val == ref.begin()->second);
+	ref.erase(ref.begin());
+    }
+    SINVARIANT(queue.empty() && queue.nBuckets() == CalendarQueue<uint32_t>::min_buckets);
+    SINVARIANT(max_buckets >= 8192);
+    cout << format("CalendarQueue distribution %d test passed, up to %d buckets.\n")
+	% distribution % max_buckets;
+}
+
+// Exponentially distributed delays with a mean of 1ms
+Clock::Tfrac expDelay(MersenneTwisterRandom &mt) {
+    return static_cast<Clock::Tfrac>(-4294967.296 * log(mt.randDoubleOpen53() + 1e-300));
+}
+
+// Event simulator hold model: take the earliest event, schedule one a
+// random time after it.
+void timeHold(uint32_t n, uint32_t steps) {
+    Clock::Tfrac granularity = Clock::secondsToTfrac(1.0e-6);
+    MersenneTwisterRandom mt(1);
+    PriorityQueue<Clock::Tfrac, std::greater_equal<Clock::Tfrac> > pq;
+    for (uint32_t i = 0; i < n; ++i) {
+	pq.push(expDelay(mt) * 1000);
+    }
+    Clock::Tfrac start = Clock::todTfrac();
+    for (uint32_t i = 0; i < steps; ++i) {
+	Clock::Tfrac now = pq.top();
+	pq.replaceTop(now + expDelay(mt) * 1000);
+    }
+    double pq_time = Clock::TfracToDouble(Clock::todTfrac() - start);
+
+    mt.init(1);
+    CalendarQueue<uint32_t> calendar;
+    for (uint32_t i = 0; i < n; ++i) {
+	calendar.insert(expDelay(mt) * 1000, i);
+    }
+    start = Clock::todTfrac();
+    for (uint32_t i = 0; i < steps; ++i) {
+	Clock::Tfrac now;
+	uint32_t val;
+	calendar.pop(now, val);
+	calendar.insert(now + expDelay(mt) * 1000, val);
+    }
+    double calendar_time = Clock::TfracToDouble(Clock::todTfrac() - start);
+
+    mt.init(1);
+    TimingWheel<uint32_t> wheel(granularity);
+    for (uint32_t i = 0; i < n; ++i) {
+	wheel.insert(expDelay(mt) * 1000, i);
+    }
+    start = Clock::todTfrac();
+    Clock::Tfrac now = 0;
+    for (uint32_t i = 0; i < steps; ) {
+	Clock::Tfrac when;
+	uint32_t val;
+	if (wheel.popExpired(now, when, val)) {
+	    wheel.insert(max(now, when) + expDelay(mt) * 1000, val);
+	    ++i;
+	} else {
+	    SINVARIANT(wheel.nextExpiry(now));
+	}
+    }
+    double wheel_time = Clock::TfracToDouble(Clock::todTfrac() - start);
+
+    cout << format("hold model, %d events, mean delay 1s, ns/event: "
+		   "PriorityQueue %.1f, CalendarQueue %.1f, TimingWheel(1us) %.1f\n")
+	% n % (1.0e9 * pq_time / steps) % (1.0e9 * calendar_time / steps)
+	% (1.0e9 * wheel_time / steps);
+}
+
+// Timeout manager: n connections each with a 30s +- 10% idle timeout;
+// every 10us one random connection sees activity and has its timeout
+// pushed back, and any expired ones are re-armed.
+template<class Timers> double runTimeouts(Timers &timers, uint32_t n, uint32_t steps) {
+    MersenneTwisterRandom mt(2);
+    Clock::Tfrac timeout = Clock::secondsToTfrac(30);
+    Clock::Tfrac now = 0, tick = Clock::secondsToTfrac(10.0e-6);
+    vector<uint32_t> handles(n);
+    for (uint32_t i = 0; i < n; ++i) {
+	handles[i] = timers.insert(mt.randLongLong() % timeout, i);
+    }
+    Clock::Tfrac start = Clock::todTfrac();
+    for (uint32_t i = 0; i < steps; ++i) {
+	now += tick;
+	uint32_t c = mt.randInt(n);
+	timers.cancel(handles[c]);
+	handles[c] = timers.insert(now + timeout - timeout / 10 + mt.randInt() % (timeout / 5), c);
+	Clock::Tfrac when;
+	uint32_t val;
+	while (timers.popExpired(now, when, val)) {
+	    handles[val] = timers.insert(now + timeout, val);
+	}
+    }
+    return Clock::TfracToDouble(Clock::todTfrac() - start);
+}
+
+// AddressablePriorityQueue with the same interface as the timer queues
+class HeapTimers {
+public:
+    uint32_t insert(Clock::Tfrac when, uint32_t val) {
+	return heap.push(make_pair(when, val));
+    }
+    void cancel(uint32_t handle) {
+	heap.erase(handle);
+    }
+    bool popExpired(Clock::Tfrac now, Clock::Tfrac &when, uint32_t &val) {
+	if (heap.empty() || heap.top().first > now) {
+	    return false;
+	}
+	when = heap.top().first;
+	val = heap.top().second;
+	heap.pop();
+	return true;
+    }
+private:
+    AddressablePriorityQueue<pair<Clock::Tfrac, uint32_t>,
+			     std::greater_equal<pair<Clock::Tfrac, uint32_t> > > heap;
+};
+
+void timeTimeouts(uint32_t n, uint32_t steps) {
+    HeapTimers heap;
+    double heap_time = runTimeouts(heap, n, steps);
+    CalendarQueue<uint32_t> calendar;
+    double calendar_time = runTimeouts(calendar, n, steps);
+    TimingWheel<uint32_t> wheel(Clock::secondsToTfrac(1.0e-3));
+    double wheel_time = runTimeouts(wheel, n, steps);
+    cout << format("timeouts, %d connections, ns per cancel+insert: "
+		   "AddressablePriorityQueue %.1f, CalendarQueue %.1f, TimingWheel(1ms) %.1f\n")
+	% n % (1.0e9 * heap_time / steps) % (1.0e9 * calendar_time / steps)
+	% (1.0e9 * wheel_time / steps);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "long") == 0) {
+	timeHold(10000, 2000000);
+	timeHold(1000000, 2000000);
+	timeTimeouts(100000, 2000000);
+	timeTimeouts(1000000, 2000000);
+	return 0;
+    }
+    testTimingWheel(1);
+    testTimingWheel(7);
+    testTimingWheel(4096);
+    for (unsigned d = 0; d < 4; ++d) {
+	testCalendarQueue(d);
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+/* -*-C++-*- */
+/*
+   (c) Copyright 2012, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Testing for radixSortTuples and the ordered walks that use it
+*/
+
+#include <bitset>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include <Lintel/Clock.hpp>
+#include <Lintel/MersenneTwisterRandom.hpp>
+#include <Lintel/StatsCube.hpp>
+#include <Lintel/TupleRadixSort.hpp>
+
+using namespace std;
+using boost::format;
+using lintel::radixSortTuples;
+using lintel::StatsCube;
+using lintel::TupleRadixSortable;
+
+BOOST_STATIC_ASSERT((TupleRadixSortable<boost::tuple<int8_t, uint64_t, double, bool> >::value));
+BOOST_STATIC_ASSERT(!(TupleRadixSortable<boost::tuple<int32_t, std::string> >::value));
+
+typedef boost::tuple<int8_t, int64_t, uint16_t, double, bool> Mixed;
+
+struct MixedKeyOf {
+    typedef Mixed TupleType;
+    static const bool has_any = false;
+    const Mixed &tuple(const Mixed *v) const { return *v; }
+    bool any(const Mixed *, int) const { return false; }
+};
+
+bool lessPtr(const Mixed *a, const Mixed *b) {
+    return *a < *b;
+}
+
+void testMixed() {
+    MersenneTwisterRandom rand(1066);
+    vector<Mixed> values;
+    for (unsigned i = 0; i < 50000; ++i) {
+	// narrow ranges so that later positions matter; -0.0 and 0.0
+	// are equal, so stay in their original order
+	double d = (static_cast<int>(rand.randInt(7)) - 3) * 1.5;
+	if (d == 0 && rand.randInt(2) == 0) {
+	    d = -0.0;
+	}
+	values.push_back(Mixed(static_cast<int8_t>(rand.randInt(256)), 
+			       static_cast<int64_t>(rand.randLongLong()) >> rand.randInt(64),
+			       static_cast<uint16_t>(rand.randInt(4)), d, rand.randInt(2) == 1));
+    }
+    vector<const Mixed *> radix, expected;
+    for (unsigned i = 0; i < values.size(); ++i) {
+	radix.push_back(&values[i]);
+    }
+    expected = radix;
+    radixSortTuples(radix, MixedKeyOf());
+    stable_sort(expected.begin(), expected.end(), lessPtr);
+    SINVARIANT(radix == expected); // stable, so even equal keys are in the same order
+
+    vector<const Mixed *> empty;
+    radixSortTuples(empty, MixedKeyOf());
+    cout << "mixed tuple radix sort test passed.\n";
+}
+
+typedef boost::tuple<float> FloatTuple;
+
+struct FloatKeyOf {
+    typedef FloatTuple TupleType;
+    static const bool has_any = false;
+    const FloatTuple &tuple(const FloatTuple *v) const { return *v; }
+    bool any(const FloatTuple *, int) const { return false; }
+};
+
+// -0.0 and 0.0 compare equal, so keep their original order; NaNs go to
+// the ends
+void testFloatKeys() {
+    float nan = numeric_limits<float>::quiet_NaN();
+    float in[] = { 0.0f, 2.5f, nan, -0.0f, -1.0f, 0.0f, -nan, -0.0f };
+    vector<FloatTuple> values(in, in + sizeof(in) / sizeof(in[0]));
+    vector<const FloatTuple *> sorted;
+    for (unsigned i = 0; i < values.size(); ++i) {
+	sorted.push_back(&values[i]);
+    }
+    radixSortTuples(sorted, FloatKeyOf());
+    unsigned want[] = { 6, 4, 0, 3, 5, 7, 1, 2 };
+    for (unsigned i = 0; i < sorted.size(); ++i) {
+	SINVARIANT(sorted[i] == &values[want[i]]);
+    }
+    cout << "float key radix sort test passed.\n";
+}
+
+typedef boost::tuple<int32_t, int32_t, int32_t> Tuple3;
+typedef StatsCube<Tuple3> Cube3;
+typedef vector<Cube3::MyAny> Keys;
+
+void collectKey(Keys &keys, const Cube3::MyAny &key, Stats &) {
+    keys.push_back(key);
+}
+
+void testCubeOrder() {
+    MersenneTwisterRandom rand(1492);
+    Cube3 cube(boost::bind(&lintel::StatsCubeFns::cubeAll));
+    for (unsigned i = 0; i < 20000; ++i) {
+	cube.add(Tuple3(static_cast<int32_t>(rand.randInt(100)) - 50, rand.randInt(30),
+			static_cast<int32_t>(rand.randInt()) >> rand.randInt(32)), 1);
+    }
+    cube.cube();
+
+    Keys walked, expected;
+    Clock::Tfrac start = Clock::todTfrac();
+    cube.walkOrdered(boost::bind(collectKey, boost::ref(walked), _1, _2));
+    Clock::Tfrac radix_done = Clock::todTfrac();
+    cube.walk(boost::bind(collectKey, boost::ref(expected), _1, _2));
+    sort(expected.begin(), expected.end());
+    Clock::Tfrac sort_done = Clock::todTfrac();
+    cout << format("walkOrdered of %d cube entries %.3fs; walk+std::sort %.3fs\n")
+	% cube.size() % Clock::TfracToDouble(radix_done - start)
+	% Clock::TfracToDouble(sort_done - radix_done);
+
+    SINVARIANT(walked.size() == expected.size());
+    for (unsigned i = 0; i < walked.size(); ++i) {
+	SINVARIANT(walked[i] == expected[i]);
+    }
+    // any sorts last
+    SINVARIANT(walked.back().any.all());
+    cout << "cube walkOrdered test passed.\n";
+}
+
+typedef boost::tuple<std::string, int32_t> StrTuple;
+typedef vector<StatsCube<StrTuple>::MyAny> StrKeys;
+
+void collectStrKey(StrKeys &keys, const StatsCube<StrTuple>::MyAny &key, Stats &) {
+    keys.push_back(key);
+}
+
+// Strings fall back to std::sort.
+void testFallback() {
+    StatsCube<StrTuple> cube;
+    cube.add(StrTuple("b", 1), 1);
+    cube.add(StrTuple("a", 2), 1);
+    cube.cube();
+    StrKeys keys;
+    cube.walkOrdered(boost::bind(collectStrKey, boost::ref(keys), _1, _2));
+    SINVARIANT(keys.size() == 5);
+    SINVARIANT(keys[0].data.get<0>() == "a" && keys[0].any[1]);
+    SINVARIANT(keys[4].any[0] && keys[4].any[1]);
+    cout << "string fallback test passed.\n";
+}
+
+int main(int, char **) {
+    testMixed();
+    testFloatKeys();
+    testCubeOrder();
+    testFallback();
+    return 0;
+}